@@ -0,0 +1,209 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "corpus.h"
+#include "seqft.h"
+
+// The allocators of seqft.h under load from several threads at once, each
+// with contexts of its own. Workloads:
+//
+//   reuse  one context per thread for every expression, which only allocates
+//          when an expression is larger than any before it
+//   churn  a new context for every expression, as a server making one per
+//          request would
+//   grow   the same, with expressions of up to 4096 tokens rather than 32, so
+//          that the stacks of the context grow through realloc
+//
+// Expressions come from the corpus with fixed seeds, one set per thread, made
+// before the clock starts. Every combination runs for min_ms, and prints one
+// CSV row on stdout:
+//
+//     allocator,workload,threads,ops,ns_per_op,mops_per_s
+//
+// where an op is one expression evaluated, and ns_per_op is wall time over
+// the ops of all threads.
+//
+// Usage: seqft_allocbench [min_ms] [threads...]
+//
+// min_ms defaults to 300; the thread counts to 1, 2 and 4, and one per CPU.
+
+typedef enum {
+    WORK_REUSE,
+    WORK_CHURN,
+    WORK_GROW,
+
+    WORK_COUNT,
+} Workload;
+
+static const char* const WORKLOAD_NAMES[] = {"reuse", "churn", "grow"};
+
+#define EXPRESSIONS 256
+
+typedef struct Worker {
+    pthread_t             thread;
+    const SeqftAllocator* allocator;
+    Workload              workload;
+    pthread_barrier_t*    start;
+    atomic_int*           stop;
+
+    char*  exprs[EXPRESSIONS];
+    size_t lens[EXPRESSIONS];
+
+    uint64_t ops;
+    double   sink; // Keeps the results alive.
+} Worker;
+
+// The expressions of one thread for the workload.
+static void Worker_prepare(Worker* w, uint64_t seed) {
+    Corpus corpus;
+    Corpus_seed(&corpus, seed);
+
+    for(size_t i = 0; i < EXPRESSIONS; ++i) {
+        CorpusShape shape  = i % 2 ? SHAPE_FUNCTIONS : SHAPE_FLAT;
+        size_t      tokens = w->workload == WORK_GROW
+                                 ? 64 + Corpus_next(&corpus) % 4032
+                                 : 4 + Corpus_next(&corpus) % 28;
+
+        w->exprs[i] = Corpus_expression(&corpus, shape, tokens, &w->lens[i]);
+    }
+}
+
+static void Worker_release(Worker* w) {
+    for(size_t i = 0; i < EXPRESSIONS; ++i) {
+        xfree(w->exprs[i]);
+    }
+}
+
+static void* Worker_run(void* user) {
+    Worker*       w   = user;
+    SeqftContext* ctx = 0;
+    size_t        i   = 0;
+    double        result;
+
+    pthread_barrier_wait(w->start);
+
+    while(!atomic_load_explicit(w->stop, memory_order_relaxed)) {
+        if(w->workload != WORK_REUSE || !ctx) {
+            SeqftContext_free(ctx);
+            ctx = SeqftContext_newWith(w->allocator);
+        }
+
+        if(SeqftContext_eval(ctx, w->exprs[i], w->lens[i], &result) == SEQFT_OK)
+            w->sink += result;
+
+        i = (i + 1) % EXPRESSIONS;
+        w->ops += 1;
+    }
+
+    SeqftContext_free(ctx);
+    return 0;
+}
+
+// Runs the workload on the threads for min_ms and prints its row.
+static void run(const char*           name,
+                const SeqftAllocator* allocator,
+                Workload              workload,
+                size_t                threads,
+                unsigned              min_ms) {
+    Worker*           workers = xmalloc(threads * sizeof(Worker));
+    atomic_int        stop    = 0;
+    pthread_barrier_t start;
+
+    pthread_barrier_init(&start, 0, (unsigned)threads + 1);
+
+    for(size_t t = 0; t < threads; ++t) {
+        memset(&workers[t], 0, sizeof(Worker));
+
+        workers[t].allocator = allocator;
+        workers[t].workload  = workload;
+        workers[t].start     = &start;
+        workers[t].stop      = &stop;
+
+        Worker_prepare(&workers[t], 0x5EED + t);
+    }
+
+    for(size_t t = 0; t < threads; ++t) {
+        pthread_create(&workers[t].thread, 0, Worker_run, &workers[t]);
+    }
+
+    pthread_barrier_wait(&start);
+    uint64_t begin = monotonic_ns();
+
+    usleep(min_ms * 1000);
+    atomic_store(&stop, 1);
+
+    uint64_t ops = 0;
+
+    for(size_t t = 0; t < threads; ++t) {
+        pthread_join(workers[t].thread, 0);
+        ops += workers[t].ops;
+    }
+
+    uint64_t elapsed = monotonic_ns() - begin;
+
+    printf("%s,%s,%zu,%llu,%.1f,%.3f\n",
+           name,
+           WORKLOAD_NAMES[workload],
+           threads,
+           (unsigned long long)ops,
+           ops ? (double)elapsed / (double)ops : 0,
+           (double)ops * 1e3 / (double)elapsed);
+    fflush(stdout);
+
+    for(size_t t = 0; t < threads; ++t) {
+        Worker_release(&workers[t]);
+    }
+
+    pthread_barrier_destroy(&start);
+    xfree(workers);
+}
+
+int main(int argc, char** argv) {
+    unsigned min_ms = argc > 1 ? (unsigned)strtoul(argv[1], 0, 10) : 300;
+    size_t   counts[16];
+    size_t   count = 0;
+
+    for(int i = 2; i < argc && count < 16; ++i) {
+        counts[count++] = strtoul(argv[i], 0, 10);
+    }
+
+    if(!count) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+        counts[count++] = 1;
+        counts[count++] = 2;
+        counts[count++] = 4;
+
+        if(online > 4)
+            counts[count++] = (size_t)online;
+    }
+
+    const struct {
+        const char*           name;
+        const SeqftAllocator* allocator;
+    } ALLOCATORS[] = {
+        {"libc",   SeqftAllocator_libc()  },
+        {"cached", SeqftAllocator_cached()},
+    };
+
+    printf("allocator,workload,threads,ops,ns_per_op,mops_per_s\n");
+
+    for(Workload w = 0; w < WORK_COUNT; ++w) {
+        for(size_t c = 0; c < count; ++c) {
+            for(size_t a = 0; a < 2; ++a) {
+                run(ALLOCATORS[a].name,
+                    ALLOCATORS[a].allocator,
+                    w,
+                    counts[c],
+                    min_ms);
+            }
+        }
+    }
+
+    return 0;
+}
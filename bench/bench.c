@@ -0,0 +1,419 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "corpus.h"
+#include "evaluator.h"
+#include "program.h"
+#include "stack.h"
+#include "tokenizer.h"
+#include "vecmath.h"
+
+// Microbenchmarks for the building blocks: Stack push/pop, tokenizing and
+// parsing every corpus shape, and evaluating pre-parsed tokens, with and
+// without memoizing the functions (eval_memo, where every evaluation after the
+// first only hits), and compiled into a mapped program (program_eval), and the
+// array kernels of vecmath.h, on every instruction set the CPU has, next to
+// libm looping over the same arrays. Inputs
+// come from the corpus with fixed seeds, so every run measures the same work.
+//
+// Prints one CSV row per benchmark on stdout:
+//
+//     name,tokens,iterations,ns_per_op,ns_per_token,allocs_per_op,bytes_per_op
+//
+// where an op is one call of the measured function (one expression for the
+// tokenizer and the evaluator, one push and pop pair for the stack, one array
+// of MATH_LEN doubles for the math kernels, counted as its tokens) and
+// allocations count every xmalloc and xrealloc made during the op. Compare
+// two runs with e.g. `join -t, <(sort a.csv) <(sort b.csv)`.
+//
+// Usage: seqft_bench [filter] [min_ms]
+//
+// Only benchmarks whose name contains filter are run. Each runs until at
+// least min_ms milliseconds were spent on it (default 200).
+
+typedef struct AllocCounters {
+    uint64_t allocs;
+    uint64_t bytes;
+} AllocCounters;
+
+static AllocCounters counters;
+
+static void count_allocation(XallocEvent event,
+                             void*       old_ptr,
+                             void*       new_ptr,
+                             size_t      size,
+                             void*       user) {
+    (void)old_ptr;
+    (void)new_ptr;
+    (void)user;
+
+    if(event != XALLOC_FREE) {
+        counters.allocs += 1;
+        counters.bytes += size;
+    }
+}
+
+// One benchmark: run() performs `batch` ops on the state.
+typedef struct Benchmark {
+    char   name[64];
+    size_t tokens; // Tokens per op, 0 where it doesn't apply.
+    void (*run)(void* state, size_t batch);
+    void* state;
+} Benchmark;
+
+static uint64_t min_ns = 200000000ull;
+
+static void Benchmark_measure(Benchmark* b) {
+    size_t   iterations = 0;
+    size_t   batch      = 1;
+    uint64_t elapsed    = 0;
+
+    // Warm up caches and any memory the benchmark keeps around, so that the
+    // allocation counts are those of the steady state.
+    b->run(b->state, 1);
+
+    memset(&counters, 0, sizeof(counters));
+    xalloc_setHook(count_allocation, 0);
+
+    // Double the batch until one takes a measurable time, then keep going
+    // until the minimum time is reached.
+    while(elapsed < min_ns) {
+        uint64_t start = monotonic_ns();
+        b->run(b->state, batch);
+        elapsed += monotonic_ns() - start;
+        iterations += batch;
+
+        if(elapsed < min_ns / 16)
+            batch *= 2;
+    }
+
+    xalloc_setHook(0, 0);
+
+    double ns = (double)elapsed / (double)iterations;
+
+    printf("%s,%zu,%zu,%.2f,%.3f,%.3f,%.1f\n",
+           b->name,
+           b->tokens,
+           iterations,
+           ns,
+           b->tokens ? ns / (double)b->tokens : 0.0,
+           (double)counters.allocs / (double)iterations,
+           (double)counters.bytes / (double)iterations);
+    fflush(stdout);
+}
+
+// Stack ---------------------------------------------------------------------
+
+// Pushes and pops a double at a depth of 64, the common cellar case.
+static void run_stack_push_pop(void* state, size_t batch) {
+    Stack* s = state;
+    double value = 1.5;
+
+    for(size_t i = 0; i < batch; ++i) {
+        Stack_pushFrom(s, &value);
+        Stack_popInto(s, &value);
+    }
+}
+
+// Pushes 1024 doubles onto a new stack, growing it from empty, and frees it.
+static void run_stack_grow(void* state, size_t batch) {
+    (void)state;
+
+    for(size_t i = 0; i < batch; ++i) {
+        Stack* s = Stack_new(sizeof(double));
+
+        for(int n = 0; n < 1024; ++n) {
+            double value = n;
+            Stack_pushFrom(s, &value);
+        }
+
+        Stack_free(s);
+    }
+}
+
+// Tokenizer and evaluator ----------------------------------------------------
+
+typedef struct ExprState {
+    Tokenizer*  t;
+    Sft*        sft;
+    Sft*        memo_sft; // Memoizing every pure function.
+    char*       expr;
+    size_t      len;
+    TokenArray* tokens; // Parsed once, for the evaluator benchmarks.
+    Program*    program; // The expression compiled as its only formula.
+} ExprState;
+
+static void run_tokenize(void* state, size_t batch) {
+    ExprState* e = state;
+
+    for(size_t i = 0; i < batch; ++i) {
+        if(!Tokenizer_tokenize(e->t, e->expr, e->len))
+            abort();
+    }
+}
+
+static void run_parse(void* state, size_t batch) {
+    ExprState* e = state;
+
+    for(size_t i = 0; i < batch; ++i) {
+        TokenArray* array = Tokenizer_parse(e->t, e->expr, e->len);
+
+        if(!array)
+            abort();
+
+        TokenArray_free(array);
+    }
+}
+
+static void run_eval(void* state, size_t batch) {
+    ExprState* e      = state;
+    double     result = 0;
+
+    for(size_t i = 0; i < batch; ++i) {
+        if(Sft_evalTokens(e->sft, e->tokens, &result))
+            abort();
+    }
+}
+
+static void run_eval_memo(void* state, size_t batch) {
+    ExprState* e      = state;
+    double     result = 0;
+
+    for(size_t i = 0; i < batch; ++i) {
+        if(Sft_evalTokens(e->memo_sft, e->tokens, &result))
+            abort();
+    }
+}
+
+static void run_program_eval(void* state, size_t batch) {
+    ExprState* e      = state;
+    double     result = 0;
+
+    for(size_t i = 0; i < batch; ++i) {
+        if(Program_eval(e->program, 0, e->sft, &result))
+            abort();
+    }
+}
+
+// Compiles the tokens into a temporary program file and maps it.
+static Program* compile_program(TokenArray* tokens) {
+    char           path[] = "/tmp/seqft_bench_XXXXXX";
+    int            fd     = mkstemp(path);
+    FILE*          stream = fd < 0 ? 0 : fdopen(fd, "wb");
+    ProgramWriter* writer = ProgramWriter_new();
+    const char*    reason = "Couldn't write the program.";
+    Program*       program = 0;
+
+    if(stream && ProgramWriter_add(writer, "bench", tokens) &&
+       !ProgramWriter_write(writer, stream)) {
+        program = Program_open(path, &reason);
+    }
+
+    if(!program)
+        fprintf(stderr, "%s: %s\n", path, reason);
+
+    if(stream)
+        fclose(stream);
+
+    unlink(path);
+    ProgramWriter_free(writer);
+    return program;
+}
+
+// Math kernels ---------------------------------------------------------------
+
+#define MATH_LEN 1024
+
+typedef struct MathState {
+    void (*vec)(const double* x, double* out, size_t len);
+    double (*libm)(double x);
+    BOOL   pow; // vec_pow and pow, ignoring the two above.
+    double x[MATH_LEN];
+    double y[MATH_LEN];
+    double out[MATH_LEN];
+} MathState;
+
+static void run_math_vec(void* state, size_t batch) {
+    MathState* m = state;
+
+    for(size_t i = 0; i < batch; ++i) {
+        if(m->pow) {
+            vec_pow(m->x, m->y, m->out, MATH_LEN);
+        } else {
+            m->vec(m->x, m->out, MATH_LEN);
+        }
+    }
+}
+
+static void run_math_libm(void* state, size_t batch) {
+    MathState* m = state;
+
+    for(size_t i = 0; i < batch; ++i) {
+        for(size_t k = 0; k < MATH_LEN; ++k) {
+            m->out[k] = m->pow ? pow(m->x[k], m->y[k]) : m->libm(m->x[k]);
+        }
+    }
+}
+
+static BOOL matches(const char* name, const char* filter) {
+    return !filter || strstr(name, filter);
+}
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 && argv[1][0] ? argv[1] : 0;
+
+    if(argc > 2)
+        min_ns = strtoull(argv[2], 0, 10) * 1000000ull;
+
+    printf("name,tokens,iterations,ns_per_op,ns_per_token,allocs_per_op,"
+           "bytes_per_op\n");
+
+    // Stack.
+    Stack* s = Stack_new(sizeof(double));
+
+    for(int n = 0; n < 64; ++n) {
+        double value = n;
+        Stack_pushFrom(s, &value);
+    }
+
+    Benchmark stack_benchmarks[] = {
+        {"stack/push_pop", 0, run_stack_push_pop, s},
+        {"stack/grow_1024", 0, run_stack_grow, 0},
+    };
+
+    for(size_t i = 0; i < sizeof(stack_benchmarks) / sizeof(Benchmark); ++i) {
+        if(matches(stack_benchmarks[i].name, filter))
+            Benchmark_measure(&stack_benchmarks[i]);
+    }
+
+    Stack_free(s);
+
+    // Math kernels, on arguments where results are finite and mostly not
+    // integers.
+    struct {
+        const char* name;
+        void (*vec)(const double*, double*, size_t);
+        double (*libm)(double);
+        double lo, hi;
+    } kernels[] = {
+        {"exp", vec_exp, exp, -20, 20},
+        {"log", vec_log, log, 1e-3, 1e3},
+        {"pow", 0, 0, 0.1, 10},
+        {"floor", vec_floor, floor, -1e6, 1e6},
+        {"ceil", vec_ceil, ceil, -1e6, 1e6},
+        {"round", vec_round, round, -1e6, 1e6},
+    };
+
+    for(size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+        MathState* m = xmalloc(sizeof(MathState));
+        Corpus     corpus;
+
+        Corpus_seed(&corpus, 7000 + i);
+
+        m->vec  = kernels[i].vec;
+        m->libm = kernels[i].libm;
+        m->pow  = !kernels[i].vec;
+
+        for(size_t k = 0; k < MATH_LEN; ++k) {
+            double unit = (double)(Corpus_next(&corpus) >> 11) * 0x1p-53;
+            m->x[k]     = kernels[i].lo + (kernels[i].hi - kernels[i].lo) * unit;
+            m->y[k]     = (double)(Corpus_next(&corpus) % 2001) / 100 - 10;
+        }
+
+        // The kernels on each instruction set the CPU has, then libm.
+        VecIsa default_isa = vec_isa();
+
+        for(int k = VEC_BASELINE; k <= VEC_AVX2 + 1; ++k) {
+            BOOL      libm      = k > VEC_AVX2;
+            Benchmark benchmark = {"", MATH_LEN, run_math_vec, m};
+
+            if(libm) {
+                benchmark.run = run_math_libm;
+            } else if(!vec_setIsa((VecIsa)k)) {
+                continue;
+            }
+
+            snprintf(benchmark.name,
+                     sizeof(benchmark.name),
+                     "math/%s/%s",
+                     kernels[i].name,
+                     libm ? "libm" : vec_isaName((VecIsa)k));
+
+            if(matches(benchmark.name, filter))
+                Benchmark_measure(&benchmark);
+        }
+
+        vec_setIsa(default_isa);
+        xfree(m);
+    }
+
+    // Every shape at a short and a long expression.
+    const size_t sizes[] = {16, 1024};
+
+    for(int shape = 0; shape < SHAPE_COUNT; ++shape) {
+        for(size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) {
+            Corpus corpus;
+            Corpus_seed(&corpus, (uint64_t)shape * 1000 + sizes[k]);
+
+            ExprState e = {0};
+            e.t         = Tokenizer_new();
+            e.sft       = Sft_new();
+            e.memo_sft  = Sft_new();
+            e.expr      = Corpus_expression(&corpus, shape, sizes[k], &e.len);
+            e.tokens    = Tokenizer_parse(e.t, e.expr, e.len);
+
+            if(!e.tokens) {
+                fprintf(stderr,
+                        "%s/%zu: %s\n",
+                        CorpusShape_name(shape),
+                        sizes[k],
+                        e.t->error->message);
+                return 1;
+            }
+
+            for(size_t i = 0; i < FN_LOOKUP_COUNT; ++i) {
+                Sft_memoize(e.memo_sft, i, 256);
+            }
+
+            e.program = compile_program(e.tokens);
+
+            if(!e.program)
+                return 1;
+
+            Benchmark benchmarks[] = {
+                {"", e.tokens->count, run_tokenize, &e},
+                {"", e.tokens->count, run_parse, &e},
+                {"", e.tokens->count, run_eval, &e},
+                {"", e.tokens->count, run_eval_memo, &e},
+                {"", e.tokens->count, run_program_eval, &e},
+            };
+            const char* kinds[] = {
+                "tokenize", "parse", "eval", "eval_memo", "program_eval"};
+
+            for(size_t i = 0; i < sizeof(benchmarks) / sizeof(Benchmark); ++i) {
+                snprintf(benchmarks[i].name,
+                         sizeof(benchmarks[i].name),
+                         "%s/%s/%zu",
+                         kinds[i],
+                         CorpusShape_name(shape),
+                         sizes[k]);
+
+                if(matches(benchmarks[i].name, filter))
+                    Benchmark_measure(&benchmarks[i]);
+            }
+
+            TokenArray_free(e.tokens);
+            xfree(e.expr);
+            Sft_free(e.sft);
+            Sft_free(e.memo_sft);
+            Program_close(e.program);
+            Tokenizer_free(e.t);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include "corpus.h"
+#include "common.h"
+
+#include <stdio.h>
+
+// Growable string the expression is built in.
+typedef struct Builder {
+    char*  data;
+    size_t len;
+    size_t capacity;
+} Builder;
+
+static void Builder_append(Builder* b, const char* str, size_t len) {
+    if(b->len + len + 1 > b->capacity) {
+        b->capacity = (b->len + len + 1) * 2;
+        b->data     = xrealloc(b->data, b->capacity);
+    }
+
+    memcpy(b->data + b->len, str, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+static void Builder_char(Builder* b, char c) {
+    Builder_append(b, &c, 1);
+}
+
+static void Builder_number(Builder* b, Corpus* c) {
+    char buffer[32];
+    int  len;
+
+    // Never zero, so that nothing divides by zero.
+    if(Corpus_next(c) % 8 == 0) {
+        len = snprintf(buffer,
+                       sizeof(buffer),
+                       "%u.%u",
+                       (unsigned)(Corpus_next(c) % 100),
+                       (unsigned)(Corpus_next(c) % 9 + 1));
+    } else {
+        len = snprintf(
+            buffer, sizeof(buffer), "%u", (unsigned)(Corpus_next(c) % 99 + 1));
+    }
+
+    Builder_append(b, buffer, (size_t)len);
+}
+
+// A decimal literal with several digits on both sides of the point.
+static void Builder_longNumber(Builder* b, Corpus* c) {
+    char buffer[32];
+    int  len = snprintf(buffer,
+                        sizeof(buffer),
+                        "%u.%06u",
+                        (unsigned)(Corpus_next(c) % 999999 + 1),
+                        (unsigned)(Corpus_next(c) % 1000000));
+
+    Builder_append(b, buffer, (size_t)len);
+}
+
+// A non-zero literal in hex, binary, octal or decimal.
+static void Builder_baseNumber(Builder* b, Corpus* c) {
+    unsigned value = (unsigned)(Corpus_next(c) % 255 + 1);
+    char     buffer[16];
+    int      len = 0;
+
+    switch(Corpus_next(c) % 4) {
+        case 0:
+            len = snprintf(buffer, sizeof(buffer), "0x%x", value);
+            break;
+        case 1:
+            buffer[len++] = '0';
+            buffer[len++] = 'b';
+
+            for(int bit = 7; bit >= 0; --bit) {
+                if(value >> bit || len > 2)
+                    buffer[len++] = (char)('0' + (value >> bit & 1));
+            }
+            break;
+        case 2:
+            len = snprintf(buffer, sizeof(buffer), "0o%o", value);
+            break;
+        default:
+            len = snprintf(buffer, sizeof(buffer), "%u", value);
+            break;
+    }
+
+    Builder_append(b, buffer, (size_t)len);
+}
+
+// A call with two to four arguments, some of them calls themselves down to
+// a depth of three. Returns the number of tokens written. Results are never
+// zero, as every argument is positive.
+static size_t Builder_call(Builder* b, Corpus* c, size_t depth) {
+    static const char* names[] = {"sum", "min", "max", "avg", "hypot"};
+
+    const char* name   = names[Corpus_next(c) % (sizeof(names) / sizeof(names[0]))];
+    size_t      args   = Corpus_next(c) % 3 + 2;
+    size_t      tokens = 2; // "name(" and ")"
+
+    Builder_append(b, name, strlen(name));
+    Builder_char(b, '(');
+
+    for(size_t i = 0; i < args; ++i) {
+        if(i) {
+            Builder_char(b, ',');
+            tokens += 1;
+        }
+
+        if(depth < 2 && Corpus_next(c) % 4 == 0) {
+            tokens += Builder_call(b, c, depth + 1);
+        } else {
+            Builder_number(b, c);
+            tokens += 1;
+        }
+    }
+
+    Builder_char(b, ')');
+    return tokens;
+}
+
+// Operators that can't overflow or divide by zero on the numbers generated.
+static void Builder_operator(Builder* b, Corpus* c) {
+    static const char operators[] = {'+', '-', '*', '/'};
+    Builder_char(b, operators[Corpus_next(c) % sizeof(operators)]);
+}
+
+void Corpus_seed(Corpus* c, uint64_t seed) {
+    c->state = seed ? seed : 0x9E3779B97F4A7C15ull;
+}
+
+uint64_t Corpus_next(Corpus* c) {
+    c->state ^= c->state >> 12;
+    c->state ^= c->state << 25;
+    c->state ^= c->state >> 27;
+    return c->state * 0x2545F4914F6CDD1Dull;
+}
+
+const char* CorpusShape_name(CorpusShape shape) {
+    switch(shape) {
+        case SHAPE_FLAT:
+            return "flat";
+        case SHAPE_NESTED:
+            return "nested";
+        case SHAPE_NUMERIC:
+            return "numeric";
+        case SHAPE_FUNCTIONS:
+            return "functions";
+        case SHAPE_BASES:
+            return "bases";
+        case SHAPE_GROUPED:
+            return "grouped";
+        default:
+            return "?";
+    }
+}
+
+char* Corpus_expression(Corpus*     c,
+                        CorpusShape shape,
+                        size_t      tokens,
+                        size_t*     out_len) {
+    Builder b = {0};
+
+    switch(shape) {
+        case SHAPE_FLAT:
+            // number (operator number)*, two tokens per step.
+            Builder_number(&b, c);
+
+            for(size_t i = 1; i + 2 <= tokens; i += 2) {
+                Builder_operator(&b, c);
+                Builder_number(&b, c);
+            }
+            break;
+
+        case SHAPE_NESTED: {
+            // depth open parens, a number, then depth times
+            // "operator number )", four tokens per level.
+            size_t depth = tokens > 1 ? (tokens - 1) / 4 : 0;
+
+            for(size_t i = 0; i < depth; ++i) {
+                Builder_char(&b, '(');
+            }
+
+            Builder_number(&b, c);
+
+            for(size_t i = 0; i < depth; ++i) {
+                Builder_operator(&b, c);
+                Builder_number(&b, c);
+                Builder_char(&b, ')');
+            }
+            break;
+        }
+
+        case SHAPE_NUMERIC:
+            Builder_longNumber(&b, c);
+
+            for(size_t i = 1; i + 2 <= tokens; i += 2) {
+                Builder_operator(&b, c);
+                Builder_longNumber(&b, c);
+            }
+            break;
+
+        case SHAPE_FUNCTIONS: {
+            // call (operator call)*, stopping at the first call that
+            // reaches the token count.
+            size_t written = Builder_call(&b, c, 0);
+
+            while(written + 2 <= tokens) {
+                Builder_operator(&b, c);
+                written += 1 + Builder_call(&b, c, 0);
+            }
+            break;
+        }
+
+        case SHAPE_BASES:
+            Builder_baseNumber(&b, c);
+
+            for(size_t i = 1; i + 2 <= tokens; i += 2) {
+                Builder_operator(&b, c);
+                Builder_baseNumber(&b, c);
+            }
+            break;
+
+        case SHAPE_GROUPED: {
+            // (number (operator number)*) joined by operators, 2 to 32
+            // numbers in each group, stopping at the first group that reaches
+            // the token count.
+            size_t written = 0;
+
+            do {
+                size_t numbers = Corpus_next(c) % 31 + 2;
+
+                if(written) {
+                    Builder_operator(&b, c);
+                    written += 1;
+                }
+
+                Builder_char(&b, '(');
+                Builder_number(&b, c);
+
+                for(size_t i = 1; i < numbers; ++i) {
+                    Builder_operator(&b, c);
+                    Builder_number(&b, c);
+                }
+
+                Builder_char(&b, ')');
+                written += 2 * numbers + 1;
+            } while(written + 2 <= tokens);
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    if(out_len) {
+        *out_len = b.len;
+    }
+
+    return b.data;
+}
@@ -0,0 +1,41 @@
+#ifndef _H_CORPUS_
+#define _H_CORPUS_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Deterministic generator of valid expressions for the benchmarks. The same
+// seed, shape and token count always produce the same expression, on every
+// platform, so that runs can be compared against each other.
+
+typedef enum {
+    SHAPE_FLAT,   // Numbers joined by binary operators: 12 + 7 * 3 - ...
+    SHAPE_NESTED, // One long chain of nesting: ((((1 + 2) * 3) - 4) ...)
+    SHAPE_NUMERIC,   // Flat, with long literals: 48213.905126 * 7702.15 ...
+    SHAPE_FUNCTIONS, // Variadic calls, some nested: max(3, sum(1, 2), 7) ...
+    SHAPE_BASES,     // Flat, mixing bases: 0x1f + 0b101 * 0o17 - 12 ...
+    SHAPE_GROUPED,   // Parenthesized runs: (3 * 7 - 2) + (41 / 5 * 8) ...
+
+    SHAPE_COUNT,
+} CorpusShape;
+
+typedef struct Corpus {
+    uint64_t state;
+} Corpus;
+
+extern void Corpus_seed(Corpus* c, uint64_t seed);
+
+// Next pseudo random number, xorshift64*.
+extern uint64_t Corpus_next(Corpus* c);
+
+extern const char* CorpusShape_name(CorpusShape shape);
+
+// Returns a newly allocated expression of roughly `tokens` tokens, never
+// fewer than one, writing its length to out_len if non-zero. Caller
+// responsible for freeing it with xfree.
+extern char* Corpus_expression(Corpus*     c,
+                               CorpusShape shape,
+                               size_t      tokens,
+                               size_t*     out_len);
+
+#endif // _H_CORPUS_
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "corpus.h"
+#include "evaluator.h"
+#include "resubmit.h"
+#include "tokenizer.h"
+
+// Edit and resubmit latency, as in the REPL. Changes one digit in the middle
+// of generated expressions of 1000, 10000, ... up to max_tokens tokens, back
+// and forth, and times tokenizing and evaluating every version: from scratch,
+// and through a Resubmit (see src/resubmit.h). Prints one CSV row per shape,
+// size and mode on stdout:
+//
+//     shape,tokens,mode,edits,us_per_edit,lexed,evaluated,same
+//
+// where lexed and evaluated are the tokens lexed and evaluated for the last
+// edit, which are all of them from scratch, and same whether every edit came
+// to what it does from scratch, bit for bit, or failed the same way. The
+// nested shape is the worst case, since the edit is inside half of its
+// groups.
+//
+// Usage: seqft_resubmit [max_tokens]   (default 1000000)
+
+// Each size is repeated until at least this much time was spent on it.
+#define MIN_SAMPLE_NS 200000000ull
+
+// The digit nearest the middle that isn't 0, so that changing it to another
+// one that isn't either leaves the expression valid.
+static size_t middle_digit(const char* expr, size_t len) {
+    for(size_t i = 0; i < len / 2; ++i) {
+        if(expr[len / 2 + i] >= '1' && expr[len / 2 + i] <= '9')
+            return len / 2 + i;
+
+        if(expr[len / 2 - i] >= '1' && expr[len / 2 - i] <= '9')
+            return len / 2 - i;
+    }
+
+    return len;
+}
+
+int main(int argc, char** argv) {
+    size_t max_tokens = argc > 1 ? strtoull(argv[1], 0, 10) : 1000000;
+
+    Tokenizer* t   = Tokenizer_new();
+    Sft*       sft = Sft_new();
+
+    printf("shape,tokens,mode,edits,us_per_edit,lexed,evaluated,same\n");
+
+    CorpusShape shapes[] = {SHAPE_FLAT, SHAPE_FUNCTIONS, SHAPE_NESTED};
+
+    for(size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+        for(size_t target = 1000; target <= max_tokens; target *= 10) {
+            Corpus corpus;
+            Corpus_seed(&corpus, target);
+
+            size_t len  = 0;
+            char*  expr = Corpus_expression(&corpus, shapes[s], target, &len);
+            size_t at   = middle_digit(expr, len);
+
+            if(at == len) {
+                xfree(expr);
+                continue;
+            }
+
+            char digits[2] = {expr[at], expr[at] == '9' ? '1' : expr[at] + 1};
+
+            for(int mode = 0; mode < 2; ++mode) {
+                Resubmit*  r       = mode ? Resubmit_new() : 0;
+                Tokenizer* tk      = r ? r->t : t;
+                uint64_t   elapsed = 0;
+                size_t     edits   = 0;
+                double     sink    = 0;
+                BOOL       same    = TRUE;
+                TokenArray tokens;
+
+                // The first round tokenizes the expression as a whole either
+                // way, and isn't counted.
+                while(elapsed < MIN_SAMPLE_NS || edits < 3) {
+                    double    result = 0;
+                    SftError* error  = 0;
+
+                    expr[at] = digits[edits % 2];
+
+                    uint64_t start = monotonic_ns();
+
+                    if(r) {
+                        Resubmit_tokenize(r, expr, len);
+                        error = Resubmit_evaluate(r, sft, &result);
+                    } else {
+                        Tokenizer_tokenize(t, expr, len);
+                        Tokenizer_view(t, &tokens);
+                        error = Sft_evalTokens(sft, &tokens, &result);
+                    }
+
+                    if(edits)
+                        elapsed += monotonic_ns() - start;
+
+                    sink += error ? 0 : result;
+                    edits += 1;
+
+                    // Checked against scratch, untimed.
+                    if(r) {
+                        SftError found = error ? *error : (SftError){0};
+                        double   check = 0;
+
+                        Tokenizer_tokenize(t, expr, len);
+                        Tokenizer_view(t, &tokens);
+                        error = Sft_evalTokens(sft, &tokens, &check);
+
+                        if(error) {
+                            same = same && found.code == error->code &&
+                                   found.offset == error->offset;
+                        } else {
+                            same = same && !found.code &&
+                                   !memcmp(&check, &result, sizeof(double));
+                        }
+                    }
+                }
+
+                Tokenizer_view(tk, &tokens);
+                edits -= 1;
+
+                printf("%s,%zu,%s,%zu,%.2f,%zu,%zu,%s\n",
+                       CorpusShape_name(shapes[s]),
+                       tokens.count,
+                       r ? "resubmit" : "scratch",
+                       edits,
+                       (double)elapsed / 1e3 / (double)edits,
+                       r ? r->lexed : tokens.count,
+                       r ? r->evaluated : tokens.count,
+                       same ? "yes" : "no");
+                fflush(stdout);
+
+                // Keeps the results alive.
+                if(sink == 0.5)
+                    fprintf(stderr, "\n");
+
+                Resubmit_free(r);
+            }
+
+            xfree(expr);
+        }
+    }
+
+    Sft_free(sft);
+    Tokenizer_free(t);
+    return 0;
+}
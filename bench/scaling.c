@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "common.h"
+#include "corpus.h"
+#include "evaluator.h"
+#include "tokenizer.h"
+
+// Scaling benchmark. Parses and evaluates generated expressions of 10, 100,
+// ... up to max_tokens tokens, for each shape, and prints the time per token
+// as CSV on stdout. Linear time shows as a flat ns/token curve; plot it with
+//
+//     seqft_scaling > scaling.csv && gnuplot bench/scaling.gp
+//
+// Usage: seqft_scaling [max_tokens]   (default 10000000)
+
+// Each size is repeated until at least this much time was spent on it.
+#define MIN_SAMPLE_NS 200000000ull
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static long peak_rss_kib(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main(int argc, char** argv) {
+    size_t max_tokens = argc > 1 ? strtoull(argv[1], 0, 10) : 10000000;
+
+    Tokenizer* t   = Tokenizer_new();
+    Sft*       sft = Sft_new();
+
+    printf("shape,tokens,bytes,reps,parse_ns_per_token,eval_ns_per_token,"
+           "ns_per_token,peak_rss_kib\n");
+
+    CorpusShape shapes[] = {SHAPE_FLAT, SHAPE_NESTED};
+
+    for(size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+        for(size_t target = 10; target <= max_tokens; target *= 10) {
+            Corpus corpus;
+            Corpus_seed(&corpus, target);
+
+            size_t len  = 0;
+            char*  expr = Corpus_expression(&corpus, shapes[s], target, &len);
+
+            uint64_t parse_ns = 0;
+            uint64_t eval_ns  = 0;
+            size_t   tokens   = 0;
+            size_t   reps     = 0;
+
+            while(parse_ns + eval_ns < MIN_SAMPLE_NS) {
+                uint64_t start = now_ns();
+
+                TokenArray* array = Tokenizer_parse(t, expr, len);
+
+                uint64_t parsed = now_ns();
+
+                if(!array) {
+                    fprintf(stderr,
+                            "%s/%zu: %s\n",
+                            CorpusShape_name(shapes[s]),
+                            target,
+                            t->error->message);
+                    return 1;
+                }
+
+                double    result = 0;
+                SftError* error  = Sft_evalTokens(sft, array, &result);
+
+                uint64_t evaluated = now_ns();
+
+                if(error) {
+                    fprintf(stderr,
+                            "%s/%zu: %s\n",
+                            CorpusShape_name(shapes[s]),
+                            target,
+                            SftError_message(error));
+                    return 1;
+                }
+
+                tokens = array->count;
+                TokenArray_free(array);
+
+                parse_ns += parsed - start;
+                eval_ns += evaluated - parsed;
+                reps += 1;
+            }
+
+            double per_token = (double)reps * (double)tokens;
+
+            printf("%s,%zu,%zu,%zu,%.2f,%.2f,%.2f,%ld\n",
+                   CorpusShape_name(shapes[s]),
+                   tokens,
+                   len,
+                   reps,
+                   (double)parse_ns / per_token,
+                   (double)eval_ns / per_token,
+                   (double)(parse_ns + eval_ns) / per_token,
+                   peak_rss_kib());
+            fflush(stdout);
+
+            xfree(expr);
+        }
+    }
+
+    Sft_free(sft);
+    Tokenizer_free(t);
+    return 0;
+}
@@ -0,0 +1,17 @@
+# Plots the output of seqft_scaling: time per token against expression size.
+# Usage: seqft_scaling > scaling.csv && gnuplot bench/scaling.gp
+
+set datafile separator ","
+set terminal pngcairo size 900,540
+set output "scaling.png"
+
+set title "seqft: time per token"
+set xlabel "tokens"
+set ylabel "ns / token"
+set logscale x 10
+set yrange [0:*]
+set key top left
+set grid
+
+plot "< grep '^flat' scaling.csv"   using 2:7 with linespoints title "flat", \
+     "< grep '^nested' scaling.csv" using 2:7 with linespoints title "nested"
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "corpus.h"
+#include "evaluator.h"
+#include "split.h"
+#include "tokenizer.h"
+
+// Speedup of Split_eval (see src/split.h) by thread count on one long
+// expression of each shape, against Sft_evalTokens, which is the 1 thread row.
+// Prints one CSV row per shape and thread count on stdout:
+//
+//     shape,tokens,threads,tasks,stolen,us_per_eval,speedup,same
+//
+// where tasks and stolen are those of the last evaluation, and same whether
+// the result is Sft_evalTokens', bit for bit. Nested leaves nothing to split,
+// and shows what trying costs.
+//
+// Usage: seqft_split [tokens] [max_threads] [grain]
+//        (default 1000000, one per online CPU, SPLIT_DEFAULT_GRAIN)
+
+// Each thread count is repeated until at least this much time was spent on it.
+#define MIN_SAMPLE_NS 500000000ull
+
+int main(int argc, char** argv) {
+    size_t target      = argc > 1 ? strtoull(argv[1], 0, 10) : 1000000;
+    size_t max_threads = argc > 2 ? strtoull(argv[2], 0, 10) : 0;
+    size_t grain       = argc > 3 ? strtoull(argv[3], 0, 10) : 0;
+
+    if(!max_threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        max_threads = online > 0 ? (size_t)online : 1;
+    }
+
+    Tokenizer* t   = Tokenizer_new();
+    Sft*       sft = Sft_new();
+
+    printf("shape,tokens,threads,tasks,stolen,us_per_eval,speedup,same\n");
+
+    CorpusShape shapes[] = {SHAPE_GROUPED, SHAPE_FUNCTIONS, SHAPE_NESTED};
+
+    for(size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+        Corpus corpus;
+        Corpus_seed(&corpus, target);
+
+        size_t len  = 0;
+        char*  expr = Corpus_expression(&corpus, shapes[s], target, &len);
+
+        if(!Tokenizer_tokenize(t, expr, len)) {
+            fprintf(stderr,
+                    "%s: %s\n",
+                    CorpusShape_name(shapes[s]),
+                    t->error->message);
+            return 1;
+        }
+
+        TokenArray tokens;
+        double     expected = 0;
+        double     single   = 0;
+
+        Tokenizer_view(t, &tokens);
+        Sft_evalTokens(sft, &tokens, &expected);
+
+        // 1, 2, 4, ... and max_threads.
+        for(size_t threads = 1;;
+            threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+            Split*   split   = Split_new(threads, grain);
+            uint64_t elapsed = 0;
+            size_t   reps    = 0;
+            BOOL     same    = TRUE;
+
+            while(elapsed < MIN_SAMPLE_NS) {
+                double   result = 0;
+                uint64_t start  = monotonic_ns();
+
+                Split_eval(split, sft, &tokens, &result);
+                elapsed += monotonic_ns() - start;
+                reps += 1;
+
+                same = same && !memcmp(&result, &expected, sizeof(double));
+            }
+
+            double us = (double)elapsed / 1e3 / (double)reps;
+
+            if(threads == 1)
+                single = us;
+
+            printf("%s,%zu,%zu,%zu,%zu,%.1f,%.2f,%s\n",
+                   CorpusShape_name(shapes[s]),
+                   tokens.count,
+                   threads,
+                   split->last_tasks,
+                   split->last_stolen,
+                   us,
+                   single / us,
+                   same ? "yes" : "no");
+            fflush(stdout);
+
+            Split_free(split);
+
+            if(threads >= max_threads)
+                break;
+        }
+
+        xfree(expr);
+    }
+
+    Sft_free(sft);
+    Tokenizer_free(t);
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include "alloc.h"
+
+#include <pthread.h>
+
+// Where the payload starts in every block; keeps it aligned like malloc's.
+#define ALLOC_HEADER 16
+
+// The size class of a cached block, or ALLOC_LARGE for one of malloc's own
+// size, which is kept in the header for realloc to copy.
+#define ALLOC_LARGE ALLOC_CLASSES
+
+typedef union AllocHeader {
+    struct {
+        uint32_t size_class;
+        size_t   size; // Of the payload, for large blocks.
+    };
+    unsigned char pad[ALLOC_HEADER];
+} AllocHeader;
+
+_Static_assert(sizeof(AllocHeader) == ALLOC_HEADER, "header size");
+
+// A free block on a cache list, over its payload.
+typedef struct AllocFree {
+    struct AllocFree* next;
+} AllocFree;
+
+typedef struct AllocCache {
+    AllocFree* lists[ALLOC_CLASSES];
+    uint32_t   counts[ALLOC_CLASSES];
+
+    // Whether the thread exit destructor knows about the cache, and whether
+    // it has run, after which freed blocks go straight back to malloc.
+    BOOL registered;
+    BOOL dead;
+} AllocCache;
+
+static _Thread_local AllocCache alloc_cache;
+
+static pthread_key_t  alloc_key;
+static pthread_once_t alloc_key_once = PTHREAD_ONCE_INIT;
+
+static void Alloc_drain(void* user) {
+    AllocCache* cache = user;
+
+    for(size_t c = 0; c < ALLOC_CLASSES; ++c) {
+        while(cache->lists[c]) {
+            AllocFree* block = cache->lists[c];
+
+            cache->lists[c] = block->next;
+            free((unsigned char*)block - ALLOC_HEADER);
+        }
+
+        cache->counts[c] = 0;
+    }
+
+    cache->dead = TRUE;
+}
+
+static void Alloc_createKey(void) {
+    pthread_key_create(&alloc_key, Alloc_drain);
+}
+
+// The class of the block holding size bytes of payload, or ALLOC_LARGE.
+static uint32_t Alloc_class(size_t size) {
+    if(size > ALLOC_MAX_BLOCK - ALLOC_HEADER)
+        return ALLOC_LARGE;
+
+    size_t block = size + ALLOC_HEADER;
+
+    if(block <= ALLOC_MIN_BLOCK)
+        return 0;
+
+    // The bit length of block - 1 is the shift of the next power of two.
+    int shift = 64 - __builtin_clzll((unsigned long long)(block - 1));
+    return (uint32_t)(shift - ALLOC_MIN_SHIFT);
+}
+
+static AllocHeader* Alloc_header(void* memory) {
+    return (AllocHeader*)((unsigned char*)memory - ALLOC_HEADER);
+}
+
+static size_t Alloc_capacity(const AllocHeader* header) {
+    if(header->size_class == ALLOC_LARGE)
+        return header->size;
+
+    return ((size_t)ALLOC_MIN_BLOCK << header->size_class) - ALLOC_HEADER;
+}
+
+static void* Alloc_cachedAllocate(void* user, size_t size) {
+    (void)user;
+
+    uint32_t     size_class = Alloc_class(size);
+    AllocCache*  cache      = &alloc_cache;
+    AllocHeader* header;
+
+    if(size_class != ALLOC_LARGE && cache->lists[size_class]) {
+        AllocFree* block = cache->lists[size_class];
+
+        cache->lists[size_class] = block->next;
+        cache->counts[size_class] -= 1;
+
+        return block;
+    }
+
+    if(size_class == ALLOC_LARGE) {
+        if(size > SIZE_MAX - ALLOC_HEADER)
+            return 0;
+
+        header = malloc(ALLOC_HEADER + size);
+    } else {
+        header = malloc((size_t)ALLOC_MIN_BLOCK << size_class);
+    }
+
+    if(!header)
+        return 0;
+
+    header->size_class = size_class;
+    header->size       = size;
+
+    return (unsigned char*)header + ALLOC_HEADER;
+}
+
+static void Alloc_cachedRelease(void* user, void* memory) {
+    (void)user;
+
+    AllocHeader* header     = Alloc_header(memory);
+    uint32_t     size_class = header->size_class;
+    AllocCache*  cache      = &alloc_cache;
+
+    if(size_class == ALLOC_LARGE || cache->dead ||
+       cache->counts[size_class] >=
+           ALLOC_CACHE_BYTES >> (ALLOC_MIN_SHIFT + size_class)) {
+        free(header);
+        return;
+    }
+
+    if(!cache->registered) {
+        pthread_once(&alloc_key_once, Alloc_createKey);
+        pthread_setspecific(alloc_key, cache);
+        cache->registered = TRUE;
+    }
+
+    AllocFree* block = memory;
+
+    block->next              = cache->lists[size_class];
+    cache->lists[size_class] = block;
+    cache->counts[size_class] += 1;
+}
+
+static void* Alloc_cachedReallocate(void* user, void* memory, size_t size) {
+    AllocHeader* header     = Alloc_header(memory);
+    uint32_t     size_class = Alloc_class(size);
+
+    // Still fits, without wasting more than half the block.
+    if(header->size_class != ALLOC_LARGE &&
+       (size_class == header->size_class ||
+        size_class + 1 == header->size_class))
+        return memory;
+
+    // Large to large is malloc's business.
+    if(header->size_class == ALLOC_LARGE && size_class == ALLOC_LARGE) {
+        if(size > SIZE_MAX - ALLOC_HEADER)
+            return 0;
+
+        header = realloc(header, ALLOC_HEADER + size);
+
+        if(!header)
+            return 0;
+
+        header->size = size;
+        return (unsigned char*)header + ALLOC_HEADER;
+    }
+
+    void* moved = Alloc_cachedAllocate(user, size);
+
+    if(!moved)
+        return 0;
+
+    size_t capacity = Alloc_capacity(header);
+
+    memcpy(moved, memory, capacity < size ? capacity : size);
+    Alloc_cachedRelease(user, memory);
+
+    return moved;
+}
+
+const SeqftAllocator ALLOC_CACHED = {
+    .allocate   = Alloc_cachedAllocate,
+    .reallocate = Alloc_cachedReallocate,
+    .release    = Alloc_cachedRelease,
+};
+
+static void* Alloc_libcAllocate(void* user, size_t size) {
+    (void)user;
+    return malloc(size);
+}
+
+static void* Alloc_libcReallocate(void* user, void* memory, size_t size) {
+    (void)user;
+    return realloc(memory, size);
+}
+
+static void Alloc_libcRelease(void* user, void* memory) {
+    (void)user;
+    free(memory);
+}
+
+const SeqftAllocator ALLOC_LIBC = {
+    .allocate   = Alloc_libcAllocate,
+    .reallocate = Alloc_libcReallocate,
+    .release    = Alloc_libcRelease,
+};
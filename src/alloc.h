@@ -0,0 +1,28 @@
+#ifndef _H_ALLOC_
+#define _H_ALLOC_
+
+#include "common.h"
+
+// The allocators of seqft.h. The cached one rounds every size up, header
+// included, to a power of two from ALLOC_MIN_BLOCK to ALLOC_MAX_BLOCK bytes,
+// and keeps the blocks freed on a thread in a list per size for the next
+// allocations of that thread, up to ALLOC_CACHE_BYTES per size. Larger
+// blocks, and those the cache has no room for, go straight to and from
+// malloc. A thread's cache is given back to malloc when it exits.
+//
+// Every block starts with a header holding its size, so that realloc can
+// tell whether the new size still fits, which it does for anything from half
+// the block up, without copying.
+
+#define ALLOC_MIN_SHIFT   5  // 32 byte blocks
+#define ALLOC_MAX_SHIFT   16 // 64 KiB
+#define ALLOC_CLASSES     (ALLOC_MAX_SHIFT - ALLOC_MIN_SHIFT + 1)
+#define ALLOC_CACHE_BYTES (256u << 10)
+
+#define ALLOC_MIN_BLOCK (1 << ALLOC_MIN_SHIFT)
+#define ALLOC_MAX_BLOCK (1 << ALLOC_MAX_SHIFT)
+
+extern const SeqftAllocator ALLOC_CACHED;
+extern const SeqftAllocator ALLOC_LIBC;
+
+#endif // _H_ALLOC_
@@ -0,0 +1,646 @@
+#include "batch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "series.h"
+
+// Appends the error line for a bad expression: its message, and where in the
+// whitespace-stripped expression it went wrong.
+static void Batch_writeError(OutBuf*             out,
+                             const BatchOptions* options,
+                             const char*         message,
+                             size_t              offset) {
+    if(options->skip_errors)
+        return;
+
+    OutBuf_puts(out, "error: ");
+    OutBuf_puts(out, message);
+    OutBuf_puts(out, " (column ");
+    OutBuf_size(out, offset + 1);
+    OutBuf_char(out, ')');
+}
+
+BatchDedup* BatchDedup_new(void) {
+    BatchDedup* dedup = xmalloc(sizeof(BatchDedup));
+    memset(dedup, 0, sizeof(BatchDedup));
+
+    dedup->index   = HashMap_new();
+    dedup->results = Stack_new(sizeof(double));
+
+    return dedup;
+}
+
+void BatchDedup_free(BatchDedup* dedup) {
+    if(!dedup)
+        return;
+
+    HashMap_free(dedup->index);
+    Stack_free(dedup->results);
+    xfree(dedup->key);
+    xfree(dedup);
+}
+
+// Makes room for size bytes of keys.
+static void BatchDedup_reserve(BatchDedup* dedup, size_t size) {
+    if(size > dedup->key_capacity) {
+        dedup->key_capacity = size * 2;
+        dedup->key          = xrealloc(dedup->key, dedup->key_capacity);
+    }
+}
+
+// Writes the key of the line's text to the start of the scratch buffer, and
+// returns its length, which is 1 for a blank line.
+static size_t BatchDedup_textKey(BatchDedup* dedup,
+                                 const char* line,
+                                 size_t      len) {
+    BatchDedup_reserve(dedup, len + 2);
+
+    dedup->key[0] = 'T';
+    return 1 + filter_whitespace(line, len, dedup->key + 1);
+}
+
+// Writes the key of the token stream to the scratch buffer at offset, and
+// returns its length: every token's type, followed by the bits of its number
+// or its name.
+static size_t BatchDedup_tokenKey(BatchDedup*       dedup,
+                                  size_t            offset,
+                                  const TokenArray* tokens,
+                                  size_t            expr_len) {
+    // Names are no longer than the expression, plus a terminator per token.
+    BatchDedup_reserve(dedup, offset + 1 + tokens->count * 13 + expr_len);
+
+    char* key = dedup->key + offset;
+    char* end = key;
+
+    *end++ = 'K';
+
+    for(size_t i = 0; i < tokens->count; ++i) {
+        const Token* token = &tokens->tokens[i];
+        uint32_t     type  = token->type;
+
+        memcpy(end, &type, sizeof(type));
+        end += sizeof(type);
+
+        if(token->type & TT_NUM) {
+            memcpy(end, &token->f64, sizeof(double));
+            end += sizeof(double);
+        } else if(token->func) {
+            size_t len = strlen(token->func) + 1;
+            memcpy(end, token->func, len);
+            end += len;
+        }
+    }
+
+    return (size_t)(end - key);
+}
+
+static BOOL BatchDedup_get(BatchDedup* dedup,
+                           size_t      offset,
+                           size_t      len,
+                           size_t*     index) {
+    return HashMap_get(dedup->index, dedup->key + offset, len, index);
+}
+
+// Adds a result, emptying the cache first if it is full, and returns its
+// index.
+static size_t BatchDedup_add(BatchDedup* dedup, double result) {
+    if(dedup->index->count + 2 > BATCH_DEDUP_MAX_ENTRIES) {
+        HashMap_clear(dedup->index);
+        Stack_clear(dedup->results);
+    }
+
+    size_t index = Stack_getCount(dedup->results);
+    Stack_pushFrom(dedup->results, &result);
+    return index;
+}
+
+// Counts a line looked up, and once BATCH_DEDUP_WINDOW were, skips the cache
+// for a while if too few of them were hits, twice as long each time in a row
+// up to BATCH_DEDUP_MAX_DOUBLINGS times.
+static void BatchDedup_count(BatchDedup* dedup, BOOL hit) {
+    dedup->lines += 1;
+    dedup->hits += hit;
+
+    if(dedup->lines < BATCH_DEDUP_WINDOW)
+        return;
+
+    if(dedup->hits * BATCH_DEDUP_MIN_HITS < dedup->lines) {
+        dedup->bypass = dedup->lines * BATCH_DEDUP_BYPASS << dedup->doublings;
+
+        if(dedup->doublings < BATCH_DEDUP_MAX_DOUBLINGS)
+            dedup->doublings += 1;
+    } else {
+        dedup->doublings = 0;
+    }
+
+    dedup->lines = 0;
+    dedup->hits  = 0;
+}
+
+// Whether the next line should go through the cache.
+static BOOL BatchDedup_active(BatchDedup* dedup) {
+    if(!dedup->bypass)
+        return TRUE;
+
+    dedup->bypass -= 1;
+    return FALSE;
+}
+
+// Records the time since *clock, and moves it to now.
+static void Batch_lap(Histogram* histogram, uint64_t* clock) {
+    uint64_t now = monotonic_ns();
+
+    Histogram_record(histogram, now - *clock);
+    *clock = now;
+}
+
+// Tokenizer_tokenize, counted as the tokenize phase, and timed from *clock
+// if latency isn't null.
+static BOOL Batch_tokenize(Tokenizer*    t,
+                           Perf*         perf,
+                           LatencyStats* latency,
+                           uint64_t*     clock,
+                           const char*   line,
+                           size_t        len) {
+    Perf_begin(perf, PERF_TOKENIZE);
+    BOOL tokenized = Tokenizer_tokenize(t, line, len);
+    Perf_end(perf);
+
+    if(latency)
+        Batch_lap(&latency->parse, clock);
+
+    return tokenized;
+}
+
+void Batch_evalLines(Tokenizer*          t,
+                     Sft*                sft,
+                     BatchDedup*         dedup,
+                     Split*              split,
+                     Perf*               perf,
+                     LatencyStats*       latency,
+                     const char*         data,
+                     size_t              len,
+                     OutBuf*             out,
+                     const BatchOptions* options,
+                     BatchStats*         stats) {
+    const char* end     = data + len;
+    const char* line    = data;
+    BOOL        limited = options->max_steps || options->max_ns;
+    SftBudget   budget  = {.steps = options->max_steps};
+
+    // Where the line being evaluated started, which is where the last one
+    // ended, and where its current phase started.
+    uint64_t line_start = latency ? monotonic_ns() : 0;
+    uint64_t clock      = line_start;
+
+    while(line < end) {
+        const char* newline  = memchr(line, '\n', (size_t)(end - line));
+        const char* line_end = newline ? newline : end;
+        size_t      line_len = (size_t)(line_end - line);
+        size_t      text_len = 0;
+        size_t      index    = 0;
+        BatchDedup* cache    = dedup && BatchDedup_active(dedup) ? dedup : 0;
+        BOOL        hit      = FALSE;
+        BOOL        blank    = FALSE;
+
+        stats->lines += 1;
+
+        if(cache) {
+            text_len = BatchDedup_textKey(cache, line, line_len);
+
+            // Blank lines are left to the tokenizer.
+            if(text_len == 1)
+                cache = 0;
+        }
+
+        if(cache && BatchDedup_get(cache, 0, text_len, &index)) {
+            hit = TRUE;
+            stats->deduped += 1;
+            OutBuf_double(out, *(double*)Stack_itemAt(cache->results, index));
+        } else if(!Batch_tokenize(t, perf, latency, &clock, line, line_len)) {
+            if(t->error->code == ERR_EMPTY_EXPRESSION) {
+                blank = TRUE;
+                stats->blank += 1;
+            } else {
+                stats->errors += 1;
+                Batch_writeError(
+                    out, options, t->error->message, t->error->index);
+            }
+        } else {
+            TokenArray tokens;
+            double     result    = 0;
+            size_t     token_len = 0;
+            SftError*  error     = 0;
+
+            Tokenizer_view(t, &tokens);
+
+            if(cache) {
+                token_len =
+                    BatchDedup_tokenKey(cache, text_len, &tokens, text_len);
+                hit = BatchDedup_get(cache, text_len, token_len, &index);
+            }
+
+            if(hit) {
+                // Remember this spelling, to skip tokenizing next time.
+                HashMap_put(cache->index, cache->key, text_len, index);
+                stats->deduped += 1;
+                result = *(double*)Stack_itemAt(cache->results, index);
+            } else {
+                // Building the token key took a while since tokenizing.
+                if(latency && cache)
+                    clock = monotonic_ns();
+
+                Perf_begin(perf, PERF_EVALUATE);
+
+                if(split && !limited) {
+                    error = Split_eval(split, sft, &tokens, &result);
+                } else {
+                    Sft_begin(sft, &tokens);
+
+                    if(options->max_ns)
+                        budget.deadline_ns = monotonic_ns() + options->max_ns;
+
+                    error = Sft_resume(sft, limited ? &budget : 0, &result);
+                }
+
+                Perf_end(perf);
+
+                if(latency)
+                    Batch_lap(&latency->evaluate, &clock);
+            }
+
+            if(error) {
+                stats->errors += 1;
+
+                if(!options->skip_errors) {
+                    Batch_writeError(
+                        out, options, SftError_message(error), error->offset);
+                }
+            } else {
+                OutBuf_double(out, result);
+
+                if(cache && !hit) {
+                    index = BatchDedup_add(cache, result);
+                    HashMap_put(cache->index, cache->key, text_len, index);
+                    HashMap_put(
+                        cache->index, cache->key + text_len, token_len, index);
+                }
+            }
+        }
+
+        if(cache)
+            BatchDedup_count(cache, hit);
+
+        OutBuf_char(out, '\n');
+        line = line_end + 1;
+
+        if(latency) {
+            clock = monotonic_ns();
+
+            // Blank lines are no expression to time.
+            if(!blank)
+                Histogram_record(&latency->total, clock - line_start);
+
+            line_start = clock;
+        }
+    }
+}
+
+// A chunk's worth of results, waiting to be written out in order.
+typedef struct BatchSlot {
+    OutBuf*    out;
+    BatchStats stats;
+    BOOL       ready; // Evaluated and not yet written.
+} BatchSlot;
+
+// State shared by the workers and the writer of a parallel run. Everything
+// below `lock` is guarded by it.
+typedef struct BatchRun {
+    const char*         data;
+    size_t              len;
+    const BatchOptions* options;
+    size_t              chunk_size;
+    size_t              window;
+    BatchSlot*          slots;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  slot_free;  // Workers wait on this for a free slot.
+    pthread_cond_t  slot_ready; // The writer waits on this for the next slot.
+    size_t          offset;     // Where the next chunk starts.
+    size_t          handed_out; // Chunks handed to workers so far.
+    size_t          written;    // Chunks written out so far.
+    PerfTotals      perf;       // Of the workers that finished.
+    LatencyStats*   latency;    // The caller's, for the workers that finished.
+} BatchRun;
+
+static void* Batch_worker(void* arg) {
+    BatchRun*     run     = arg;
+    Tokenizer*    t       = Tokenizer_new();
+    Sft*          sft     = Sft_new();
+    BatchDedup*   dedup   = run->options->dedup ? BatchDedup_new() : 0;
+    Perf*         perf    = run->options->perf ? Perf_new() : 0;
+    LatencyStats* latency = run->latency ? LatencyStats_new() : 0;
+
+    Series_setPooled(TRUE);
+    pthread_mutex_lock(&run->lock);
+
+    while(TRUE) {
+        while(run->offset < run->len &&
+              run->handed_out >= run->written + run->window) {
+            pthread_cond_wait(&run->slot_free, &run->lock);
+        }
+
+        if(run->offset >= run->len)
+            break;
+
+        // Take the next chunk, extended to the end of the line it stops in.
+        size_t start = run->offset;
+        size_t end   = start + run->chunk_size;
+
+        if(end >= run->len) {
+            end = run->len;
+        } else {
+            const char* newline =
+                memchr(run->data + end - 1, '\n', run->len - end + 1);
+            end = newline ? (size_t)(newline - run->data) + 1 : run->len;
+        }
+
+        BatchSlot* slot = &run->slots[run->handed_out % run->window];
+        run->offset     = end;
+        run->handed_out += 1;
+
+        pthread_mutex_unlock(&run->lock);
+
+        OutBuf_clear(slot->out);
+        memset(&slot->stats, 0, sizeof(BatchStats));
+        Batch_evalLines(t,
+                        sft,
+                        dedup,
+                        0,
+                        perf,
+                        latency,
+                        run->data + start,
+                        end - start,
+                        slot->out,
+                        run->options,
+                        &slot->stats);
+
+        pthread_mutex_lock(&run->lock);
+        slot->ready = TRUE;
+        pthread_cond_signal(&run->slot_ready);
+    }
+
+    if(perf)
+        PerfTotals_add(&run->perf, &perf->totals);
+
+    if(latency && run->latency)
+        LatencyStats_add(run->latency, latency);
+
+    pthread_mutex_unlock(&run->lock);
+
+    xfree(latency);
+    Perf_free(perf);
+    BatchDedup_free(dedup);
+    Sft_free(sft);
+    Tokenizer_free(t);
+    return 0;
+}
+
+// Evaluates data[0..len) on worker threads while the calling thread writes
+// the finished chunks out in order. Returns -1 if no worker could be started
+// and nothing was evaluated, otherwise whether writing failed.
+static int Batch_evalParallel(const char*         data,
+                              size_t              len,
+                              FILE*               stream,
+                              size_t              threads,
+                              const BatchOptions* options,
+                              BatchStats*         stats) {
+    BatchRun run;
+    memset(&run, 0, sizeof(BatchRun));
+
+    run.data       = data;
+    run.len        = len;
+    run.options    = options;
+    run.chunk_size = options->chunk_size ? options->chunk_size
+                                         : BATCH_DEFAULT_CHUNK_SIZE;
+    run.window     = options->window ? options->window : threads * 4;
+    run.slots      = xmalloc(run.window * sizeof(BatchSlot));
+    run.latency    = options->latency ? stats->latency : 0;
+
+    for(size_t i = 0; i < run.window; ++i) {
+        run.slots[i].out   = OutBuf_new(0, run.chunk_size);
+        run.slots[i].ready = FALSE;
+    }
+
+    pthread_mutex_init(&run.lock, 0);
+    pthread_cond_init(&run.slot_free, 0);
+    pthread_cond_init(&run.slot_ready, 0);
+
+    pthread_t* workers = xmalloc(threads * sizeof(pthread_t));
+    size_t     started = 0;
+
+    // Make do with fewer workers if the system won't give us all of them.
+    while(started < threads &&
+          pthread_create(&workers[started], 0, Batch_worker, &run) == 0) {
+        started += 1;
+    }
+
+    int failed = started ? 0 : -1;
+
+    if(started) {
+        pthread_mutex_lock(&run.lock);
+
+        while(TRUE) {
+            BatchSlot* slot = &run.slots[run.written % run.window];
+
+            while(!slot->ready &&
+                  !(run.offset >= run.len && run.written == run.handed_out)) {
+                pthread_cond_wait(&run.slot_ready, &run.lock);
+            }
+
+            if(!slot->ready)
+                break;
+
+            pthread_mutex_unlock(&run.lock);
+
+            // Keep draining after a failed write so the workers can finish.
+            if(!failed && fwrite(slot->out->data, 1, slot->out->len, stream) !=
+                              slot->out->len) {
+                failed = 1;
+            }
+
+            stats->lines += slot->stats.lines;
+            stats->errors += slot->stats.errors;
+            stats->blank += slot->stats.blank;
+            stats->deduped += slot->stats.deduped;
+
+            pthread_mutex_lock(&run.lock);
+            slot->ready = FALSE;
+            run.written += 1;
+            pthread_cond_broadcast(&run.slot_free);
+        }
+
+        pthread_mutex_unlock(&run.lock);
+    }
+
+    for(size_t i = 0; i < started; ++i) {
+        pthread_join(workers[i], 0);
+    }
+
+    PerfTotals_add(&stats->perf, &run.perf);
+
+    pthread_cond_destroy(&run.slot_ready);
+    pthread_cond_destroy(&run.slot_free);
+    pthread_mutex_destroy(&run.lock);
+
+    for(size_t i = 0; i < run.window; ++i) {
+        OutBuf_free(run.slots[i].out);
+    }
+
+    xfree(run.slots);
+    xfree(workers);
+    return failed;
+}
+
+// Evaluates the lines on the calling thread, with options->split splitting
+// the long ones over the given number of threads.
+static int Batch_evalSerial(const char*         data,
+                            size_t              len,
+                            FILE*               stream,
+                            size_t              threads,
+                            const BatchOptions* options,
+                            BatchStats*         stats) {
+    Tokenizer*  t     = Tokenizer_new();
+    Sft*        sft   = Sft_new();
+    OutBuf*     out   = OutBuf_new(stream, 0);
+    BatchDedup* dedup = options->dedup ? BatchDedup_new() : 0;
+    Split*      split = options->split ? Split_new(threads, 0) : 0;
+    Perf*       perf  = options->perf ? Perf_new() : 0;
+
+    Batch_evalLines(t,
+                    sft,
+                    dedup,
+                    split,
+                    perf,
+                    options->latency ? stats->latency : 0,
+                    data,
+                    len,
+                    out,
+                    options,
+                    stats);
+    OutBuf_flush(out);
+
+    int failed = out->failed;
+
+    if(perf)
+        PerfTotals_add(&stats->perf, &perf->totals);
+
+    Perf_free(perf);
+    Split_free(split);
+    BatchDedup_free(dedup);
+    OutBuf_free(out);
+    Sft_free(sft);
+    Tokenizer_free(t);
+    return failed;
+}
+
+int Batch_runFile(const char*         path,
+                  FILE*               stream,
+                  const BatchOptions* options,
+                  BatchStats*         stats) {
+    uint64_t start = monotonic_ns();
+    int      fd    = open(path, O_RDONLY);
+
+    if(fd < 0) {
+        perror(path);
+        return 1;
+    }
+
+    struct stat st;
+
+    if(fstat(fd, &st) < 0) {
+        perror(path);
+        close(fd);
+        return 1;
+    }
+
+    size_t len  = (size_t)st.st_size;
+    char*  data = 0;
+
+    // mmap refuses empty mappings; an empty file simply has no lines.
+    if(len) {
+        data = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if(data == MAP_FAILED) {
+            perror(path);
+            close(fd);
+            return 1;
+        }
+
+        madvise(data, len, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+
+    size_t threads    = options->threads;
+    size_t chunk_size = options->chunk_size ? options->chunk_size
+                                            : BATCH_DEFAULT_CHUNK_SIZE;
+
+    if(!threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads     = online > 0 ? (size_t)online : 1;
+    }
+
+    // Threads only pay off once there is more than one chunk to go around,
+    // unless they split the lines instead.
+    int failed = -1;
+
+    if(threads > 1 && len > chunk_size && !options->split) {
+        failed = Batch_evalParallel(data, len, stream, threads, options, stats);
+    }
+
+    if(failed < 0) {
+        failed = Batch_evalSerial(data, len, stream, threads, options, stats);
+    }
+
+    failed = failed || fflush(stream) != 0;
+
+    if(failed) {
+        perror("Failed to write results");
+    }
+
+    if(data) {
+        munmap(data, len);
+    }
+
+    stats->ns += monotonic_ns() - start;
+    return failed;
+}
+
+void BatchStats_print(const BatchStats* stats, FILE* stream) {
+    double seconds = (double)stats->ns / 1e9;
+
+    fprintf(stream,
+            "%zu lines, %zu errors, %zu blank in %.3fs (%.2fM lines/s)\n",
+            stats->lines,
+            stats->errors,
+            stats->blank,
+            seconds,
+            seconds > 0 ? (double)stats->lines / seconds / 1e6 : 0.0);
+
+    // Expressions evaluated against lines answered, blank and bad ones aside.
+    size_t answered = stats->lines - stats->errors - stats->blank;
+
+    if(stats->deduped) {
+        fprintf(stream,
+                "%zu repeats answered from the dedup cache, dedup ratio "
+                "%.2f:1\n",
+                stats->deduped,
+                (double)answered / (double)(answered - stats->deduped));
+    }
+}
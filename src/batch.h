@@ -0,0 +1,149 @@
+#ifndef _H_BATCH_
+#define _H_BATCH_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "evaluator.h"
+#include "hashmap.h"
+#include "histogram.h"
+#include "outbuf.h"
+#include "perf.h"
+#include "split.h"
+#include "tokenizer.h"
+
+// Batch mode: evaluates a file of newline separated expressions, writing one
+// output line per input line, in the same order. A line that fails to parse
+// or evaluate produces an error line instead of a result and the run carries
+// on. Blank lines produce blank lines.
+//
+// With more than one thread the mapped file is cut into newline aligned
+// chunks which worker threads evaluate with their own Tokenizer/Sft pair,
+// each into the output buffer of a slot in a ring of `window` slots. The
+// calling thread writes the slots out in chunk order, so the output is the
+// same as a single threaded run. A chunk is only handed out once its slot is
+// free again, so at most `window` chunks of results are held at any time.
+
+typedef struct BatchOptions {
+    // Write an empty line for a bad expression instead of its error message,
+    // so that bad lines cost no formatting at all; they are still counted.
+    BOOL skip_errors;
+
+    // Worker threads; 0 uses one per online CPU, 1 evaluates on the calling
+    // thread without starting any.
+    size_t threads;
+
+    // Input bytes per chunk, rounded up to the end of a line; 0 means
+    // BATCH_DEFAULT_CHUNK_SIZE.
+    size_t chunk_size;
+
+    // Chunks in flight, evaluated or waiting to be written, which bounds the
+    // memory held for results; 0 means four per thread.
+    size_t window;
+
+    // Per expression limits on evaluation steps and wall time, 0 for none.
+    // An expression over either fails with ERR_BUDGET_EXHAUSTED, which keeps
+    // one pathological line from holding up a worker (see SftBudget).
+    uint64_t max_steps;
+    uint64_t max_ns;
+
+    // Evaluate every distinct expression once per thread and answer repeats
+    // from a cache (see BatchDedup).
+    BOOL dedup;
+
+    // Count hardware events while tokenizing and evaluating, on every
+    // thread, into the perf totals of the stats (see perf.h).
+    BOOL perf;
+
+    // Time every expression, on every thread, into the latencies of the
+    // stats (see histogram.h). Costs three clock reads per line.
+    BOOL latency;
+
+    // Evaluate one line at a time on all the threads, splitting each long
+    // expression among them (see split.h), rather than a chunk of lines on
+    // each. Lines with a limit of max_steps or max_ns are evaluated whole.
+    BOOL split;
+} BatchOptions;
+
+#define BATCH_DEFAULT_CHUNK_SIZE (1 << 20)
+
+typedef struct BatchStats {
+    size_t   lines;   // Lines read, blank ones included.
+    size_t   errors;  // Lines that failed to parse or evaluate.
+    size_t   blank;   // Lines with nothing but whitespace.
+    size_t   deduped; // Lines answered from the dedup cache.
+    uint64_t ns;      // Wall time of the whole run.
+
+    PerfTotals perf; // With BatchOptions.perf.
+
+    // With BatchOptions.latency, where Batch_runFile adds the latencies of
+    // the run. Owned by the caller.
+    LatencyStats* latency;
+} BatchStats;
+
+// Results of the expressions seen so far, keyed on their canonical forms: the
+// line with its whitespace stripped, which is looked up before tokenizing so
+// that exact and whitespace-only repeats cost a hash probe, and failing that
+// its token stream, which also matches spellings of the same tokens such as
+// "0x10" and "16". Only results are kept; lines that fail are evaluated every
+// time, so that their error columns stay their own.
+//
+// At most BATCH_DEDUP_MAX_ENTRIES keys are held; the cache is emptied when it
+// is full. A miss costs about as much as evaluating a short line, so when
+// fewer than one in BATCH_DEDUP_MIN_HITS of the last BATCH_DEDUP_WINDOW lines
+// looked up were hits, it is skipped for BATCH_DEDUP_BYPASS times as many
+// lines before being tried again, and for twice as many after each such try,
+// up to BATCH_DEDUP_MAX_DOUBLINGS times.
+typedef struct BatchDedup {
+    HashMap* index;   // Key to index in results.
+    Stack*   results; // double
+    char*    key;     // Scratch for building keys.
+    size_t   key_capacity;
+
+    size_t lines;     // Looked up since the hits were last weighed.
+    size_t hits;      // Of those lines.
+    size_t bypass;    // Lines left to skip the cache.
+    size_t doublings; // Of the bypass, since the last try with enough hits.
+} BatchDedup;
+
+#define BATCH_DEDUP_MAX_ENTRIES   (1 << 18)
+#define BATCH_DEDUP_WINDOW        4096
+#define BATCH_DEDUP_MIN_HITS      8
+#define BATCH_DEDUP_BYPASS        15
+#define BATCH_DEDUP_MAX_DOUBLINGS 4
+
+extern BatchDedup* BatchDedup_new(void);
+extern void        BatchDedup_free(BatchDedup* dedup);
+
+// Evaluates every line of data[0..len) with the given Tokenizer/Sft pair,
+// appending the results to out, and adding to stats. A last line without a
+// trailing newline is evaluated too. Repeats are answered from dedup, and
+// long expressions split over the threads of split, unless they are null.
+// Tokenizing and evaluating are counted in perf, and every expression timed
+// into latency, unless they are null.
+extern void Batch_evalLines(Tokenizer*          t,
+                            Sft*                sft,
+                            BatchDedup*         dedup,
+                            Split*              split,
+                            Perf*               perf,
+                            LatencyStats*       latency,
+                            const char*         data,
+                            size_t              len,
+                            OutBuf*             out,
+                            const BatchOptions* options,
+                            BatchStats*         stats);
+
+// Memory maps the file and evaluates it with Batch_evalLines, on as many
+// threads as the options ask for, writing the results to the stream. Returns
+// non-zero if the file couldn't be read or the output couldn't be written;
+// bad expressions don't count as failure.
+extern int Batch_runFile(const char*         path,
+                         FILE*               stream,
+                         const BatchOptions* options,
+                         BatchStats*         stats);
+
+// Prints a one line summary of the run.
+extern void BatchStats_print(const BatchStats* stats, FILE* stream);
+
+#endif // _H_BATCH_
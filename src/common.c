@@ -1,5 +1,6 @@
 #include "common.h"
 #include <stdio.h>
+#include <time.h>
 
 #ifdef DEBUG
     #define dprintf(s, ...) printf(s, ...)
@@ -7,72 +8,224 @@
     #define dprintf(v, ...)
 #endif
 
+static XallocHook xalloc_hook      = 0;
+static void*      xalloc_hook_user = 0;
+
+static _Thread_local XallocScope xalloc_scope = {0};
+
+void xalloc_setHook(XallocHook hook, void* user) {
+    xalloc_hook      = hook;
+    xalloc_hook_user = user;
+}
+
+XallocScope xalloc_enter(const SeqftAllocator* allocator, jmp_buf* recover) {
+    XallocScope previous = xalloc_scope;
+
+    xalloc_scope.allocator = allocator;
+    xalloc_scope.recover   = recover;
+
+    return previous;
+}
+
+void xalloc_leave(XallocScope previous) {
+    xalloc_scope = previous;
+}
+
+const SeqftAllocator* xalloc_current(void) {
+    return xalloc_scope.allocator;
+}
+
+// Out of memory: back to where the thread entered the library, if it said
+// where, and otherwise the end.
+static void xalloc_fail(const char* message) {
+    if(xalloc_scope.recover)
+        longjmp(*xalloc_scope.recover, 1);
+
+    perror(message);
+    abort();
+}
+
+void* xtrymalloc(size_t size) {
+    const SeqftAllocator* allocator = xalloc_scope.allocator;
+    void*                 ptr;
+
+    if(allocator)
+        ptr = allocator->allocate(allocator->user, size);
+    else
+        ptr = malloc(size);
+
+    if(ptr && xalloc_hook) {
+        xalloc_hook(XALLOC_MALLOC, 0, ptr, size, xalloc_hook_user);
+    }
+
+    return ptr;
+}
+
 // A wrapper to malloc that aborts the program immediately if malloc fails.
 void* xmalloc(size_t size) {
-    void* ptr = malloc(size);
+    void* ptr = xtrymalloc(size);
 
     if(!ptr) {
-        perror("Failed to malloc; out of memory.");
-        abort();
+        xalloc_fail("Failed to malloc; out of memory.");
     }
+
     return ptr;
 }
 
 // A wrapper to realloc that aborts the program immediately if realloc fails.
 void* xrealloc(void* memory, size_t size) {
-    void* ptr = realloc(memory, size);
+    const SeqftAllocator* allocator = xalloc_scope.allocator;
+    void*                 ptr       = 0;
+
+    // Allocators only see the sizes and pointers realloc would reallocate.
+    if(!allocator) {
+        ptr = realloc(memory, size);
+    } else if(!memory) {
+        ptr = allocator->allocate(allocator->user, size);
+    } else if(!size) {
+        allocator->release(allocator->user, memory);
+    } else {
+        ptr = allocator->reallocate(allocator->user, memory, size);
+    }
 
     if(!ptr && size != 0) {
-        perror("Failed to realloc; out of memory.");
-        abort();
+        xalloc_fail("Failed to realloc; out of memory.");
+    }
+
+    if(xalloc_hook) {
+        xalloc_hook(XALLOC_REALLOC, memory, ptr, size, xalloc_hook_user);
     }
 
     return ptr;
 }
 
-size_t filter_whitespace(const char* input, size_t len, char* dest) {
-    char buffer[len + 2];
-    memset(buffer, 0, len + 2);
+void xfree(void* memory) {
+    if(!memory)
+        return;
 
-    for(int i = 0, j = 0; i < len; ++i) {
-        if(!isspace(input[i])) {
-            buffer[j] = input[i];
-            ++j;
-        }
+    const SeqftAllocator* allocator = xalloc_scope.allocator;
+
+    if(allocator)
+        allocator->release(allocator->user, memory);
+    else
+        free(memory);
+
+    if(xalloc_hook) {
+        xalloc_hook(XALLOC_FREE, memory, 0, 0, xalloc_hook_user);
     }
+}
 
-    if(dest) {
-        size_t buflen = strlen(buffer);
-        memcpy(dest, buffer, buflen + 1);
-        return buflen;
-    } else {
+const char* ErrCode_describe(ErrCode code) {
+    switch(code) {
+        case ERR_NONE:
+            return "No error.";
+        case ERR_EMPTY_EXPRESSION:
+            return "Empty expression.";
+        case ERR_NUMBER_TOO_SHORT:
+            return "Not enough digits to construct a number.";
+        case ERR_INCOMPLETE_NUMBER:
+            return "Incomplete number.";
+        case ERR_INVALID_DIGIT:
+            return "Invalid character in number.";
+        case ERR_LEADING_ZERO:
+            return "Leading zero in number is illegal in this context.";
+        case ERR_INVALID_CHARACTER:
+            return "Invalid expression.";
+        case ERR_MISSING_OPERAND:
+            return "Missing operand for operator.";
+        case ERR_MISSING_ARGUMENT:
+            return "Missing argument in function call.";
+        case ERR_COMMA_OUTSIDE_CALL:
+            return "',' outside of a function call.";
+        case ERR_UNKNOWN_FUNCTION:
+            return "No such function.";
+        case ERR_ARGUMENT_COUNT:
+            return "Wrong number of arguments for function.";
+        case ERR_UNKNOWN_VARIABLE:
+            return "Variable has no value.";
+        case ERR_DEPENDENCY_CYCLE:
+            return "Formula depends on its own variable.";
+        case ERR_BUDGET_EXHAUSTED:
+            return "Evaluation budget exhausted.";
+        case ERR_CANCELLED:
+            return "Evaluation cancelled.";
+        case ERR_CORRUPT_PROGRAM:
+            return "Corrupt compiled program.";
+        case ERR_SERIES_FORM:
+            return "Series takes an index, a range and a body, as in "
+                   "sum(i, 1, 10, i^2).";
+        case ERR_SERIES_RANGE:
+            return "Series range is not finite or holds more than 2^53 values.";
+        case ERR_SERIES_INDEX:
+            return "Series index is a variable with a value.";
+        case ERR_OUT_OF_MEMORY:
+            return "Out of memory.";
+        case ERR_EMIT_UNSUPPORTED:
+            return "Expression can't be emitted as C.";
+        default:
+            return "Unknown error.";
+    }
+}
+
+// Copies input to dest without its whitespace, and null terminates it. dest
+// must have room for len + 1 bytes. Returns the length of the result, or 0
+// if dest is null.
+size_t filter_whitespace(const char* input, size_t len, char* dest) {
+    if(!dest) {
         return 0;
     }
+
+    size_t j = 0;
+
+    for(size_t i = 0; i < len && input[i]; ++i) {
+        if(!isspace((unsigned char)input[i])) {
+            dest[j++] = input[i];
+        }
+    }
+
+    dest[j] = '\0';
+    return j;
 }
 
 char* read_input(const char* prompt) {
-    char*  buffer = xmalloc(1);
-    size_t size   = 0;
+    char*  buffer = xmalloc(256);
+    size_t size   = 256;
     size_t len    = 0;
     int    c;
 
     if(prompt) {
         printf("%s", prompt);
+        fflush(stdout);
     }
 
     while((c = fgetc(stdin)) != '\n') {
+        if(c == EOF) {
+            if(len == 0) {
+                xfree(buffer);
+                return 0;
+            }
+
+            break;
+        }
+
         if(len + 1 >= size) {
-            size   = size ? size * 2 : 256;
-            buffer = realloc(buffer, size);
+            size *= 2;
+            buffer = xrealloc(buffer, size);
         }
 
-        buffer[len++] = c;
+        buffer[len++] = (char)c;
     }
 
-    buffer[len++] = '\0';
+    buffer[len] = '\0';
     return buffer;
 }
 
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
 void minmax(int64_t* n1, int64_t* n2, int64_t** min, int64_t** max) {
     if(*n1 < *n2) {
         *min = n1;
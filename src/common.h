@@ -1,10 +1,14 @@
 #ifndef _H_COMMON_
 #define _H_COMMON_
 
+#include <setjmp.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
+#include "seqft.h"
+
 #ifndef BOOL
 #define BOOL int
 #endif
@@ -26,19 +30,121 @@
 #endif
 
 
+// Machine readable error codes shared by the tokenizer and the evaluator.
+// Errors are recorded as a code plus the position they occurred at; turning
+// one into a human readable message is left to whoever wants to display it,
+// so that rejecting malformed input costs no formatting.
+typedef enum ErrCode {
+    ERR_NONE = 0,
+
+    // Tokenizer
+    ERR_EMPTY_EXPRESSION,  // Nothing but whitespace.
+    ERR_NUMBER_TOO_SHORT,  // Not enough digits to construct a number.
+    ERR_INCOMPLETE_NUMBER, // Base prefix or decimal point without digits.
+    ERR_INVALID_DIGIT,     // Character not valid for the number's base.
+    ERR_LEADING_ZERO,      // Leading zero in a decimal number.
+    ERR_INVALID_CHARACTER, // Character that can't start or continue a token.
+
+    // Evaluator
+    ERR_MISSING_OPERAND,    // Operator without enough numbers to apply to.
+    ERR_MISSING_ARGUMENT,   // Empty argument in a function call.
+    ERR_COMMA_OUTSIDE_CALL, // ',' that doesn't separate function arguments.
+    ERR_UNKNOWN_FUNCTION,   // No function of that name.
+    ERR_ARGUMENT_COUNT,     // Function called with a wrong argument count.
+    ERR_UNKNOWN_VARIABLE,   // Variable that is undefined or has no value.
+
+    // Variables
+    ERR_DEPENDENCY_CYCLE, // Formula that depends on its own variable.
+
+    // Budgets
+    ERR_BUDGET_EXHAUSTED, // Out of steps or time; the evaluation can resume.
+    ERR_CANCELLED,        // Cancelled from outside while evaluating.
+
+    // Programs
+    ERR_CORRUPT_PROGRAM, // Compiled formula pointing outside of its file.
+
+    // Series
+    ERR_SERIES_FORM,  // Series without a body, or left open.
+    ERR_SERIES_RANGE, // Series over a range that isn't finite or too long.
+    ERR_SERIES_INDEX, // Series whose index is a variable with a value.
+
+    // C emission
+    ERR_EMIT_UNSUPPORTED, // Expression that has no C equivalent, see emit.h.
+
+    // Memory
+    ERR_OUT_OF_MEMORY, // The allocator of the context returned null.
+
+    ERR_COUNT,
+} ErrCode;
+
+// Returns a static, one line description of the error code.
+extern const char* ErrCode_describe(ErrCode code);
+
 // Represents any non-recoverable error that can occur during iteration.
+// The message is the static description of the code.
 typedef struct IterErr {
+    ErrCode     code;
     const char* message;
     size_t      index;
 } IterErr;
 
 
-// A wrapper to malloc that aborts the program immediately if malloc fails.
+// A wrapper to malloc that aborts the program immediately if malloc fails,
+// unless the thread is within an xalloc_enter scope with somewhere to
+// recover to.
 extern void* xmalloc(size_t size);
 
-// A wrapper to realloc that aborts the program immediately if realloc fails.
+// Like xmalloc, but returns null if out of memory, for threads that can't
+// jump back to where they entered the library.
+extern void* xtrymalloc(size_t size);
+
+// A wrapper to realloc that aborts the program immediately if realloc fails,
+// or recovers like xmalloc.
 extern void* xrealloc(void* memory, size_t size);
 
+// The counterpart to xmalloc and xrealloc. Memory obtained through either of
+// them should be released through this, so that the allocation hook sees it.
+extern void xfree(void* memory);
+
+typedef enum {
+    XALLOC_MALLOC,
+    XALLOC_REALLOC,
+    XALLOC_FREE,
+} XallocEvent;
+
+// Called after every successful xmalloc, xrealloc and xfree. For XALLOC_FREE
+// the size is unknown and passed as 0; for XALLOC_MALLOC old_ptr is null.
+typedef void (*XallocHook)(XallocEvent event,
+                           void*       old_ptr,
+                           void*       new_ptr,
+                           size_t      size,
+                           void*       user);
+
+// Installs an allocation hook for the whole process, or removes it if null.
+// Intended for accounting in test harnesses and benchmarks; install it before
+// any other thread starts allocating.
+extern void xalloc_setHook(XallocHook hook, void* user);
+
+// The allocator and recovery point of a thread, which are malloc and
+// aborting until it enters a scope.
+typedef struct XallocScope {
+    const SeqftAllocator* allocator;
+    jmp_buf*              recover;
+} XallocScope;
+
+// Makes xmalloc, xrealloc and xfree of the calling thread go through the
+// allocator, and running out of memory longjmp to recover with 1 instead of
+// aborting if it isn't null, until xalloc_leave is given the scope returned,
+// which is the one entered before. Scopes nest. The allocator must stay valid
+// until then, and memory must be freed in a scope of the allocator it came
+// from.
+extern XallocScope xalloc_enter(const SeqftAllocator* allocator,
+                                jmp_buf*              recover);
+extern void        xalloc_leave(XallocScope previous);
+
+// The allocator of the calling thread's scope, null outside of any.
+extern const SeqftAllocator* xalloc_current(void);
+
 // An alias for xmalloc meaning "call site responsible" that explicitly states 
 // that the caller of malloc is not responsible for freeing the memory, and
 // that the corresponding free() should be found at the call site, or elsewhere. 
@@ -48,8 +154,13 @@ extern void* xrealloc(void* memory, size_t size);
 
 extern size_t filter_whitespace(const char* input, size_t len, char* dest);
 
+// Reads a line from stdin without its newline. Returns null once stdin is at
+// its end and nothing was read. Caller responsible for freeing the line.
 extern char* read_input(const char* prompt);
 
+// CLOCK_MONOTONIC in nanoseconds.
+extern uint64_t monotonic_ns(void);
+
 
 extern void minmax(int64_t* n1, int64_t* n2, int64_t** min, int64_t** max);
 
@@ -0,0 +1,480 @@
+#include "dtoa.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+
+// Grisu2, after Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+// Accurately with Integers" (PLDI 2010). The double and its rounding
+// boundaries are scaled by a cached power of ten into a range where their
+// digits can be cut out of 64-bit integers, and digits are generated until
+// the number is pinned down between the boundaries.
+
+// A floating point number f * 2^e with a 64-bit significand.
+typedef struct DiyFp {
+    uint64_t f;
+    int      e;
+} DiyFp;
+
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFull
+#define DP_HIDDEN_BIT       0x0010000000000000ull
+#define DP_EXPONENT_MASK    0x7FF0000000000000ull
+#define DP_EXPONENT_BIAS    (0x3FF + 52)
+
+// Normalized 10^k for k = -348, -340, ..., 340, rounded to nearest.
+static const DiyFp CACHED_POWERS[] = {
+    {0xfa8fd5a0081c0288ull, -1220}, // 1e-348
+    {0xbaaee17fa23ebf76ull, -1193}, // 1e-340
+    {0x8b16fb203055ac76ull, -1166}, // 1e-332
+    {0xcf42894a5dce35eaull, -1140}, // 1e-324
+    {0x9a6bb0aa55653b2dull, -1113}, // 1e-316
+    {0xe61acf033d1a45dfull, -1087}, // 1e-308
+    {0xab70fe17c79ac6caull, -1060}, // 1e-300
+    {0xff77b1fcbebcdc4full, -1034}, // 1e-292
+    {0xbe5691ef416bd60cull, -1007}, // 1e-284
+    {0x8dd01fad907ffc3cull, -980}, // 1e-276
+    {0xd3515c2831559a83ull, -954}, // 1e-268
+    {0x9d71ac8fada6c9b5ull, -927}, // 1e-260
+    {0xea9c227723ee8bcbull, -901}, // 1e-252
+    {0xaecc49914078536dull, -874}, // 1e-244
+    {0x823c12795db6ce57ull, -847}, // 1e-236
+    {0xc21094364dfb5637ull, -821}, // 1e-228
+    {0x9096ea6f3848984full, -794}, // 1e-220
+    {0xd77485cb25823ac7ull, -768}, // 1e-212
+    {0xa086cfcd97bf97f4ull, -741}, // 1e-204
+    {0xef340a98172aace5ull, -715}, // 1e-196
+    {0xb23867fb2a35b28eull, -688}, // 1e-188
+    {0x84c8d4dfd2c63f3bull, -661}, // 1e-180
+    {0xc5dd44271ad3cdbaull, -635}, // 1e-172
+    {0x936b9fcebb25c996ull, -608}, // 1e-164
+    {0xdbac6c247d62a584ull, -582}, // 1e-156
+    {0xa3ab66580d5fdaf6ull, -555}, // 1e-148
+    {0xf3e2f893dec3f126ull, -529}, // 1e-140
+    {0xb5b5ada8aaff80b8ull, -502}, // 1e-132
+    {0x87625f056c7c4a8bull, -475}, // 1e-124
+    {0xc9bcff6034c13053ull, -449}, // 1e-116
+    {0x964e858c91ba2655ull, -422}, // 1e-108
+    {0xdff9772470297ebdull, -396}, // 1e-100
+    {0xa6dfbd9fb8e5b88full, -369}, // 1e-92
+    {0xf8a95fcf88747d94ull, -343}, // 1e-84
+    {0xb94470938fa89bcfull, -316}, // 1e-76
+    {0x8a08f0f8bf0f156bull, -289}, // 1e-68
+    {0xcdb02555653131b6ull, -263}, // 1e-60
+    {0x993fe2c6d07b7facull, -236}, // 1e-52
+    {0xe45c10c42a2b3b06ull, -210}, // 1e-44
+    {0xaa242499697392d3ull, -183}, // 1e-36
+    {0xfd87b5f28300ca0eull, -157}, // 1e-28
+    {0xbce5086492111aebull, -130}, // 1e-20
+    {0x8cbccc096f5088ccull, -103}, // 1e-12
+    {0xd1b71758e219652cull, -77}, // 1e-4
+    {0x9c40000000000000ull, -50}, // 1e4
+    {0xe8d4a51000000000ull, -24}, // 1e12
+    {0xad78ebc5ac620000ull, 3}, // 1e20
+    {0x813f3978f8940984ull, 30}, // 1e28
+    {0xc097ce7bc90715b3ull, 56}, // 1e36
+    {0x8f7e32ce7bea5c70ull, 83}, // 1e44
+    {0xd5d238a4abe98068ull, 109}, // 1e52
+    {0x9f4f2726179a2245ull, 136}, // 1e60
+    {0xed63a231d4c4fb27ull, 162}, // 1e68
+    {0xb0de65388cc8ada8ull, 189}, // 1e76
+    {0x83c7088e1aab65dbull, 216}, // 1e84
+    {0xc45d1df942711d9aull, 242}, // 1e92
+    {0x924d692ca61be758ull, 269}, // 1e100
+    {0xda01ee641a708deaull, 295}, // 1e108
+    {0xa26da3999aef774aull, 322}, // 1e116
+    {0xf209787bb47d6b85ull, 348}, // 1e124
+    {0xb454e4a179dd1877ull, 375}, // 1e132
+    {0x865b86925b9bc5c2ull, 402}, // 1e140
+    {0xc83553c5c8965d3dull, 428}, // 1e148
+    {0x952ab45cfa97a0b3ull, 455}, // 1e156
+    {0xde469fbd99a05fe3ull, 481}, // 1e164
+    {0xa59bc234db398c25ull, 508}, // 1e172
+    {0xf6c69a72a3989f5cull, 534}, // 1e180
+    {0xb7dcbf5354e9beceull, 561}, // 1e188
+    {0x88fcf317f22241e2ull, 588}, // 1e196
+    {0xcc20ce9bd35c78a5ull, 614}, // 1e204
+    {0x98165af37b2153dfull, 641}, // 1e212
+    {0xe2a0b5dc971f303aull, 667}, // 1e220
+    {0xa8d9d1535ce3b396ull, 694}, // 1e228
+    {0xfb9b7cd9a4a7443cull, 720}, // 1e236
+    {0xbb764c4ca7a44410ull, 747}, // 1e244
+    {0x8bab8eefb6409c1aull, 774}, // 1e252
+    {0xd01fef10a657842cull, 800}, // 1e260
+    {0x9b10a4e5e9913129ull, 827}, // 1e268
+    {0xe7109bfba19c0c9dull, 853}, // 1e276
+    {0xac2820d9623bf429ull, 880}, // 1e284
+    {0x80444b5e7aa7cf85ull, 907}, // 1e292
+    {0xbf21e44003acdd2dull, 933}, // 1e300
+    {0x8e679c2f5e44ff8full, 960}, // 1e308
+    {0xd433179d9c8cb841ull, 986}, // 1e316
+    {0x9e19db92b4e31ba9ull, 1013}, // 1e324
+    {0xeb96bf6ebadf77d9ull, 1039}, // 1e332
+    {0xaf87023b9bf0ee6bull, 1066}, // 1e340
+};
+
+static const uint32_t POW10[] = {1,
+                                 10,
+                                 100,
+                                 1000,
+                                 10000,
+                                 100000,
+                                 1000000,
+                                 10000000,
+                                 100000000,
+                                 1000000000};
+
+static DiyFp DiyFp_fromDouble(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    int      biased      = (int)((bits & DP_EXPONENT_MASK) >> 52);
+    uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+    DiyFp    result;
+
+    if(biased) {
+        result.f = significand + DP_HIDDEN_BIT;
+        result.e = biased - DP_EXPONENT_BIAS;
+    } else {
+        // Subnormal.
+        result.f = significand;
+        result.e = 1 - DP_EXPONENT_BIAS;
+    }
+
+    return result;
+}
+
+static DiyFp DiyFp_normalize(DiyFp x) {
+    int shift = __builtin_clzll(x.f);
+
+    x.f <<= shift;
+    x.e -= shift;
+    return x;
+}
+
+// The upper 64 bits of the 128-bit product, rounded.
+static DiyFp DiyFp_multiply(DiyFp x, DiyFp y) {
+    const uint64_t mask = 0xFFFFFFFFull;
+
+    uint64_t a = x.f >> 32, b = x.f & mask;
+    uint64_t c = y.f >> 32, d = y.f & mask;
+
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t mid = (bd >> 32) + (ad & mask) + (bc & mask) + (1ull << 31);
+
+    DiyFp result = {ac + (ad >> 32) + (bc >> 32) + (mid >> 32), x.e + y.e + 64};
+    return result;
+}
+
+// The points halfway to the neighbouring doubles, which bound the numbers
+// that read back as v. Both get the exponent of the normalized upper one.
+static void DiyFp_boundaries(DiyFp v, DiyFp* minus, DiyFp* plus) {
+    DiyFp upper = {(v.f << 1) + 1, v.e - 1};
+    DiyFp lower;
+
+    upper = DiyFp_normalize(upper);
+
+    // Below a power of two the gap to the previous double is half as wide.
+    if(v.f == DP_HIDDEN_BIT) {
+        lower.f = (v.f << 2) - 1;
+        lower.e = v.e - 2;
+    } else {
+        lower.f = (v.f << 1) - 1;
+        lower.e = v.e - 1;
+    }
+
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+
+    *minus = lower;
+    *plus  = upper;
+}
+
+// Picks the cached power that brings a number with binary exponent e into
+// the range where the digit generation works, and its decimal exponent K
+// such that the scaled number is the original times 10^-K.
+static DiyFp cached_power(int e, int* K) {
+    double dk    = (-61 - e) * 0.30102999566398114 + 347;
+    int    k     = (int)dk;
+
+    if(dk - k > 0.0)
+        k++;
+
+    unsigned index = (unsigned)((k >> 3) + 1);
+
+    *K = -(-348 + (int)(index << 3));
+    return CACHED_POWERS[index];
+}
+
+static int count_digits(uint32_t n) {
+    for(int digits = 1; digits < 10; ++digits) {
+        if(n < POW10[digits])
+            return digits;
+    }
+
+    return 10;
+}
+
+// Nudges the last digit down while that brings the number closer to the
+// exact value without leaving the boundaries.
+static void grisu_round(char*    buffer,
+                        int      len,
+                        uint64_t delta,
+                        uint64_t rest,
+                        uint64_t ten_kappa,
+                        uint64_t wp_w) {
+    while(rest < wp_w && delta - rest >= ten_kappa &&
+          (rest + ten_kappa < wp_w ||
+           wp_w - rest > rest + ten_kappa - wp_w)) {
+        buffer[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int digit_gen(DiyFp W, DiyFp Mp, uint64_t delta, char* buffer, int* K) {
+    DiyFp    one  = {1ull << -Mp.e, Mp.e};
+    uint64_t wp_w = Mp.f - W.f;
+    uint32_t p1   = (uint32_t)(Mp.f >> -one.e);
+    uint64_t p2   = Mp.f & (one.f - 1);
+    int      kappa = count_digits(p1);
+    int      len   = 0;
+
+    // Integral part.
+    while(kappa > 0) {
+        uint32_t digit = p1 / POW10[kappa - 1];
+        p1 %= POW10[kappa - 1];
+
+        if(digit || len)
+            buffer[len++] = (char)('0' + digit);
+
+        kappa--;
+
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+
+        if(rest <= delta) {
+            *K += kappa;
+            grisu_round(
+                buffer, len, delta, rest, (uint64_t)POW10[kappa] << -one.e, wp_w);
+            return len;
+        }
+    }
+
+    // Fractional part.
+    while(TRUE) {
+        p2 *= 10;
+        delta *= 10;
+
+        char digit = (char)(p2 >> -one.e);
+
+        if(digit || len)
+            buffer[len++] = (char)('0' + digit);
+
+        p2 &= one.f - 1;
+        kappa--;
+
+        if(p2 < delta) {
+            *K += kappa;
+            int index = -kappa;
+            grisu_round(buffer,
+                        len,
+                        delta,
+                        p2,
+                        one.f,
+                        wp_w * (index < 10 ? POW10[index] : 0));
+            return len;
+        }
+    }
+}
+
+// Writes the digits of a finite positive double into buffer, such that the
+// double reads back from digits * 10^K. Returns the number of digits, at
+// most 17.
+static int grisu2(double value, char* buffer, int* K) {
+    DiyFp v = DiyFp_fromDouble(value);
+    DiyFp minus, plus;
+
+    DiyFp_boundaries(v, &minus, &plus);
+
+    DiyFp c  = cached_power(plus.e, K);
+    DiyFp W  = DiyFp_multiply(DiyFp_normalize(v), c);
+    DiyFp Wp = DiyFp_multiply(plus, c);
+    DiyFp Wm = DiyFp_multiply(minus, c);
+
+    // Stay clear of the boundaries, which are inexact after scaling.
+    Wm.f++;
+    Wp.f--;
+
+    return digit_gen(W, Wp, Wp.f - Wm.f, buffer, K);
+}
+
+// Writes inf, -inf, nan or zero. Returns 0 for any other number.
+static size_t dtoa_special(double value, char* buffer) {
+    char*  p = buffer;
+    size_t n = 0;
+
+    if(isnan(value)) {
+        memcpy(buffer, "nan", 3);
+        return 3;
+    }
+
+    if(signbit(value))
+        *p++ = '-';
+
+    if(isinf(value)) {
+        memcpy(p, "inf", 3);
+        n = 3;
+    } else if(value == 0) {
+        *p = '0';
+        n  = 1;
+    } else {
+        return 0;
+    }
+
+    return (size_t)(p - buffer) + n;
+}
+
+static size_t write_exponent(char* p, int exponent) {
+    char* start = p;
+
+    *p++ = 'e';
+    *p++ = exponent < 0 ? '-' : '+';
+
+    if(exponent < 0)
+        exponent = -exponent;
+
+    if(exponent >= 100)
+        *p++ = (char)('0' + exponent / 100);
+
+    *p++ = (char)('0' + exponent / 10 % 10);
+    *p++ = (char)('0' + exponent % 10);
+
+    return (size_t)(p - start);
+}
+
+size_t dtoa_shortest(double value, char* buffer) {
+    size_t special = dtoa_special(value, buffer);
+
+    if(special)
+        return special;
+
+    char* p = buffer;
+
+    if(value < 0) {
+        *p++  = '-';
+        value = -value;
+    }
+
+    char digits[24];
+    int  K   = 0;
+    int  len = grisu2(value, digits, &K);
+
+    // The value is 0.d1d2...dn * 10^kk.
+    int kk = len + K;
+
+    if(K >= 0 && kk <= 21) {
+        // Integer: digits, then zeros.
+        memcpy(p, digits, (size_t)len);
+        memset(p + len, '0', (size_t)K);
+        p += kk;
+    } else if(kk > 0 && kk <= 21) {
+        // Point inside the digits.
+        memcpy(p, digits, (size_t)kk);
+        p[kk] = '.';
+        memcpy(p + kk + 1, digits + kk, (size_t)(len - kk));
+        p += len + 1;
+    } else if(kk > -6 && kk <= 0) {
+        // Point before the digits.
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', (size_t)-kk);
+        memcpy(p - kk, digits, (size_t)len);
+        p += len - kk;
+    } else {
+        *p++ = digits[0];
+
+        if(len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, (size_t)(len - 1));
+            p += len - 1;
+        }
+
+        p += write_exponent(p, kk - 1);
+    }
+
+    return (size_t)(p - buffer);
+}
+
+size_t dtoa_fixed(double value, int precision, char* buffer) {
+    if(precision < 0)
+        precision = 0;
+
+    if(precision > DTOA_MAX_PRECISION)
+        precision = DTOA_MAX_PRECISION;
+
+    char digits[24];
+    int  len      = 0;
+    int  kk       = 0;
+    int  negative = signbit(value) != 0;
+
+    if(isnan(value) || isinf(value))
+        return dtoa_special(value, buffer);
+
+    if(value != 0) {
+        int K = 0;
+        len   = grisu2(fabs(value), digits, &K);
+        kk    = len + K;
+
+        // Keep the digits down to 10^-precision, rounding half up.
+        int keep = kk + precision;
+
+        if(keep < 0) {
+            len = 0;
+        } else if(keep < len) {
+            BOOL up = digits[keep] >= '5';
+            len     = keep;
+
+            if(up) {
+                int i = keep - 1;
+
+                while(i >= 0 && digits[i] == '9') {
+                    --i;
+                }
+
+                if(i < 0) {
+                    // All nines, or nothing kept: carries into a new digit.
+                    digits[0] = '1';
+                    len       = 1;
+                    kk += 1;
+                } else {
+                    digits[i] += 1;
+                    len = i + 1;
+                }
+            }
+        }
+    }
+
+    char* p = buffer;
+
+    if(negative && len)
+        *p++ = '-';
+
+    if(kk <= 0) {
+        *p++ = '0';
+    } else {
+        for(int i = 0; i < kk; ++i) {
+            *p++ = i < len ? digits[i] : '0';
+        }
+    }
+
+    if(precision) {
+        *p++ = '.';
+
+        for(int i = 0; i < precision; ++i) {
+            int position = kk + i;
+            *p++ = position >= 0 && position < len ? digits[position] : '0';
+        }
+    }
+
+    return (size_t)(p - buffer);
+}
@@ -0,0 +1,37 @@
+#ifndef _H_DTOA_
+#define _H_DTOA_
+
+#include <stddef.h>
+
+// Double to text without stdio, for results. Output never depends on the
+// locale.
+//
+// Digits come from Grisu2: the printed number always reads back (with strtod)
+// as exactly the same double, and for all but a tiny fraction of doubles it
+// is also the shortest text that does. Numbers from 1e-6 up to 1e21 are
+// written in plain notation ("1024", "0.1", "-0.000125"), anything else with
+// an exponent ("1e+21", "2.5e-07"). Infinities and NaN are written as "inf",
+// "-inf" and "nan".
+
+// Large enough for any double in shortest form.
+#define DTOA_SHORTEST_SIZE 32
+
+// Largest precision dtoa_fixed accepts.
+#define DTOA_MAX_PRECISION 40
+
+// Large enough for any double in fixed form with the given precision.
+#define DTOA_FIXED_SIZE(precision) (312 + (precision))
+
+// Writes the shortest form of the double into buffer, which must hold
+// DTOA_SHORTEST_SIZE bytes. Returns the length; the text is not terminated.
+extern size_t dtoa_shortest(double value, char* buffer);
+
+// Writes the double with exactly `precision` digits after the point (none,
+// and no point, for 0) into buffer, which must hold DTOA_FIXED_SIZE(precision)
+// bytes. Returns the length; the text is not terminated.
+//
+// Rounds the shortest form half away from zero, so 2.675 gives "2.68" even
+// though the double nearest 2.675 is slightly below it.
+extern size_t dtoa_fixed(double value, int precision, char* buffer);
+
+#endif // _H_DTOA_
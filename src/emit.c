@@ -0,0 +1,833 @@
+#include "emit.h"
+
+#include <ctype.h>
+
+#include "dtoa.h"
+#include "hashmap.h"
+#include "series.h"
+
+typedef enum EmitKind {
+    EMIT_NUM,
+    EMIT_VAR,
+    EMIT_OPERATOR,
+    EMIT_CALL,
+} EmitKind;
+
+// A node of the expression tree, whose operands or arguments are the count
+// node indices from first on in the Emitter's children.
+typedef struct EmitNode {
+    EmitKind        kind;
+    TokenType       type;     // EMIT_OPERATOR
+    double          value;    // EMIT_NUM
+    const char*     name;     // EMIT_VAR
+    const Function* function; // EMIT_CALL
+    size_t          first;
+    size_t          count;
+} EmitNode;
+
+// An operator or open paren on the cellar. A paren remembers the number of
+// values on the value cellar when it was pushed, like the Sft's.
+typedef struct EmitOperator {
+    Token token;
+    BOOL  series; // A sum or prod that the Sft would take for a series.
+} EmitOperator;
+
+// Where the printer is in a node: the index of the child to print next.
+typedef struct EmitFrame {
+    size_t node;
+    size_t next;
+} EmitFrame;
+
+// The helpers the function calls, each emitted once above it.
+typedef enum EmitHelper {
+    EMIT_MOD     = 1 << 0,
+    EMIT_SUM     = 1 << 1,
+    EMIT_EXTREME = 1 << 2,
+    EMIT_MIN     = 1 << 3,
+    EMIT_MAX     = 1 << 4,
+    EMIT_HYPOT   = 1 << 5,
+    EMIT_PROD    = 1 << 6,
+    EMIT_POW     = 1 << 7,
+} EmitHelper;
+
+typedef struct Emitter {
+    const TokenArray* tokens;
+    SftError*         error;
+
+    Stack* nodes;     // EmitNode
+    Stack* children;  // size_t
+    Stack* values;    // size_t, the node of every value computed so far.
+    Stack* operators; // EmitOperator
+
+    unsigned helpers; // EmitHelper
+} Emitter;
+
+// Copies of the reductions of reduce.c, which must stay in step with them:
+// the emitted function gives the same results as the evaluator only for as
+// long as they add up in the same order.
+static const char EMIT_REDUCE_HEADER[] =
+    "#if defined(__SSE2__)\n"
+    "    #include <emmintrin.h>\n"
+    "    #define SEQFT_SSE2\n"
+    "#endif\n";
+
+static const char EMIT_MOD_SOURCE[] =
+    "static double seqft_mod(double num1, double num2) {\n"
+    "    return fmod(num1, num2);\n"
+    "}\n";
+
+// Called through a pointer the compiler can't see through, since it would
+// otherwise turn pow(x, 2) into x * x, and so on, which round differently.
+static const char EMIT_POW_SOURCE[] =
+    "static double (*volatile seqft_pow)(double, double) = pow;\n";
+
+static const char EMIT_SUM_SOURCE[] =
+    "static double seqft_sum(const double* nums, size_t len) {\n"
+    "    size_t i   = 0;\n"
+    "    double sum = 0;\n"
+    "\n"
+    "#ifdef SEQFT_SSE2\n"
+    "    __m128d acc0 = _mm_setzero_pd();\n"
+    "    __m128d acc1 = _mm_setzero_pd();\n"
+    "\n"
+    "    for(; i + 4 <= len; i += 4) {\n"
+    "        acc0 = _mm_add_pd(acc0, _mm_loadu_pd(nums + i));\n"
+    "        acc1 = _mm_add_pd(acc1, _mm_loadu_pd(nums + i + 2));\n"
+    "    }\n"
+    "\n"
+    "    double lanes[2];\n"
+    "    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));\n"
+    "    sum = lanes[0] + lanes[1];\n"
+    "#else\n"
+    "    double acc[4] = {0, 0, 0, 0};\n"
+    "\n"
+    "    for(; i + 4 <= len; i += 4) {\n"
+    "        acc[0] += nums[i];\n"
+    "        acc[1] += nums[i + 1];\n"
+    "        acc[2] += nums[i + 2];\n"
+    "        acc[3] += nums[i + 3];\n"
+    "    }\n"
+    "\n"
+    "    sum = (acc[0] + acc[2]) + (acc[1] + acc[3]);\n"
+    "#endif\n"
+    "\n"
+    "    for(; i < len; ++i) {\n"
+    "        sum += nums[i];\n"
+    "    }\n"
+    "\n"
+    "    return sum;\n"
+    "}\n";
+
+static const char EMIT_EXTREME_SOURCE[] =
+    "static double seqft_extreme(const double* nums, size_t len, "
+    "int want_max) {\n"
+    "    size_t i      = 0;\n"
+    "    double result = nums[0];\n"
+    "    int    nan    = 0;\n"
+    "\n"
+    "#ifdef SEQFT_SSE2\n"
+    "    __m128d acc0 = _mm_set1_pd(nums[0]);\n"
+    "    __m128d acc1 = acc0;\n"
+    "    __m128d nans = _mm_setzero_pd();\n"
+    "\n"
+    "    for(; i + 4 <= len; i += 4) {\n"
+    "        __m128d v0 = _mm_loadu_pd(nums + i);\n"
+    "        __m128d v1 = _mm_loadu_pd(nums + i + 2);\n"
+    "\n"
+    "        nans = _mm_or_pd(nans, _mm_cmpunord_pd(v0, v1));\n"
+    "\n"
+    "        if(want_max) {\n"
+    "            acc0 = _mm_max_pd(acc0, v0);\n"
+    "            acc1 = _mm_max_pd(acc1, v1);\n"
+    "        } else {\n"
+    "            acc0 = _mm_min_pd(acc0, v0);\n"
+    "            acc1 = _mm_min_pd(acc1, v1);\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    double lanes[2];\n"
+    "    acc0 = want_max ? _mm_max_pd(acc0, acc1) : _mm_min_pd(acc0, acc1);\n"
+    "    _mm_storeu_pd(lanes, acc0);\n"
+    "\n"
+    "    nan    = _mm_movemask_pd(nans) != 0;\n"
+    "    result = want_max ? fmax(lanes[0], lanes[1]) "
+    ": fmin(lanes[0], lanes[1]);\n"
+    "#endif\n"
+    "\n"
+    "    for(; i < len; ++i) {\n"
+    "        double num = nums[i];\n"
+    "\n"
+    "        nan |= isnan(num);\n"
+    "        result = want_max ? (num > result ? num : result)\n"
+    "                          : (num < result ? num : result);\n"
+    "    }\n"
+    "\n"
+    "    return nan ? NAN : result;\n"
+    "}\n";
+
+static const char EMIT_MIN_SOURCE[] =
+    "static double seqft_min(const double* nums, size_t len) {\n"
+    "    return seqft_extreme(nums, len, 0);\n"
+    "}\n";
+
+static const char EMIT_MAX_SOURCE[] =
+    "static double seqft_max(const double* nums, size_t len) {\n"
+    "    return seqft_extreme(nums, len, 1);\n"
+    "}\n";
+
+static const char EMIT_HYPOT_SOURCE[] =
+    "static double seqft_hypot(const double* nums, size_t len) {\n"
+    "    size_t i     = 0;\n"
+    "    double scale = 0;\n"
+    "    int    nan   = 0;\n"
+    "\n"
+    "    for(size_t j = 0; j < len; ++j) {\n"
+    "        double mag = fabs(nums[j]);\n"
+    "\n"
+    "        nan |= isnan(mag);\n"
+    "\n"
+    "        if(mag > scale)\n"
+    "            scale = mag;\n"
+    "    }\n"
+    "\n"
+    "    if(isinf(scale))\n"
+    "        return scale;\n"
+    "\n"
+    "    if(nan)\n"
+    "        return NAN;\n"
+    "\n"
+    "    if(scale == 0)\n"
+    "        return 0;\n"
+    "\n"
+    "    if(scale < DBL_MIN) {\n"
+    "        double sum = 0;\n"
+    "\n"
+    "        for(; i < len; ++i) {\n"
+    "            double scaled = nums[i] / scale;\n"
+    "            sum += scaled * scaled;\n"
+    "        }\n"
+    "\n"
+    "        return scale * sqrt(sum);\n"
+    "    }\n"
+    "\n"
+    "    int    exponent = ilogb(scale);\n"
+    "    double factor   = ldexp(1.0, -exponent);\n"
+    "    double sum      = 0;\n"
+    "\n"
+    "#ifdef SEQFT_SSE2\n"
+    "    __m128d vfactor = _mm_set1_pd(factor);\n"
+    "    __m128d acc0    = _mm_setzero_pd();\n"
+    "    __m128d acc1    = _mm_setzero_pd();\n"
+    "\n"
+    "    for(; i + 4 <= len; i += 4) {\n"
+    "        __m128d v0 = _mm_mul_pd(_mm_loadu_pd(nums + i), vfactor);\n"
+    "        __m128d v1 = _mm_mul_pd(_mm_loadu_pd(nums + i + 2), vfactor);\n"
+    "\n"
+    "        acc0 = _mm_add_pd(acc0, _mm_mul_pd(v0, v0));\n"
+    "        acc1 = _mm_add_pd(acc1, _mm_mul_pd(v1, v1));\n"
+    "    }\n"
+    "\n"
+    "    double lanes[2];\n"
+    "    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));\n"
+    "    sum = lanes[0] + lanes[1];\n"
+    "#endif\n"
+    "\n"
+    "    for(; i < len; ++i) {\n"
+    "        double scaled = nums[i] * factor;\n"
+    "        sum += scaled * scaled;\n"
+    "    }\n"
+    "\n"
+    "    return ldexp(sqrt(sum), exponent);\n"
+    "}\n";
+
+static const char EMIT_PROD_SOURCE[] =
+    "static double seqft_prod(const double* nums, size_t len) {\n"
+    "    double product = 1;\n"
+    "\n"
+    "    for(size_t i = 0; i < len; ++i) {\n"
+    "        product *= nums[i];\n"
+    "    }\n"
+    "\n"
+    "    return product;\n"
+    "}\n";
+
+// C keywords, and what the function body refers to besides its parameters.
+static const char* const EMIT_RESERVED[] = {
+    "auto",     "break",    "case",     "char",          "const",
+    "continue", "default",  "do",       "double",        "else",
+    "enum",     "extern",   "float",    "for",           "goto",
+    "if",       "inline",   "int",      "long",          "register",
+    "restrict", "return",   "short",    "signed",        "sizeof",
+    "static",   "struct",   "switch",   "typedef",       "union",
+    "unsigned", "void",     "volatile", "while",         "_Alignas",
+    "_Alignof", "_Atomic",  "_Bool",    "_Complex",      "_Generic",
+    "_Imaginary", "_Noreturn", "_Static_assert", "_Thread_local",
+    "pow",      "round",    "ceil",     "HUGE_VAL",      "NAN",
+};
+
+BOOL Emit_isName(const char* name) {
+    if(!isalpha((unsigned char)name[0]) && name[0] != '_')
+        return FALSE;
+
+    for(const char* c = name; *c; ++c) {
+        if(!isalnum((unsigned char)*c) && *c != '_')
+            return FALSE;
+    }
+
+    if(!strncmp(name, "seqft_", 6))
+        return FALSE;
+
+    for(size_t i = 0; i < sizeof(EMIT_RESERVED) / sizeof(EMIT_RESERVED[0]);
+        ++i) {
+        if(!strcmp(name, EMIT_RESERVED[i]))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+Stack* Emit_parameters(const TokenArray* tokens) {
+    Stack*   names = Stack_new(sizeof(const char*));
+    HashMap* seen  = HashMap_new();
+
+    for(size_t i = 0; i < tokens->count; ++i) {
+        const char* name  = tokens->tokens[i].func;
+        size_t      index = 0;
+
+        if(!(tokens->tokens[i].type & TT_VAR) ||
+           HashMap_get(seen, name, strlen(name), &index))
+            continue;
+
+        HashMap_put(seen, name, strlen(name), Stack_getCount(names));
+        Stack_pushFrom(names, &name);
+    }
+
+    HashMap_free(seen);
+    return names;
+}
+
+// Records the error at the token, like Sft_fail, and returns it.
+static SftError* Emitter_fail(Emitter*     e,
+                              ErrCode      code,
+                              size_t       index,
+                              const Token* token,
+                              const char*  symbol) {
+    SftError* error = e->error;
+    memset(error, 0, sizeof(SftError));
+
+    error->code        = code;
+    error->token_index = index;
+    error->offset      = token ? token->offset : 0;
+
+    if(symbol)
+        snprintf(error->symbol, sizeof(error->symbol), "%s", symbol);
+
+    return error;
+}
+
+// Adds a node over the top count values, which it replaces.
+static void Emitter_reduce(Emitter* e, EmitNode* node, size_t count) {
+    size_t  depth = Stack_getCount(e->values);
+    size_t* top   = Stack_itemAt(e->values, depth - count);
+    size_t  index = Stack_getCount(e->nodes);
+
+    node->first = Stack_getCount(e->children);
+    node->count = count;
+
+    for(size_t k = 0; k < count; ++k) {
+        Stack_pushFrom(e->children, &top[k]);
+    }
+
+    Stack_pushFrom(e->nodes, node);
+    Stack_truncate(e->values, depth - count);
+    Stack_pushFrom(e->values, &index);
+}
+
+// Adds a leaf, which becomes a value.
+static void Emitter_leaf(Emitter* e, EmitNode* node) {
+    size_t index = Stack_getCount(e->nodes);
+
+    node->first = 0;
+    node->count = 0;
+
+    Stack_pushFrom(e->nodes, node);
+    Stack_pushFrom(e->values, &index);
+}
+
+// Like eval_apply_operator.
+static SftError* Emitter_apply(Emitter* e, const Token* op, size_t index) {
+    size_t   operands = op->type & TT_UOP ? 1 : 2;
+    EmitNode node     = {.kind = EMIT_OPERATOR, .type = op->type};
+
+    if(Stack_getCount(e->values) < op->depth + operands) {
+        SftError* error =
+            Emitter_fail(e, ERR_MISSING_OPERAND, index, op, 0);
+        error->operator_type = op->type;
+        return error;
+    }
+
+    Emitter_reduce(e, &node, operands);
+    return 0;
+}
+
+// Like eval_until_open_paren.
+static SftError* Emitter_untilParen(Emitter* e, size_t index) {
+    while(!Stack_empty(e->operators)) {
+        EmitOperator* top = Stack_getHead(e->operators);
+
+        if(top->token.type == TT_OPA)
+            break;
+
+        Token op = top->token;
+        Stack_popInto(e->operators, 0);
+
+        SftError* error = Emitter_apply(e, &op, index);
+
+        if(error)
+            return error;
+    }
+
+    return 0;
+}
+
+// Like eval_x_is_close_paren, with series turned away.
+static SftError* Emitter_closeParen(Emitter*     e,
+                                    const Token* token,
+                                    size_t       index) {
+    SftError* error = Emitter_untilParen(e, index);
+
+    if(error || Stack_empty(e->operators))
+        return error;
+
+    EmitOperator paren;
+    Stack_popInto(e->operators, &paren);
+
+    Token* open  = &paren.token;
+    size_t count = Stack_getCount(e->values) - open->depth;
+
+    if(open->commas && count != open->commas + 1)
+        return Emitter_fail(e, ERR_MISSING_ARGUMENT, index, token, 0);
+
+    if(!open->func) {
+        if(open->commas)
+            return Emitter_fail(e, ERR_COMMA_OUTSIDE_CALL, index, open, 0);
+
+        return 0;
+    }
+
+    if(paren.series && count == 4) {
+        return Emitter_fail(
+            e, ERR_EMIT_UNSUPPORTED, index, open, "series aren't supported");
+    }
+
+    const Function* f = Function_lookup(open->func, 0);
+
+    if(!f)
+        return Emitter_fail(e, ERR_UNKNOWN_FUNCTION, index, open, open->func);
+
+    if(count < f->min_args || count > f->max_args) {
+        error = Emitter_fail(e, ERR_ARGUMENT_COUNT, index, open, open->func);
+        error->given = count;
+        return error;
+    }
+
+    EmitNode node = {.kind = EMIT_CALL, .function = f};
+
+    if(f->ptr == sft_sum || f->ptr == sft_avg)
+        e->helpers |= EMIT_SUM;
+    else if(f->ptr == sft_min)
+        e->helpers |= EMIT_EXTREME | EMIT_MIN;
+    else if(f->ptr == sft_max)
+        e->helpers |= EMIT_EXTREME | EMIT_MAX;
+    else if(f->ptr == sft_hypot)
+        e->helpers |= EMIT_HYPOT;
+    else if(f->ptr == sft_prod)
+        e->helpers |= EMIT_PROD;
+
+    Emitter_reduce(e, &node, count);
+    return 0;
+}
+
+// Builds the tree of the tokens by the rules the Sft evaluates them by,
+// precedences and all, failing where the Sft would.
+static SftError* Emitter_build(Emitter* e) {
+    const TokenArray* tokens = e->tokens;
+
+    for(size_t i = 0; i < tokens->count; ++i) {
+        const Token* token = &tokens->tokens[i];
+        SftError*    error = 0;
+
+        if(token->type & TT_NUM) {
+            EmitNode node = {.kind = EMIT_NUM, .value = token->f64};
+            Emitter_leaf(e, &node);
+        } else if(token->type & TT_VAR) {
+            if(!Emit_isName(token->func)) {
+                return Emitter_fail(e,
+                                    ERR_EMIT_UNSUPPORTED,
+                                    i,
+                                    token,
+                                    "a variable isn't a usable C name");
+            }
+
+            EmitNode node = {.kind = EMIT_VAR, .name = token->func};
+            Emitter_leaf(e, &node);
+        } else if(token->type & TT_OPS) {
+            while(!error && !Stack_empty(e->operators)) {
+                EmitOperator* top = Stack_getHead(e->operators);
+
+                if(top->token.type & TT_OPA ||
+                   TokenType_precedence(top->token.type) <
+                       TokenType_precedence(token->type))
+                    break;
+
+                Token op = top->token;
+                Stack_popInto(e->operators, 0);
+                error = Emitter_apply(e, &op, i);
+            }
+
+            // Where its operands start, as the Sft keeps it.
+            EmitOperator op = {.token = *token};
+            op.token.depth  = 0;
+
+            if(!Stack_empty(e->operators)) {
+                const Token* top =
+                    &((EmitOperator*)Stack_getHead(e->operators))->token;
+
+                op.token.depth = top->type & TT_OPA ? top->depth + top->commas
+                                                    : top->depth;
+            }
+
+            Stack_pushFrom(e->operators, &op);
+
+            if(token->type == TT_MOD)
+                e->helpers |= EMIT_MOD;
+            else if(token->type == TT_POW)
+                e->helpers |= EMIT_POW;
+        } else if(token->type & TT_COM) {
+            error = Emitter_untilParen(e, i);
+
+            if(!error && Stack_empty(e->operators))
+                return Emitter_fail(e, ERR_COMMA_OUTSIDE_CALL, i, token, 0);
+
+            EmitOperator* paren = error ? 0 : Stack_getHead(e->operators);
+
+            if(paren && Stack_getCount(e->values) !=
+                            paren->token.depth + paren->token.commas + 1)
+                return Emitter_fail(e, ERR_MISSING_ARGUMENT, i, token, 0);
+
+            if(paren)
+                paren->token.commas += 1;
+        } else if(token->type & TT_OPA) {
+            EmitOperator paren = {.token = *token};
+
+            paren.token.depth  = Stack_getCount(e->values);
+            paren.token.commas = 0;
+            paren.series       = Series_isSeries(token->func) &&
+                           i + 2 < tokens->count &&
+                           tokens->tokens[i + 1].type & TT_VAR &&
+                           tokens->tokens[i + 2].type & TT_COM;
+
+            Stack_pushFrom(e->operators, &paren);
+        } else if(token->type & TT_CPA) {
+            error = Emitter_closeParen(e, token, i);
+        }
+
+        if(error)
+            return error;
+    }
+
+    // What's left must be operators, applied like Sft_drain does.
+    while(!Stack_empty(e->operators)) {
+        EmitOperator op;
+        Stack_popInto(e->operators, &op);
+
+        if(op.token.type & TT_OPA) {
+            return Emitter_fail(e,
+                                ERR_EMIT_UNSUPPORTED,
+                                tokens->count,
+                                &op.token,
+                                "a paren is never closed");
+        }
+
+        SftError* error = Emitter_apply(e, &op.token, tokens->count);
+
+        if(error)
+            return error;
+    }
+
+    if(Stack_getCount(e->values) != 1) {
+        return Emitter_fail(e,
+                            ERR_EMIT_UNSUPPORTED,
+                            tokens->count,
+                            tokens->count ? &tokens->tokens[0] : 0,
+                            "there isn't exactly one result");
+    }
+
+    return 0;
+}
+
+static void Emit_number(FILE* stream, double value) {
+    char   text[DTOA_SHORTEST_SIZE];
+    size_t len = dtoa_shortest(value, text);
+
+    if(isinf(value)) {
+        fprintf(stream, "HUGE_VAL");
+        return;
+    }
+
+    // A double, however it's written.
+    fprintf(stream,
+            "%.*s%s",
+            (int)len,
+            text,
+            memchr(text, '.', len) || memchr(text, 'e', len) ? "" : ".0");
+}
+
+// The name of the helper a variadic function is emitted as.
+static const char* Emit_reduction(const Function* f) {
+    if(f->ptr == sft_min)
+        return "seqft_min";
+    if(f->ptr == sft_max)
+        return "seqft_max";
+    if(f->ptr == sft_hypot)
+        return "seqft_hypot";
+    if(f->ptr == sft_prod)
+        return "seqft_prod";
+
+    return "seqft_sum"; // sum and avg
+}
+
+static const char* Emit_operator(TokenType type) {
+    switch(type) {
+        case TT_ADD:
+            return " + ";
+        case TT_SUB:
+            return " - ";
+        case TT_DIV:
+            return " / ";
+        case TT_MUL:
+            return " * ";
+        case TT_LT:
+            return " < ";
+        case TT_LE:
+            return " <= ";
+        case TT_GT:
+            return " > ";
+        case TT_GE:
+            return " >= ";
+        case TT_EQ:
+            return " == ";
+        case TT_NE:
+            return " != ";
+        case TT_AND:
+            return " != 0 && ";
+        case TT_OR:
+            return " != 0 || ";
+        default: // Function like.
+            return ", ";
+    }
+}
+
+// Prints what comes before the first child of the node, or the node if it has
+// none. Every node comes out parenthesized or as a call, so that it can be
+// the operand of anything.
+static void Emit_open(FILE* stream, const EmitNode* node) {
+    switch(node->kind) {
+        case EMIT_NUM:
+            Emit_number(stream, node->value);
+            break;
+        case EMIT_VAR:
+            fprintf(stream, "%s", node->name);
+            break;
+        case EMIT_OPERATOR:
+            if(node->type == TT_NEG)
+                fprintf(stream, "(-");
+            else if(node->type == TT_MOD)
+                fprintf(stream, "seqft_mod(");
+            else if(node->type == TT_POW)
+                fprintf(stream, "seqft_pow(");
+            else if(node->type & (TT_CMP | TT_LOG))
+                fprintf(stream, "(double)(");
+            else
+                fprintf(stream, "(");
+            break;
+        case EMIT_CALL: {
+            const Function* f = node->function;
+
+            if(f->ptr == sft_if)
+                fprintf(stream, "(");
+            else if(f->ptr == sft_round || f->ptr == sft_ceil)
+                fprintf(stream, "%s(", f->name);
+            else
+                fprintf(stream,
+                        "%s%s((const double[]) {",
+                        f->ptr == sft_avg ? "(" : "",
+                        Emit_reduction(f));
+            break;
+        }
+    }
+}
+
+// Prints what goes before the child at index k > 0.
+static void Emit_separator(FILE* stream, const EmitNode* node, size_t k) {
+    if(node->kind == EMIT_OPERATOR) {
+        fprintf(stream, "%s", Emit_operator(node->type));
+    } else if(node->function->ptr == sft_if) {
+        fprintf(stream, k == 1 ? " != 0 ? " : " : ");
+    } else {
+        fprintf(stream, ", ");
+    }
+}
+
+static void Emit_close(FILE* stream, const EmitNode* node) {
+    if(node->kind == EMIT_OPERATOR) {
+        fprintf(stream, node->type & TT_LOG ? " != 0)" : ")");
+    } else if(node->kind == EMIT_CALL) {
+        const Function* f = node->function;
+
+        if(f->ptr == sft_if || f->ptr == sft_round || f->ptr == sft_ceil)
+            fprintf(stream, ")");
+        else if(f->ptr == sft_avg)
+            fprintf(stream, "}, %zu) / %zu.0)", node->count, node->count);
+        else
+            fprintf(stream, "}, %zu)", node->count);
+    }
+}
+
+// Prints the tree under the root depth first, without recursing, so that
+// the depth of the expression isn't bounded by the C stack.
+static void Emitter_print(Emitter* e, FILE* stream, size_t root) {
+    const EmitNode* nodes    = Stack_getBase(e->nodes);
+    const size_t*   children = Stack_getBase(e->children);
+    Stack*          frames   = Stack_new(sizeof(EmitFrame));
+    EmitFrame       frame    = {.node = root, .next = 0};
+
+    Emit_open(stream, &nodes[root]);
+    Stack_pushFrom(frames, &frame);
+
+    while(!Stack_empty(frames)) {
+        EmitFrame*      top  = Stack_getHead(frames);
+        const EmitNode* node = &nodes[top->node];
+
+        if(top->next == node->count) {
+            Emit_close(stream, node);
+            Stack_popInto(frames, 0);
+            continue;
+        }
+
+        if(top->next)
+            Emit_separator(stream, node, top->next);
+
+        frame.node = children[node->first + top->next];
+        frame.next = 0;
+        top->next += 1;
+
+        Emit_open(stream, &nodes[frame.node]);
+        Stack_pushFrom(frames, &frame);
+    }
+
+    Stack_free(frames);
+}
+
+static void Emitter_printHelpers(Emitter* e, FILE* stream) {
+    const struct {
+        EmitHelper  helper;
+        const char* source;
+    } HELPERS[] = {
+        {EMIT_MOD,     EMIT_MOD_SOURCE    },
+        {EMIT_POW,     EMIT_POW_SOURCE    },
+        {EMIT_SUM,     EMIT_SUM_SOURCE    },
+        {EMIT_EXTREME, EMIT_EXTREME_SOURCE},
+        {EMIT_MIN,     EMIT_MIN_SOURCE    },
+        {EMIT_MAX,     EMIT_MAX_SOURCE    },
+        {EMIT_HYPOT,   EMIT_HYPOT_SOURCE  },
+        {EMIT_PROD,    EMIT_PROD_SOURCE   },
+    };
+
+    if(e->helpers & ~(unsigned)(EMIT_MOD | EMIT_POW))
+        fprintf(stream, "%s\n", EMIT_REDUCE_HEADER);
+
+    for(size_t i = 0; i < sizeof(HELPERS) / sizeof(HELPERS[0]); ++i) {
+        if(e->helpers & HELPERS[i].helper)
+            fprintf(stream, "%s\n", HELPERS[i].source);
+    }
+}
+
+// Quotes the source in a comment, on one line.
+static void Emit_source(FILE* stream, const char* source) {
+    fprintf(stream, "//     ");
+
+    for(const char* c = source; *c; ++c) {
+        fputc(*c == '\n' || *c == '\r' ? ' ' : *c, stream);
+    }
+
+    fprintf(stream, "\n");
+}
+
+SftError* Emit_c(FILE*             stream,
+                 const char*       name,
+                 const char*       source,
+                 const TokenArray* tokens,
+                 SftError*         error) {
+    Emitter e = {
+        .tokens    = tokens,
+        .error     = error,
+        .nodes     = Stack_new(sizeof(EmitNode)),
+        .children  = Stack_new(sizeof(size_t)),
+        .values    = Stack_new(sizeof(size_t)),
+        .operators = Stack_new(sizeof(EmitOperator)),
+    };
+    Stack*    parameters = Emit_parameters(tokens);
+    SftError* failed     = Emitter_build(&e);
+
+    if(!failed) {
+        fprintf(stream, "// Generated by seqft --emit-c");
+
+        if(source) {
+            fprintf(stream, " from\n//\n");
+            Emit_source(stream, source);
+        } else {
+            fprintf(stream, "\n");
+        }
+
+        fprintf(stream,
+                "//\n"
+                "// Gives the same results as the evaluator unless compiled "
+                "with -ffast-math.\n"
+                "\n"
+                "#include <float.h>\n"
+                "#include <math.h>\n"
+                "#include <stddef.h>\n"
+                "#include <stdint.h>\n"
+                "\n"
+                "#if defined(__clang__)\n"
+                "    #pragma STDC FP_CONTRACT OFF\n"
+                "#elif defined(__GNUC__)\n"
+                "    #pragma GCC optimize(\"fp-contract=off\")\n"
+                "#endif\n"
+                "\n");
+
+        Emitter_printHelpers(&e, stream);
+
+        const char** names = Stack_getBase(parameters);
+        size_t       count = Stack_getCount(parameters);
+
+        fprintf(stream, "double %s(", name);
+
+        for(size_t i = 0; i < count; ++i) {
+            fprintf(stream, "%sdouble %s", i ? ", " : "", names[i]);
+        }
+
+        fprintf(stream, "%s) {\n    return ", count ? "" : "void");
+        Emitter_print(&e, stream, *(size_t*)Stack_getHead(e.values));
+        fprintf(stream, ";\n}\n");
+    }
+
+    Stack_free(parameters);
+    Stack_free(e.nodes);
+    Stack_free(e.children);
+    Stack_free(e.values);
+    Stack_free(e.operators);
+
+    return failed;
+}
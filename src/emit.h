@@ -0,0 +1,50 @@
+#ifndef _H_EMIT_
+#define _H_EMIT_
+
+#include <stdio.h>
+
+#include "common.h"
+#include "evaluator.h"
+#include "stack.h"
+#include "tokenizer.h"
+
+// Ahead of time C for formulas that never change: a standalone function
+//
+//     double name(double x, double y)
+//
+// with the variables of the formula as its parameters, in the order they
+// first appear, that computes what Sft_evalTokens would with those values,
+// bit for bit. Operators and if() become C operators, round and ceil the
+// libm functions of the same name, ^ a call of pow() that the compiler can't
+// rewrite, and the variadic functions static copies of the reductions of
+// reduce.h, emitted only when called, so that the file needs nothing but libm.
+//
+// The function must be compiled without -ffast-math and without contracting
+// multiplications and additions into fused ones, which the file asks of the
+// compilers that take pragmas for it. % takes its operands as unsigned 64 bit
+// integers, which is undefined in C for negative and NaN ones, as it is in
+// the evaluator.
+//
+// Series aren't emitted, nor are expressions the evaluator only gets a result
+// out of by accident, with unbalanced open parens or stray numbers.
+
+// Whether the name is a C identifier that the emitted code doesn't use for
+// anything else: not a keyword, nor a libm function or macro it calls, nor
+// starting with seqft_.
+extern BOOL Emit_isName(const char* name);
+
+// The names of the variables of the tokens, in order of first appearance, as
+// a Stack of const char* borrowed from them.
+extern Stack* Emit_parameters(const TokenArray* tokens);
+
+// Writes the C source of the function to the stream. Returns null, or the
+// error in the buffer, either the one evaluating the tokens would run into, or
+// ERR_EMIT_UNSUPPORTED. The name must pass Emit_isName. The source, if not
+// null, is quoted in a comment.
+extern SftError* Emit_c(FILE*             stream,
+                        const char*       name,
+                        const char*       source,
+                        const TokenArray* tokens,
+                        SftError*         error);
+
+#endif // _H_EMIT_
@@ -1,4 +1,6 @@
 #include "evaluator.h"
+#include "reduce.h"
+#include "series.h"
 
 
 double sft_round(double nums[], size_t len) {
@@ -17,151 +19,247 @@ double sft_ceil(double nums[], size_t len) {
     return ceil(num);
 }
 
-Function FN_LOOKUP[] = {
-    (Function) {.ptr = sft_round, .name = "round"},
-    (Function) {.ptr = sft_ceil,  .name = "ceil" }
-};
+double sft_sum(double nums[], size_t len) {
+    return reduce_sum(nums, len);
+}
 
-#ifdef DEBUG
-    #define debug_step(drawer, ...)   \
-        Sft_draw(drawer);             \
-        fprintf(stderr, __VA_ARGS__); \
-        getchar();
-#else
-    #define debug_step(...)
-#endif
+double sft_min(double nums[], size_t len) {
+    return reduce_min(nums, len);
+}
 
-void Sft_draw(SftDrawer* drawer) {
-#ifdef DEBUG
-    system("clear");
+double sft_max(double nums[], size_t len) {
+    return reduce_max(nums, len);
+}
 
-    if(!drawer || !drawer->tarray || !drawer->sft)
-        return;
-    // Draw expression
-    // -----------------------------------------------------------------------
+double sft_avg(double nums[], size_t len) {
+    if(len < 1)
+        return 0;
 
-    for(int i = 0; i < drawer->tarray->count; ++i) {
-        Token token = drawer->tarray->tokens[i];
+    return reduce_sum(nums, len) / (double)len;
+}
+
+double sft_hypot(double nums[], size_t len) {
+    return reduce_hypot(nums, len);
+}
 
-        char* as_string = Token_toString(&token);
+double sft_prod(double nums[], size_t len) {
+    double product = 1;
 
-        fprintf(stderr, "%s ", as_string);
+    for(size_t i = 0; i < len; ++i) {
+        product *= nums[i];
     }
 
-    fprintf(stderr, "\n");
+    return product;
+}
 
-    for(int i = 0; i < drawer->tarray->count; ++i) {
-        Token token = drawer->tarray->tokens[i];
+double sft_if(double nums[], size_t len) {
+    (void)len;
+    return nums[0] != 0 ? nums[1] : nums[2];
+}
 
-        if(i == drawer->tarray_idx) {
-            fprintf(stderr, "^");
-            break;
-        } else {
-            char* as_string = Token_toString(&token);
+const Function FN_LOOKUP[] = {
+    {.ptr = sft_round, .name = "round", .min_args = 1, .max_args = 1,           .pure = TRUE},
+    {.ptr = sft_ceil,  .name = "ceil",  .min_args = 1, .max_args = 1,           .pure = TRUE},
+    {.ptr = sft_sum,   .name = "sum",   .min_args = 1, .max_args = FN_VARIADIC, .pure = TRUE},
+    {.ptr = sft_min,   .name = "min",   .min_args = 1, .max_args = FN_VARIADIC, .pure = TRUE},
+    {.ptr = sft_max,   .name = "max",   .min_args = 1, .max_args = FN_VARIADIC, .pure = TRUE},
+    {.ptr = sft_avg,   .name = "avg",   .min_args = 1, .max_args = FN_VARIADIC, .pure = TRUE},
+    {.ptr = sft_hypot, .name = "hypot", .min_args = 1, .max_args = FN_VARIADIC, .pure = TRUE},
+    {.ptr = sft_prod,  .name = "prod",  .min_args = 1, .max_args = FN_VARIADIC, .pure = TRUE},
+    {.ptr = sft_if,    .name = "if",    .min_args = 3, .max_args = 3,           .pure = TRUE},
+};
 
-            size_t astr_len = strlen(as_string);
+const size_t FN_LOOKUP_COUNT = sizeof(FN_LOOKUP) / sizeof(FN_LOOKUP[0]);
 
-            for(int i = 0; i < astr_len; ++i) {
-                fprintf(stderr, " ");
-            }
+const Function* Function_lookup(const char* name, size_t* out_index) {
+    for(size_t i = 0; i < FN_LOOKUP_COUNT; ++i) {
+        if(!strcmp(FN_LOOKUP[i].name, name)) {
+            if(out_index)
+                *out_index = i;
 
-            fprintf(stderr, " ");
+            return &FN_LOOKUP[i];
         }
     }
 
-    fprintf(stderr, "\n");
-
-    // Matrix
-    // =======================================================================
+    return 0;
+}
 
-    // Initialize
-    // -------------------------------
-    char* matrix[12][2];
-    char* empty = " ";
+Sft* Sft_new() {
+    Sft* sft = xmalloc(sizeof(Sft));
+    memset(sft, 0, sizeof(Sft));
 
-    for(int i = 0; i < 12; ++i) {
-        matrix[i][0] = empty;
-        matrix[i][1] = empty;
-    }
+    // The operator cellar only borrows tokens from the TokenArray being
+    // evaluated, so it must not free their members.
+    sft->operator_stack = Stack_withCapacity(sizeof(Token), 100);
+    sft->number_stack   = Stack_withCapacity(sizeof(double), 100);
+    sft->series         = Stack_new(sizeof(SftSeries));
+    sft->body           = Stack_new(sizeof(Token));
 
-    // Populate
-    // -------------------------------
-    Stack* ostack = drawer->sft->operator_stack;
-    Stack* nstack = drawer->sft->number_stack;
+    sft->cursor = 0;
+    sft->trace  = 0;
 
-    for(int i = 0; i < Stack_getCount(ostack); ++i) {
-        if(i >= 12) {
-            fprintf(stderr,
-                    "Broke while populating matrix, operator stack index %d "
-                    "exceeded matrix size!\n",
-                    i);
-            sleep(2);
-            break;
-        }
+#ifdef SEQFT_TRACE
+    sft->trace = Trace_new(TRACE_DEFAULT_CAPACITY);
+#endif
 
-        Token* token = Stack_itemAt(ostack, i);
+    return sft;
+}
 
-        char* as_string = Token_toString(token);
+void Sft_setResolver(Sft* sft, SftResolver resolve, void* user) {
+    sft->resolve      = resolve;
+    sft->resolve_user = user;
+}
 
-        if(strlen(as_string) > 1) {
-            as_string[1] = '\0';
-        }
+BOOL Sft_memoize(Sft* sft, size_t index, size_t slots) {
+    if(index >= FN_LOOKUP_COUNT || !FN_LOOKUP[index].pure)
+        return FALSE;
 
-        matrix[i][0] = as_string;
+    if(!sft->memo) {
+        sft->memo = xmalloc(FN_LOOKUP_COUNT * sizeof(FunctionMemo*));
+        memset(sft->memo, 0, FN_LOOKUP_COUNT * sizeof(FunctionMemo*));
     }
 
-    for(int i = 0; i < Stack_getCount(nstack); ++i) {
-        if(i >= 12) {
-            fprintf(stderr,
-                    "Broke while populating matrix, number stack index %d "
-                    "exceeded matrix size!\n",
-                    i);
-            sleep(2);
-            break;
-        }
+    FunctionMemo_free(sft->memo[index]);
+    sft->memo[index] = slots ? FunctionMemo_new(slots) : 0;
+
+    return TRUE;
+}
 
-        double* number = Stack_itemAt(nstack, i);
+const FunctionMemo* Sft_memo(const Sft* sft, size_t index) {
+    return sft->memo && index < FN_LOOKUP_COUNT ? sft->memo[index] : 0;
+}
 
-        char* as_string = (char*)malloc(256);
-        memset(as_string, 0, 256);
+void Sft_reset(Sft* sft) {
+    Stack_clear(sft->operator_stack);
+    Stack_clear(sft->number_stack);
+    Stack_clear(sft->series);
+    Stack_clear(sft->body);
+
+    sft->index_pending    = FALSE;
+    sft->capturing        = FALSE;
+    sft->budget           = 0;
+    sft->steps            = 0;
+    sft->cursor           = 0;
+    sft->skip_to          = 0;
+    sft->error.code       = ERR_NONE;
+    sft->error.message[0] = '\0';
+}
 
-        snprintf(as_string, 256, "%.2f", *number);
+// Records an error at the token, without formatting anything, and returns
+// the Sft's error buffer.
+static SftError* Sft_fail(Sft* sft, ErrCode code, Token* token) {
+    SftError* error = &sft->error;
+
+    error->code          = code;
+    error->token_index   = sft->cursor;
+    error->offset        = token->offset;
+    error->operator_type = 0;
+    error->given         = 0;
+    error->symbol[0]     = '\0';
+    error->message[0]    = '\0';
+
+    SFT_TRACE(sft->trace, TRACE_ERROR, sft->cursor, code, 0);
+    return error;
+}
 
-        matrix[i][1] = as_string;
-    }
+static void SftError_setSymbol(SftError* error, const char* symbol) {
+    size_t len = strlen(symbol);
 
-    // Draw
-    // -------------------------------
-    for(int i = 11; i >= 0; i--) {
-        char* str_operator = matrix[i][0];
-        char* str_number   = matrix[i][1];
-        fprintf(stderr, "[%s] | [%s]\n", str_operator, str_number);
+    if(len >= sizeof(error->symbol))
+        len = sizeof(error->symbol) - 1;
 
-        if(str_operator != empty) {
-            matrix[i][0] = empty;
-        }
+    memcpy(error->symbol, symbol, len);
+    error->symbol[len] = '\0';
+}
 
-        if(str_number != empty) {
-            matrix[i][1] = empty;
+const char* SftError_message(SftError* error) {
+    if(error->message[0] || error->code == ERR_NONE)
+        return error->message;
+
+    char*  buffer = error->message;
+    size_t size   = sizeof(error->message);
+
+    switch(error->code) {
+        case ERR_MISSING_OPERAND: {
+            Token token = {.type = error->operator_type};
+            char  symbol[8];
+
+            Token_toString(&token, symbol, sizeof(symbol));
+            snprintf(buffer,
+                     size,
+                     "Invalid expression, missing operand for %s operator "
+                     "'%s'",
+                     error->operator_type & TT_UOP ? "unary" : "binary",
+                     symbol);
+            break;
+        }
+        case ERR_UNKNOWN_FUNCTION:
+            snprintf(buffer,
+                     size,
+                     "Invalid expression, no such function '%s'",
+                     error->symbol);
+            break;
+        case ERR_UNKNOWN_VARIABLE:
+            snprintf(buffer,
+                     size,
+                     "Invalid expression, variable '%s' has no value",
+                     error->symbol);
+            break;
+        case ERR_ARGUMENT_COUNT: {
+            const Function* f = Function_lookup(error->symbol, 0);
+
+            snprintf(buffer,
+                     size,
+                     "Invalid expression, function '%s' takes %s%zu "
+                     "argument%s but was given %zu",
+                     error->symbol,
+                     f && f->max_args == FN_VARIADIC ? "at least " : "",
+                     f ? f->min_args : 0,
+                     f && f->min_args == 1 ? "" : "s",
+                     error->given);
+            break;
         }
+        case ERR_SERIES_INDEX:
+            snprintf(buffer,
+                     size,
+                     "Invalid expression, '%s' has a value and can't be the "
+                     "index of a series, write (%s) for the value",
+                     error->symbol,
+                     error->symbol);
+            break;
+        case ERR_EMIT_UNSUPPORTED:
+            snprintf(buffer,
+                     size,
+                     "Can't emit C for the expression, %s",
+                     error->symbol);
+            break;
+        default:
+            snprintf(buffer, size, "%s", ErrCode_describe(error->code));
+            break;
     }
 
-    fprintf(stderr, "\n");
-#endif
+    return buffer;
 }
 
+void Sft_free(Sft* sft) {
+    if(sft) {
+        Stack_free(sft->operator_stack);
+        Stack_free(sft->number_stack);
+        Stack_free(sft->series);
+        Stack_free(sft->body);
+        Series_free(sft->runs);
+        Trace_free(sft->trace);
+
+        if(sft->memo) {
+            for(size_t i = 0; i < FN_LOOKUP_COUNT; ++i) {
+                FunctionMemo_free(sft->memo[i]);
+            }
 
+            xfree(sft->memo);
+        }
 
-Sft* Sft_new() {
-    Sft* sft = malloc(sizeof(Sft));
-
-    sft->operator_stack = Stack_withCapacity(sizeof(Token), 100);
-    sft->number_stack   = Stack_withCapacity(sizeof(double), 100);
-
-    Stack_setDeallocator(sft->operator_stack,
-                         (void (*)(void*))Token_freeMembers);
-
-    return sft;
+        xfree(sft);
+    }
 }
 
 
@@ -169,6 +267,23 @@ Sft* Sft_new() {
 
 
 
+static double eval_compare(TokenType operator_type, double num1, double num2) {
+    switch(operator_type) {
+        case TT_LT:
+            return num1 < num2;
+        case TT_LE:
+            return num1 <= num2;
+        case TT_GT:
+            return num1 > num2;
+        case TT_GE:
+            return num1 >= num2;
+        case TT_EQ:
+            return num1 == num2;
+        default: // TT_NE
+            return num1 != num2;
+    }
+}
+
 double eval_binary_op(TokenType operator_type, double num1, double num2) {
     if(operator_type == TT_ADD)
         return num1 + num2;
@@ -182,11 +297,24 @@ double eval_binary_op(TokenType operator_type, double num1, double num2) {
     else if(operator_type == TT_MUL)
         return num1 * num2;
 
+    // The remainder of the division truncated toward zero, NaN for a zero
+    // divisor, as the division gives an infinity rather than failing.
     else if(operator_type == TT_MOD)
-        return (uint64_t)num1 % (uint64_t)num2;
+        return fmod(num1, num2);
 
     else if(operator_type == TT_POW)
         return pow(num1, num2);
+
+    // Comparisons and logical operators give 1 for true and 0 for false, and
+    // take any operand other than 0 as true, NaN included.
+    else if(operator_type & TT_CMP)
+        return eval_compare(operator_type, num1, num2);
+
+    else if(operator_type == TT_AND)
+        return num1 != 0 && num2 != 0;
+
+    else if(operator_type == TT_OR)
+        return num1 != 0 || num2 != 0;
     else
         return 0xDEADC0DE;
 }
@@ -202,10 +330,78 @@ double eval_unary_op(TokenType operator_type, double num) {
 }
 
 
+// The number of numbers on the number cellar that precede the operand being
+// read: the arguments before it of the innermost paren on the operator
+// cellar, which the operators above it keep as their depth, or none outside
+// parens.
+static size_t Sft_operandBase(Sft* sft) {
+    if(Stack_empty(sft->operator_stack))
+        return 0;
+
+    Token* top = Stack_getHead(sft->operator_stack);
+    return top->type & TT_OPA ? top->depth + top->commas : top->depth;
+}
+
+// Pops the operands of the operator token off the number cellar, applies the
+// operator, and pushes the result back onto the number cellar.
+static SftError* eval_apply_operator(Sft* sft, Token* operator_token) {
+    Stack* number_cellar  = sft->number_stack;
+    double result_to_push = 0;
+
+    // Eval binary operators.
+    if(operator_token->type & TT_BOP) {
+        double num1, num2;
+
+        // The numbers below its depth aren't its to take, but belong to
+        // what is around its parens.
+        if(Stack_getCount(number_cellar) < operator_token->depth + 2) {
+            SftError* error =
+                Sft_fail(sft, ERR_MISSING_OPERAND, operator_token);
+            error->operator_type = operator_token->type;
+            return error;
+        }
+
+        Stack_popInto(number_cellar, &num2);
+        Stack_popInto(number_cellar, &num1);
+        SFT_TRACE(sft->trace, TRACE_POP_NUM, sft->cursor, 0, num2);
+        SFT_TRACE(sft->trace, TRACE_POP_NUM, sft->cursor, 0, num1);
+
+        result_to_push = eval_binary_op(operator_token->type, num1, num2);
+    }
+
+    // Eval unary operators.
+    else if(operator_token->type & TT_UOP) {
+        double num;
+
+        if(Stack_getCount(number_cellar) < operator_token->depth + 1) {
+            SftError* error =
+                Sft_fail(sft, ERR_MISSING_OPERAND, operator_token);
+            error->operator_type = operator_token->type;
+            return error;
+        }
+
+        Stack_popInto(number_cellar, &num);
+
+        SFT_TRACE(sft->trace, TRACE_POP_NUM, sft->cursor, 0, num);
+
+        result_to_push = eval_unary_op(operator_token->type, num);
+    }
+
+    SFT_TRACE(sft->trace,
+              TRACE_APPLY_OP,
+              sft->cursor,
+              operator_token->type,
+              result_to_push);
+
+    // Add calculation result to number cellar.
+    Stack_pushFrom(number_cellar, &result_to_push);
+    SFT_TRACE(sft->trace, TRACE_PUSH_NUM, sft->cursor, 0, result_to_push);
+
+    return 0;
+}
+
 SftError* eval_x_is_operator(Sft* sft, Token token) {
-    Stack*     operator_cellar = sft->operator_stack;
-    Stack*     number_cellar   = sft->number_stack;
-    SftDrawer* drawer          = sft->drawer;
+    Stack* operator_cellar = sft->operator_stack;
 
     while(1) {
         if(Stack_empty(operator_cellar))
@@ -216,234 +412,601 @@ SftError* eval_x_is_operator(Sft* sft, Token token) {
         if(top->type & TT_OPA)
             break;
 
-        if(top->type < token.type)
+        if(TokenType_precedence(top->type) < TokenType_precedence(token.type))
             break;
 
-        Token* operator_token = Stack_pop(operator_cellar);
-        DEBUGBLOCK({ Sft_draw(drawer); });
+        Token operator_token;
+        Stack_popInto(operator_cellar, &operator_token);
+        SFT_TRACE(
+            sft->trace, TRACE_POP_OP, sft->cursor, operator_token.type, 0);
+
+        SftError* error = eval_apply_operator(sft, &operator_token);
 
-        double result_to_push = 0;
+        if(error) {
+            return error;
+        }
+    }
+
+    return 0;
+}
 
-        // Eval binary operators.
-        if(operator_token->type & TT_BOP) {
-            double* num2 = Stack_pop(number_cellar);
-            DEBUGBLOCK({ Sft_draw(drawer); });
+// Evaluates operators until an open paren is at the top of the operator
+// cellar, or the operator cellar is empty.
+static SftError* eval_until_open_paren(Sft* sft) {
+    Stack* operator_cellar = sft->operator_stack;
 
-            double* num1 = Stack_pop(number_cellar);
-            DEBUGBLOCK({ Sft_draw(drawer); });
+    while(!Stack_empty(operator_cellar)) {
+        Token* top = Stack_getHead(operator_cellar);
 
-            if(!num2 || !num1) {
-                sprintf(sft->error.message,
-                        "Invalid expression, missing '%s' for binary operator "
-                        "'%s'\n\n",
-                        num1 ? "num1" : "num2",
-                        Token_toString(operator_token));
+        if(top->type == TT_OPA)
+            break;
 
-                return &sft->error;
-            }
+        Token operator_token;
+        Stack_popInto(operator_cellar, &operator_token);
+        SFT_TRACE(
+            sft->trace, TRACE_POP_OP, sft->cursor, operator_token.type, 0);
 
-            result_to_push = eval_binary_op(operator_token->type, *num1, *num2);
+        SftError* error = eval_apply_operator(sft, &operator_token);
+
+        if(error) {
+            return error;
         }
+    }
 
-        // Eval unary operators.
-        else if(operator_token->type & TT_UOP) {
-            double* num = Stack_pop(number_cellar);
+    return 0;
+}
 
-            if(!num) {
-                sprintf(sft->error.message,
-                        "Invalid expression, missing '%s' for unary operator "
-                        "'%s'\n\n",
-                        "num",
-                        Token_toString(operator_token));
+SftError* eval_x_is_comma(Sft* sft, Token token) {
+    SftError* error = eval_until_open_paren(sft);
 
-                return &sft->error;
-            }
+    if(error) {
+        return error;
+    }
 
-            DEBUGBLOCK({ Sft_draw(drawer); });
+    if(Stack_empty(sft->operator_stack)) {
+        return Sft_fail(sft, ERR_COMMA_OUTSIDE_CALL, &token);
+    }
 
-            result_to_push = eval_unary_op(operator_token->type, *num);
-        }
+    // Every argument so far must have been reduced to exactly one number,
+    // which catches an empty argument such as in "f(1,,2)".
+    Token* paren = Stack_getHead(sft->operator_stack);
+    size_t depth = Stack_getCount(sft->number_stack);
 
-        // Add calculation result to number cellar.
-        Stack_pushFrom(number_cellar, &result_to_push);
-        DEBUGBLOCK({ Sft_draw(drawer); });
+    if(depth != paren->depth + paren->commas + 1) {
+        return Sft_fail(sft, ERR_MISSING_ARGUMENT, &token);
     }
 
+    paren->commas += 1;
     return 0;
 }
 
-SftError* eval_x_is_close_paren(Sft* sft, Token token) {
+// The series whose paren is on top of the operator cellar, or null.
+static SftSeries* Sft_seriesTop(Sft* sft) {
+    if(Stack_empty(sft->series))
+        return 0;
 
-    Stack*     operator_cellar = sft->operator_stack;
-    Stack*     number_cellar   = sft->number_stack;
-    SftDrawer* drawer          = sft->drawer;
+    SftSeries* series = Stack_getHead(sft->series);
 
-    while(1) {
-        double result_to_push = 0;
+    return series->paren + 1 == Stack_getCount(sft->operator_stack) ? series
+                                                                    : 0;
+}
 
-        if(Stack_empty(operator_cellar))
-            break;
+// Looks up the variable token, read at index at, into value.
+static SftError* Sft_resolveVariable(Sft*         sft,
+                                     const Token* token,
+                                     size_t       at,
+                                     double*      value) {
+    if(sft->resolve && sft->resolve(sft->resolve_user, token, value))
+        return 0;
 
-        Token* top = Stack_getHead(operator_cellar);
+    Token copy = *token;
 
-        if(top->type == TT_OPA) {
-            if(top->func) {
+    sft->cursor     = at;
+    SftError* error = Sft_fail(sft, ERR_UNKNOWN_VARIABLE, &copy);
+    SftError_setSymbol(error, token->func);
+    return error;
+}
 
-                int found_func = 0;
+// Whether a variable read now would be the whole first argument of a sum or
+// prod so far, and so may be the index of a series.
+static BOOL Sft_mayBeIndex(Sft* sft) {
+    if(Stack_empty(sft->operator_stack))
+        return FALSE;
 
-                for(int i = 0; i < 2; ++i) {
-                    Function* f = &FN_LOOKUP[i];
+    Token* paren = Stack_getHead(sft->operator_stack);
 
-                    if(!strcmp(f->name, top->func)) {
-                        found_func = 1;
+    return paren->type == TT_OPA && Series_isSeries(paren->func) &&
+           !paren->commas && Stack_getCount(sft->number_stack) == paren->depth;
+}
 
-                        double* num = Stack_pop(number_cellar);
+// Settles the pending variable by the token read after it: the index of a
+// series if that is a comma, whose value stays a placeholder, and otherwise
+// an ordinary argument, whose value replaces the placeholder.
+static SftError* Sft_settleIndex(Sft* sft, BOOL comma) {
+    size_t cursor = sft->cursor;
 
-                        DEBUGBLOCK({ Sft_draw(drawer); });
+    sft->index_pending = FALSE;
 
-                        if(!num) {
-                            sprintf(sft->error.message,
-                                    "Invalid expression, missing argument for"
-                                    "function '%s'\n\n",
-                                    Token_toString(top));
+    if(comma) {
+        SftSeries series = {
+            .paren    = Stack_getCount(sft->operator_stack) - 1,
+            .index    = sft->index_token,
+            .index_at = sft->index_at,
+        };
 
-                            return &sft->error;
-                        }
+        Stack_pushFrom(sft->series, &series);
+        return 0;
+    }
 
-                        double nums[1] = {*num};
-                        double result  = f->ptr(nums, 1);
-                        Stack_pushFrom(number_cellar, &result);
-                        DEBUGBLOCK({ Sft_draw(drawer); });
-                        break;
-                    }
-                }
+    SftError* error = Sft_resolveVariable(sft,
+                                          &sft->index_token,
+                                          sft->index_at,
+                                          Stack_getHead(sft->number_stack));
 
-                if(!found_func) {
-                    printf("\nNo such function '%s'\n", top->func);
-                }
-            }
+    if(!error)
+        sft->cursor = cursor;
 
-            free(Stack_pop(operator_cellar));
-            DEBUGBLOCK({ Sft_draw(drawer); });
-            break;
-        }
+    return error;
+}
 
-        Token* operator_token = Stack_pop(operator_cellar);
-        DEBUGBLOCK({ Sft_draw(drawer); });
+// Makes the series on top an ordinary call of sum or prod after all, with the
+// value of its variable as the first argument.
+static SftError* Sft_demoteSeries(Sft* sft) {
+    SftSeries series;
+    Stack_popInto(sft->series, &series);
 
-        // Eval binary operators.
-        if(operator_token->type & TT_BOP) {
-            double* num2 = Stack_pop(number_cellar);
-            DEBUGBLOCK({ Sft_draw(drawer); });
+    Token*    paren  = Stack_getHead(sft->operator_stack);
+    size_t    cursor = sft->cursor;
+    double*   value  = Stack_itemAt(sft->number_stack, paren->depth);
+    SftError* error =
+        Sft_resolveVariable(sft, &series.index, series.index_at, value);
 
-            double* num1 = Stack_pop(number_cellar);
-            DEBUGBLOCK({ Sft_draw(drawer); });
+    if(!error)
+        sft->cursor = cursor;
 
-            if(!num2 || !num1) {
-                sprintf(sft->error.message,
-                        "Invalid expression, missing '%s' for binary operator "
-                        "'%s'\n\n",
-                        num1 ? "num1" : "num2",
-                        Token_toString(operator_token));
+    return error;
+}
 
-                return &sft->error;
-            }
+// Evaluates the series on top over its range, once its close paren was read,
+// and replaces its arguments with the result.
+static SftError* Sft_evalSeries(Sft* sft, Token* close) {
+    Token*     paren  = Stack_getHead(sft->operator_stack);
+    SftSeries* series = Stack_getHead(sft->series);
+    double*    args   = Stack_itemAt(sft->number_stack, paren->depth);
+    size_t     index  = 0;
+    double     result = 0;
+
+    if(Stack_empty(sft->body))
+        return Sft_fail(sft, ERR_MISSING_ARGUMENT, close);
+
+    // With a value, the index could as well be the first of four numbers to
+    // add or multiply, which is what sum and prod made of it before series.
+    // Rather than guess, the call is turned away; (x) is the number.
+    if(sft->resolve &&
+       sft->resolve(sft->resolve_user, &series->index, &result)) {
+        Token index_token = series->index;
+
+        sft->cursor     = series->index_at;
+        SftError* error = Sft_fail(sft, ERR_SERIES_INDEX, &index_token);
+        SftError_setSymbol(error, index_token.func);
+        return error;
+    }
 
-            result_to_push = eval_binary_op(operator_token->type, *num1, *num2);
-        }
+    if(!sft->runs)
+        sft->runs = Series_new();
+
+    TokenArray body = {
+        .tokens = Stack_getBase(sft->body),
+        .count  = Stack_getCount(sft->body),
+    };
+    SeriesCall call = {
+        .index        = series->index.func,
+        .body         = &body,
+        .product      = !strcmp(paren->func, "prod"),
+        .lo           = args[1],
+        .hi           = args[2],
+        .resolve      = sft->resolve,
+        .resolve_user = sft->resolve_user,
+        .budget       = sft->budget,
+        .steps        = &sft->steps,
+        .resume       = series->interrupted,
+        .offset       = close->offset,
+    };
+
+    SftError* error = Series_eval(sft->runs, &call, &result);
+
+    // Errors within the body are placed among the Sft's own tokens.
+    if(error) {
+        series->interrupted = error->code == ERR_BUDGET_EXHAUSTED;
+
+        sft->error = *error;
+        sft->error.token_index += sft->body_at;
+        sft->error.message[0] = '\0';
+
+        SFT_TRACE(sft->trace, TRACE_ERROR, sft->cursor, error->code, 0);
+        return &sft->error;
+    }
 
-        // Eval unary operators.
-        else if(operator_token->type & TT_UOP) {
-            double* num = Stack_pop(number_cellar);
+    Function_lookup(paren->func, &index);
+    SFT_TRACE(sft->trace, TRACE_CALL, sft->cursor, index, result);
 
-            if(!num) {
-                sprintf(sft->error.message,
-                        "Invalid expression, missing '%s' for unary operator "
-                        "'%s'\n\n",
-                        "num",
-                        Token_toString(operator_token));
+    sft->capturing = FALSE;
 
-                return &sft->error;
-            }
+    Stack_truncate(sft->number_stack, paren->depth);
+    Stack_pushFrom(sft->number_stack, &result);
+    SFT_TRACE(sft->trace, TRACE_PUSH_NUM, sft->cursor, 0, result);
 
-            DEBUGBLOCK({ Sft_draw(drawer); });
-            result_to_push = eval_unary_op(operator_token->type, *num);
+    Stack_popInto(sft->operator_stack, 0);
+    Stack_popInto(sft->series, 0);
+    SFT_TRACE(sft->trace, TRACE_POP_OP, sft->cursor, TT_OPA, 0);
+
+    return 0;
+}
+
+// A comma ending the fourth argument of a series makes it an ordinary call of
+// five or more arguments: what was read as its body is evaluated after all,
+// and then the comma.
+static SftError* Sft_uncapture(Sft* sft, Token* comma) {
+    size_t count  = Stack_getCount(sft->body);
+    size_t at     = sft->body_at;
+    size_t cursor = sft->cursor;
+
+    // Evaluating them may read another body.
+    Token* tokens = xmalloc((count + 1) * sizeof(Token));
+
+    if(count)
+        memcpy(tokens, Stack_getBase(sft->body), count * sizeof(Token));
+
+    // Their jumps go back to counting from the Sft's first token.
+    for(size_t i = 0; i < count; ++i) {
+        if(tokens[i].type & TT_JMP && tokens[i].depth)
+            tokens[i].depth += at;
+    }
+
+    sft->capturing  = FALSE;
+    SftError* error = Sft_demoteSeries(sft);
+
+    for(size_t i = 0; !error && i < count; ++i) {
+        error = Sft_evalToken(sft, &tokens[i], at + i);
+
+        if(sft->skip_to) {
+            i            = sft->skip_to - at - 1;
+            sft->skip_to = 0;
         }
+    }
+
+    xfree(tokens);
+    return error ? error : Sft_evalToken(sft, comma, cursor);
+}
+
+// Reads a token of the body of the series on top instead of evaluating it,
+// until the series' close paren.
+static SftError* Sft_capture(Sft* sft, Token* token) {
+    if(token->type & TT_OPA) {
+        sft->body_parens += 1;
+    } else if(token->type & TT_CPA) {
+        if(!sft->body_parens)
+            return Sft_evalSeries(sft, token);
+
+        sft->body_parens -= 1;
+    } else if(token->type & TT_COM && !sft->body_parens) {
+        return Sft_uncapture(sft, token);
+    }
+
+    // The body is a TokenArray of its own, whose jumps count from its first
+    // token.
+    Stack_pushFrom(sft->body, token);
+    Token* copy = Stack_getHead(sft->body);
+
+    if(copy->type & TT_JMP && copy->depth)
+        copy->depth -= sft->body_at;
 
-        // Add calculation result to number cellar.
-        Stack_pushFrom(number_cellar, &result_to_push);
-        DEBUGBLOCK({ Sft_draw(drawer); });
+    return 0;
+}
+
+// Calls the function of the open paren at the top of the operator cellar with
+// the numbers pushed since the paren, which are replaced by the result. The
+// arguments are passed straight out of the number cellar, without copying.
+static SftError* eval_call_function(Sft* sft, Token* paren, size_t argc) {
+    Stack*          number_cellar = sft->number_stack;
+    size_t          index         = 0;
+    const Function* f             = Function_lookup(paren->func, &index);
+
+    if(!f) {
+        SftError* error = Sft_fail(sft, ERR_UNKNOWN_FUNCTION, paren);
+        SftError_setSymbol(error, paren->func);
+        return error;
+    }
+
+    if(argc < f->min_args || argc > f->max_args) {
+        SftError* error = Sft_fail(sft, ERR_ARGUMENT_COUNT, paren);
+        SftError_setSymbol(error, paren->func);
+        error->given = argc;
+        return error;
+    }
+
+    double*       args   = Stack_itemAt(number_cellar, paren->depth);
+    FunctionMemo* memo   = sft->memo ? sft->memo[index] : 0;
+    uint64_t      hash   = 0;
+    double        result = 0;
+
+    if(!memo || !FunctionMemo_lookup(memo, args, argc, &hash, &result)) {
+        result = f->ptr(args, argc);
+
+        if(memo)
+            FunctionMemo_store(memo, hash, args, argc, result);
     }
+    SFT_TRACE(sft->trace, TRACE_CALL, sft->cursor, index, result);
+
+    Stack_truncate(number_cellar, paren->depth);
+    Stack_pushFrom(number_cellar, &result);
+    SFT_TRACE(sft->trace, TRACE_PUSH_NUM, sft->cursor, 0, result);
 
     return 0;
 }
 
+SftError* eval_x_is_close_paren(Sft* sft, Token token) {
+    Stack* operator_cellar = sft->operator_stack;
+
+    SftError* error = eval_until_open_paren(sft);
+
+    if(error) {
+        return error;
+    }
+
+    if(Stack_empty(operator_cellar)) {
+        return 0;
+    }
+
+    // A sum or prod of fewer than four arguments, the first a lone variable,
+    // is an ordinary call.
+    if(Sft_seriesTop(sft)) {
+        error = Sft_demoteSeries(sft);
+
+        if(error) {
+            return error;
+        }
+    }
+
+    Token  paren = *(Token*)Stack_getHead(operator_cellar);
+    size_t depth = Stack_getCount(sft->number_stack);
+    size_t count = depth > paren.depth ? depth - paren.depth : 0;
+
+    // A trailing comma leaves one argument fewer than there were commas.
+    if(paren.commas && count != paren.commas + 1) {
+        return Sft_fail(sft, ERR_MISSING_ARGUMENT, &token);
+    }
+
+    if(paren.func) {
+        error = eval_call_function(sft, &paren, count);
+    } else if(paren.commas) {
+        error = Sft_fail(sft, ERR_COMMA_OUTSIDE_CALL, &paren);
+    }
+
+    if(error) {
+        return error;
+    }
+
+    Stack_popInto(operator_cellar, 0);
+    SFT_TRACE(sft->trace, TRACE_POP_OP, sft->cursor, TT_OPA, 0);
 
+    return 0;
+}
 
 SftError* Sft_evalTokens(Sft* sft, TokenArray* tokens, double* out_result) {
-    SftDrawer* drawer = (SftDrawer*)malloc(sizeof(SftDrawer));
-    drawer->sft       = sft;
-    drawer->tarray    = tokens;
-    drawer->padding   = 0;
+    Sft_begin(sft, tokens);
+    return Sft_resume(sft, 0, out_result);
+}
 
-    // Iterate from left to right.
-    for(int i = 0; i < tokens->count; ++i) {
-        drawer->tarray_idx = i;
-        DEBUGBLOCK({ Sft_draw(drawer); });
+void Sft_begin(Sft* sft, TokenArray* tokens) {
+    // Anything left behind by a previous failed evaluation is discarded.
+    Sft_reset(sft);
+    sft->tokens = tokens;
 
-        Token token = tokens->tokens[i];
+    SFT_TRACE(sft->trace, TRACE_BEGIN, 0, tokens->count, 0);
+}
 
-        // If X is a number, place X in the number cellar.
-        if(token.type & TT_NUM) {
-            debug_step(drawer, "\n> Push Number\n");
-            Stack_pushFrom(sft->number_stack, &token.f64);
+// Called before every step with the steps taken so far including it. Returns
+// the error to stop with if the budget doesn't allow for the step, or null.
+static SftError* Sft_spend(Sft* sft, const SftBudget* budget, uint64_t steps) {
+    ErrCode code = ERR_NONE;
+
+    if(budget->steps && steps > budget->steps) {
+        code = ERR_BUDGET_EXHAUSTED;
+    } else if(steps % SFT_BUDGET_CHECK_INTERVAL == 1) {
+        if(budget->cancel &&
+           atomic_load_explicit(budget->cancel, memory_order_relaxed)) {
+            code = ERR_CANCELLED;
+        } else if(budget->deadline_ns && monotonic_ns() >= budget->deadline_ns) {
+            code = ERR_BUDGET_EXHAUSTED;
         }
+    }
+
+    if(code == ERR_NONE)
+        return 0;
+
+    // Points at the token to continue with, or the last one if they were all
+    // read.
+    TokenArray* tokens = sft->tokens;
+    size_t at = sft->cursor < tokens->count ? sft->cursor : tokens->count - 1;
+
+    return Sft_fail(sft, code, &tokens->tokens[at]);
+}
 
-        // If token is an operator, evaluate operators until either
-        // - Operator cellar is empty.
-        //
-        // - The top of the operator cellar is an open paren.
-        //
-        // - The precedence of the operator at the top of the operator
-        //   cellar is LOWER than the precedence of t.
-        else if(token.type & (TT_OPS | TT_COM)) {
-            // The first time we encounter an operator, simply add it, no
-            // evaluation.
+// Once the operators binding tighter than an && or || were applied, its left
+// operand is on top of the number cellar, and if that decides it, it's
+// replaced with the result and its right operand is skipped, instead of
+// pushing the operator. Returns whether it did.
+static BOOL Sft_shortCircuit(Sft* sft, const Token* token) {
+    if(!token->depth ||
+       Stack_getCount(sft->number_stack) <= Sft_operandBase(sft))
+        return FALSE;
 
-            debug_step(drawer, "\n> Evaluate Stack\n");
+    double* left  = Stack_getHead(sft->number_stack);
+    BOOL    truth = *left != 0;
 
-            SftError* error = eval_x_is_operator(sft, token);
+    if(truth != (token->type == TT_OR))
+        return FALSE;
+
+    *left        = truth;
+    sft->skip_to = token->depth;
+
+    SFT_TRACE(sft->trace, TRACE_APPLY_OP, sft->cursor, token->type, *left);
+    return TRUE;
+}
+
+// After a comma of an if(), skips the branch its condition doesn't take,
+// leaving a NaN in its place: the second argument after the first comma if
+// the condition is false, or the third after the second if it's true.
+static void Sft_branch(Sft* sft, const Token* comma) {
+    Token* paren = Stack_getHead(sft->operator_stack);
+
+    if(!comma->depth || !paren->func || strcmp(paren->func, "if"))
+        return;
+
+    double condition = *(double*)Stack_itemAt(sft->number_stack, paren->depth);
+    double skipped   = NAN;
+
+    if((condition != 0) != (paren->commas == 2))
+        return;
+
+    Stack_pushFrom(sft->number_stack, &skipped);
+    SFT_TRACE(sft->trace, TRACE_PUSH_NUM, sft->cursor, 0, skipped);
+
+    sft->skip_to = comma->depth;
+}
+
+// The step of Sft_evalTokens for one token; source is the token as it lives
+// in its array, which the resolver gets to see.
+SftError* Sft_evalToken(Sft* sft, const Token* source, size_t index) {
+    Token token = *source;
+
+    sft->cursor = index;
+
+    if(sft->capturing)
+        return Sft_capture(sft, &token);
+
+    if(sft->index_pending) {
+        SftError* error =
+            Sft_settleIndex(sft, token.type & TT_COM ? TRUE : FALSE);
+
+        if(error) {
+            return error;
+        }
+    }
+
+    // If X is a number, place X in the number cellar.
+    if(token.type & TT_NUM) {
+        Stack_pushFrom(sft->number_stack, &token.f64);
+        SFT_TRACE(sft->trace, TRACE_PUSH_NUM, index, 0, token.f64);
+    }
+
+    // If X is a variable, place its value in the number cellar, unless it
+    // may be the index of a series, which the next token tells.
+    else if(token.type & TT_VAR) {
+        double value = NAN;
+
+        if(Sft_mayBeIndex(sft)) {
+            sft->index_pending = TRUE;
+            sft->index_token   = token;
+            sft->index_at      = index;
+        } else {
+            SftError* error = Sft_resolveVariable(sft, source, index, &value);
 
             if(error) {
                 return error;
             }
+        }
+
+        Stack_pushFrom(sft->number_stack, &value);
+        SFT_TRACE(sft->trace, TRACE_PUSH_NUM, index, 0, value);
+    }
 
-            // Then place X in the cellar.
-            debug_step(drawer, "\n> Push Operator\n");
-            Stack_pushFrom(sft->operator_stack, &token);
+    // If token is an operator, evaluate operators until either
+    // - Operator cellar is empty.
+    //
+    // - The top of the operator cellar is an open paren.
+    //
+    // - The precedence of the operator at the top of the operator
+    //   cellar is LOWER than the precedence of t.
+    else if(token.type & TT_OPS) {
+        // The first time we encounter an operator, simply add it, no
+        // evaluation.
+        SftError* error = eval_x_is_operator(sft, token);
+
+        if(error) {
+            return error;
         }
 
-        // If X is an open parenthesis, push X onto the operator cellar.
-        else if(token.type & TT_OPA) {
-            debug_step(drawer, "\n> Push Operator\n");
-            Stack_pushFrom(sft->operator_stack, &token);
+        // An && or || whose left operand decides it skips its right one.
+        if(token.type & TT_LOG && Sft_shortCircuit(sft, &token))
+            return 0;
+
+        // Then place X in the cellar, with where its operands start.
+        token.depth = Sft_operandBase(sft);
+        Stack_pushFrom(sft->operator_stack, &token);
+        SFT_TRACE(sft->trace, TRACE_PUSH_OP, index, token.type, 0);
+    }
+
+    // If X is a comma, evaluate operators until the open parenthesis of
+    // the function call it belongs to, completing one argument.
+    // The comma before the fourth argument of a series starts its body, and
+    // those of an if() may skip a branch.
+    else if(token.type & TT_COM) {
+        SftError* error = eval_x_is_comma(sft, token);
+
+        if(!error && token.depth)
+            Sft_branch(sft, &token);
+
+        if(!error && Sft_seriesTop(sft) &&
+           ((Token*)Stack_getHead(sft->operator_stack))->commas == 3) {
+            sft->capturing   = TRUE;
+            sft->body_parens = 0;
+            sft->body_at     = index + 1;
+            Stack_clear(sft->body);
         }
 
-        // If X is a close parenthesis
-        // - Evaluate operators until an open parenthesis is at the
-        //   top of the operator cellar
-        // - Remove the open parenthesis from the operator cellar.
-        else if(token.type & TT_CPA) {
-            debug_step(drawer, "\n> Evaluate Stack\n");
-            SftError* error = eval_x_is_close_paren(sft, token);
+        return error;
+    }
 
-            if(error) {
-                return error;
-            }
+    // If X is an open parenthesis, push X onto the operator cellar,
+    // remembering where its arguments will start on the number cellar.
+    else if(token.type & TT_OPA) {
+        token.depth  = Stack_getCount(sft->number_stack);
+        token.commas = 0;
+        Stack_pushFrom(sft->operator_stack, &token);
+        SFT_TRACE(sft->trace, TRACE_PUSH_OP, index, token.type, 0);
+    }
+
+    // If X is a close parenthesis
+    // - Evaluate operators until an open parenthesis is at the
+    //   top of the operator cellar
+    // - Remove the open parenthesis from the operator cellar.
+    else if(token.type & TT_CPA) {
+        return eval_x_is_close_paren(sft, token);
+    }
+
+    return 0;
+}
+
+// Once every token was read: applies the remaining operators, spending a step
+// on each if there is a budget, and pops the result.
+static SftError* Sft_drain(Sft*             sft,
+                           const SftBudget* budget,
+                           double*          out_result) {
+    if(sft->index_pending) {
+        SftError* error = Sft_settleIndex(sft, FALSE);
+
+        if(error) {
+            return error;
         }
     }
 
-    debug_step(drawer, "\n> Evaluate Stack\n");
+    // A series whose close paren never came has nothing to evaluate.
+    if(sft->capturing) {
+        return Sft_fail(
+            sft, ERR_SERIES_FORM, Stack_getHead(sft->operator_stack));
+    }
 
     // If there are no more tokens to read, evaluate the remaining operators.
     while(1) {
@@ -451,57 +1014,82 @@ SftError* Sft_evalTokens(Sft* sft, TokenArray* tokens, double* out_result) {
             break;
         }
 
-        Token* operator_token = Stack_pop(sft->operator_stack);
-
-        double result_to_push = 0;
+        if(budget) {
+            SftError* error = Sft_spend(sft, budget, ++sft->steps);
 
-        // Eval binary operators.
-        if(operator_token->type & TT_BOP) {
-            double* num2 = Stack_pop(sft->number_stack);
-            double* num1 = Stack_pop(sft->number_stack);
+            if(error) {
+                return error;
+            }
+        }
 
-            if(!num2 || !num1) {
-                sprintf(sft->error.message,
-                        "Invalid expression, missing '%s' for binary operator "
-                        "'%s'\n\n",
-                        num1 ? "num2" : "num1",
-                        Token_toString(operator_token));
+        Token operator_token;
+        Stack_popInto(sft->operator_stack, &operator_token);
+        SFT_TRACE(
+            sft->trace, TRACE_POP_OP, sft->cursor, operator_token.type, 0);
+
+        // A call left open after a comma lacks the argument that its close
+        // paren would have found missing.
+        if(operator_token.type & TT_OPA && operator_token.commas &&
+           Stack_getCount(sft->number_stack) !=
+               operator_token.depth + operator_token.commas + 1) {
+            return Sft_fail(sft, ERR_MISSING_ARGUMENT, &operator_token);
+        }
 
-                return &sft->error;
-            }
+        SftError* error = eval_apply_operator(sft, &operator_token);
 
-            result_to_push = eval_binary_op(operator_token->type, *num1, *num2);
+        if(error) {
+            return error;
         }
+    }
 
-        // Eval unary operators.
-        else if(operator_token->type & TT_UOP) {
-            double* num = Stack_pop(sft->number_stack);
+    double result;
 
-            if(!num) {
-                sprintf(sft->error.message,
-                        "Invalid expression, missing '%s' for unary operator "
-                        "'%s'\n\n",
-                        "num",
-                        Token_toString(operator_token));
+    if(Stack_popInto(sft->number_stack, &result)) {
+        SFT_TRACE(sft->trace, TRACE_POP_NUM, sft->cursor, 0, result);
+        SFT_TRACE(sft->trace, TRACE_END, sft->cursor, 0, result);
 
-                return &sft->error;
-            }
+        *out_result = result;
+    }
+
+    return NULL;
+}
 
-            result_to_push = eval_unary_op(operator_token->type, *num);
+SftError* Sft_finish(Sft* sft, size_t count, double* out_result) {
+    sft->cursor = count;
+    return Sft_drain(sft, 0, out_result);
+}
+
+SftError* Sft_resume(Sft* sft, const SftBudget* budget, double* out_result) {
+    TokenArray* tokens = sft->tokens;
+
+    sft->budget = budget;
+    sft->steps  = 0;
+
+    // Iterate from left to right.
+    for(size_t i = sft->cursor; i < tokens->count; ++i) {
+        sft->cursor = i;
+
+        if(budget) {
+            SftError* error = Sft_spend(sft, budget, ++sft->steps);
+
+            if(error) {
+                return error;
+            }
         }
 
-        // Add calculation result to number cellar.
-        Stack_pushFrom(sft->number_stack, &result_to_push);
-    }
+        SftError* error = Sft_evalToken(sft, &tokens->tokens[i], i);
 
-    debug_step(drawer, "\n> Pop Result\n");
-    double* result = Stack_pop(sft->number_stack);
-    DEBUGBLOCK({ Sft_draw(drawer); });
+        if(error) {
+            return error;
+        }
 
-    if(result) {
-        *out_result = *result;
-        free(result);
+        if(sft->skip_to) {
+            i            = sft->skip_to - 1;
+            sft->skip_to = 0;
+        }
     }
 
-    return NULL;
+    sft->cursor = tokens->count;
+
+    return Sft_drain(sft, budget, out_result);
 }
@@ -2,48 +2,184 @@
 #define _H_EVALUATOR_
 
 #include "common.h"
+#include "memo.h"
 #include "stack.h"
 #include "tokenizer.h"
+#include "trace.h"
 
 #include <math.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+// Marks a function that takes any number of arguments past min_args.
+#define FN_VARIADIC ((size_t)-1)
+
 typedef struct {
     char* name;
     double (*ptr)(double nums[], size_t len);
+    size_t min_args;
+    size_t max_args;
+
+    // The result depends on nothing but the arguments, and calling it has no
+    // side effects, so it may be remembered (see Sft_memoize).
+    BOOL pure;
 } Function;
 
 extern double sft_round(double nums[], size_t len);
 
 extern double sft_ceil(double nums[], size_t len);
 
-extern Function FN_LOOKUP[];
+// Variadic reductions, see reduce.h.
+extern double sft_sum(double nums[], size_t len);
+extern double sft_min(double nums[], size_t len);
+extern double sft_max(double nums[], size_t len);
+extern double sft_avg(double nums[], size_t len);
+extern double sft_hypot(double nums[], size_t len);
+extern double sft_prod(double nums[], size_t len);
+
+// if(c, a, b): a if c isn't 0, b if it is. Evaluated token by token, only the
+// argument taken is; the other is skipped (see Token).
+extern double sft_if(double nums[], size_t len);
+
+extern const Function FN_LOOKUP[];
 
-typedef struct SftDrawer SftDrawer;
+extern const size_t FN_LOOKUP_COUNT;
 
+// Returns the function of that name in FN_LOOKUP, or null, writing its index
+// to out_index if non-zero.
+extern const Function* Function_lookup(const char* name, size_t* out_index);
+
+// The last error of an Sft. Only the code and position are recorded when the
+// error occurs; the message is formatted by SftError_message() when asked for.
 typedef struct SftError {
+    ErrCode code;
+
+    // Index of the token being evaluated when the error was detected, and the
+    // offset of the offending token in the whitespace-stripped expression.
+    size_t token_index;
+    size_t offset;
+
+    // Details for the message, only set for the codes that need them.
+    TokenType operator_type; // ERR_MISSING_OPERAND
+    size_t    given;         // ERR_ARGUMENT_COUNT
+    char      symbol[64];    // ERR_UNKNOWN_FUNCTION, ERR_ARGUMENT_COUNT,
+                             // ERR_UNKNOWN_VARIABLE
+
+    // Empty until SftError_message() formats it.
     char message[256];
 } SftError;
 
-typedef struct {
-    Stack*     operator_stack;
-    Stack*     number_stack;
-    SftDrawer* drawer;
-    SftError   error;
+// Formats the error's message on first call, and returns the same buffer on
+// subsequent ones. The message lives inside the error.
+extern const char* SftError_message(SftError* error);
+
+// Looks up the value of a TT_VAR token, whose name is token->func. Returns
+// FALSE if the variable has no value, which fails the evaluation with
+// ERR_UNKNOWN_VARIABLE.
+typedef BOOL (*SftResolver)(void* user, const Token* token, double* value);
+
+// Limits on one call of Sft_resume. A step is a token, an operator left over
+// once every token was read, or a value of the index of a series that its
+// body is evaluated for (see series.h). Steps are counted on every one; the
+// clock and the cancellation flag are looked at on the first step and then
+// every SFT_BUDGET_CHECK_INTERVAL steps, so a deadline can be overrun by that
+// many steps, and by however long a single function call takes.
+typedef struct SftBudget {
+    uint64_t steps;       // 0 for no limit.
+    uint64_t deadline_ns; // Against monotonic_ns(), 0 for none.
+
+    // Set to non-zero from any thread to cancel; null for none.
+    const atomic_int* cancel;
+} SftBudget;
+
+#define SFT_BUDGET_CHECK_INTERVAL 256
+
+// A sum or prod on the operator cellar that is a series (see series.h): the
+// position of its open paren, its index variable, and whether evaluating it
+// ran out of the budget of an Sft_resume, leaving how far it got in the
+// Sft's Series.
+typedef struct SftSeries {
+    size_t paren;
+    Token  index;
+    size_t index_at;
+    BOOL   interrupted;
+} SftSeries;
+
+typedef struct Sft {
+    Stack*   operator_stack;
+    Stack*   number_stack;
+    SftError error;
+
+    // The tokens given to Sft_begin, and the index of the token currently
+    // being evaluated, where Sft_resume carries on.
+    TokenArray* tokens;
+    size_t      cursor;
+
+    // Ring buffer of evaluation events, only allocated when built with
+    // SEQFT_TRACE, otherwise always null.
+    Trace* trace;
+
+    // Where TT_VAR tokens get their values from; without one, every variable
+    // is unknown.
+    SftResolver resolve;
+    void*       resolve_user;
+
+    // Remembered results, indexed like FN_LOOKUP, with null for functions that
+    // aren't memoized. Null until the first Sft_memoize. Kept across
+    // evaluations.
+    FunctionMemo** memo;
+
+    // A variable read as the first argument of a sum or prod, which is the
+    // index of a series if a comma follows, and its value otherwise. Its
+    // value is left pending until the next token tells.
+    BOOL   index_pending;
+    Token  index_token;
+    size_t index_at;
+
+    // The series open on the operator cellar, innermost last. The body of a
+    // series is read into body rather than evaluated, from the comma before
+    // it up to its close paren, and only then evaluated over the range.
+    Stack*         series;      // SftSeries
+    Stack*         body;        // Token
+    BOOL           capturing;   // Reading a body.
+    size_t         body_parens; // Parens open within the body read so far.
+    size_t         body_at;     // Index of the body's first token.
+    struct Series* runs;        // Evaluates bodies; null until the first.
+
+    // The budget of the Sft_resume running, for series to check, or null, and
+    // the steps it has taken, series included.
+    const SftBudget* budget;
+    uint64_t         steps;
+
+    // Index of the token to read next instead of the one after the token just
+    // evaluated, when that skipped what follows it; 0 if it didn't.
+    size_t skip_to;
 } Sft;
 
-typedef struct SftDrawer {
-    Sft*        sft;
-    TokenArray* tarray;
-    size_t      tarray_idx;
-    size_t      padding;
-} SftDrawer;
+extern Sft* Sft_new();
+
+// Installs the resolver for variables, passing it user on every call, or
+// removes it if null.
+extern void Sft_setResolver(Sft* sft, SftResolver resolve, void* user);
 
-extern void Sft_draw(SftDrawer* drawer);
+// Remembers up to about `slots` results, at most MEMO_MAX_SLOTS, of the pure
+// function at index in FN_LOOKUP, so that calling it again with the same
+// arguments costs a hash probe, or stops remembering them if slots is 0. Only
+// worth it for functions that cost more than the probe. Returns FALSE for a
+// function that isn't pure.
+extern BOOL Sft_memoize(Sft* sft, size_t index, size_t slots);
 
-extern Sft* Sft_new();
+// The memo of the function at index in FN_LOOKUP, or null if not memoized.
+extern const FunctionMemo* Sft_memo(const Sft* sft, size_t index);
+
+// Empties both cellars and the last error, keeping their memory allocated so
+// that the Sft can be reused for the next evaluation without allocating. The
+// trace, if any, is left alone so that it can span several evaluations.
+extern void Sft_reset(Sft* sft);
+
+extern void Sft_free(Sft* sft);
 
 extern double eval_binary_op(TokenType operator_type, double num1, double num2);
 
@@ -51,6 +187,8 @@ extern double eval_unary_op(TokenType operator_type, double num);
 
 extern SftError* eval_x_is_operator(Sft* sft, Token token);
 
+extern SftError* eval_x_is_comma(Sft* sft, Token token);
+
 extern SftError* eval_x_is_close_paren(Sft* sft, Token token);
 
 // Returns pointer to SftError stored internally in Sft instance on error.
@@ -58,4 +196,24 @@ extern SftError* eval_x_is_close_paren(Sft* sft, Token token);
 // SftError field is used as the "last error" buffer.
 extern SftError* Sft_evalTokens(Sft* sft, TokenArray* tokens, double* out_result);
 
+// Sft_evalTokens in installments: Sft_begin sets up the evaluation of tokens,
+// which must stay valid until it is over, and every Sft_resume runs it on
+// within the budget, or without limits if budget is null.
+//
+// Sft_resume returns null with the result once done. If the budget runs out
+// it returns ERR_BUDGET_EXHAUSTED, and the next Sft_resume continues from
+// there, with a budget of its own. Any other error, ERR_CANCELLED included,
+// ends the evaluation.
+extern void      Sft_begin(Sft* sft, TokenArray* tokens);
+extern SftError* Sft_resume(Sft* sft, const SftBudget* budget, double* out_result);
+
+// The steps of Sft_evalTokens, for tokens that aren't laid out in a
+// TokenArray, such as those decoded one at a time from a compiled program:
+// Sft_reset, then Sft_evalToken for every token in order with its index, then
+// Sft_finish with their count. Where an Sft_evalToken leaves sft->skip_to
+// non-zero, the caller zeroes it and carries on from the token at that index
+// instead, which may be the count.
+extern SftError* Sft_evalToken(Sft* sft, const Token* token, size_t index);
+extern SftError* Sft_finish(Sft* sft, size_t count, double* out_result);
+
 #endif // _H_EVALUATOR_
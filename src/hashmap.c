@@ -0,0 +1,133 @@
+#include "hashmap.h"
+
+#define HASHMAP_MIN_CAPACITY 16
+
+// Eight bytes at a time, each word folded in with a multiply, and the tail
+// padded with zeros; the length is mixed in so that padding can't collide.
+// Finishes with the avalanche step of splitmix64, as the low bits pick the
+// slot.
+static size_t hash_bytes(const char* key, size_t len) {
+    uint64_t hash = len * 0x9e3779b97f4a7c15ull;
+    uint64_t word;
+
+    for(; len >= sizeof(word); key += sizeof(word), len -= sizeof(word)) {
+        memcpy(&word, key, sizeof(word));
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+
+    if(len) {
+        word = 0;
+        memcpy(&word, key, len);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebull;
+    hash ^= hash >> 31;
+
+    return (size_t)hash;
+}
+
+// The slot holding the key, or the empty slot where it would go.
+static HashMapEntry* HashMap_find(const HashMap* map,
+                                  const char*    key,
+                                  size_t         len,
+                                  size_t         hash) {
+    size_t mask = map->capacity - 1;
+
+    for(size_t i = hash & mask;; i = (i + 1) & mask) {
+        HashMapEntry* entry = &map->entries[i];
+
+        if(!entry->key ||
+           (entry->hash == hash && entry->len == len &&
+            !memcmp(entry->key, key, len))) {
+            return entry;
+        }
+    }
+}
+
+static void HashMap_grow(HashMap* map) {
+    HashMapEntry* old      = map->entries;
+    size_t        old_size = map->capacity;
+    size_t        capacity = old_size ? old_size * 2 : HASHMAP_MIN_CAPACITY;
+
+    // Left as it was if out of memory.
+    map->entries  = xmalloc(capacity * sizeof(HashMapEntry));
+    map->capacity = capacity;
+    memset(map->entries, 0, map->capacity * sizeof(HashMapEntry));
+
+    for(size_t i = 0; i < old_size; ++i) {
+        if(old[i].key) {
+            *HashMap_find(map, old[i].key, old[i].len, old[i].hash) = old[i];
+        }
+    }
+
+    xfree(old);
+}
+
+HashMap* HashMap_new(void) {
+    HashMap* map = xmalloc(sizeof(HashMap));
+    memset(map, 0, sizeof(HashMap));
+
+    HashMap_grow(map);
+    return map;
+}
+
+void HashMap_free(HashMap* map) {
+    if(!map)
+        return;
+
+    for(size_t i = 0; i < map->capacity; ++i) {
+        xfree(map->entries[i].key);
+    }
+
+    xfree(map->entries);
+    xfree(map);
+}
+
+BOOL HashMap_get(const HashMap* map,
+                 const char*    key,
+                 size_t         len,
+                 size_t*        value) {
+    HashMapEntry* entry = HashMap_find(map, key, len, hash_bytes(key, len));
+
+    if(!entry->key)
+        return FALSE;
+
+    *value = entry->value;
+    return TRUE;
+}
+
+void HashMap_put(HashMap* map, const char* key, size_t len, size_t value) {
+    size_t        hash  = hash_bytes(key, len);
+    HashMapEntry* entry = HashMap_find(map, key, len, hash);
+
+    if(!entry->key) {
+        if((map->count + 1) * 2 > map->capacity) {
+            HashMap_grow(map);
+            entry = HashMap_find(map, key, len, hash);
+        }
+
+        entry->key = xmalloc(len + 1);
+        memcpy(entry->key, key, len);
+        entry->key[len] = '\0';
+        entry->len      = len;
+        entry->hash     = hash;
+        map->count += 1;
+    }
+
+    entry->value = value;
+}
+
+void HashMap_clear(HashMap* map) {
+    for(size_t i = 0; i < map->capacity; ++i) {
+        xfree(map->entries[i].key);
+    }
+
+    memset(map->entries, 0, map->capacity * sizeof(HashMapEntry));
+    map->count = 0;
+}
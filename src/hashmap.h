@@ -0,0 +1,40 @@
+#ifndef _H_HASHMAP_
+#define _H_HASHMAP_
+
+#include <stddef.h>
+
+#include "common.h"
+
+// Map from strings to indices, for looking names up in O(1). Keys are copied
+// in; entries can be added and replaced but not removed. Open addressing with
+// linear probing over a power of two table kept at most half full.
+
+typedef struct HashMapEntry {
+    char*  key; // Null for an empty slot.
+    size_t len;
+    size_t hash;
+    size_t value;
+} HashMapEntry;
+
+typedef struct HashMap {
+    HashMapEntry* entries;
+    size_t        capacity;
+    size_t        count;
+} HashMap;
+
+extern HashMap* HashMap_new(void);
+extern void     HashMap_free(HashMap* map);
+
+// Looks up the len bytes at key. Returns FALSE if absent, leaving value alone.
+extern BOOL HashMap_get(const HashMap* map,
+                        const char*    key,
+                        size_t         len,
+                        size_t*        value);
+
+// Adds the key, or replaces its value if it is already there.
+extern void HashMap_put(HashMap* map, const char* key, size_t len, size_t value);
+
+// Removes every entry, keeping the table's memory.
+extern void HashMap_clear(HashMap* map);
+
+#endif // _H_HASHMAP_
@@ -0,0 +1,98 @@
+#include "histogram.h"
+
+// Largest value that lands in the bucket.
+static uint64_t Histogram_bucketTop(size_t bucket) {
+    if(bucket < HISTOGRAM_SUB_BUCKETS)
+        return bucket;
+
+    int      shift = (int)(bucket / HISTOGRAM_SUB_BUCKETS) - 1;
+    uint64_t base  = HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS;
+
+    return (base << shift) + ((1ull << shift) - 1);
+}
+
+void Histogram_add(Histogram* into, const Histogram* from) {
+    for(size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        into->buckets[i] += from->buckets[i];
+    }
+
+    into->count += from->count;
+
+    if(from->max > into->max)
+        into->max = from->max;
+}
+
+uint64_t Histogram_percentile(const Histogram* histogram, double p) {
+    if(!histogram->count)
+        return 0;
+
+    // The rank of the value, counting from 1.
+    uint64_t rank = (uint64_t)(p * (double)histogram->count + 0.5);
+
+    if(rank < 1)
+        rank = 1;
+
+    if(rank >= histogram->count)
+        return histogram->max;
+
+    uint64_t seen = 0;
+
+    for(size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->buckets[i];
+
+        if(seen >= rank) {
+            uint64_t top = Histogram_bucketTop(i);
+            return top < histogram->max ? top : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+LatencyStats* LatencyStats_new(void) {
+    LatencyStats* stats = xmalloc(sizeof(LatencyStats));
+    memset(stats, 0, sizeof(LatencyStats));
+    return stats;
+}
+
+void LatencyStats_add(LatencyStats* into, const LatencyStats* from) {
+    Histogram_add(&into->parse, &from->parse);
+    Histogram_add(&into->evaluate, &from->evaluate);
+    Histogram_add(&into->total, &from->total);
+}
+
+void LatencyStats_print(const LatencyStats* stats, FILE* stream) {
+    static const double PERCENTILES[] = {0.5, 0.9, 0.99, 0.999, 1};
+
+    const Histogram* histograms[] = {&stats->parse, &stats->evaluate, &stats->total};
+    const char*      names[]      = {"parse", "evaluate", "total"};
+
+    fprintf(stream,
+            "%-12s %10s %9s %9s %9s %9s %9s\n",
+            "latency (us)",
+            "count",
+            "p50",
+            "p90",
+            "p99",
+            "p99.9",
+            "max");
+
+    for(size_t i = 0; i < 3; ++i) {
+        if(!histograms[i]->count)
+            continue;
+
+        fprintf(stream,
+                "%-12s %10llu",
+                names[i],
+                (unsigned long long)histograms[i]->count);
+
+        for(size_t k = 0; k < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); ++k) {
+            fprintf(stream,
+                    " %9.2f",
+                    (double)Histogram_percentile(histograms[i], PERCENTILES[k]) /
+                        1e3);
+        }
+
+        fprintf(stream, "\n");
+    }
+}
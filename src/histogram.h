@@ -0,0 +1,75 @@
+#ifndef _H_HISTOGRAM_
+#define _H_HISTOGRAM_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+
+// Log bucketed histograms of latencies, cheap enough to record every
+// expression: recording is a count of leading zeros, two shifts and an
+// increment, and the buckets take a fixed 8 KiB whatever the values.
+//
+// Values below HISTOGRAM_SUB_BUCKETS get a bucket each. Above that, every
+// power of two is cut into HISTOGRAM_SUB_BUCKETS buckets of equal width, so
+// a bucket is never wider than 1 / HISTOGRAM_SUB_BUCKETS of the values in
+// it, and percentiles read back from the buckets are within that of the
+// true ones. Histograms of the same kind merge by adding their buckets,
+// which is how the histograms of worker threads are combined.
+
+#define HISTOGRAM_SUB_BITS    4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS     ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+// Zeroed is empty.
+typedef struct Histogram {
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+static inline size_t Histogram_bucket(uint64_t value) {
+    if(value < HISTOGRAM_SUB_BUCKETS)
+        return (size_t)value;
+
+    int top = 63 - __builtin_clzll(value);
+
+    // The power of two, and the HISTOGRAM_SUB_BITS bits below its top bit.
+    return (size_t)(top - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS +
+           (size_t)(value >> (top - HISTOGRAM_SUB_BITS) &
+                    (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static inline void Histogram_record(Histogram* histogram, uint64_t value) {
+    histogram->buckets[Histogram_bucket(value)] += 1;
+    histogram->count += 1;
+
+    if(value > histogram->max)
+        histogram->max = value;
+}
+
+extern void Histogram_add(Histogram* into, const Histogram* from);
+
+// The value below which a fraction p, in [0, 1], of the values fall: the top
+// of the bucket holding it, or the largest value if that's lower. 0 if the
+// histogram is empty.
+extern uint64_t Histogram_percentile(const Histogram* histogram, double p);
+
+// Latencies per expression, in nanoseconds: tokenizing it, evaluating it,
+// and everything from reading it to having written its result.
+typedef struct LatencyStats {
+    Histogram parse;
+    Histogram evaluate;
+    Histogram total;
+} LatencyStats;
+
+// Empty, for xfree.
+extern LatencyStats* LatencyStats_new(void);
+
+extern void LatencyStats_add(LatencyStats* into, const LatencyStats* from);
+
+// Prints p50, p90, p99, p99.9 and max in microseconds, one line per
+// histogram with any values.
+extern void LatencyStats_print(const LatencyStats* stats, FILE* stream);
+
+#endif // _H_HISTOGRAM_
@@ -1,12 +1,24 @@
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "batch.h"
 #include "common.h"
+#include "dtoa.h"
+#include "emit.h"
 #include "evaluator.h"
+#include "hashmap.h"
+#include "histogram.h"
+#include "perf.h"
+#include "program.h"
+#include "resubmit.h"
+#include "server.h"
+#include "split.h"
 #include "stack.h"
 #include "tokenizer.h"
+#include "vars.h"
 
 void test_stack() {
     Stack* s = Stack_withCapacity(4, 100);
@@ -49,11 +61,11 @@ void highlight_error(const char* expr,
 
     printf("\n");
 
-    char stripped[expr_len];
+    char* stripped = xmalloc(expr_len + 1);
     filter_whitespace(expr, expr_len, stripped);
 
     const size_t bufsize = indent + expr_len + strlen(error.message) + 1;
-    char         padding[bufsize];
+    char*        padding = xmalloc(bufsize);
     memset(padding, 0, bufsize);
 
     memset(padding, ' ', indent);
@@ -69,26 +81,53 @@ void highlight_error(const char* expr,
     memset(padding, 0, bufsize);
 
     printf("\n\n");
-}
 
-void test_sft(const char* expr) {
-    Tokenizer* t   = Tokenizer_new();
-    Sft*       sft = Sft_new();
+    xfree(padding);
+    xfree(stripped);
+}
 
+// Evaluates and prints an expression using the given Resubmit and Sft, which
+// are reused across calls and left ready for the next expression, which only
+// has to be tokenized and evaluated where it differs from this one. Unless
+// split is null, the expression is evaluated whole, split over its threads,
+// instead. Results are printed with `precision` decimals, or in shortest form
+// if negative. Both phases are counted in perf, unless it is null, and timed
+// into latency.
+void test_sft(Resubmit*     resubmit,
+              Sft*          sft,
+              Split*        split,
+              Perf*         perf,
+              LatencyStats* latency,
+              const char*   expr,
+              int           precision) {
     size_t expr_len = strlen(expr);
 
     if(!expr_len) {
-        Tokenizer_free(t);
         return;
     }
 
-    TokenArray* token_array = Tokenizer_parse(t, expr, expr_len);
+    uint64_t start = monotonic_ns();
+
+    Perf_begin(perf, PERF_TOKENIZE);
+    BOOL tokenized = Resubmit_tokenize(resubmit, expr, expr_len);
+    Perf_end(perf);
+
+    uint64_t parsed = monotonic_ns();
+    Histogram_record(&latency->parse, parsed - start);
+
+    TokenArray  tokens;
+    TokenArray* token_array = 0;
+
+    if(tokenized) {
+        Tokenizer_view(resubmit->t, &tokens);
+        token_array = &tokens;
+    }
 
     // char buffer[256];
     //
     // for(int i = 0; i < token_array->count; ++i) {
     //     Token  t   = token_array->tokens[i];
-    //     size_t len = Token_toString(&t, buffer);
+    //     size_t len = Token_toString(&t, buffer, sizeof(buffer));
     //     printf("Token '%s'\n", buffer);
     // }
     //
@@ -110,28 +149,58 @@ void test_sft(const char* expr) {
     }
 #endif
 
-    if(t->error) {
-        highlight_error(expr, expr_len, *t->error, 2);
-        TokenArray_free(token_array);
-        Tokenizer_free(t);
+    if(!tokenized) {
+        highlight_error(expr, expr_len, *resubmit->t->error, 2);
+        Histogram_record(&latency->total, monotonic_ns() - start);
         return;
     }
 
     if(token_array) {
         double result = 0;
 
-        SftError* error =Sft_evalTokens(sft, token_array, &result);
+        Perf_begin(perf, PERF_EVALUATE);
+        SftError* error = split ? Split_eval(split, sft, &tokens, &result)
+                                : Resubmit_evaluate(resubmit, sft, &result);
+        Perf_end(perf);
+
+        Histogram_record(&latency->evaluate, monotonic_ns() - parsed);
 
         if(error) {
-          printf("%s", error->message);
+            IterErr at = {.code    = error->code,
+                          .message = SftError_message(error),
+                          .index   = error->offset};
+
+            highlight_error(expr, expr_len, at, 2);
         } else {
-          printf("Result: %f\n", result);
+            char   text[DTOA_FIXED_SIZE(DTOA_MAX_PRECISION)];
+            size_t len = precision < 0 ? dtoa_shortest(result, text)
+                                       : dtoa_fixed(result, precision, text);
+
+            printf("Result: %.*s\n", (int)len, text);
         }
 
     }
 
-    TokenArray_free(token_array);
-    Tokenizer_free(t);
+#ifdef SEQFT_TRACE
+    // Append the events of this evaluation to the trace file, if requested,
+    // to be rendered later with seqft_tracedump.
+    const char* trace_path = getenv("SEQFT_TRACE_FILE");
+
+    if(trace_path) {
+        FILE* trace_file = fopen(trace_path, "ab");
+
+        if(trace_file) {
+            Trace_write(sft->trace, trace_file);
+            fclose(trace_file);
+        } else {
+            perror(trace_path);
+        }
+    }
+
+    Trace_clear(sft->trace);
+#endif
+
+    Histogram_record(&latency->total, monotonic_ns() - start);
 }
 
 void test_tokenizer(const char* expr) {
@@ -153,9 +222,6 @@ void test_tokenizer(const char* expr) {
             Token* t = &token_array->tokens[i];
             Token_print(t);
         }
-
-        TokenArray_freeMembers(token_array);
-        free(token_array);
     }
 #endif
 
@@ -163,34 +229,597 @@ void test_tokenizer(const char* expr) {
         highlight_error(expr, expr_len, *t->error, 2);
     }
 
+    TokenArray_free(token_array);
     Tokenizer_free(t);
 }
 
-int main() {
+// Prints the value of a variable, or why it has none.
+static void print_variable(const Variable* var, int precision) {
+    if(var->state != ERR_NONE) {
+        printf("%s: %s\n", var->name, ErrCode_describe(var->state));
+        return;
+    }
+
+    char   text[DTOA_FIXED_SIZE(DTOA_MAX_PRECISION)];
+    size_t len = precision < 0 ? dtoa_shortest(var->value, text)
+                               : dtoa_fixed(var->value, precision, text);
+
+    printf("%s = %.*s\n", var->name, (int)len, text);
+}
+
+// Handles "name = formula": assigns it, and prints the new value and how
+// many formulas had to be evaluated for it.
+static void assign_variable(Vars*       vars,
+                            const char* name,
+                            size_t      name_len,
+                            const char* formula,
+                            size_t      formula_len,
+                            int         precision) {
+    IterErr error;
+
+    if(!Vars_assign(vars, name, name_len, formula, formula_len, &error)) {
+        highlight_error(formula, formula_len, error, 2);
+        return;
+    }
+
+    char* key = xmalloc(name_len + 1);
+    memcpy(key, name, name_len);
+    key[name_len] = '\0';
+
+    print_variable(Vars_get(vars, key), precision);
+
+    if(vars->recomputed > 1) {
+        printf("Recomputed %zu formulas\n", vars->recomputed);
+    }
+
+    xfree(key);
+}
+
+// Handles !memo: memoizes the function in both the REPL's Sft and the one
+// evaluating variables, or prints the hit rates so far if function is null.
+static void memo_command(Sft*        sft,
+                         Vars*       vars,
+                         const char* function,
+                         size_t      slots) {
+    if(!function) {
+        for(size_t i = 0; i < FN_LOOKUP_COUNT; ++i) {
+            const FunctionMemo* memo      = Sft_memo(sft, i);
+            const FunctionMemo* vars_memo = Sft_memo(vars->sft, i);
+
+            if(!memo)
+                continue;
+
+            uint64_t hits   = memo->hits + vars_memo->hits;
+            uint64_t misses = memo->misses + vars_memo->misses;
+
+            printf("  %s: %zu slots, %llu hits, %llu misses (%.1f%% hits)\n",
+                   FN_LOOKUP[i].name,
+                   FunctionMemo_slots(memo),
+                   (unsigned long long)hits,
+                   (unsigned long long)misses,
+                   hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+        }
+
+        return;
+    }
+
+    size_t index = 0;
+
+    if(!Function_lookup(function, &index)) {
+        printf("No such function '%s'\n", function);
+    } else if(!Sft_memoize(sft, index, slots) ||
+              !Sft_memoize(vars->sft, index, slots)) {
+        printf("Can't memoize '%s'\n", function);
+    } else if(slots) {
+        printf("Remembering %zu results of '%s'\n",
+               FunctionMemo_slots(Sft_memo(sft, index)),
+               function);
+    } else {
+        printf("Not remembering results of '%s'\n", function);
+    }
+}
+
+// Reads text, all of it, as a whole number from 0 to max into value.
+static BOOL parse_count(const char* text, size_t max, size_t* value) {
+    char* end = 0;
+
+    // strtoull would take a sign, and leading whitespace.
+    if(*text < '0' || *text > '9')
+        return FALSE;
+
+    errno                     = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+
+    if(errno || *end || parsed > max)
+        return FALSE;
+
+    *value = (size_t)parsed;
+    return TRUE;
+}
+
+// REPL commands, entered with a leading '!':
+//   !precision N   print results with N decimals
+//   !precision     print results in shortest round trip form again
+//   !vars          list the variables with their formulas and values
+//   !memo F N      remember N results of the pure function F, 0 to stop
+//   !memo          print the hit rates of the memoized functions
+//   !stats         print latency percentiles of the expressions so far, and
+//                  how much of the last one was lexed and evaluated again
+static void run_command(const char*         command,
+                        int*                precision,
+                        Sft*                sft,
+                        Vars*               vars,
+                        const LatencyStats* latency,
+                        const Resubmit*     resubmit) {
+    char name[32];
+    char function[32];
+    char argument[32];
+    int  assigned = sscanf(command, "%31s %31s", name, argument);
+
+    if(assigned >= 1 && !strcmp(name, "memo")) {
+        char   count[32];
+        size_t slots = 0;
+
+        assigned = sscanf(command, "%31s %31s %31s", name, function, count);
+
+        if(assigned == 3 && !parse_count(count, MEMO_MAX_SLOTS, &slots)) {
+            printf("Slots must be between 0 and %zu\n", MEMO_MAX_SLOTS);
+            return;
+        }
+
+        memo_command(sft, vars, assigned == 3 ? function : 0, slots);
+        return;
+    }
+
+    if(assigned >= 1 && !strcmp(name, "precision")) {
+        size_t decimals = 0;
+
+        if(assigned == 1) {
+            *precision = -1;
+            printf("Printing results in shortest form\n");
+        } else if(!parse_count(argument, DTOA_MAX_PRECISION, &decimals)) {
+            printf("Precision must be between 0 and %d\n", DTOA_MAX_PRECISION);
+        } else {
+            *precision = (int)decimals;
+            printf("Printing results with %d decimals\n", *precision);
+        }
+
+        return;
+    }
+
+    if(assigned >= 1 && !strcmp(name, "stats")) {
+        if(latency->total.count) {
+            LatencyStats_print(latency, stdout);
+
+            TokenArray tokens;
+            Tokenizer_view(resubmit->t, &tokens);
+
+            printf("Last expression: lexed %zu of %zu tokens, evaluated %zu\n",
+                   resubmit->lexed,
+                   tokens.count,
+                   resubmit->evaluated);
+        } else {
+            printf("No expressions evaluated yet\n");
+        }
+
+        return;
+    }
+
+    if(assigned >= 1 && !strcmp(name, "vars")) {
+        for(size_t i = 0; i < Vars_count(vars); ++i) {
+            const Variable* var = Vars_at(vars, i);
+
+            if(var->source) {
+                printf("  %s := %s\n  ", var->name, var->source);
+                print_variable(var, *precision);
+            }
+        }
+
+        return;
+    }
+
+    printf("Unknown command '!%s'\n", command);
+}
+
+// Tokenizer_tokenize, counted as the tokenize phase.
+static BOOL tokenize_counted(Tokenizer*  t,
+                             Perf*       perf,
+                             const char* formula,
+                             size_t      len) {
+    Perf_begin(perf, PERF_TOKENIZE);
+    BOOL tokenized = Tokenizer_tokenize(t, formula, len);
+    Perf_end(perf);
+    return tokenized;
+}
+
+// Compiles a formula library, one "name = formula" per line with blank lines
+// and lines starting with '#' ignored, into a program file. Tokenizing and
+// compiling are counted in perf, unless it is null.
+static int compile_library(const char* library_path,
+                           const char* program_path,
+                           Perf*       perf) {
+    FILE* library = fopen(library_path, "r");
+
+    if(!library) {
+        perror(library_path);
+        return 1;
+    }
+
+    Tokenizer*     t       = Tokenizer_new();
+    ProgramWriter* writer  = ProgramWriter_new();
+    HashMap*       names   = HashMap_new();
+    char*          line    = 0;
+    size_t         size    = 0;
+    size_t         number  = 0;
+    int            rc      = 0;
+    ssize_t        len;
+
+    while(!rc && (len = getline(&line, &size, library)) >= 0) {
+        const char* name;
+        const char* formula;
+        size_t      name_len, formula_len, first;
+
+        number += 1;
+
+        while(len && isspace((unsigned char)line[len - 1]))
+            line[--len] = '\0';
+
+        if(!len || line[strspn(line, " \t")] == '#' ||
+           line[strspn(line, " \t")] == '\0')
+            continue;
+
+        if(!Vars_splitAssignment(
+               line, (size_t)len, &name, &name_len, &formula, &formula_len)) {
+            fprintf(stderr, "%s:%zu: expected 'name = formula'\n",
+                    library_path, number);
+            rc = 1;
+        } else if(HashMap_get(names, name, name_len, &first)) {
+            fprintf(stderr, "%s:%zu: '%.*s' already defined on line %zu\n",
+                    library_path, number, (int)name_len, name, first);
+            rc = 1;
+        } else if(!tokenize_counted(t, perf, formula, formula_len)) {
+            fprintf(stderr, "%s:%zu: %s (column %zu)\n",
+                    library_path, number, t->error->message,
+                    t->error->index + 1);
+            rc = 1;
+        } else {
+            TokenArray tokens;
+            Tokenizer_view(t, &tokens);
+
+            char* key = xmalloc(name_len + 1);
+            memcpy(key, name, name_len);
+            key[name_len] = '\0';
+
+            Perf_begin(perf, PERF_COMPILE);
+            BOOL added = ProgramWriter_add(writer, key, &tokens);
+            Perf_end(perf);
+
+            if(!added) {
+                fprintf(stderr, "%s:%zu: formula too large\n",
+                        library_path, number);
+                rc = 1;
+            }
+
+            HashMap_put(names, name, name_len, number);
+            xfree(key);
+        }
+    }
+
+    fclose(library);
+    free(line);
+
+    if(!rc) {
+        FILE* out = fopen(program_path, "wb");
+
+        if(!out || ProgramWriter_write(writer, out)) {
+            perror(program_path);
+            rc = 1;
+        }
+
+        if(out && fclose(out)) {
+            perror(program_path);
+            rc = 1;
+        }
+    }
+
+    if(!rc) {
+        fprintf(stderr, "%zu formulas compiled\n", names->count);
+    }
+
+    HashMap_free(names);
+    ProgramWriter_free(writer);
+    Tokenizer_free(t);
+
+    return rc;
+}
+
+// Evaluates the formula of that name in the program, or all of them if name
+// is null, printing "name = result" lines. Evaluating is counted in perf,
+// unless it is null.
+static int run_program(const char* path, const char* name, Perf* perf) {
+    uint64_t    start  = monotonic_ns();
+    const char* reason = 0;
+    Program*    program = Program_open(path, &reason);
+
+    if(!program) {
+        fprintf(stderr, "%s: %s\n", path, reason);
+        return 1;
+    }
+
+    uint64_t opened = monotonic_ns();
+    size_t   first  = 0;
+    size_t   last   = Program_count(program);
+    Sft*     sft    = Sft_new();
+    int      rc     = 0;
+
+    if(name) {
+        if(!Program_find(program, name, &first)) {
+            fprintf(stderr, "%s: no formula named '%s'\n", path, name);
+            Sft_free(sft);
+            Program_close(program);
+            return 1;
+        }
+
+        last = first + 1;
+    }
+
+    for(size_t i = first; i < last; ++i) {
+        double result = 0;
+
+        Perf_begin(perf, PERF_EVALUATE);
+        ErrCode code = Program_eval(program, i, sft, &result);
+        Perf_end(perf);
+
+        if(code == ERR_NONE) {
+            char   text[DTOA_SHORTEST_SIZE];
+            size_t len = dtoa_shortest(result, text);
+
+            printf("%s = %.*s\n", Program_name(program, i), (int)len, text);
+        } else {
+            printf("%s: %s\n",
+                   Program_name(program, i),
+                   code == ERR_CORRUPT_PROGRAM ? ErrCode_describe(code)
+                                               : SftError_message(&sft->error));
+            rc = 1;
+        }
+    }
+
+    fprintf(stderr,
+            "opened in %.3fms, %zu formulas evaluated in %.3fms\n",
+            (double)(opened - start) / 1e6,
+            last - first,
+            (double)(monotonic_ns() - opened) / 1e6);
+
+    Sft_free(sft);
+    Program_close(program);
+    return rc;
+}
+
+// Writes the formula as a C function of that name to stdout, and what's wrong
+// with it to stderr.
+static int emit_function(const char* name, const char* expr) {
+    if(!Emit_isName(name)) {
+        fprintf(stderr, "'%s' can't be the name of a C function\n", name);
+        return 1;
+    }
+
+    Tokenizer* t   = Tokenizer_new();
+    size_t     len = strlen(expr);
+    int        rc  = 0;
+
+    if(!Tokenizer_tokenize(t, expr, len)) {
+        fprintf(stderr, "%s (column %zu)\n", t->error->message,
+                t->error->index + 1);
+        rc = 1;
+    } else {
+        TokenArray tokens;
+        SftError   error;
+
+        Tokenizer_view(t, &tokens);
+
+        if(Emit_c(stdout, name, expr, &tokens, &error)) {
+            fprintf(stderr, "%s (column %zu)\n", SftError_message(&error),
+                    error.offset + 1);
+            rc = 1;
+        }
+    }
+
+    Tokenizer_free(t);
+    return rc;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [--batch FILE | --serve ADDRESS] [options]\n"
+            "       %s --compile LIBRARY PROGRAM\n"
+            "       %s --run PROGRAM [NAME]\n"
+            "       %s --emit-c NAME FORMULA\n"
+            "\n"
+            "Without arguments, reads expressions interactively.\n"
+            "  --compile       Compile the 'name = formula' lines of LIBRARY\n"
+            "                  into the PROGRAM file.\n"
+            "  --run           Evaluate the formula NAME of a compiled PROGRAM,\n"
+            "                  or every formula in it.\n"
+            "  --emit-c        Print FORMULA as the C function NAME of its\n"
+            "                  variables, which computes the same results.\n"
+            "  --batch FILE    Evaluate every line of FILE, printing one result\n"
+            "                  per line to stdout and a summary to stderr.\n"
+            "  --serve ADDRESS Answer newline separated expressions sent to\n"
+            "                  unix:PATH or tcp:PORT (localhost) until SIGINT.\n"
+            "  --skip-errors   Print an empty line for a bad expression instead\n"
+            "                  of its error.\n"
+            "  --threads N     Evaluate on N threads, default one per CPU.\n"
+            "  --split         Evaluate one expression at a time on all the\n"
+            "                  threads, splitting long ones among them.\n"
+            "                  Goes with --batch and interactive input.\n"
+            "  --window N      Chunks of results held at most while waiting to\n"
+            "                  be written in order, default four per thread.\n"
+            "  --dedup         Evaluate repeated expressions only once.\n"
+            "  --max-steps N   Fail an expression after N evaluation steps.\n"
+            "  --max-ms N      Fail an expression after N milliseconds.\n"
+            "  --latency       Time every expression and print the p50, p90,\n"
+            "                  p99, p99.9 and max latencies to stderr at exit.\n"
+            "  --perf          Count cycles, instructions, branch and cache\n"
+            "                  misses while tokenizing, compiling and\n"
+            "                  evaluating, and print them to stderr at exit.\n"
+            "                  Goes with every mode but --serve.\n",
+            program,
+            program,
+            program,
+            program);
+}
+
+// Prints what perf counted and frees it. Returns rc.
+static int finish_perf(Perf* perf, int rc) {
+    if(perf) {
+        fprintf(stderr, "\n");
+        PerfTotals_print(&perf->totals, stderr);
+        Perf_free(perf);
+    }
+
+    return rc;
+}
+
+int main(int argc, char** argv) {
+    const char*  batch_path = 0;
+    const char*  serve_at   = 0;
+    BatchOptions options    = {0};
+    int          kept       = 1;
+
+    // --perf goes with every mode, so it is taken out before the rest is
+    // parsed.
+    for(int i = 1; i < argc; ++i) {
+        if(!strcmp(argv[i], "--perf")) {
+            options.perf = TRUE;
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+
+    argc = kept;
+
+    if(argc == 4 && !strcmp(argv[1], "--compile")) {
+        Perf* perf = options.perf ? Perf_new() : 0;
+        return finish_perf(perf, compile_library(argv[2], argv[3], perf));
+    }
+
+    if((argc == 3 || argc == 4) && !strcmp(argv[1], "--run")) {
+        Perf* perf = options.perf ? Perf_new() : 0;
+        int   rc   = run_program(argv[2], argc == 4 ? argv[3] : 0, perf);
+
+        return finish_perf(perf, rc);
+    }
+
+    if(argc == 4 && !strcmp(argv[1], "--emit-c")) {
+        return emit_function(argv[2], argv[3]);
+    }
+
+    for(int i = 1; i < argc; ++i) {
+        if(!strcmp(argv[i], "--batch") && i + 1 < argc) {
+            batch_path = argv[++i];
+        } else if(!strcmp(argv[i], "--serve") && i + 1 < argc) {
+            serve_at = argv[++i];
+        } else if(!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            options.threads = strtoul(argv[++i], 0, 10);
+        } else if(!strcmp(argv[i], "--window") && i + 1 < argc) {
+            options.window = strtoul(argv[++i], 0, 10);
+        } else if(!strcmp(argv[i], "--max-steps") && i + 1 < argc) {
+            options.max_steps = strtoull(argv[++i], 0, 10);
+        } else if(!strcmp(argv[i], "--max-ms") && i + 1 < argc) {
+            options.max_ns = strtoull(argv[++i], 0, 10) * 1000000ull;
+        } else if(!strcmp(argv[i], "--latency")) {
+            options.latency = TRUE;
+        } else if(!strcmp(argv[i], "--dedup")) {
+            options.dedup = TRUE;
+        } else if(!strcmp(argv[i], "--skip-errors")) {
+            options.skip_errors = TRUE;
+        } else if(!strcmp(argv[i], "--split")) {
+            options.split = TRUE;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if(batch_path) {
+        BatchStats stats = {0};
+
+        if(options.latency)
+            stats.latency = LatencyStats_new();
+
+        int rc = Batch_runFile(batch_path, stdout, &options, &stats);
+
+        BatchStats_print(&stats, stderr);
+
+        if(stats.latency) {
+            LatencyStats_print(stats.latency, stderr);
+            xfree(stats.latency);
+        }
+
+        if(options.perf) {
+            fprintf(stderr, "\n");
+            PerfTotals_print(&stats.perf, stderr);
+        }
+
+        return rc;
+    }
+
+    if(serve_at) {
+        ServerOptions server_options = {.threads = options.threads,
+                                        .batch   = options};
+
+        return Server_run(serve_at, &server_options);
+    }
+
     // test_stack();
 
-    // for(int i=0;i<100000000;++i) {
-    //     test_tokenizer("1+1+1");
-    //     test_tokenizer("1+1+1");
-    //     test_tokenizer("0x10230");
-    //     test_tokenizer("0x20f");
-    //     test_tokenizer("0xz012");
-    //     test_tokenizer("1*2+func(213)/0b123");
-    //     test_tokenizer("10");
-    //     test_tokenizer("10");
-    //     test_tokenizer("10");
-    //     test_tokenizer("213");
-    //     test_tokenizer("1232^123");
-    //     test_tokenizer("19");
-    //     test_tokenizer("");
-    //     test_tokenizer("");
-    //     test_tokenizer("");
-    //     test_tokenizer("         ");
-    //     test_tokenizer("");
-    // }
+    Resubmit* resubmit  = Resubmit_new();
+    Sft*      sft       = Sft_new();
+    Vars*     vars      = Vars_new();
+    Split*    split     = options.split ? Split_new(options.threads, 0) : 0;
+    Perf*     perf      = options.perf ? Perf_new() : 0;
+    int       precision = -1;
+
+    // Always kept, for !stats; a few clock reads are nothing interactively.
+    LatencyStats* latency = LatencyStats_new();
+
+    Sft_setResolver(sft, Vars_resolve, vars);
 
     while(TRUE) {
         char* expr = read_input("Enter Expression: ");
-        test_sft(expr);
+
+        if(!expr) {
+            break;
+        }
+
+        if(expr[0] == '!') {
+            run_command(expr + 1, &precision, sft, vars, latency, resubmit);
+            xfree(expr);
+            continue;
+        }
+
+        const char* name;
+        const char* formula;
+        size_t      name_len, formula_len;
+
+        if(Vars_splitAssignment(
+               expr, strlen(expr), &name, &name_len, &formula, &formula_len)) {
+            assign_variable(
+                vars, name, name_len, formula, formula_len, precision);
+        } else {
+            test_sft(resubmit, sft, split, perf, latency, expr, precision);
+        }
+
+        xfree(expr);
     }
+
+    if(options.latency)
+        LatencyStats_print(latency, stderr);
+
+    xfree(latency);
+    Split_free(split);
+    Vars_free(vars);
+    Sft_free(sft);
+    Resubmit_free(resubmit);
+    return finish_perf(perf, 0);
 }
@@ -0,0 +1,105 @@
+#include "memo.h"
+
+// The doubling below stops at MEMO_MAX_SLOTS, and the size of that many
+// entries fits in a size_t.
+_Static_assert((MEMO_MAX_SLOTS & (MEMO_MAX_SLOTS - 1)) == 0, "power of two");
+_Static_assert(MEMO_MAX_SLOTS <= SIZE_MAX / sizeof(MemoEntry), "table size");
+
+FunctionMemo* FunctionMemo_new(size_t slots) {
+    size_t capacity = 1;
+
+    if(slots > MEMO_MAX_SLOTS)
+        slots = MEMO_MAX_SLOTS;
+
+    while(capacity < slots)
+        capacity *= 2;
+
+    FunctionMemo* memo = xmalloc(sizeof(FunctionMemo));
+    memo->entries      = xmalloc(capacity * sizeof(MemoEntry));
+    memo->mask         = capacity - 1;
+
+    FunctionMemo_clear(memo);
+    return memo;
+}
+
+void FunctionMemo_free(FunctionMemo* memo) {
+    if(memo) {
+        xfree(memo->entries);
+        xfree(memo);
+    }
+}
+
+size_t FunctionMemo_slots(const FunctionMemo* memo) {
+    return memo->mask + 1;
+}
+
+// Mixes the bits of every argument, finishing with the avalanche step of
+// splitmix64 so that the low bits used as the slot index depend on all of
+// them.
+static uint64_t hash_args(const double* args, size_t argc) {
+    uint64_t hash = argc * 0x9e3779b97f4a7c15ull;
+
+    for(size_t i = 0; i < argc; ++i) {
+        uint64_t bits;
+        memcpy(&bits, &args[i], sizeof(bits));
+
+        hash = (hash ^ bits) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebull;
+    hash ^= hash >> 31;
+
+    return hash;
+}
+
+BOOL FunctionMemo_lookup(FunctionMemo* memo,
+                         const double* args,
+                         size_t        argc,
+                         uint64_t*     hash,
+                         double*       result) {
+    if(!argc || argc > MEMO_MAX_ARGS) {
+        *hash = 0;
+        memo->misses += 1;
+        return FALSE;
+    }
+
+    *hash = hash_args(args, argc);
+
+    MemoEntry* entry = &memo->entries[*hash & memo->mask];
+
+    if(entry->hash == *hash && entry->argc == argc &&
+       !memcmp(entry->args, args, argc * sizeof(double))) {
+        memo->hits += 1;
+        *result = entry->result;
+        return TRUE;
+    }
+
+    memo->misses += 1;
+    return FALSE;
+}
+
+void FunctionMemo_store(FunctionMemo* memo,
+                        uint64_t      hash,
+                        const double* args,
+                        size_t        argc,
+                        double        result) {
+    if(!argc || argc > MEMO_MAX_ARGS)
+        return;
+
+    MemoEntry* entry = &memo->entries[hash & memo->mask];
+
+    entry->hash   = hash;
+    entry->argc   = argc;
+    entry->result = result;
+    memcpy(entry->args, args, argc * sizeof(double));
+}
+
+void FunctionMemo_clear(FunctionMemo* memo) {
+    memset(memo->entries, 0, (memo->mask + 1) * sizeof(MemoEntry));
+    memo->hits   = 0;
+    memo->misses = 0;
+}
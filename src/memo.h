@@ -0,0 +1,64 @@
+#ifndef _H_MEMO_
+#define _H_MEMO_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+// Remembered results of one pure function, keyed on its argument vector. The
+// table has a fixed number of slots and each argument vector can only live in
+// the one its hash selects, so a lookup is a single probe and a new result
+// simply replaces whatever was in its slot.
+//
+// Arguments are compared bit for bit: 0 and -0 are different keys, and a NaN
+// matches a NaN with the same payload. Calls with more than MEMO_MAX_ARGS
+// arguments are never remembered.
+
+#define MEMO_MAX_ARGS 8
+
+// Most slots a table has, some 22 MiB of them; asking for more gets these.
+#define MEMO_MAX_SLOTS ((size_t)1 << 18)
+
+typedef struct MemoEntry {
+    uint64_t hash;
+    size_t   argc; // 0 for an empty slot.
+    double   args[MEMO_MAX_ARGS];
+    double   result;
+} MemoEntry;
+
+typedef struct FunctionMemo {
+    MemoEntry* entries;
+    size_t     mask;
+
+    // Lookups that found the result, and those that didn't, including the
+    // ones with too many arguments to be remembered.
+    uint64_t hits;
+    uint64_t misses;
+} FunctionMemo;
+
+// Makes a table of at least `slots` slots, rounded up to a power of two, but
+// no more than MEMO_MAX_SLOTS.
+extern FunctionMemo* FunctionMemo_new(size_t slots);
+extern void          FunctionMemo_free(FunctionMemo* memo);
+
+extern size_t FunctionMemo_slots(const FunctionMemo* memo);
+
+// Looks the arguments up, and on a hit writes the remembered result. Either
+// way, writes the hash to pass to FunctionMemo_store after a miss.
+extern BOOL FunctionMemo_lookup(FunctionMemo* memo,
+                                const double* args,
+                                size_t        argc,
+                                uint64_t*     hash,
+                                double*       result);
+
+extern void FunctionMemo_store(FunctionMemo* memo,
+                               uint64_t      hash,
+                               const double* args,
+                               size_t        argc,
+                               double        result);
+
+// Forgets every result and zeroes the counters.
+extern void FunctionMemo_clear(FunctionMemo* memo);
+
+#endif // _H_MEMO_
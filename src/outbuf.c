@@ -0,0 +1,93 @@
+#include "outbuf.h"
+
+#include "dtoa.h"
+
+OutBuf* OutBuf_new(FILE* stream, size_t capacity) {
+    OutBuf* out = xmalloc(sizeof(OutBuf));
+    memset(out, 0, sizeof(OutBuf));
+
+    out->capacity = capacity ? capacity : OUTBUF_DEFAULT_CAPACITY;
+    out->data     = xmalloc(out->capacity);
+    out->stream   = stream;
+
+    return out;
+}
+
+void OutBuf_free(OutBuf* out) {
+    if(out) {
+        OutBuf_flush(out);
+        xfree(out->data);
+        xfree(out);
+    }
+}
+
+void OutBuf_flush(OutBuf* out) {
+    if(!out->stream || !out->len)
+        return;
+
+    if(!out->failed && fwrite(out->data, 1, out->len, out->stream) != out->len)
+        out->failed = TRUE;
+
+    out->len = 0;
+}
+
+void OutBuf_clear(OutBuf* out) {
+    out->len = 0;
+}
+
+char* OutBuf_reserve(OutBuf* out, size_t size) {
+    if(out->len + size > out->capacity) {
+        OutBuf_flush(out);
+
+        // Still too small, either in memory or for one oversized write.
+        if(out->len + size > out->capacity) {
+            while(out->len + size > out->capacity) {
+                out->capacity *= 2;
+            }
+
+            out->data = xrealloc(out->data, out->capacity);
+        }
+    }
+
+    return out->data + out->len;
+}
+
+void OutBuf_commit(OutBuf* out, size_t size) {
+    out->len += size;
+}
+
+void OutBuf_write(OutBuf* out, const char* data, size_t len) {
+    memcpy(OutBuf_reserve(out, len), data, len);
+    OutBuf_commit(out, len);
+}
+
+void OutBuf_puts(OutBuf* out, const char* str) {
+    OutBuf_write(out, str, strlen(str));
+}
+
+void OutBuf_char(OutBuf* out, char c) {
+    *OutBuf_reserve(out, 1) = c;
+    OutBuf_commit(out, 1);
+}
+
+void OutBuf_size(OutBuf* out, size_t value) {
+    char   digits[24];
+    size_t len = 0;
+
+    do {
+        digits[sizeof(digits) - ++len] = (char)('0' + value % 10);
+        value /= 10;
+    } while(value);
+
+    OutBuf_write(out, digits + sizeof(digits) - len, len);
+}
+
+void OutBuf_double(OutBuf* out, double value) {
+    char* dest = OutBuf_reserve(out, DTOA_SHORTEST_SIZE);
+    OutBuf_commit(out, dtoa_shortest(value, dest));
+}
+
+void OutBuf_fixed(OutBuf* out, double value, int precision) {
+    char* dest = OutBuf_reserve(out, DTOA_FIXED_SIZE(precision));
+    OutBuf_commit(out, dtoa_fixed(value, precision, dest));
+}
@@ -0,0 +1,53 @@
+#ifndef _H_OUTBUF_
+#define _H_OUTBUF_
+
+#include <stdio.h>
+
+#include "common.h"
+
+// Output buffer for batch results. Writes are gathered into one large block
+// and handed to the stream with a single fwrite whenever it fills up, instead
+// of going through stdio formatting per result.
+//
+// Without a stream the buffer simply grows, which is how results are
+// collected in memory to be written out later.
+
+#define OUTBUF_DEFAULT_CAPACITY (1 << 20)
+
+typedef struct OutBuf {
+    char*  data;
+    size_t len;
+    size_t capacity;
+    FILE*  stream; // Null for an in-memory buffer.
+    BOOL   failed; // Set once a write to the stream fails.
+} OutBuf;
+
+// 0 means OUTBUF_DEFAULT_CAPACITY.
+extern OutBuf* OutBuf_new(FILE* stream, size_t capacity);
+extern void    OutBuf_free(OutBuf* out);
+
+// Returns a pointer to at least `size` writable bytes at the end of the
+// buffer, flushing or growing it first if needed. Follow with OutBuf_commit
+// for the number of bytes actually written.
+extern char* OutBuf_reserve(OutBuf* out, size_t size);
+extern void  OutBuf_commit(OutBuf* out, size_t size);
+
+extern void OutBuf_write(OutBuf* out, const char* data, size_t len);
+extern void OutBuf_puts(OutBuf* out, const char* str);
+extern void OutBuf_char(OutBuf* out, char c);
+extern void OutBuf_size(OutBuf* out, size_t value);
+
+// Writes the number in its shortest form that reads back as the same
+// double, see dtoa_shortest.
+extern void OutBuf_double(OutBuf* out, double value);
+
+// Writes the number with a fixed number of decimals, see dtoa_fixed.
+extern void OutBuf_fixed(OutBuf* out, double value, int precision);
+
+// Writes out everything buffered so far. Does nothing without a stream.
+extern void OutBuf_flush(OutBuf* out);
+
+// Empties the buffer without writing it anywhere.
+extern void OutBuf_clear(OutBuf* out);
+
+#endif // _H_OUTBUF_
@@ -0,0 +1,253 @@
+#include "perf.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+#endif
+
+static const char* PERF_PHASE_NAMES[PERF_PHASE_COUNT] = {
+    [PERF_TOKENIZE] = "tokenize",
+    [PERF_COMPILE]  = "compile",
+    [PERF_EVALUATE] = "evaluate",
+};
+
+#ifdef __linux__
+
+static const uint64_t PERF_CONFIGS[PERF_COUNTER_COUNT] = {
+    [PERF_CYCLES]        = PERF_COUNT_HW_CPU_CYCLES,
+    [PERF_INSTRUCTIONS]  = PERF_COUNT_HW_INSTRUCTIONS,
+    [PERF_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+    [PERF_CACHE_MISSES]  = PERF_COUNT_HW_CACHE_MISSES,
+};
+
+// Opens the counter for the calling thread, in user space only, as a member
+// of the group, or as its leader if group is -1. Returns -1 and sets errno if
+// it can't.
+static int Perf_open(PerfCounter counter, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = PERF_CONFIGS[counter];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+#else
+
+static int Perf_open(PerfCounter counter, int group) {
+    (void)counter;
+    (void)group;
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
+
+Perf* Perf_new(void) {
+    Perf* perf = xmalloc(sizeof(Perf));
+    memset(perf, 0, sizeof(Perf));
+
+    perf->group = -1;
+
+    for(int k = 0; k < PERF_COUNTER_COUNT; ++k) {
+        int fd = Perf_open((PerfCounter)k, perf->group);
+
+        if(fd < 0) {
+            perf->totals.missing |= 1u << k;
+
+            if(!perf->totals.error)
+                perf->totals.error = errno;
+            continue;
+        }
+
+        if(perf->group < 0)
+            perf->group = fd;
+
+        perf->fds[perf->count]   = fd;
+        perf->order[perf->count] = (PerfCounter)k;
+        perf->count += 1;
+    }
+
+    return perf;
+}
+
+void Perf_free(Perf* perf) {
+    if(!perf)
+        return;
+
+    for(size_t i = 0; i < perf->count; ++i) {
+        close(perf->fds[i]);
+    }
+
+    xfree(perf);
+}
+
+// Reads time enabled, time running and the counters, in the order they were
+// opened, into values. Leaves zeros if there are none or the read fails.
+static void Perf_read(Perf* perf, uint64_t* values) {
+    uint64_t buffer[3 + PERF_COUNTER_COUNT];
+
+    memset(values, 0, (2 + PERF_COUNTER_COUNT) * sizeof(uint64_t));
+
+    if(perf->group < 0 ||
+       read(perf->group, buffer, sizeof(buffer)) < (ssize_t)(3 * sizeof(uint64_t)))
+        return;
+
+    // buffer[0] is the number of counters that follow.
+    memcpy(values, buffer + 1, (2 + perf->count) * sizeof(uint64_t));
+}
+
+void Perf_begin(Perf* perf, PerfPhase phase) {
+    if(!perf)
+        return;
+
+    perf->phase    = phase;
+    perf->start_ns = monotonic_ns();
+    Perf_read(perf, perf->start);
+}
+
+void Perf_end(Perf* perf) {
+    if(!perf)
+        return;
+
+    uint64_t    now[2 + PERF_COUNTER_COUNT];
+    PerfTotals* totals = &perf->totals;
+    PerfPhase   phase  = perf->phase;
+
+    Perf_read(perf, now);
+
+    totals->calls[phase] += 1;
+    totals->ns[phase] += monotonic_ns() - perf->start_ns;
+    totals->enabled[phase] += now[0] - perf->start[0];
+    totals->running[phase] += now[1] - perf->start[1];
+
+    for(size_t i = 0; i < perf->count; ++i) {
+        totals->counts[phase][perf->order[i]] += now[2 + i] - perf->start[2 + i];
+    }
+}
+
+void PerfTotals_add(PerfTotals* into, const PerfTotals* from) {
+    for(int p = 0; p < PERF_PHASE_COUNT; ++p) {
+        into->calls[p] += from->calls[p];
+        into->ns[p] += from->ns[p];
+        into->enabled[p] += from->enabled[p];
+        into->running[p] += from->running[p];
+
+        for(int k = 0; k < PERF_COUNTER_COUNT; ++k) {
+            into->counts[p][k] += from->counts[p][k];
+        }
+    }
+
+    into->missing |= from->missing;
+
+    if(!into->error)
+        into->error = from->error;
+}
+
+// Why the counters are missing, with what to do about it where there is
+// something.
+static void PerfTotals_printError(const PerfTotals* totals, FILE* stream) {
+    int error = totals->error;
+
+    if(error == EACCES || error == EPERM) {
+        FILE* file     = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        int   paranoid = 0;
+
+        if(file && fscanf(file, "%d", &paranoid) == 1) {
+            fprintf(stream,
+                    "hardware counters not permitted: "
+                    "kernel.perf_event_paranoid is %d, 2 or below allows "
+                    "them\n",
+                    paranoid);
+        } else {
+            fprintf(stream, "hardware counters not permitted\n");
+        }
+
+        if(file)
+            fclose(file);
+    } else if(error == ENOENT || error == EOPNOTSUPP) {
+        fprintf(stream,
+                "hardware counters not supported here, e.g. in a virtual "
+                "machine without a PMU\n");
+    } else {
+        fprintf(stream, "hardware counters unavailable: %s\n", strerror(error));
+    }
+}
+
+void PerfTotals_print(const PerfTotals* totals, FILE* stream) {
+    static const char* const COUNTER_HEADERS[PERF_COUNTER_COUNT] = {
+        [PERF_CYCLES]        = "cycles/call",
+        [PERF_INSTRUCTIONS]  = "instrs/call",
+        [PERF_BRANCH_MISSES] = "br-misses/call",
+        [PERF_CACHE_MISSES]  = "llc-misses/call",
+    };
+
+    BOOL scaled = FALSE;
+
+    fprintf(stream, "%-9s %10s %9s %9s", "phase", "calls", "time", "ns/call");
+
+    for(int k = 0; k < PERF_COUNTER_COUNT; ++k) {
+        fprintf(stream, " %15s", COUNTER_HEADERS[k]);
+    }
+
+    fprintf(stream, " %5s\n", "IPC");
+
+    for(int p = 0; p < PERF_PHASE_COUNT; ++p) {
+        uint64_t calls = totals->calls[p];
+
+        if(!calls)
+            continue;
+
+        double scale = 1;
+
+        if(totals->running[p] && totals->running[p] < totals->enabled[p]) {
+            scale  = (double)totals->enabled[p] / (double)totals->running[p];
+            scaled = TRUE;
+        }
+
+        fprintf(stream,
+                "%-9s %10llu %8.3fs %9.1f",
+                PERF_PHASE_NAMES[p],
+                (unsigned long long)calls,
+                (double)totals->ns[p] / 1e9,
+                (double)totals->ns[p] / (double)calls);
+
+        for(int k = 0; k < PERF_COUNTER_COUNT; ++k) {
+            if(totals->missing >> k & 1) {
+                fprintf(stream, " %15s", "-");
+            } else {
+                fprintf(stream,
+                        " %15.2f",
+                        (double)totals->counts[p][k] * scale / (double)calls);
+            }
+        }
+
+        uint64_t cycles       = totals->counts[p][PERF_CYCLES];
+        uint64_t instructions = totals->counts[p][PERF_INSTRUCTIONS];
+
+        if(totals->missing & (1u << PERF_CYCLES | 1u << PERF_INSTRUCTIONS) ||
+           !cycles) {
+            fprintf(stream, " %5s\n", "-");
+        } else {
+            fprintf(stream, " %5.2f\n", (double)instructions / (double)cycles);
+        }
+    }
+
+    if(scaled) {
+        fprintf(stream,
+                "counters shared the PMU with other events and were scaled "
+                "up to the time they were enabled\n");
+    }
+
+    if(totals->missing)
+        PerfTotals_printError(totals, stream);
+}
@@ -0,0 +1,79 @@
+#ifndef _H_PERF_
+#define _H_PERF_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+
+// Hardware event counts per phase of the work: tokenizing, compiling
+// formulas into programs and evaluating, to tell which of them got slower,
+// and whether it is down to more instructions, fewer per cycle, branch
+// misses or cache misses. Counting is opt in (`seqft --perf`): every phase
+// boundary reads the counters with one read() syscall.
+//
+// Counters come from perf_event_open(2), for the calling thread and in user
+// space only, which an unprivileged process may count while
+// kernel.perf_event_paranoid is 2 or below. Counters that can't be opened,
+// because of that setting, a virtual machine without a PMU, or a kernel
+// without perf events, are left out; calls and wall time are counted
+// regardless, and the summary says why the rest is missing.
+
+typedef enum PerfPhase {
+    PERF_TOKENIZE,
+    PERF_COMPILE,
+    PERF_EVALUATE,
+    PERF_PHASE_COUNT,
+} PerfPhase;
+
+typedef enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_CACHE_MISSES, // Last level cache.
+    PERF_COUNTER_COUNT,
+} PerfCounter;
+
+// What one or more threads counted. Counts are raw; where the kernel had to
+// share the PMU with other events, enabled > running, and they are scaled by
+// enabled / running when printed. Zeroed is empty.
+typedef struct PerfTotals {
+    uint64_t calls[PERF_PHASE_COUNT];
+    uint64_t ns[PERF_PHASE_COUNT];
+    uint64_t counts[PERF_PHASE_COUNT][PERF_COUNTER_COUNT];
+    uint64_t enabled[PERF_PHASE_COUNT];
+    uint64_t running[PERF_PHASE_COUNT];
+    uint32_t missing; // Bit per PerfCounter some thread couldn't count.
+    int      error;   // errno of a counter that couldn't be opened, or 0.
+} PerfTotals;
+
+// The counters of one thread, in one group so that a single read() gets
+// them all.
+typedef struct Perf {
+    int         group; // Leader, -1 if no counter could be opened.
+    int         fds[PERF_COUNTER_COUNT];
+    PerfCounter order[PERF_COUNTER_COUNT]; // Counter of each value read.
+    size_t      count;
+    PerfPhase   phase;
+    uint64_t    start_ns;
+    uint64_t    start[PERF_COUNTER_COUNT + 2]; // enabled, running, values
+    PerfTotals  totals;
+} Perf;
+
+// Opens the counters for the calling thread, which must be the only one to
+// use the Perf.
+extern Perf* Perf_new(void);
+extern void  Perf_free(Perf* perf);
+
+// Brackets one phase; phases don't nest. Both do nothing on a null Perf, so
+// callers can pass one along whether counting is on or not.
+extern void Perf_begin(Perf* perf, PerfPhase phase);
+extern void Perf_end(Perf* perf);
+
+// Adds the counts of from, from another thread or run, to into.
+extern void PerfTotals_add(PerfTotals* into, const PerfTotals* from);
+
+// Prints a table with one row per phase that ran.
+extern void PerfTotals_print(const PerfTotals* totals, FILE* stream);
+
+#endif // _H_PERF_
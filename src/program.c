@@ -0,0 +1,431 @@
+#include "program.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Token type of every op that isn't decoded from its operand.
+static const TokenType OP_TYPES[OP_COUNT] = {
+    [OP_ADD] = TT_ADD,
+    [OP_SUB] = TT_SUB,
+    [OP_DIV] = TT_DIV,
+    [OP_MOD] = TT_MOD,
+    [OP_MUL] = TT_MUL,
+    [OP_POW] = TT_POW,
+    [OP_NEG] = TT_NEG,
+    [OP_COM] = TT_COM,
+    [OP_OPA] = TT_OPA,
+    [OP_CPA] = TT_CPA,
+    [OP_LT]  = TT_LT,
+    [OP_LE]  = TT_LE,
+    [OP_GT]  = TT_GT,
+    [OP_GE]  = TT_GE,
+    [OP_EQ]  = TT_EQ,
+    [OP_NE]  = TT_NE,
+    [OP_AND] = TT_AND,
+    [OP_OR]  = TT_OR,
+};
+
+ProgramWriter* ProgramWriter_new(void) {
+    ProgramWriter* writer = xmalloc(sizeof(ProgramWriter));
+
+    writer->constants    = Stack_new(sizeof(double));
+    writer->formulas     = Stack_new(sizeof(ProgramFormula));
+    writer->code         = Stack_new(sizeof(ProgramInstruction));
+    writer->strings      = Stack_new(sizeof(char));
+    writer->constant_ids = HashMap_new();
+    writer->string_ids   = HashMap_new();
+
+    return writer;
+}
+
+void ProgramWriter_free(ProgramWriter* writer) {
+    if(!writer)
+        return;
+
+    Stack_free(writer->constants);
+    Stack_free(writer->formulas);
+    Stack_free(writer->code);
+    Stack_free(writer->strings);
+    HashMap_free(writer->constant_ids);
+    HashMap_free(writer->string_ids);
+    xfree(writer);
+}
+
+// Returns the offset of the string in the string table, adding it once.
+static size_t ProgramWriter_string(ProgramWriter* writer, const char* string) {
+    size_t len    = strlen(string);
+    size_t offset = Stack_getCount(writer->strings);
+
+    if(HashMap_get(writer->string_ids, string, len, &offset))
+        return offset;
+
+    for(size_t i = 0; i <= len; ++i) {
+        Stack_pushFrom(writer->strings, (void*)&string[i]);
+    }
+
+    HashMap_put(writer->string_ids, string, len, offset);
+    return offset;
+}
+
+// Returns the index of the constant in the pool, adding it once. Constants
+// are told apart by their bits, which keeps 0 and -0 apart.
+static size_t ProgramWriter_constant(ProgramWriter* writer, double value) {
+    char   key[sizeof(double)];
+    size_t index = Stack_getCount(writer->constants);
+
+    memcpy(key, &value, sizeof(double));
+
+    if(HashMap_get(writer->constant_ids, key, sizeof(key), &index))
+        return index;
+
+    Stack_pushFrom(writer->constants, &value);
+    HashMap_put(writer->constant_ids, key, sizeof(key), index);
+    return index;
+}
+
+BOOL ProgramWriter_add(ProgramWriter*    writer,
+                       const char*       name,
+                       const TokenArray* tokens) {
+    if(tokens->count > UINT32_MAX)
+        return FALSE;
+
+    ProgramFormula formula = {.count = (uint32_t)tokens->count,
+                              .first = Stack_getCount(writer->code)};
+
+    for(size_t i = 0; i < tokens->count; ++i) {
+        const Token* token   = &tokens->tokens[i];
+        ProgramOp    op      = OP_COUNT;
+        size_t       operand = 0;
+        double       value   = token->f64;
+
+        switch(token->type) {
+            case TT_NUM:
+                if(value >= PROGRAM_MIN_INT && value <= PROGRAM_MAX_INT &&
+                   value == (int32_t)value && !(value == 0 && signbit(value))) {
+                    op      = OP_INT;
+                    operand = (uint32_t)(int32_t)value & PROGRAM_MAX_OPERAND;
+                } else {
+                    op      = OP_NUM;
+                    operand = ProgramWriter_constant(writer, value);
+                }
+                break;
+            case TT_VAR:
+                op      = OP_VAR;
+                operand = ProgramWriter_string(writer, token->func);
+                break;
+            case TT_OPA:
+                op = token->func ? OP_CALL : OP_OPA;
+
+                if(token->func)
+                    operand = ProgramWriter_string(writer, token->func);
+                break;
+            default:
+                for(int k = OP_ADD; k < OP_COUNT; ++k) {
+                    if(OP_TYPES[k] == token->type)
+                        op = (ProgramOp)k;
+                }
+
+                if(token->type & TT_JMP)
+                    operand = token->depth;
+                break;
+        }
+
+        if(op == OP_COUNT || operand > PROGRAM_MAX_OPERAND) {
+            Stack_truncate(writer->code, formula.first);
+            return FALSE;
+        }
+
+        ProgramInstruction instruction =
+            (uint32_t)op | (uint32_t)operand << PROGRAM_OP_BITS;
+        Stack_pushFrom(writer->code, &instruction);
+    }
+
+    size_t name_offset = ProgramWriter_string(writer, name);
+
+    if(name_offset > UINT32_MAX ||
+       Stack_getCount(writer->formulas) >= UINT32_MAX) {
+        Stack_truncate(writer->code, formula.first);
+        return FALSE;
+    }
+
+    formula.name = (uint32_t)name_offset;
+    Stack_pushFrom(writer->formulas, &formula);
+
+    return TRUE;
+}
+
+typedef struct NamedFormula {
+    const char*    name;
+    ProgramFormula formula;
+} NamedFormula;
+
+static int NamedFormula_compare(const void* a, const void* b) {
+    return strcmp(((const NamedFormula*)a)->name, ((const NamedFormula*)b)->name);
+}
+
+int ProgramWriter_write(ProgramWriter* writer, FILE* stream) {
+    size_t      formula_count = Stack_getCount(writer->formulas);
+    const char* strings       = Stack_getBase(writer->strings);
+
+    ProgramHeader header = {
+        .magic             = PROGRAM_MAGIC,
+        .version           = PROGRAM_VERSION,
+        .byte_order        = PROGRAM_BYTE_ORDER,
+        .formula_count     = (uint32_t)formula_count,
+        .constant_count    = Stack_getCount(writer->constants),
+        .instruction_count = Stack_getCount(writer->code),
+        .string_bytes      = Stack_getCount(writer->strings),
+    };
+
+    // Sorted by name for Program_find.
+    NamedFormula* sorted = xmalloc((formula_count + 1) * sizeof(NamedFormula));
+
+    for(size_t i = 0; i < formula_count; ++i) {
+        ProgramFormula* formula = Stack_itemAt(writer->formulas, i);
+
+        sorted[i].name    = strings + formula->name;
+        sorted[i].formula = *formula;
+    }
+
+    qsort(sorted, formula_count, sizeof(NamedFormula), NamedFormula_compare);
+
+    int failed = fwrite(&header, sizeof(header), 1, stream) != 1;
+
+    if(!failed && header.constant_count) {
+        failed = fwrite(Stack_getBase(writer->constants),
+                        sizeof(double),
+                        header.constant_count,
+                        stream) != header.constant_count;
+    }
+
+    for(size_t i = 0; i < formula_count && !failed; ++i) {
+        failed = fwrite(&sorted[i].formula, sizeof(ProgramFormula), 1, stream) != 1;
+    }
+
+    if(!failed && header.instruction_count) {
+        failed = fwrite(Stack_getBase(writer->code),
+                        sizeof(ProgramInstruction),
+                        header.instruction_count,
+                        stream) != header.instruction_count;
+    }
+
+    if(!failed && header.string_bytes) {
+        failed = fwrite(strings, 1, header.string_bytes, stream) !=
+                 header.string_bytes;
+    }
+
+    xfree(sorted);
+
+    return failed || fflush(stream) ? -1 : 0;
+}
+
+// Checks everything a lookup relies on: the sizes of the sections against
+// the size of the file, the string table being terminated, and every formula
+// being inside of the code. Instructions are checked as they are evaluated.
+static const char* Program_check(Program* program) {
+    const ProgramHeader* header = program->header;
+
+    if(header->magic != PROGRAM_MAGIC)
+        return "Not a compiled program.";
+
+    if(header->byte_order != PROGRAM_BYTE_ORDER)
+        return "Program compiled on a machine of another byte order.";
+
+    if(header->version != PROGRAM_VERSION)
+        return "Program compiled for another version of the format.";
+
+    uint64_t left = program->size - sizeof(ProgramHeader);
+
+    if(header->constant_count > left / sizeof(double))
+        return "Truncated program.";
+
+    left -= header->constant_count * sizeof(double);
+
+    if(header->formula_count > left / sizeof(ProgramFormula))
+        return "Truncated program.";
+
+    left -= header->formula_count * sizeof(ProgramFormula);
+
+    if(header->instruction_count > left / sizeof(ProgramInstruction))
+        return "Truncated program.";
+
+    left -= header->instruction_count * sizeof(ProgramInstruction);
+
+    if(header->string_bytes != left)
+        return "Truncated program.";
+
+    const char* base = program->base;
+
+    program->constants = (const double*)(base + sizeof(ProgramHeader));
+    program->formulas =
+        (const ProgramFormula*)(program->constants + header->constant_count);
+    program->code =
+        (const ProgramInstruction*)(program->formulas + header->formula_count);
+    program->strings = (const char*)(program->code + header->instruction_count);
+
+    if(header->string_bytes && program->strings[header->string_bytes - 1])
+        return ErrCode_describe(ERR_CORRUPT_PROGRAM);
+
+    for(size_t i = 0; i < header->formula_count; ++i) {
+        const ProgramFormula* formula = &program->formulas[i];
+
+        if(formula->name >= header->string_bytes ||
+           formula->first > header->instruction_count ||
+           formula->count > header->instruction_count - formula->first)
+            return ErrCode_describe(ERR_CORRUPT_PROGRAM);
+    }
+
+    return 0;
+}
+
+Program* Program_open(const char* path, const char** reason) {
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0) {
+        *reason = strerror(errno);
+        return 0;
+    }
+
+    struct stat st;
+
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ProgramHeader)) {
+        *reason = "Not a compiled program.";
+        close(fd);
+        return 0;
+    }
+
+    void* base = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(base == MAP_FAILED) {
+        *reason = strerror(errno);
+        return 0;
+    }
+
+    Program* program = xmalloc(sizeof(Program));
+    memset(program, 0, sizeof(Program));
+
+    program->base   = base;
+    program->size   = (size_t)st.st_size;
+    program->header = base;
+
+    *reason = Program_check(program);
+
+    if(*reason) {
+        Program_close(program);
+        return 0;
+    }
+
+    return program;
+}
+
+void Program_close(Program* program) {
+    if(program) {
+        munmap(program->base, program->size);
+        xfree(program);
+    }
+}
+
+size_t Program_count(const Program* program) {
+    return program->header->formula_count;
+}
+
+const char* Program_name(const Program* program, size_t index) {
+    return program->strings + program->formulas[index].name;
+}
+
+BOOL Program_find(const Program* program, const char* name, size_t* index) {
+    size_t low  = 0;
+    size_t high = Program_count(program);
+
+    while(low < high) {
+        size_t middle = low + (high - low) / 2;
+        int    order  = strcmp(Program_name(program, middle), name);
+
+        if(!order) {
+            *index = middle;
+            return TRUE;
+        }
+
+        if(order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return FALSE;
+}
+
+ErrCode Program_eval(const Program* program,
+                     size_t         index,
+                     Sft*           sft,
+                     double*        result) {
+    const ProgramHeader*      header  = program->header;
+    const ProgramFormula*     formula = &program->formulas[index];
+    const ProgramInstruction* code    = program->code + formula->first;
+
+    Sft_reset(sft);
+
+    for(size_t i = 0; i < formula->count; ++i) {
+        uint32_t op      = code[i] & ((1u << PROGRAM_OP_BITS) - 1);
+        uint32_t operand = code[i] >> PROGRAM_OP_BITS;
+        Token    token   = {0};
+
+        switch(op) {
+            case OP_INT:
+                // Sign extended from the top bits.
+                token.type = TT_NUM;
+                token.f64  = (double)((int32_t)code[i] >> PROGRAM_OP_BITS);
+                break;
+            case OP_NUM:
+                if(operand >= header->constant_count)
+                    return ERR_CORRUPT_PROGRAM;
+
+                token.type = TT_NUM;
+                token.f64  = program->constants[operand];
+                break;
+            case OP_VAR:
+            case OP_CALL:
+                if(operand >= header->string_bytes)
+                    return ERR_CORRUPT_PROGRAM;
+
+                // Borrowed from the mapping; the Sft never frees token names.
+                token.type = op == OP_VAR ? TT_VAR : TT_OPA;
+                token.func = (char*)program->strings + operand;
+                break;
+            default:
+                if(op >= OP_COUNT)
+                    return ERR_CORRUPT_PROGRAM;
+
+                token.type = OP_TYPES[op];
+
+                // A jump goes forward, at most to the end of the formula.
+                if(token.type & TT_JMP) {
+                    if(operand && (operand <= i || operand > formula->count))
+                        return ERR_CORRUPT_PROGRAM;
+
+                    token.depth = operand;
+                }
+                break;
+        }
+
+        SftError* error = Sft_evalToken(sft, &token, i);
+
+        if(error)
+            return error->code;
+
+        if(sft->skip_to) {
+            i            = sft->skip_to - 1;
+            sft->skip_to = 0;
+        }
+    }
+
+    SftError* error = Sft_finish(sft, formula->count, result);
+
+    return error ? error->code : ERR_NONE;
+}
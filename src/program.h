@@ -0,0 +1,144 @@
+#ifndef _H_PROGRAM_
+#define _H_PROGRAM_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "evaluator.h"
+#include "hashmap.h"
+#include "stack.h"
+#include "tokenizer.h"
+
+// Compiled programs: a library of named formulas, tokenized once and written
+// to a file that later processes map into memory and evaluate in place. The
+// tokens of a formula are decoded one at a time as the Sft consumes them, so
+// opening a program costs a few checks on its header, and its pages are only
+// read once a formula in them is evaluated.
+//
+// A file is laid out as, in host byte order:
+//
+//     ProgramHeader
+//     double             constants[constant_count]
+//     ProgramFormula     formulas[formula_count]      sorted by name
+//     ProgramInstruction code[instruction_count]
+//     char               strings[string_bytes]        null terminated names
+//
+// Every token is one 32 bit instruction, and integers that fit in one are
+// stored in it rather than in the constants. The positions of the tokens are
+// not kept, so errors found evaluating a program have no column.
+//
+// Files written on a machine of the other byte order, or by another version
+// of the format, are rejected when opened.
+
+#define PROGRAM_MAGIC      0x47505153 // "SQPG"
+#define PROGRAM_VERSION    2
+#define PROGRAM_BYTE_ORDER 0x01020304
+
+typedef struct ProgramHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order; // PROGRAM_BYTE_ORDER as the writer saw it.
+    uint32_t formula_count;
+    uint64_t constant_count;
+    uint64_t instruction_count;
+    uint64_t string_bytes;
+} ProgramHeader;
+
+typedef struct ProgramFormula {
+    uint32_t name;  // Offset in the strings.
+    uint32_t count; // Instructions, starting at first.
+    uint64_t first;
+} ProgramFormula;
+
+// One per token.
+typedef enum {
+    OP_INT,  // Operand: the number itself, as a signed integer.
+    OP_NUM,  // Operand: index in the constants.
+    OP_VAR,  // Operand: offset of the name in the strings.
+    OP_CALL, // Function call paren. Operand: offset of the function's name.
+    OP_ADD,
+    OP_SUB,
+    OP_DIV,
+    OP_MOD,
+    OP_MUL,
+    OP_POW,
+    OP_NEG,
+    OP_COM, // Operand: the jump of an if() comma, see Token.
+    OP_OPA,
+    OP_CPA,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_EQ,
+    OP_NE,
+    OP_AND, // Operand: the jump, see Token.
+    OP_OR,  // Same.
+    OP_COUNT,
+} ProgramOp;
+
+// The ProgramOp in the low 5 bits, and the operand above them.
+typedef uint32_t ProgramInstruction;
+
+#define PROGRAM_OP_BITS     5
+#define PROGRAM_MAX_OPERAND (UINT32_MAX >> PROGRAM_OP_BITS)
+#define PROGRAM_MIN_INT     (-(1 << (31 - PROGRAM_OP_BITS)))
+#define PROGRAM_MAX_INT     ((1 << (31 - PROGRAM_OP_BITS)) - 1)
+
+// Collects formulas and writes them out as a program.
+typedef struct ProgramWriter {
+    Stack*   constants;    // double
+    Stack*   formulas;     // ProgramFormula
+    Stack*   code;         // ProgramInstruction
+    Stack*   strings;      // char
+    HashMap* constant_ids; // Bit pattern to index in constants.
+    HashMap* string_ids;   // Name to offset in strings.
+} ProgramWriter;
+
+extern ProgramWriter* ProgramWriter_new(void);
+extern void           ProgramWriter_free(ProgramWriter* writer);
+
+// Adds the formula under the name, which should be unique. Returns FALSE if
+// the program can't hold it.
+extern BOOL ProgramWriter_add(ProgramWriter*    writer,
+                              const char*       name,
+                              const TokenArray* tokens);
+
+// Returns non-zero if the stream couldn't be written.
+extern int ProgramWriter_write(ProgramWriter* writer, FILE* stream);
+
+// A program mapped into memory.
+typedef struct Program {
+    void*  base;
+    size_t size;
+
+    const ProgramHeader*      header;
+    const double*             constants;
+    const ProgramFormula*     formulas;
+    const ProgramInstruction* code;
+    const char*               strings;
+} Program;
+
+// Maps the file. Returns null and points reason at a static description if it
+// can't be read or isn't a program this build understands.
+extern Program* Program_open(const char* path, const char** reason);
+extern void     Program_close(Program* program);
+
+extern size_t      Program_count(const Program* program);
+extern const char* Program_name(const Program* program, size_t index);
+
+// Finds the formula of that name with a binary search. Returns FALSE if there
+// is none.
+extern BOOL Program_find(const Program* program, const char* name, size_t* index);
+
+// Evaluates the formula at index with the Sft. Returns ERR_NONE and writes
+// the result, ERR_CORRUPT_PROGRAM if its instructions point outside of the
+// file or jump outside of the formula, or the code of the Sft's error, left
+// in sft->error for the message.
+extern ErrCode Program_eval(const Program* program,
+                            size_t         index,
+                            Sft*           sft,
+                            double*        result);
+
+#endif // _H_PROGRAM_
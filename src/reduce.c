@@ -0,0 +1,177 @@
+#include "reduce.h"
+
+#include <float.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+    #define REDUCE_SSE2
+#endif
+
+// Every kernel walks four doubles per iteration in two independent two lane
+// accumulators, so that consecutive additions don't wait on each other.
+//
+// src/emit.c holds copies of these for the C it emits, which must be changed
+// along with them.
+
+double reduce_sum(const double* nums, size_t len) {
+    size_t i   = 0;
+    double sum = 0;
+
+#ifdef REDUCE_SSE2
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+
+    for(; i + 4 <= len; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_loadu_pd(nums + i));
+        acc1 = _mm_add_pd(acc1, _mm_loadu_pd(nums + i + 2));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    sum = lanes[0] + lanes[1];
+#else
+    double acc[4] = {0, 0, 0, 0};
+
+    for(; i + 4 <= len; i += 4) {
+        acc[0] += nums[i];
+        acc[1] += nums[i + 1];
+        acc[2] += nums[i + 2];
+        acc[3] += nums[i + 3];
+    }
+
+    sum = (acc[0] + acc[2]) + (acc[1] + acc[3]);
+#endif
+
+    for(; i < len; ++i) {
+        sum += nums[i];
+    }
+
+    return sum;
+}
+
+// Shared by min and max. NaNs are tracked separately since the SSE2 min/max
+// instructions silently return one of their operands when the other is NaN.
+static double reduce_extreme(const double* nums, size_t len, int want_max) {
+    if(!len)
+        return 0;
+
+    size_t i      = 0;
+    double result = nums[0];
+    int    nan    = 0;
+
+#ifdef REDUCE_SSE2
+    __m128d acc0  = _mm_set1_pd(nums[0]);
+    __m128d acc1  = acc0;
+    __m128d nans  = _mm_setzero_pd();
+
+    for(; i + 4 <= len; i += 4) {
+        __m128d v0 = _mm_loadu_pd(nums + i);
+        __m128d v1 = _mm_loadu_pd(nums + i + 2);
+
+        nans = _mm_or_pd(nans, _mm_cmpunord_pd(v0, v1));
+
+        if(want_max) {
+            acc0 = _mm_max_pd(acc0, v0);
+            acc1 = _mm_max_pd(acc1, v1);
+        } else {
+            acc0 = _mm_min_pd(acc0, v0);
+            acc1 = _mm_min_pd(acc1, v1);
+        }
+    }
+
+    double lanes[2];
+    acc0 = want_max ? _mm_max_pd(acc0, acc1) : _mm_min_pd(acc0, acc1);
+    _mm_storeu_pd(lanes, acc0);
+
+    nan    = _mm_movemask_pd(nans) != 0;
+    result = want_max ? fmax(lanes[0], lanes[1]) : fmin(lanes[0], lanes[1]);
+#endif
+
+    for(; i < len; ++i) {
+        double num = nums[i];
+
+        nan |= isnan(num);
+        result = want_max ? (num > result ? num : result)
+                          : (num < result ? num : result);
+    }
+
+    return nan ? NAN : result;
+}
+
+double reduce_min(const double* nums, size_t len) {
+    return reduce_extreme(nums, len, 0);
+}
+
+double reduce_max(const double* nums, size_t len) {
+    return reduce_extreme(nums, len, 1);
+}
+
+double reduce_hypot(const double* nums, size_t len) {
+    size_t i     = 0;
+    double scale = 0;
+    int    nan   = 0;
+
+    // First pass: the largest magnitude, which becomes the scale.
+    for(size_t j = 0; j < len; ++j) {
+        double mag = fabs(nums[j]);
+
+        nan |= isnan(mag);
+
+        if(mag > scale)
+            scale = mag;
+    }
+
+    if(isinf(scale))
+        return scale;
+
+    if(nan)
+        return NAN;
+
+    if(scale == 0)
+        return 0;
+
+    // A subnormal scale has no representable inverse. All elements are tiny
+    // then, so the slow path of dividing each one is fine.
+    if(scale < DBL_MIN) {
+        double sum = 0;
+
+        for(; i < len; ++i) {
+            double scaled = nums[i] / scale;
+            sum += scaled * scaled;
+        }
+
+        return scale * sqrt(sum);
+    }
+
+    // Scaling by a power of two is exact, so the only rounding is in the
+    // squares and their sum. Scaled elements fall within [0, 2).
+    int    exponent = ilogb(scale);
+    double factor   = ldexp(1.0, -exponent);
+    double sum      = 0;
+
+#ifdef REDUCE_SSE2
+    __m128d vfactor = _mm_set1_pd(factor);
+    __m128d acc0    = _mm_setzero_pd();
+    __m128d acc1    = _mm_setzero_pd();
+
+    for(; i + 4 <= len; i += 4) {
+        __m128d v0 = _mm_mul_pd(_mm_loadu_pd(nums + i), vfactor);
+        __m128d v1 = _mm_mul_pd(_mm_loadu_pd(nums + i + 2), vfactor);
+
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(v0, v0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(v1, v1));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    sum = lanes[0] + lanes[1];
+#endif
+
+    for(; i < len; ++i) {
+        double scaled = nums[i] * factor;
+        sum += scaled * scaled;
+    }
+
+    return ldexp(sqrt(sum), exponent);
+}
@@ -0,0 +1,24 @@
+#ifndef _H_REDUCE_
+#define _H_REDUCE_
+
+#include <stddef.h>
+
+// Reductions over a vector of doubles, used by the variadic builtins. These
+// process several lanes per instruction where SSE2 is available and fall back
+// to plain loops elsewhere. Lanes are combined at the end, so the order of
+// additions differs from a left to right loop and the last bits of a sum may
+// differ from one.
+//
+// All of them return NaN if any element is NaN, except that reduce_hypot
+// returns infinity if any element is infinite, like hypot() does. An empty
+// vector reduces to 0.
+
+extern double reduce_sum(const double* nums, size_t len);
+extern double reduce_min(const double* nums, size_t len);
+extern double reduce_max(const double* nums, size_t len);
+
+// sqrt(x0^2 + x1^2 + ...) without intermediate overflow or underflow, by
+// scaling every element by the largest magnitude first.
+extern double reduce_hypot(const double* nums, size_t len);
+
+#endif // _H_REDUCE_
@@ -0,0 +1,222 @@
+#include "resubmit.h"
+
+// A paren open while evaluating: the index of its group in found, the depth
+// of the number cellar before it, and whether it has read nothing that could
+// change its value from one expression to the next so far.
+typedef struct ResubmitFrame {
+    size_t found;
+    size_t depth;
+    BOOL   pure;
+} ResubmitFrame;
+
+Resubmit* Resubmit_new(void) {
+    Resubmit* r = xmalloc(sizeof(Resubmit));
+    memset(r, 0, sizeof(Resubmit));
+
+    r->t      = Tokenizer_new();
+    r->groups = Stack_new(sizeof(ResubmitGroup));
+    r->frames = Stack_new(sizeof(ResubmitFrame));
+    r->found  = Stack_new(sizeof(ResubmitGroup));
+
+    return r;
+}
+
+void Resubmit_free(Resubmit* r) {
+    if(r) {
+        Tokenizer_free(r->t);
+        Stack_free(r->groups);
+        Stack_free(r->frames);
+        Stack_free(r->found);
+        xfree(r);
+    }
+}
+
+// Forgets the groups the edit touched, and moves those after it along.
+static void Resubmit_forget(Resubmit* r, const TokenEdit* edit) {
+    ResubmitGroup* groups = Stack_getBase(r->groups);
+    size_t         count  = Stack_getCount(r->groups);
+    size_t         end    = edit->first + edit->removed;
+    size_t         kept   = 0;
+
+    for(size_t i = 0; i < count; ++i) {
+        ResubmitGroup group = groups[i];
+
+        if(group.open >= end) {
+            group.open  = group.open - edit->removed + edit->inserted;
+            group.close = group.close - edit->removed + edit->inserted;
+        } else if(group.close >= edit->first) {
+            continue;
+        }
+
+        groups[kept++] = group;
+    }
+
+    Stack_truncate(r->groups, kept);
+}
+
+BOOL Resubmit_tokenize(Resubmit* r, const char* expr, size_t len) {
+    TokenEdit edit;
+
+    // Nothing to start from, such as before the first expression.
+    if(!r->t->kept)
+        Stack_clear(r->groups);
+
+    if(!Tokenizer_retokenize(r->t, expr, len, &edit))
+        return FALSE;
+
+    r->lexed = edit.inserted;
+    Resubmit_forget(r, &edit);
+
+    return TRUE;
+}
+
+// The remembered group whose open paren is at index open, or null.
+static const ResubmitGroup* Resubmit_group(const Resubmit* r, size_t open) {
+    const ResubmitGroup* groups = Stack_getBase(r->groups);
+    size_t               low    = 0;
+    size_t               high   = Stack_getCount(r->groups);
+
+    while(low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if(groups[mid].open < open)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low < Stack_getCount(r->groups) && groups[low].open == open
+               ? &groups[low]
+               : 0;
+}
+
+// Evaluates the token, keeping track of the groups it opens and closes, and
+// recording the value of those that close without having read a variable.
+// Every group gets its place in found as it opens, so that they're in order,
+// and a close of 0 until recorded. Parens read into the body of a series
+// aren't evaluated there, so their groups aren't recorded.
+static SftError* Resubmit_step(Resubmit*    r,
+                               Sft*         sft,
+                               const Token* token,
+                               size_t       index) {
+    if(token->type & TT_OPA) {
+        ResubmitGroup group = {.open = index};
+        ResubmitFrame frame = {.found = Stack_getCount(r->found),
+                               .depth = Stack_getCount(sft->number_stack),
+                               .pure  = !sft->capturing};
+
+        Stack_pushFrom(r->found, &group);
+        Stack_pushFrom(r->frames, &frame);
+    } else if(token->type & TT_VAR && !Stack_empty(r->frames)) {
+        ((ResubmitFrame*)Stack_getHead(r->frames))->pure = FALSE;
+    }
+
+    SftError* error = Sft_evalToken(sft, token, index);
+
+    ResubmitFrame frame;
+
+    if(error || !(token->type & TT_CPA) || !Stack_popInto(r->frames, &frame))
+        return error;
+
+    if(!frame.pure) {
+        if(!Stack_empty(r->frames))
+            ((ResubmitFrame*)Stack_getHead(r->frames))->pure = FALSE;
+
+        return 0;
+    }
+
+    // A group that was evaluated leaves its value alone on top of where the
+    // number cellar was, and its operators took nothing from below that (see
+    // Sft_operandBase), so the value is its own wherever it stands.
+    if(Stack_getCount(sft->number_stack) == frame.depth + 1) {
+        ResubmitGroup* group = Stack_itemAt(r->found, frame.found);
+
+        group->close = index;
+        group->value = *(double*)Stack_getHead(sft->number_stack);
+    }
+
+    return 0;
+}
+
+// Merges the groups recorded into the remembered ones. None of them was
+// remembered before, or it would have been read as a number rather than
+// evaluated.
+static void Resubmit_remember(Resubmit* r) {
+    ResubmitGroup* fresh = Stack_getBase(r->found);
+    size_t         found = 0;
+    size_t         count = Stack_getCount(r->groups);
+
+    for(size_t i = 0; i < Stack_getCount(r->found); ++i) {
+        if(fresh[i].close)
+            fresh[found++] = fresh[i];
+    }
+
+    Stack_clear(r->found);
+
+    if(!found)
+        return;
+
+    // From the back, into room made at the end.
+    Stack_splice(r->groups, count, 0, fresh, found);
+
+    ResubmitGroup* groups = Stack_getBase(r->groups);
+    size_t         i      = count;
+    size_t         j      = found;
+    size_t         k      = count + found;
+
+    while(j) {
+        if(i && groups[i - 1].open > fresh[j - 1].open)
+            groups[--k] = groups[--i];
+        else
+            groups[--k] = fresh[--j];
+    }
+}
+
+SftError* Resubmit_evaluate(Resubmit* r, Sft* sft, double* out_result) {
+    TokenArray tokens;
+    Tokenizer_view(r->t, &tokens);
+
+    SftError* error = 0;
+
+    Sft_reset(sft);
+    Stack_clear(r->frames);
+    Stack_clear(r->found);
+
+    r->evaluated = 0;
+
+    for(size_t i = 0; !error && i < tokens.count; ++i) {
+        const Token*         token = &tokens.tokens[i];
+        const ResubmitGroup* group = 0;
+
+        // Inside the body of a series, tokens are read and counted one by
+        // one, so a group can't stand in for its tokens there.
+        if(token->type & TT_OPA && !sft->capturing)
+            group = Resubmit_group(r, i);
+
+        r->evaluated += 1;
+
+        if(group) {
+            Token number = {.type   = TT_NUM,
+                            .f64    = group->value,
+                            .offset = token->offset};
+
+            error = Sft_evalToken(sft, &number, i);
+            i     = group->close;
+        } else {
+            error = Resubmit_step(r, sft, token, i);
+        }
+
+        if(sft->skip_to) {
+            i            = sft->skip_to - 1;
+            sft->skip_to = 0;
+        }
+    }
+
+    if(!error)
+        error = Sft_finish(sft, tokens.count, out_result);
+
+    // What was evaluated before an error is as good as any.
+    Resubmit_remember(r);
+
+    return error;
+}
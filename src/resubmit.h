@@ -0,0 +1,59 @@
+#ifndef _H_RESUBMIT_
+#define _H_RESUBMIT_
+
+#include "common.h"
+#include "evaluator.h"
+#include "stack.h"
+#include "tokenizer.h"
+
+// Evaluates expression after expression, each usually a small edit of the one
+// before, as entered into the REPL, redoing as little as the edit allows. The
+// expression is retokenized from where it changed (see Tokenizer_retokenize),
+// and the values of its groups, the parenthesized subexpressions and function
+// calls that read no variables, are remembered, so that the groups the edit
+// left alone are read as the numbers they came to instead of being evaluated
+// again. An edit inside a group evaluates the groups around it again, and
+// those of its own that it didn't touch are numbers too.
+//
+// What takes time in proportion to the whole expression regardless is moving
+// the tokens after the edit, linking their jumps again, and evaluating the
+// tokens outside of any remembered group; passes over tokens rather than text,
+// all but the last of them cheap.
+
+typedef struct ResubmitGroup {
+    size_t open;  // Index of the open paren, or function name and paren.
+    size_t close; // Index of its close paren.
+    double value;
+} ResubmitGroup;
+
+typedef struct Resubmit {
+    Tokenizer* t;
+
+    // The values of the groups of the tokens of t, by open paren. Nested
+    // groups are remembered too, for edits inside the groups around them.
+    Stack* groups;
+
+    // Scratch for Resubmit_evaluate: the parens open, and the groups it
+    // evaluated.
+    Stack* frames;
+    Stack* found;
+
+    // Of the last expression: the tokens lexed, and the tokens evaluated, in
+    // which a remembered group counts as one.
+    size_t lexed;
+    size_t evaluated;
+} Resubmit;
+
+extern Resubmit* Resubmit_new(void);
+extern void      Resubmit_free(Resubmit* r);
+
+// Tokenizes the next expression. Returns FALSE and sets r->t->error on
+// failure, after which the expression before is still the one to start from.
+extern BOOL Resubmit_tokenize(Resubmit* r, const char* expr, size_t len);
+
+// Evaluates the last expression tokenized with the Sft, like Sft_evalTokens,
+// and remembers the groups it evaluated. The functions the Sft calls must be
+// pure, as those of FN_LOOKUP are.
+extern SftError* Resubmit_evaluate(Resubmit* r, Sft* sft, double* out_result);
+
+#endif // _H_RESUBMIT_
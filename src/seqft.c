@@ -0,0 +1,225 @@
+#include "seqft.h"
+
+#include "alloc.h"
+#include "common.h"
+#include "evaluator.h"
+#include "tokenizer.h"
+
+// The codes of ErrCode are returned as they are, as the SeqftError of the
+// same name.
+#define SEQFT_SAME_CODE(name) \
+    _Static_assert((int)SEQFT_ERR_##name == (int)ERR_##name, #name)
+
+SEQFT_SAME_CODE(EMPTY_EXPRESSION);
+SEQFT_SAME_CODE(NUMBER_TOO_SHORT);
+SEQFT_SAME_CODE(INCOMPLETE_NUMBER);
+SEQFT_SAME_CODE(INVALID_DIGIT);
+SEQFT_SAME_CODE(LEADING_ZERO);
+SEQFT_SAME_CODE(INVALID_CHARACTER);
+SEQFT_SAME_CODE(MISSING_OPERAND);
+SEQFT_SAME_CODE(MISSING_ARGUMENT);
+SEQFT_SAME_CODE(COMMA_OUTSIDE_CALL);
+SEQFT_SAME_CODE(UNKNOWN_FUNCTION);
+SEQFT_SAME_CODE(ARGUMENT_COUNT);
+SEQFT_SAME_CODE(UNKNOWN_VARIABLE);
+SEQFT_SAME_CODE(SERIES_FORM);
+SEQFT_SAME_CODE(SERIES_RANGE);
+SEQFT_SAME_CODE(BUDGET_EXHAUSTED);
+SEQFT_SAME_CODE(CANCELLED);
+SEQFT_SAME_CODE(OUT_OF_MEMORY);
+
+struct SeqftContext {
+    // Installed for every call, with the call to return to if it runs out.
+    SeqftAllocator allocator;
+
+    Tokenizer* t;
+    Sft*       sft;
+
+    // Limits of every evaluation, and the flag SeqftContext_cancel raises.
+    uint64_t   max_steps;
+    uint64_t   max_ns;
+    atomic_int cancel;
+    TokenArray tokens; // Kept for SeqftContext_resume.
+
+    // Where the last error came from; the messages live in the tokenizer or
+    // the Sft.
+    ErrCode code;
+    BOOL    in_evaluator;
+    size_t  offset;
+};
+
+const SeqftAllocator* SeqftAllocator_cached(void) {
+    return &ALLOC_CACHED;
+}
+
+const SeqftAllocator* SeqftAllocator_libc(void) {
+    return &ALLOC_LIBC;
+}
+
+SeqftContext* SeqftContext_newWith(const SeqftAllocator* allocator) {
+    SeqftAllocator         copy  = *allocator;
+    SeqftContext* volatile ctx   = 0;
+    jmp_buf                recover;
+    XallocScope            scope = xalloc_enter(&copy, &recover);
+
+    // What was made before running out is given back; the tokenizer or Sft
+    // that was being made may hold on to some.
+    if(setjmp(recover)) {
+        if(ctx) {
+            Sft_free(ctx->sft);
+            Tokenizer_free(ctx->t);
+            xfree(ctx);
+        }
+
+        xalloc_leave(scope);
+        return 0;
+    }
+
+    ctx = xmalloc(sizeof(SeqftContext));
+    memset(ctx, 0, sizeof(SeqftContext));
+
+    ctx->allocator = copy;
+    ctx->t         = Tokenizer_new();
+    ctx->sft       = Sft_new();
+
+    xalloc_leave(scope);
+    return ctx;
+}
+
+SeqftContext* SeqftContext_new(void) {
+    return SeqftContext_newWith(&ALLOC_CACHED);
+}
+
+void SeqftContext_free(SeqftContext* ctx) {
+    if(!ctx)
+        return;
+
+    // Outlives the context.
+    SeqftAllocator allocator = ctx->allocator;
+    XallocScope    scope     = xalloc_enter(&allocator, 0);
+
+    Sft_free(ctx->sft);
+    Tokenizer_free(ctx->t);
+    xfree(ctx);
+
+    xalloc_leave(scope);
+}
+
+// Records running out of memory as the context's error.
+static int SeqftContext_outOfMemory(SeqftContext* ctx) {
+    ctx->code         = ERR_OUT_OF_MEMORY;
+    ctx->in_evaluator = FALSE;
+    ctx->offset       = 0;
+
+    return (int)ctx->code;
+}
+
+// Runs the evaluation set up by Sft_begin within the context's budget. A
+// cancellation is used up by the evaluation it stops.
+static int SeqftContext_run(SeqftContext* ctx, double* result) {
+    SftBudget budget = {.steps = ctx->max_steps, .cancel = &ctx->cancel};
+
+    if(ctx->max_ns)
+        budget.deadline_ns = monotonic_ns() + ctx->max_ns;
+
+    SftError* error = Sft_resume(ctx->sft, &budget, result);
+
+    ctx->code         = ERR_NONE;
+    ctx->in_evaluator = FALSE;
+    ctx->offset       = 0;
+
+    if(error) {
+        ctx->code         = error->code;
+        ctx->in_evaluator = TRUE;
+        ctx->offset       = error->offset;
+    }
+
+    if(ctx->code == ERR_CANCELLED)
+        atomic_store(&ctx->cancel, 0);
+
+    return (int)ctx->code;
+}
+
+static int SeqftContext_evalIn(SeqftContext* ctx,
+                               const char*   expr,
+                               size_t        len,
+                               double*       result) {
+    ctx->code         = ERR_NONE;
+    ctx->in_evaluator = FALSE;
+    ctx->offset       = 0;
+
+    if(!Tokenizer_tokenize(ctx->t, expr, len)) {
+        ctx->code   = ctx->t->error->code;
+        ctx->offset = ctx->t->error->index;
+        return (int)ctx->code;
+    }
+
+    Tokenizer_view(ctx->t, &ctx->tokens);
+    Sft_begin(ctx->sft, &ctx->tokens);
+
+    return SeqftContext_run(ctx, result);
+}
+
+static int SeqftContext_resumeIn(SeqftContext* ctx, double* result) {
+    if(ctx->code != ERR_BUDGET_EXHAUSTED)
+        return (int)ctx->code;
+
+    return SeqftContext_run(ctx, result);
+}
+
+// The calls that evaluate run in the context's allocator, and return
+// ERR_OUT_OF_MEMORY if it runs out.
+int SeqftContext_eval(SeqftContext* ctx,
+                      const char*   expr,
+                      size_t        len,
+                      double*       result) {
+    jmp_buf     recover;
+    XallocScope scope = xalloc_enter(&ctx->allocator, &recover);
+    int         code;
+
+    if(setjmp(recover))
+        code = SeqftContext_outOfMemory(ctx);
+    else
+        code = SeqftContext_evalIn(ctx, expr, len, result);
+
+    xalloc_leave(scope);
+    return code;
+}
+
+int SeqftContext_resume(SeqftContext* ctx, double* result) {
+    jmp_buf     recover;
+    XallocScope scope = xalloc_enter(&ctx->allocator, &recover);
+    int         code;
+
+    if(setjmp(recover))
+        code = SeqftContext_outOfMemory(ctx);
+    else
+        code = SeqftContext_resumeIn(ctx, result);
+
+    xalloc_leave(scope);
+    return code;
+}
+
+void SeqftContext_setBudget(SeqftContext* ctx, uint64_t steps, uint64_t ns) {
+    ctx->max_steps = steps;
+    ctx->max_ns    = ns;
+}
+
+void SeqftContext_cancel(SeqftContext* ctx) {
+    atomic_store(&ctx->cancel, 1);
+}
+
+int SeqftContext_errorCode(const SeqftContext* ctx) {
+    return (int)ctx->code;
+}
+
+const char* SeqftContext_errorMessage(SeqftContext* ctx) {
+    if(ctx->in_evaluator)
+        return SftError_message(&ctx->sft->error);
+
+    return ErrCode_describe(ctx->code);
+}
+
+size_t SeqftContext_errorOffset(const SeqftContext* ctx) {
+    return ctx->offset;
+}
@@ -0,0 +1,147 @@
+#ifndef _H_SEQFT_
+#define _H_SEQFT_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// libseqft: evaluate arithmetic expressions in-process.
+//
+//     SeqftContext* ctx = SeqftContext_new();
+//     double        result;
+//
+//     if(SeqftContext_eval(ctx, "max(1, 2) * 3", 13, &result) != 0)
+//         fprintf(stderr, "%s\n", SeqftContext_errorMessage(ctx));
+//
+//     SeqftContext_free(ctx);
+//
+// A context owns everything an evaluation needs and keeps its memory between
+// evaluations, so reusing one costs no allocations for expressions no larger
+// than earlier ones. Contexts share no mutable state: any number of threads
+// may evaluate at the same time as long as each uses its own context. A
+// single context must not be used from two threads at once.
+//
+// Every context allocates through an allocator of its own, given when it is
+// made, and running out of memory fails the call that ran out rather than
+// the process. The only process-wide setting is the allocation hook of
+// common.h, meant for tooling, which must be installed before any thread
+// starts evaluating.
+
+#if defined(__GNUC__)
+    #define SEQFT_API __attribute__((visibility("default")))
+#else
+    #define SEQFT_API
+#endif
+
+typedef struct SeqftContext SeqftContext;
+
+// What the calls that evaluate return: 0 on success, or what failed. The
+// codes are those the library uses within, and keep their values.
+typedef enum SeqftError {
+    SEQFT_OK = 0,
+
+    // Syntax errors, of the expression as written, which fails the same way
+    // however often it's evaluated.
+    SEQFT_ERR_EMPTY_EXPRESSION   = 1,  // Nothing but whitespace.
+    SEQFT_ERR_NUMBER_TOO_SHORT   = 2,  // Not enough digits for a number.
+    SEQFT_ERR_INCOMPLETE_NUMBER  = 3,  // Base prefix or point without digits.
+    SEQFT_ERR_INVALID_DIGIT      = 4,  // Digit not valid for the base.
+    SEQFT_ERR_LEADING_ZERO       = 5,  // Leading zero in a decimal number.
+    SEQFT_ERR_INVALID_CHARACTER  = 6,  // Character that can't be in a token.
+    SEQFT_ERR_MISSING_OPERAND    = 7,  // Operator without enough operands.
+    SEQFT_ERR_MISSING_ARGUMENT   = 8,  // Empty argument in a function call.
+    SEQFT_ERR_COMMA_OUTSIDE_CALL = 9,  // ',' that doesn't separate arguments.
+    SEQFT_ERR_UNKNOWN_FUNCTION   = 10, // No function of that name.
+    SEQFT_ERR_ARGUMENT_COUNT     = 11, // Wrong number of arguments.
+    SEQFT_ERR_UNKNOWN_VARIABLE   = 12, // A name not followed by (.
+    SEQFT_ERR_SERIES_FORM        = 17, // Series without a body, or left open.
+    SEQFT_ERR_SERIES_RANGE       = 18, // Range not finite, or too long.
+
+    // Out of budget (see SeqftContext_setBudget), to be carried on with
+    // SeqftContext_resume, and cancelled.
+    SEQFT_ERR_BUDGET_EXHAUSTED = 14,
+    SEQFT_ERR_CANCELLED        = 15,
+
+    // The allocator of the context returned null.
+    SEQFT_ERR_OUT_OF_MEMORY = 21,
+} SeqftError;
+
+// Where a context gets its memory from. allocate and reallocate return null
+// when out of memory, and memory from them must be aligned for any type, like
+// malloc's. reallocate is only called with memory from this allocator and a
+// size other than 0, release only with memory from it. A context calls them
+// from the threads that use it and from the threads a long series is
+// evaluated on (see series.h), which are done before the call returns; an
+// allocator given to more than one context must take being called from
+// several threads at once.
+typedef struct SeqftAllocator {
+    void* (*allocate)(void* user, size_t size);
+    void* (*reallocate)(void* user, void* memory, size_t size);
+    void (*release)(void* user, void* memory);
+    void* user;
+} SeqftAllocator;
+
+// malloc in front of which every thread keeps its own cache of freed blocks,
+// by size class, so that a context allocates and frees without taking any
+// locks once warm. A block freed on another thread than the one it was
+// allocated on goes into the cache of the thread freeing it. The default of
+// SeqftContext_new.
+SEQFT_API extern const SeqftAllocator* SeqftAllocator_cached(void);
+
+// malloc, realloc and free, as they are.
+SEQFT_API extern const SeqftAllocator* SeqftAllocator_libc(void);
+
+// A context on the allocator, which is copied. Returns null if it ran out of
+// memory making one.
+SEQFT_API extern SeqftContext* SeqftContext_newWith(
+    const SeqftAllocator* allocator);
+
+// A context on SeqftAllocator_cached().
+SEQFT_API extern SeqftContext* SeqftContext_new(void);
+SEQFT_API extern void          SeqftContext_free(SeqftContext* ctx);
+
+// Evaluates the len bytes at expr, which need not be null terminated, and
+// writes the result. Returns SEQFT_OK on success, otherwise a SeqftError and
+// leaves result untouched.
+//
+// SEQFT_ERR_OUT_OF_MEMORY leaves the context usable; what the evaluation had
+// allocated for itself alone by then may not be given back to the allocator.
+SEQFT_API extern int SeqftContext_eval(SeqftContext* ctx,
+                                       const char*   expr,
+                                       size_t        len,
+                                       double*       result);
+
+// Limits every following evaluation to `steps` evaluation steps (about one
+// per token, and one per value of the index of a series) and `ns`
+// nanoseconds of wall time; 0 lifts either limit. An evaluation over budget
+// fails with SEQFT_ERR_BUDGET_EXHAUSTED and can be carried on with
+// SeqftContext_resume. Tokenizing is not limited; it is linear in the
+// length of the expression.
+SEQFT_API extern void SeqftContext_setBudget(SeqftContext* ctx,
+                                             uint64_t      steps,
+                                             uint64_t      ns);
+
+// Continues the last evaluation if it failed with SEQFT_ERR_BUDGET_EXHAUSTED,
+// with a fresh budget, and returns like SeqftContext_eval.
+SEQFT_API extern int SeqftContext_resume(SeqftContext* ctx, double* result);
+
+// Makes the evaluation running in ctx fail with SEQFT_ERR_CANCELLED soon, or
+// the next one if none is running. Unlike everything else, safe to call from
+// any thread while another uses the context.
+SEQFT_API extern void SeqftContext_cancel(SeqftContext* ctx);
+
+// The last evaluation's error: its SeqftError (0 if it succeeded), a message
+// valid until the next evaluation, and the offset in the expression with
+// whitespace removed where it occurred.
+SEQFT_API extern int         SeqftContext_errorCode(const SeqftContext* ctx);
+SEQFT_API extern const char* SeqftContext_errorMessage(SeqftContext* ctx);
+SEQFT_API extern size_t      SeqftContext_errorOffset(const SeqftContext* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _H_SEQFT_
@@ -0,0 +1,1165 @@
+#include "series.h"
+
+#include <pthread.h>
+
+#include "vecmath.h"
+
+// Values of the index per block: at least SERIES_BLOCK, and more where the
+// range would otherwise take more than SERIES_MAX_BLOCKS blocks.
+#define SERIES_BLOCK      (1 << 14)
+#define SERIES_MAX_BLOCKS (1 << 16)
+
+// One past the longest range, 2^53, beyond which lo + t stops being exact.
+#define SERIES_MAX_COUNT 9007199254740992.0
+
+typedef enum SeriesOpCode {
+    SERIES_CONST,
+    SERIES_INDEX,
+    SERIES_BINARY,
+    SERIES_NEG,
+    SERIES_CALL,
+} SeriesOpCode;
+
+// One step of a compiled body, on a stack of chunks of values.
+typedef struct SeriesOp {
+    SeriesOpCode    code;
+    TokenType       type;     // SERIES_BINARY
+    double          value;    // SERIES_CONST
+    const Function* function; // SERIES_CALL
+    size_t          argc;     // SERIES_CALL
+} SeriesOp;
+
+// A polynomial in the offset of the index from lo, lowest coefficient first.
+typedef struct SeriesPoly {
+    double c[SERIES_DEGREE + 1];
+    int    degree;
+} SeriesPoly;
+
+// A sum or product as its rounded value and the error of that rounding.
+typedef struct SeriesAcc {
+    double value;
+    double error;
+} SeriesAcc;
+
+// What the child resolves variables with: the index to its current value,
+// and anything else the way the series' own Sft would.
+typedef struct SeriesScope {
+    const char* index;
+    double      value;
+    SftResolver resolve;
+    void*       user;
+} SeriesScope;
+
+struct Series {
+    Stack* ops;       // SeriesOp, the body in postfix.
+    Stack* operators; // Token, scratch for compiling.
+    size_t depth;     // Most values the body has on its stack at once.
+    size_t max_argc;
+
+    // Only used for bodies that don't compile.
+    SeriesScope scope;
+    Sft*        child;
+
+    // How far the last series to run out of budget got, for resuming it: the
+    // values of the index before next, those of the blocks before the one
+    // next is in merged into total, those of the chunks before the one next
+    // is in merged into lanes, and the rest in values. For bodies that don't
+    // compile, the child may have run out of budget evaluating the body for
+    // next itself, and carries on with that.
+    uint64_t  next;
+    SeriesAcc total;
+    SeriesAcc lanes[SERIES_LANES];
+    double    values[SERIES_CHUNK];
+    BOOL      child_pending;
+
+    SftError error;
+};
+
+// A compiled body running over a range, shared by the threads running it.
+typedef struct SeriesRun {
+    const SeriesOp*  ops;
+    size_t           op_count;
+    size_t           depth;
+    size_t           max_argc;
+    double           lo;
+    uint64_t         count;
+    uint64_t         block;
+    uint64_t         blocks;
+    uint64_t         first; // Block to start at, those before being done.
+    uint64_t         limit; // Block to stop at, short of the steps left.
+    BOOL             product;
+    const SftBudget* budget;
+
+    SeriesAcc*    partials;   // One per block.
+    atomic_ullong next;       // Block to claim next.
+    atomic_int    stop;       // ErrCode every thread stops for, or ERR_NONE.
+    atomic_ullong unfinished; // Lowest block claimed but not run.
+
+    // Blocks merged into the total once the run is over: all of them, unless
+    // it stopped.
+    uint64_t finished;
+
+    // Of the calling thread, for the others to allocate with too.
+    const SeqftAllocator* allocator;
+} SeriesRun;
+
+// Set on the threads of pools, see Series_setPooled.
+static _Thread_local BOOL series_pooled;
+
+BOOL Series_setPooled(BOOL pooled) {
+    BOOL was      = series_pooled;
+    series_pooled = pooled;
+    return was;
+}
+
+BOOL Series_isSeries(const char* func) {
+    return func && (!strcmp(func, "sum") || !strcmp(func, "prod"));
+}
+
+Series* Series_new(void) {
+    Series* series = xmalloc(sizeof(Series));
+    memset(series, 0, sizeof(Series));
+
+    series->ops       = Stack_new(sizeof(SeriesOp));
+    series->operators = Stack_new(sizeof(Token));
+
+    return series;
+}
+
+void Series_free(Series* series) {
+    if(!series)
+        return;
+
+    Stack_free(series->ops);
+    Stack_free(series->operators);
+    Sft_free(series->child);
+    xfree(series);
+}
+
+static SftError* Series_fail(Series*           series,
+                             const SeriesCall* call,
+                             ErrCode           code) {
+    SftError* error = &series->error;
+    memset(error, 0, sizeof(SftError));
+
+    error->code        = code;
+    error->token_index = call->body->count;
+    error->offset      = call->offset;
+
+    return error;
+}
+
+// Emits the operator, which the values on the stack above its depth must have
+// operands for.
+static BOOL Series_emitOperator(Series*      series,
+                                const Token* op,
+                                size_t*      count) {
+    size_t   operands = op->type & TT_UOP ? 1 : 2;
+    SeriesOp emitted  = {
+        .code = op->type & TT_UOP ? SERIES_NEG : SERIES_BINARY,
+        .type = op->type,
+    };
+
+    if(*count < op->depth + operands)
+        return FALSE;
+
+    *count -= operands - 1;
+    Stack_pushFrom(series->ops, &emitted);
+    return TRUE;
+}
+
+// Emits operators down to the nearest open paren, like eval_until_open_paren.
+static BOOL Series_emitUntilParen(Series* series, size_t* count) {
+    Stack* operators = series->operators;
+
+    while(!Stack_empty(operators)) {
+        Token* top = Stack_getHead(operators);
+
+        if(top->type == TT_OPA)
+            break;
+
+        Token op;
+        Stack_popInto(operators, &op);
+
+        if(!Series_emitOperator(series, &op, count))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Compiles the body into series->ops by the rules the Sft evaluates it by,
+// precedences and all, looking up the variables other than the index. Fails
+// for anything the Sft would fail on, leaving the error to the child, and
+// for series within the body.
+static BOOL Series_compile(Series* series, const SeriesCall* call) {
+    TokenArray* body      = call->body;
+    Stack*      operators = series->operators;
+    size_t      count     = 0;
+
+    Stack_clear(series->ops);
+    Stack_clear(operators);
+    series->depth    = 0;
+    series->max_argc = 0;
+
+    for(size_t i = 0; i < body->count; ++i) {
+        Token*   token = &body->tokens[i];
+        SeriesOp op    = {.code = SERIES_CONST};
+
+        if(token->type & TT_NUM) {
+            op.value = token->f64;
+            Stack_pushFrom(series->ops, &op);
+            count += 1;
+        } else if(token->type & TT_VAR) {
+            if(!strcmp(token->func, call->index)) {
+                op.code = SERIES_INDEX;
+            } else if(!call->resolve ||
+                      !call->resolve(call->resolve_user, token, &op.value)) {
+                return FALSE;
+            }
+
+            Stack_pushFrom(series->ops, &op);
+            count += 1;
+        } else if(token->type & TT_OPS) {
+            while(!Stack_empty(operators)) {
+                Token* top = Stack_getHead(operators);
+
+                if(top->type & TT_OPA ||
+                   TokenType_precedence(top->type) <
+                       TokenType_precedence(token->type))
+                    break;
+
+                Token popped;
+                Stack_popInto(operators, &popped);
+
+                if(!Series_emitOperator(series, &popped, &count))
+                    return FALSE;
+            }
+
+            // Where its operands start, as the Sft keeps it.
+            Token pushed = *token;
+            pushed.depth = 0;
+
+            if(!Stack_empty(operators)) {
+                Token* top   = Stack_getHead(operators);
+                pushed.depth = top->type & TT_OPA ? top->depth + top->commas
+                                                  : top->depth;
+            }
+
+            Stack_pushFrom(operators, &pushed);
+        } else if(token->type & TT_COM) {
+            if(!Series_emitUntilParen(series, &count) || Stack_empty(operators))
+                return FALSE;
+
+            Token* paren = Stack_getHead(operators);
+
+            if(count != paren->depth + paren->commas + 1)
+                return FALSE;
+
+            paren->commas += 1;
+        } else if(token->type & TT_OPA) {
+            if(Series_isSeries(token->func) && i + 2 < body->count &&
+               body->tokens[i + 1].type & TT_VAR &&
+               body->tokens[i + 2].type & TT_COM)
+                return FALSE;
+
+            Token paren  = *token;
+            paren.depth  = count;
+            paren.commas = 0;
+            Stack_pushFrom(operators, &paren);
+        } else if(token->type & TT_CPA) {
+            if(!Series_emitUntilParen(series, &count))
+                return FALSE;
+
+            // The Sft ignores a close paren without an open one.
+            if(Stack_empty(operators))
+                continue;
+
+            Token paren;
+            Stack_popInto(operators, &paren);
+
+            size_t argc = count - paren.depth;
+
+            if(paren.commas && argc != paren.commas + 1)
+                return FALSE;
+
+            if(paren.func) {
+                const Function* f = Function_lookup(paren.func, 0);
+
+                if(!f || argc < f->min_args || argc > f->max_args)
+                    return FALSE;
+
+                op.code     = SERIES_CALL;
+                op.function = f;
+                op.argc     = argc;
+                Stack_pushFrom(series->ops, &op);
+
+                count = paren.depth + 1;
+
+                if(argc > series->max_argc)
+                    series->max_argc = argc;
+            } else if(paren.commas) {
+                return FALSE;
+            }
+        }
+
+        if(count > series->depth)
+            series->depth = count;
+    }
+
+    return Series_emitUntilParen(series, &count) && Stack_empty(operators) &&
+           count == 1;
+}
+
+static BOOL SeriesPoly_mul(SeriesPoly* a, const SeriesPoly* b) {
+    SeriesPoly product;
+    memset(&product, 0, sizeof(SeriesPoly));
+
+    if(a->degree + b->degree > SERIES_DEGREE)
+        return FALSE;
+
+    product.degree = a->degree + b->degree;
+
+    for(int j = 0; j <= a->degree; ++j) {
+        for(int k = 0; k <= b->degree; ++k) {
+            product.c[j + k] += a->c[j] * b->c[k];
+        }
+    }
+
+    *a = product;
+    return TRUE;
+}
+
+// Applies the binary operator to a and b, in place of a. Fails unless the
+// result is a polynomial of degree SERIES_DEGREE or less.
+static BOOL SeriesPoly_apply(TokenType         type,
+                             SeriesPoly*       a,
+                             const SeriesPoly* b) {
+    BOOL constant = a->degree == 0 && b->degree == 0;
+
+    switch(type) {
+        case TT_ADD:
+        case TT_SUB:
+            for(int k = 0; k <= b->degree; ++k) {
+                a->c[k] += type == TT_ADD ? b->c[k] : -b->c[k];
+            }
+
+            if(b->degree > a->degree)
+                a->degree = b->degree;
+            return TRUE;
+        case TT_MUL:
+            return SeriesPoly_mul(a, b);
+        case TT_DIV:
+            if(b->degree)
+                return FALSE;
+
+            for(int k = 0; k <= a->degree; ++k) {
+                a->c[k] /= b->c[0];
+            }
+            return TRUE;
+        case TT_POW: {
+            double exponent = b->c[0];
+
+            if(constant) {
+                a->c[0] = pow(a->c[0], exponent);
+                return TRUE;
+            }
+
+            if(b->degree || exponent < 0 || exponent != floor(exponent) ||
+               exponent * a->degree > SERIES_DEGREE)
+                return FALSE;
+
+            SeriesPoly base = *a;
+            memset(a, 0, sizeof(SeriesPoly));
+            a->c[0] = 1;
+
+            for(int k = 0; k < (int)exponent; ++k) {
+                SeriesPoly_mul(a, &base);
+            }
+            return TRUE;
+        }
+        default:
+            if(!constant)
+                return FALSE;
+
+            a->c[0] = eval_binary_op(type, a->c[0], b->c[0]);
+            return TRUE;
+    }
+}
+
+// Works the compiled body out as a polynomial in t, the offset of the index
+// from lo, if it is one.
+static BOOL Series_polynomial(const Series* series,
+                              double        lo,
+                              SeriesPoly*   out) {
+    const SeriesOp* ops   = Stack_getBase(series->ops);
+    size_t          count = Stack_getCount(series->ops);
+    SeriesPoly*     stack = xmalloc(series->depth * sizeof(SeriesPoly));
+    size_t          top   = 0;
+    BOOL            ok    = TRUE;
+
+    for(size_t i = 0; i < count && ok; ++i) {
+        const SeriesOp* op = &ops[i];
+
+        switch(op->code) {
+            case SERIES_CONST:
+            case SERIES_INDEX:
+                memset(&stack[top], 0, sizeof(SeriesPoly));
+
+                if(op->code == SERIES_CONST) {
+                    stack[top].c[0] = op->value;
+                } else {
+                    stack[top].c[0]   = lo;
+                    stack[top].c[1]   = 1;
+                    stack[top].degree = 1;
+                }
+
+                top += 1;
+                break;
+            case SERIES_NEG:
+                for(int k = 0; k <= stack[top - 1].degree; ++k) {
+                    stack[top - 1].c[k] = -stack[top - 1].c[k];
+                }
+                break;
+            case SERIES_BINARY:
+                ok = SeriesPoly_apply(
+                    op->type, &stack[top - 2], &stack[top - 1]);
+                top -= 1;
+                break;
+            case SERIES_CALL: {
+                double args[64];
+                size_t first = top - op->argc;
+
+                // A constant condition picks a branch, whatever it is.
+                if(op->function->ptr == sft_if && stack[first].degree == 0) {
+                    stack[first] = stack[first].c[0] != 0 ? stack[first + 1]
+                                                          : stack[first + 2];
+                    top          = first + 1;
+                    break;
+                }
+
+                ok = op->argc <= sizeof(args) / sizeof(args[0]);
+
+                for(size_t k = 0; ok && k < op->argc; ++k) {
+                    ok      = stack[first + k].degree == 0;
+                    args[k] = stack[first + k].c[0];
+                }
+
+                if(ok) {
+                    memset(&stack[first], 0, sizeof(SeriesPoly));
+                    stack[first].c[0] = op->function->ptr(args, op->argc);
+                    top               = first + 1;
+                }
+                break;
+            }
+        }
+    }
+
+    if(ok)
+        *out = stack[0];
+
+    xfree(stack);
+    return ok;
+}
+
+static inline void SeriesAcc_add(SeriesAcc* acc, double x) {
+    double sum = acc->value + x;
+    double z   = sum - acc->value;
+
+    acc->error += (acc->value - (sum - z)) + (x - z);
+    acc->value = sum;
+}
+
+static inline void SeriesAcc_mul(SeriesAcc* acc, double x) {
+    double product = acc->value * x;
+
+    acc->error = acc->error * x + fma(acc->value, x, -product);
+    acc->value = product;
+}
+
+static void SeriesAcc_merge(SeriesAcc*       into,
+                            const SeriesAcc* from,
+                            BOOL             product) {
+    if(product) {
+        double value = into->value * from->value;
+
+        into->error = fma(into->value, from->value, -value) +
+                      into->value * from->error + into->error * from->value;
+        into->value = value;
+    } else {
+        double error = from->error;
+
+        SeriesAcc_add(into, from->value);
+        into->error += error;
+    }
+}
+
+static SeriesAcc SeriesAcc_identity(BOOL product) {
+    SeriesAcc acc = {.value = product ? 1 : 0, .error = 0};
+    return acc;
+}
+
+// The error is meaningless once the value overflowed or went NaN.
+static double SeriesAcc_result(const SeriesAcc* acc) {
+    return isfinite(acc->value) ? acc->value + acc->error : acc->value;
+}
+
+// Adds or multiplies values into the lanes, the k-th value of the chunk into
+// lane k % SERIES_LANES. The lanes are independent, so the additions of one
+// don't wait on those of another.
+static void Series_accumulate(SeriesAcc*    lanes,
+                              const double* values,
+                              size_t        len,
+                              BOOL          product) {
+    double value[SERIES_LANES];
+    double error[SERIES_LANES];
+    size_t k = 0;
+
+    for(size_t l = 0; l < SERIES_LANES; ++l) {
+        value[l] = lanes[l].value;
+        error[l] = lanes[l].error;
+    }
+
+    if(product) {
+        for(; k < len; ++k) {
+            size_t l  = k % SERIES_LANES;
+            double p  = value[l] * values[k];
+            error[l]  = error[l] * values[k] + fma(value[l], values[k], -p);
+            value[l]  = p;
+        }
+    } else {
+        for(; k + SERIES_LANES <= len; k += SERIES_LANES) {
+            for(size_t l = 0; l < SERIES_LANES; ++l) {
+                double x   = values[k + l];
+                double sum = value[l] + x;
+                double z   = sum - value[l];
+
+                error[l] += (value[l] - (sum - z)) + (x - z);
+                value[l] = sum;
+            }
+        }
+
+        for(; k < len; ++k) {
+            size_t l   = k % SERIES_LANES;
+            double sum = value[l] + values[k];
+            double z   = sum - value[l];
+
+            error[l] += (value[l] - (sum - z)) + (values[k] - z);
+            value[l] = sum;
+        }
+    }
+
+    for(size_t l = 0; l < SERIES_LANES; ++l) {
+        lanes[l].value = value[l];
+        lanes[l].error = error[l];
+    }
+}
+
+static void Series_startLanes(SeriesAcc* lanes, BOOL product) {
+    for(size_t k = 0; k < SERIES_LANES; ++k) {
+        lanes[k] = SeriesAcc_identity(product);
+    }
+}
+
+static SeriesAcc Series_mergeLanes(const SeriesAcc* lanes, BOOL product) {
+    SeriesAcc acc = lanes[0];
+
+    for(size_t k = 1; k < SERIES_LANES; ++k) {
+        SeriesAcc_merge(&acc, &lanes[k], product);
+    }
+
+    return acc;
+}
+
+// Sum of t^j for t = 0 .. n - 1.
+static double Series_powerSum(int j, double n) {
+    switch(j) {
+        case 0:
+            return n;
+        case 1:
+            return n * (n - 1) / 2;
+        case 2:
+            return (n - 1) * n * (2 * n - 1) / 6;
+        case 3: {
+            double s = n * (n - 1) / 2;
+            return s * s;
+        }
+        default:
+            return (n - 1) * n * (2 * n - 1) * (3 * n * n - 3 * n - 1) / 30;
+    }
+}
+
+// Sums the polynomial over t = 0 .. n - 1 in closed form, unless its terms
+// cancel too much for that to be accurate.
+static BOOL Series_closedSum(const SeriesPoly* poly, double n, double* result) {
+    SeriesAcc acc       = SeriesAcc_identity(FALSE);
+    double    magnitude = 0;
+
+    for(int j = 0; j <= poly->degree; ++j) {
+        if(poly->c[j] == 0)
+            continue;
+
+        double term = poly->c[j] * Series_powerSum(j, n);
+
+        magnitude += fabs(term);
+        SeriesAcc_add(&acc, term);
+    }
+
+    double sum = SeriesAcc_result(&acc);
+
+    if(!isfinite(magnitude) ||
+       magnitude > ldexp(fabs(sum), SERIES_CANCEL_BITS))
+        return FALSE;
+
+    *result = sum;
+    return TRUE;
+}
+
+static ErrCode Series_check(const SftBudget* budget) {
+    if(!budget)
+        return ERR_NONE;
+
+    if(budget->cancel &&
+       atomic_load_explicit(budget->cancel, memory_order_relaxed))
+        return ERR_CANCELLED;
+
+    if(budget->deadline_ns && monotonic_ns() >= budget->deadline_ns)
+        return ERR_BUDGET_EXHAUSTED;
+
+    return ERR_NONE;
+}
+
+static void Series_binary(TokenType     type,
+                          double*       a,
+                          const double* b,
+                          size_t        len) {
+    switch(type) {
+        case TT_ADD:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] += b[k];
+            }
+            break;
+        case TT_SUB:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] -= b[k];
+            }
+            break;
+        case TT_MUL:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] *= b[k];
+            }
+            break;
+        case TT_DIV:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] /= b[k];
+            }
+            break;
+        // Not vec_pow: pow() is what the Sft calls, and integer powers of
+        // integers must come out exact.
+        case TT_POW:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] = pow(a[k], b[k]);
+            }
+            break;
+        // Over a chunk, comparisons and logical operators are masks rather
+        // than branches: both operands of && and || were computed anyway,
+        // and which way each value of the index goes is anyone's guess.
+        case TT_LT:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] = a[k] < b[k];
+            }
+            break;
+        case TT_LE:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] = a[k] <= b[k];
+            }
+            break;
+        case TT_GT:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] = a[k] > b[k];
+            }
+            break;
+        case TT_GE:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] = a[k] >= b[k];
+            }
+            break;
+        case TT_EQ:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] = a[k] == b[k];
+            }
+            break;
+        case TT_NE:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] = a[k] != b[k];
+            }
+            break;
+        case TT_AND:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] = (a[k] != 0) & (b[k] != 0);
+            }
+            break;
+        case TT_OR:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] = (a[k] != 0) | (b[k] != 0);
+            }
+            break;
+        default:
+            for(size_t k = 0; k < len; ++k) {
+                a[k] = eval_binary_op(type, a[k], b[k]);
+            }
+            break;
+    }
+}
+
+// Calls the function on every lane of the argument columns from first on,
+// leaving the results in first.
+static void Series_call(const SeriesOp* op,
+                        double*         first,
+                        double*         args,
+                        size_t          len) {
+    const Function* f = op->function;
+
+    if(f->ptr == sft_round) {
+        vec_round(first, first, len);
+        return;
+    }
+
+    if(f->ptr == sft_ceil) {
+        vec_ceil(first, first, len);
+        return;
+    }
+
+    // Both branches were computed; each value of the index selects one.
+    if(f->ptr == sft_if) {
+        const double* taken  = first + SERIES_CHUNK;
+        const double* others = first + 2 * SERIES_CHUNK;
+
+        for(size_t k = 0; k < len; ++k) {
+            first[k] = first[k] != 0 ? taken[k] : others[k];
+        }
+        return;
+    }
+
+    for(size_t k = 0; k < len; ++k) {
+        for(size_t a = 0; a < op->argc; ++a) {
+            args[a] = first[a * SERIES_CHUNK + k];
+        }
+
+        first[k] = f->ptr(args, op->argc);
+    }
+}
+
+// Runs the body for len values of the index, from the start-th on, leaving
+// its values in the first column.
+static void Series_runChunk(const SeriesRun* run,
+                            double*          columns,
+                            double*          args,
+                            uint64_t         start,
+                            size_t           len) {
+    size_t top = 0;
+
+    for(size_t i = 0; i < run->op_count; ++i) {
+        const SeriesOp* op  = &run->ops[i];
+        double*         out = columns + top * SERIES_CHUNK;
+
+        switch(op->code) {
+            case SERIES_CONST:
+                for(size_t k = 0; k < len; ++k) {
+                    out[k] = op->value;
+                }
+
+                top += 1;
+                break;
+            case SERIES_INDEX:
+                for(size_t k = 0; k < len; ++k) {
+                    out[k] = run->lo + (double)(start + k);
+                }
+
+                top += 1;
+                break;
+            case SERIES_NEG:
+                out -= SERIES_CHUNK;
+
+                for(size_t k = 0; k < len; ++k) {
+                    out[k] = -out[k];
+                }
+                break;
+            case SERIES_BINARY:
+                Series_binary(
+                    op->type, out - 2 * SERIES_CHUNK, out - SERIES_CHUNK, len);
+                top -= 1;
+                break;
+            case SERIES_CALL:
+                Series_call(op, out - op->argc * SERIES_CHUNK, args, len);
+                top -= op->argc - 1;
+                break;
+        }
+    }
+}
+
+// Gives up the claimed block, stopping the run for code.
+static void Series_abandon(SeriesRun* run, uint64_t block, ErrCode code) {
+    uint64_t unfinished = atomic_load(&run->unfinished);
+
+    while(block < unfinished &&
+          !atomic_compare_exchange_weak(&run->unfinished, &unfinished, block)) {
+    }
+
+    int none = ERR_NONE;
+    atomic_compare_exchange_strong(&run->stop, &none, code);
+}
+
+// Runs blocks until there are none left or the run stops. Allocates with
+// xtrymalloc, since running out can't jump back to where the calling thread
+// entered the library while other threads still work on the run, and stops
+// the run with ERR_OUT_OF_MEMORY instead.
+static void* Series_worker(void* user) {
+    SeriesRun*  run     = user;
+    XallocScope scope   = xalloc_enter(run->allocator, 0);
+    size_t      values  = run->depth * SERIES_CHUNK;
+    double*     columns = xtrymalloc(values * sizeof(double));
+    double*     args    = xtrymalloc((run->max_argc + 1) * sizeof(double));
+
+    if(!columns || !args)
+        atomic_store(&run->stop, ERR_OUT_OF_MEMORY);
+
+    while(columns && args) {
+        uint64_t block = atomic_fetch_add(&run->next, 1);
+
+        if(block >= run->limit)
+            break;
+
+        ErrCode code = atomic_load_explicit(&run->stop, memory_order_relaxed);
+
+        if(code == ERR_NONE)
+            code = Series_check(run->budget);
+
+        if(code != ERR_NONE) {
+            Series_abandon(run, block, code);
+            break;
+        }
+
+        uint64_t  start = block * run->block;
+        uint64_t  end   = start + run->block < run->count ? start + run->block
+                                                          : run->count;
+        SeriesAcc lanes[SERIES_LANES];
+
+        Series_startLanes(lanes, run->product);
+
+        for(; start < end; start += SERIES_CHUNK) {
+            size_t len =
+                end - start < SERIES_CHUNK ? end - start : SERIES_CHUNK;
+
+            Series_runChunk(run, columns, args, start, len);
+            Series_accumulate(lanes, columns, len, run->product);
+        }
+
+        run->partials[block] = Series_mergeLanes(lanes, run->product);
+    }
+
+    xfree(columns);
+    xfree(args);
+
+    xalloc_leave(scope);
+    return 0;
+}
+
+// Runs the compiled body over the range from the first block on, on threads
+// if it is long, and combines the blocks in order, as many of them as the
+// steps left pay for. A run that stops still combines the blocks before the
+// first it didn't get through.
+static ErrCode Series_runCompiled(Series*    series,
+                                  SeriesRun* run,
+                                  uint64_t   steps,
+                                  SeriesAcc* total) {
+    size_t   threads = 1;
+    uint64_t left    = run->count - run->first * run->block;
+
+    run->limit = run->blocks;
+
+    if(steps < left) {
+        run->limit = run->first + steps / run->block;
+        left       = (run->limit - run->first) * run->block;
+    }
+
+    run->ops       = Stack_getBase(series->ops);
+    run->op_count  = Stack_getCount(series->ops);
+    run->depth     = series->depth;
+    run->max_argc  = series->max_argc;
+    run->partials  = xmalloc(run->blocks * sizeof(SeriesAcc));
+    run->allocator = xalloc_current();
+    atomic_init(&run->next, run->first);
+    atomic_init(&run->stop, ERR_NONE);
+    atomic_init(&run->unfinished, run->limit);
+
+    if(left >= SERIES_PARALLEL_MIN && !series_pooled) {
+        long     online = sysconf(_SC_NPROCESSORS_ONLN);
+        uint64_t blocks = run->limit - run->first;
+
+        if(online > 1)
+            threads = (uint64_t)online < blocks ? (size_t)online : blocks;
+    }
+
+    pthread_t* workers = xmalloc(threads * sizeof(pthread_t));
+    size_t     started = 0;
+
+    // The calling thread is one of them; whoever isn't started is done
+    // without.
+    while(started + 1 < threads &&
+          pthread_create(&workers[started], 0, Series_worker, run) == 0) {
+        started += 1;
+    }
+
+    Series_worker(run);
+
+    for(size_t i = 0; i < started; ++i) {
+        pthread_join(workers[i], 0);
+    }
+
+    xfree(workers);
+
+    // Every block before next was claimed, and run unless it was abandoned.
+    uint64_t claimed = atomic_load(&run->next);
+
+    run->finished = atomic_load(&run->unfinished);
+
+    if(claimed < run->finished)
+        run->finished = claimed;
+
+    for(uint64_t b = run->first; b < run->finished; ++b) {
+        SeriesAcc_merge(total, &run->partials[b], run->product);
+    }
+
+    xfree(run->partials);
+
+    ErrCode code = atomic_load(&run->stop);
+
+    return code == ERR_NONE && run->finished < run->blocks
+               ? ERR_BUDGET_EXHAUSTED
+               : code;
+}
+
+static BOOL Series_resolve(void* user, const Token* token, double* value) {
+    SeriesScope* scope = user;
+
+    if(!strcmp(token->func, scope->index)) {
+        *value = scope->value;
+        return TRUE;
+    }
+
+    return scope->resolve && scope->resolve(scope->user, token, value);
+}
+
+// Keeps how far a series got for resuming it, with lanes null at the start of
+// a block.
+static void Series_keep(Series*          series,
+                        uint64_t         next,
+                        const SeriesAcc* total,
+                        const SeriesAcc* lanes) {
+    series->next  = next;
+    series->total = *total;
+
+    if(lanes)
+        memcpy(series->lanes, lanes, sizeof(series->lanes));
+}
+
+// Evaluates the body token by token for every value of the index, in the
+// same blocks and lanes as Series_runCompiled, from the value next on. The
+// child runs within the budget, looking at the deadline and cancellation for
+// every value, and its steps count toward the series'.
+static SftError* Series_evalEach(Series*           series,
+                                 const SeriesCall* call,
+                                 const SeriesRun*  run,
+                                 uint64_t          next,
+                                 SeriesAcc*        total) {
+    double*    values  = series->values;
+    BOOL       pending = call->resume && series->child_pending;
+    BOOL       limited = call->budget && call->budget->steps && call->steps;
+    SftBudget  limits  = {0};
+    SftBudget* budget  = 0;
+
+    if(call->budget) {
+        limits.deadline_ns = call->budget->deadline_ns;
+        limits.cancel      = call->budget->cancel;
+        budget             = &limits;
+    }
+
+    series->child_pending = FALSE;
+
+    if(!series->child)
+        series->child = Sft_new();
+
+    series->scope.index   = call->index;
+    series->scope.resolve = call->resolve;
+    series->scope.user    = call->resolve_user;
+    Sft_setResolver(series->child, Series_resolve, &series->scope);
+
+    for(uint64_t b = next / run->block; b < run->blocks; ++b) {
+        uint64_t  start = b * run->block;
+        uint64_t  end   = start + run->block < run->count ? start + run->block
+                                                          : run->count;
+        SeriesAcc lanes[SERIES_LANES];
+        size_t    from = 0; // Values of the first chunk already in values.
+
+        // Carries on within the block it stopped in.
+        if(next > start) {
+            memcpy(lanes, series->lanes, sizeof(lanes));
+            from  = (size_t)((next - start) % SERIES_CHUNK);
+            start = next - from;
+        } else {
+            Series_startLanes(lanes, run->product);
+        }
+
+        for(; start < end; start += SERIES_CHUNK, from = 0) {
+            size_t len =
+                end - start < SERIES_CHUNK ? end - start : SERIES_CHUNK;
+
+            for(size_t k = from; k < len; ++k) {
+                series->scope.value = run->lo + (double)(start + k);
+
+                // The child may take the steps left, which 0 wouldn't limit.
+                if(limited) {
+                    uint64_t spent = *call->steps;
+                    uint64_t steps = call->budget->steps;
+
+                    limits.steps = spent < steps ? steps - spent : 0;
+
+                    if(!limits.steps) {
+                        Series_keep(series, start + k, total, lanes);
+                        series->child_pending = pending;
+                        return Series_fail(
+                            series, call, ERR_BUDGET_EXHAUSTED);
+                    }
+                }
+
+                // The body is the same tokens as when the child stopped, but
+                // the TokenArray around them may have moved.
+                if(pending) {
+                    series->child->tokens = call->body;
+                } else {
+                    values[k] = 0;
+                    Sft_begin(series->child, call->body);
+                }
+
+                pending = FALSE;
+                SftError* error =
+                    Sft_resume(series->child, budget, &values[k]);
+
+                if(limited)
+                    *call->steps += series->child->steps;
+
+                if(!error)
+                    continue;
+
+                if(error->code == ERR_BUDGET_EXHAUSTED) {
+                    Series_keep(series, start + k, total, lanes);
+                    series->child_pending = TRUE;
+                }
+
+                // The series as a whole stops for the budget, or for
+                // cancellation, rather than the token of the body the child
+                // was at.
+                if(error->code == ERR_BUDGET_EXHAUSTED ||
+                   error->code == ERR_CANCELLED)
+                    return Series_fail(series, call, error->code);
+
+                series->error = *error;
+                return &series->error;
+            }
+
+            Series_accumulate(lanes, values, len, run->product);
+        }
+
+        SeriesAcc partial = Series_mergeLanes(lanes, run->product);
+        SeriesAcc_merge(total, &partial, run->product);
+    }
+
+    return 0;
+}
+
+SftError* Series_eval(Series* series, const SeriesCall* call, double* result) {
+    double lo = call->lo;
+    double hi = call->hi;
+
+    if(!isfinite(lo) || !isfinite(hi) || hi - lo >= SERIES_MAX_COUNT)
+        return Series_fail(series, call, ERR_SERIES_RANGE);
+
+    uint64_t count = hi >= lo ? (uint64_t)(hi - lo) + 1 : 0;
+
+    if(!count) {
+        *result = call->product ? 1 : 0;
+        return 0;
+    }
+
+    BOOL       compiled = Series_compile(series, call);
+    SeriesPoly poly;
+
+    if(compiled && Series_polynomial(series, lo, &poly)) {
+        if(!call->product && Series_closedSum(&poly, (double)count, result))
+            return 0;
+
+        if(call->product && poly.degree == 0) {
+            *result = pow(poly.c[0], (double)count);
+            return 0;
+        }
+    }
+
+    SeriesRun run;
+    memset(&run, 0, sizeof(SeriesRun));
+
+    // Blocks depend on nothing but the count, so neither does the order of
+    // the additions.
+    uint64_t block = (count + SERIES_MAX_BLOCKS - 1) / SERIES_MAX_BLOCKS;
+
+    if(block < SERIES_BLOCK)
+        block = SERIES_BLOCK;
+
+    run.lo      = lo;
+    run.count   = count;
+    run.block   = (block + SERIES_CHUNK - 1) / SERIES_CHUNK * SERIES_CHUNK;
+    run.blocks  = (count + run.block - 1) / run.block;
+    run.product = call->product;
+    run.budget  = call->budget;
+
+    SeriesAcc total = SeriesAcc_identity(call->product);
+    uint64_t  next  = 0;
+
+    if(call->resume) {
+        next  = series->next;
+        total = series->total;
+    }
+
+    if(compiled) {
+        const SftBudget* budget = call->budget;
+        uint64_t         steps  = UINT64_MAX;
+
+        if(budget && budget->steps && call->steps) {
+            steps = *call->steps < budget->steps ? budget->steps - *call->steps
+                                                 : 0;
+        }
+
+        run.first    = next / run.block;
+        ErrCode code = Series_runCompiled(series, &run, steps, &total);
+
+        // A step for every value of the index the body ran for.
+        if(call->steps) {
+            uint64_t end = run.finished * run.block;
+
+            *call->steps += (end < count ? end : count) - run.first * run.block;
+        }
+
+        if(code != ERR_NONE) {
+            Series_keep(series, run.finished * run.block, &total, 0);
+            return Series_fail(series, call, code);
+        }
+    } else {
+        SftError* error = Series_evalEach(series, call, &run, next, &total);
+
+        if(error)
+            return error;
+    }
+
+    *result = SeriesAcc_result(&total);
+    return 0;
+}
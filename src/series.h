@@ -0,0 +1,106 @@
+#ifndef _H_SERIES_
+#define _H_SERIES_
+
+#include "common.h"
+#include "evaluator.h"
+#include "tokenizer.h"
+
+// Sums and products of a body over a range of an index variable:
+//
+//     sum(i, 1, 100, i^2)     prod(k, 1, 10, k)     sum(n, 0, 20, x^n / f(n))
+//
+// The index takes the values lo, lo + 1, ... up to hi, both of which are
+// ordinary arguments; an empty range sums to 0 and multiplies to 1. What
+// makes sum and prod series rather than the variadic functions is the first
+// argument being a lone variable, followed by exactly three more. That
+// variable must have no value of its own, or the call fails with
+// ERR_SERIES_INDEX rather than pick between the two: sum(x, 1, 2, 3) with x
+// set is written sum((x), 1, 2, 3). So the index of a series within another
+// can't be that of the outer one.
+//
+// The body is compiled once, into a postfix program whose variables other
+// than the index are looked up once, up front. If it turns out to be a
+// polynomial in the index of degree SERIES_DEGREE or less, a sum is worked
+// out in closed form, and a product of a constant is a power. Otherwise the
+// program runs over SERIES_CHUNK values of the index at a time, every
+// operation a loop over the chunk, with the chunks of long ranges spread over
+// threads, unless the series is evaluated on a pool's thread. Each operation
+// computes what evaluating the body token by token would for every value of
+// the index, so only the order of the additions or multiplications differs.
+// Comparisons, && and || and if() compute both of their sides over the chunk
+// and select between them with masks, rather than branching on every value.
+//
+// Sums are compensated (TwoSum) and products too (TwoProduct), so the result
+// is as accurate as if it had been accumulated in twice the precision and
+// rounded once, unless the terms cancel to less than the rounding error of
+// the largest of them. Accumulation goes in blocks, each in SERIES_LANES
+// interleaved lanes, and the blocks are combined in order, which depends on
+// nothing but the length of the range: the result is the same whatever the
+// number of threads.
+//
+// A closed form is only taken where its terms don't cancel by more than
+// SERIES_CANCEL_BITS bits, which keeps it within a few ulps of the exact sum.
+//
+// Bodies that can't be compiled, such as those holding series of their own,
+// are evaluated token by token for every value of the index by a child Sft,
+// on the calling thread.
+//
+// Against the steps of a budget, a compiled body costs a step per value of
+// the index, paid a block at a time before the block runs, and one that
+// isn't compiled the steps of the child. Closed forms cost nothing.
+
+#define SERIES_DEGREE      4
+#define SERIES_CHUNK       256
+#define SERIES_LANES       4
+#define SERIES_CANCEL_BITS 8
+
+// Ranges shorter than this stay on the calling thread.
+#define SERIES_PARALLEL_MIN (1 << 18)
+
+// Marks the calling thread as one of a pool that already keeps the CPUs busy,
+// such as the workers of batch.h, server.h and split.h, or unmarks it, and
+// returns whether it was marked. Series evaluated on a marked thread run on
+// it alone, rather than start a thread per CPU for every one.
+extern BOOL Series_setPooled(BOOL pooled);
+
+// Whether the function of an open paren makes it a series when its first
+// argument is a lone variable.
+extern BOOL Series_isSeries(const char* func);
+
+// One series to evaluate. Variables other than the index are resolved by
+// resolve, which may be null. The budget, if any, is checked for
+// cancellation and the deadline between blocks, and its steps against those
+// taken so far, which the series adds its own to.
+//
+// If the budget runs out, the Series keeps how far it got, and evaluating the
+// same series on it again with resume set carries on from there, to the same
+// result as evaluating it in one go.
+typedef struct SeriesCall {
+    const char*      index;
+    TokenArray*      body;
+    BOOL             product;
+    double           lo;
+    double           hi;
+    SftResolver      resolve;
+    void*            resolve_user;
+    const SftBudget* budget;
+    uint64_t*        steps; // Taken so far, or null.
+    BOOL             resume;
+
+    // Offset of the series' close paren, for errors of the series as a whole.
+    size_t offset;
+} SeriesCall;
+
+typedef struct Series Series;
+
+extern Series* Series_new(void);
+extern void    Series_free(Series* series);
+
+// Evaluates the series, reusing the Series' memory from earlier ones. Returns
+// null with the result, or the error, kept in the Series. Its token_index
+// counts from the first token of the body, and is the body's token count for
+// errors of the series as a whole: a range that isn't finite or holds more
+// than 2^53 values, a budget that ran out, or cancellation.
+extern SftError* Series_eval(Series* series, const SeriesCall* call, double* result);
+
+#endif // _H_SERIES_
@@ -0,0 +1,504 @@
+// accept4
+#define _GNU_SOURCE
+
+#include "server.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "series.h"
+
+#define SERVER_READ_SIZE (64 << 10)
+#define SERVER_EVENTS    64
+
+typedef struct Connection {
+    int     fd;
+    char*   in; // Received bytes not yet evaluated, at most a partial line.
+    size_t  in_len;
+    size_t  in_capacity;
+    OutBuf* out; // Replies not yet accepted by the socket, from `sent` on.
+    size_t  sent;
+    BOOL    closing; // The client is done sending; close once out is sent.
+    BOOL    writing; // Polled for EPOLLOUT rather than EPOLLIN.
+
+    struct Connection* prev;
+    struct Connection* next;
+} Connection;
+
+typedef struct Server Server;
+
+typedef struct Worker {
+    Server*     server;
+    pthread_t   thread;
+    int         epoll_fd;
+    Tokenizer*    t;
+    Sft*          sft;
+    LatencyStats* latency; // With BatchOptions.latency.
+    Connection*   connections;
+} Worker;
+
+struct Server {
+    const ServerOptions* options;
+    size_t               max_line;
+    int                  listen_fd;
+    int                  stop_fd; // eventfd, readable once the server stops.
+};
+
+// Fills in the socket address for "unix:PATH" or "tcp:PORT". Returns the
+// address family, or -1 after printing what is wrong with the address.
+static int Server_parseAddress(const char*              address,
+                               struct sockaddr_storage* storage,
+                               socklen_t*               length) {
+    memset(storage, 0, sizeof(*storage));
+
+    if(!strncmp(address, "unix:", 5)) {
+        struct sockaddr_un* un   = (struct sockaddr_un*)storage;
+        const char*         path = address + 5;
+
+        if(!*path || strlen(path) >= sizeof(un->sun_path)) {
+            fprintf(stderr, "Bad Unix socket path '%s'\n", path);
+            return -1;
+        }
+
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, path);
+        *length = sizeof(struct sockaddr_un);
+        return AF_UNIX;
+    }
+
+    if(!strncmp(address, "tcp:", 4)) {
+        struct sockaddr_in* in   = (struct sockaddr_in*)storage;
+        char*               end  = 0;
+        unsigned long       port = strtoul(address + 4, &end, 10);
+
+        if(end == address + 4 || *end || port == 0 || port > 65535) {
+            fprintf(stderr, "Bad TCP port '%s'\n", address + 4);
+            return -1;
+        }
+
+        in->sin_family      = AF_INET;
+        in->sin_port        = htons((uint16_t)port);
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        *length             = sizeof(struct sockaddr_in);
+        return AF_INET;
+    }
+
+    fprintf(stderr, "Address must be unix:PATH or tcp:PORT, not '%s'\n", address);
+    return -1;
+}
+
+int Server_listen(const char* address) {
+    struct sockaddr_storage storage;
+    socklen_t               length;
+    int family = Server_parseAddress(address, &storage, &length);
+
+    if(family < 0)
+        return -1;
+
+    int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if(fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if(family == AF_UNIX) {
+        // Replace the socket file a previous server left behind, but nothing
+        // that isn't a socket.
+        const char* path = ((struct sockaddr_un*)&storage)->sun_path;
+        struct stat st;
+
+        if(!stat(path, &st) && S_ISSOCK(st.st_mode))
+            unlink(path);
+    } else {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+
+    if(bind(fd, (struct sockaddr*)&storage, length) < 0 ||
+       listen(fd, SOMAXCONN) < 0) {
+        perror(address);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int Server_connect(const char* address) {
+    struct sockaddr_storage storage;
+    socklen_t               length;
+    int family = Server_parseAddress(address, &storage, &length);
+
+    if(family < 0)
+        return -1;
+
+    int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if(fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if(connect(fd, (struct sockaddr*)&storage, length) < 0) {
+        perror(address);
+        close(fd);
+        return -1;
+    }
+
+    if(family == AF_INET) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    return fd;
+}
+
+static void Connection_close(Worker* worker, Connection* c) {
+    if(c->prev)
+        c->prev->next = c->next;
+    else
+        worker->connections = c->next;
+
+    if(c->next)
+        c->next->prev = c->prev;
+
+    close(c->fd); // Also takes it out of the epoll set.
+    OutBuf_free(c->out);
+    xfree(c->in);
+    xfree(c);
+}
+
+static void Worker_accept(Worker* worker) {
+    while(TRUE) {
+        int fd = accept4(worker->server->listen_fd,
+                         0,
+                         0,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if(fd < 0) {
+            // EAGAIN once the backlog is empty; anything else is about that
+            // one connection, or transient, and is retried on the next wakeup.
+            if(errno == EINTR)
+                continue;
+
+            return;
+        }
+
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        Connection* c = xmalloc(sizeof(Connection));
+        memset(c, 0, sizeof(Connection));
+
+        c->fd          = fd;
+        c->in_capacity = SERVER_READ_SIZE;
+        c->in          = xmalloc(c->in_capacity);
+        c->out         = OutBuf_new(0, SERVER_READ_SIZE);
+        c->next        = worker->connections;
+
+        if(c->next)
+            c->next->prev = c;
+
+        worker->connections = c;
+
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = c};
+
+        if(epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            perror("epoll_ctl");
+            Connection_close(worker, c);
+        }
+    }
+}
+
+// Sends as much of the pending replies as the socket takes. Reading from the
+// connection pauses while replies are left over and resumes once they're
+// all sent. Returns FALSE if the connection is finished with.
+static BOOL Connection_send(Worker* worker, Connection* c) {
+    while(c->sent < c->out->len) {
+        ssize_t n = send(c->fd,
+                         c->out->data + c->sent,
+                         c->out->len - c->sent,
+                         MSG_NOSIGNAL);
+
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            return FALSE;
+        }
+
+        c->sent += (size_t)n;
+    }
+
+    BOOL pending = c->sent < c->out->len;
+
+    if(!pending) {
+        OutBuf_clear(c->out);
+        c->sent = 0;
+
+        if(c->closing)
+            return FALSE;
+    }
+
+    if(pending != c->writing) {
+        struct epoll_event event = {.events   = pending ? EPOLLOUT : EPOLLIN,
+                                    .data.ptr = c};
+
+        if(epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, c->fd, &event) < 0)
+            return FALSE;
+
+        c->writing = pending;
+    }
+
+    return TRUE;
+}
+
+// Evaluates the complete lines received so far, or everything once the
+// client has stopped sending, and keeps the partial line for later.
+static void Connection_evaluate(Worker* worker, Connection* c) {
+    size_t complete = c->in_len;
+
+    if(!c->closing) {
+        while(complete && c->in[complete - 1] != '\n') {
+            --complete;
+        }
+    }
+
+    if(!complete)
+        return;
+
+    BatchStats stats = {0};
+    Batch_evalLines(worker->t,
+                    worker->sft,
+                    0,
+                    0,
+                    0,
+                    worker->latency,
+                    c->in,
+                    complete,
+                    c->out,
+                    &worker->server->options->batch,
+                    &stats);
+
+    c->in_len -= complete;
+    memmove(c->in, c->in + complete, c->in_len);
+}
+
+// Reads once from the connection and answers what was read. Returns FALSE if
+// the connection is finished with.
+static BOOL Connection_receive(Worker* worker, Connection* c) {
+    if(c->in_len == c->in_capacity) {
+        if(c->in_capacity > worker->server->max_line)
+            return FALSE;
+
+        c->in_capacity *= 2;
+        c->in = xrealloc(c->in, c->in_capacity);
+    }
+
+    ssize_t n = recv(c->fd, c->in + c->in_len, c->in_capacity - c->in_len, 0);
+
+    if(n < 0)
+        return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+
+    if(n == 0) {
+        // An unterminated last expression is still answered, as in batch mode.
+        c->closing = TRUE;
+    }
+
+    c->in_len += (size_t)n;
+
+    Connection_evaluate(worker, c);
+    return Connection_send(worker, c);
+}
+
+static void* Worker_run(void* arg) {
+    Worker*            worker = arg;
+    Server*            server = worker->server;
+    struct epoll_event events[SERVER_EVENTS];
+    BOOL               running = TRUE;
+
+    Series_setPooled(TRUE);
+
+    while(running) {
+        int count = epoll_wait(worker->epoll_fd, events, SERVER_EVENTS, -1);
+
+        if(count < 0) {
+            if(errno == EINTR)
+                continue;
+
+            perror("epoll_wait");
+            break;
+        }
+
+        for(int i = 0; i < count && running; ++i) {
+            void* ptr = events[i].data.ptr;
+
+            if(ptr == &server->stop_fd) {
+                running = FALSE;
+                continue;
+            }
+
+            if(ptr == &server->listen_fd) {
+                Worker_accept(worker);
+                continue;
+            }
+
+            Connection* c    = ptr;
+            BOOL        keep = TRUE;
+
+            if(events[i].events & EPOLLOUT)
+                keep = Connection_send(worker, c);
+            else if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                keep = Connection_receive(worker, c);
+
+            if(!keep)
+                Connection_close(worker, c);
+        }
+    }
+
+    while(worker->connections) {
+        Connection_close(worker, worker->connections);
+    }
+
+    return 0;
+}
+
+int Server_run(const char* address, const ServerOptions* options) {
+    Server server = {.options   = options,
+                     .max_line  = options->max_line ? options->max_line
+                                                    : SERVER_DEFAULT_MAX_LINE,
+                     .listen_fd = -1,
+                     .stop_fd   = -1};
+
+    size_t threads = options->threads;
+
+    if(!threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads     = online > 0 ? (size_t)online : 1;
+    }
+
+    // Block the stop signals before starting any thread, so that they are
+    // only ever delivered to the sigwait below.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, 0);
+
+    server.listen_fd = Server_listen(address);
+
+    if(server.listen_fd < 0)
+        return 1;
+
+    server.stop_fd = eventfd(0, EFD_CLOEXEC);
+
+    if(server.stop_fd < 0) {
+        perror("eventfd");
+        close(server.listen_fd);
+        return 1;
+    }
+
+    Worker* workers = xmalloc(threads * sizeof(Worker));
+    size_t  started = 0;
+
+    memset(workers, 0, threads * sizeof(Worker));
+
+    for(; started < threads; ++started) {
+        Worker* worker = &workers[started];
+
+        worker->server   = &server;
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+        if(worker->epoll_fd < 0)
+            break;
+
+        struct epoll_event listen_event = {.events = EPOLLIN | EPOLLEXCLUSIVE,
+                                           .data.ptr = &server.listen_fd};
+        struct epoll_event stop_event   = {.events   = EPOLLIN,
+                                           .data.ptr = &server.stop_fd};
+
+        if(epoll_ctl(worker->epoll_fd,
+                     EPOLL_CTL_ADD,
+                     server.listen_fd,
+                     &listen_event) < 0 ||
+           epoll_ctl(worker->epoll_fd,
+                     EPOLL_CTL_ADD,
+                     server.stop_fd,
+                     &stop_event) < 0) {
+            close(worker->epoll_fd);
+            break;
+        }
+
+        worker->t       = Tokenizer_new();
+        worker->sft     = Sft_new();
+        worker->latency = options->batch.latency ? LatencyStats_new() : 0;
+
+        if(pthread_create(&worker->thread, 0, Worker_run, worker) != 0) {
+            xfree(worker->latency);
+            Sft_free(worker->sft);
+            Tokenizer_free(worker->t);
+            close(worker->epoll_fd);
+            break;
+        }
+    }
+
+    int rc = 0;
+
+    if(started) {
+        fprintf(stderr, "Serving %s on %zu workers\n", address, started);
+
+        int received = 0;
+        sigwait(&stop_signals, &received);
+
+        // Never read, so it stays readable and wakes every worker.
+        uint64_t one = 1;
+
+        if(write(server.stop_fd, &one, sizeof(one)) != sizeof(one))
+            perror("eventfd");
+    } else {
+        perror("Failed to start a worker");
+        rc = 1;
+    }
+
+    LatencyStats* latency = options->batch.latency ? LatencyStats_new() : 0;
+
+    for(size_t i = 0; i < started; ++i) {
+        pthread_join(workers[i].thread, 0);
+        close(workers[i].epoll_fd);
+
+        if(latency)
+            LatencyStats_add(latency, workers[i].latency);
+
+        xfree(workers[i].latency);
+        Sft_free(workers[i].sft);
+        Tokenizer_free(workers[i].t);
+    }
+
+    if(latency && started)
+        LatencyStats_print(latency, stderr);
+
+    xfree(latency);
+
+    xfree(workers);
+    close(server.stop_fd);
+    close(server.listen_fd);
+
+    if(!strncmp(address, "unix:", 5))
+        unlink(address + 5);
+
+    return rc;
+}
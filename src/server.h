@@ -0,0 +1,52 @@
+#ifndef _H_SERVER_
+#define _H_SERVER_
+
+#include "batch.h"
+#include "common.h"
+
+// Evaluation server: keeps Tokenizer/Sft pairs warm so that callers pay for
+// a round trip over a local socket rather than a process start.
+//
+// Clients send newline separated expressions and get one line back per
+// expression, in order, formatted as in batch mode. A client may pipeline as
+// many expressions as it likes; replies are written as the socket accepts
+// them and reading from a client pauses while its replies are backed up.
+//
+// Each worker thread owns an epoll instance, a Tokenizer/Sft pair and the
+// connections it accepted. The listening socket is in every worker's epoll
+// set with EPOLLEXCLUSIVE, so a new connection wakes one worker, which then
+// serves it for its whole lifetime without any locking.
+//
+// Addresses are "unix:PATH" for a Unix domain socket, or "tcp:PORT" for a
+// TCP socket bound to 127.0.0.1 only.
+
+typedef struct ServerOptions {
+    // Worker threads; 0 uses one per online CPU.
+    size_t threads;
+
+    // Longest line a client may send; a client sending a longer one is
+    // disconnected. 0 means SERVER_DEFAULT_MAX_LINE.
+    size_t max_line;
+
+    // Only skip_errors, the max_steps and max_ns limits on every expression,
+    // and latency apply; latency times every expression and prints the
+    // percentiles when the server stops.
+    BatchOptions batch;
+} ServerOptions;
+
+#define SERVER_DEFAULT_MAX_LINE (16 << 20)
+
+// Opens a non-blocking socket listening on the address, replacing a stale
+// Unix socket file. Returns -1 and prints the reason on failure.
+extern int Server_listen(const char* address);
+
+// Opens a blocking socket connected to the address. Returns -1 and prints
+// the reason on failure.
+extern int Server_connect(const char* address);
+
+// Serves the address until SIGINT or SIGTERM, then closes every connection
+// and returns 0, or non-zero if the server couldn't start. Blocks both
+// signals in the calling thread.
+extern int Server_run(const char* address, const ServerOptions* options);
+
+#endif // _H_SERVER_
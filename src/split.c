@@ -0,0 +1,655 @@
+#include "split.h"
+
+#include "series.h"
+
+// A paren open while planning: where its group starts, where the members and
+// units found in it start in the scratch, and the tokens of those members.
+typedef struct SplitFrame {
+    size_t open;
+    size_t members;
+    size_t units;
+    size_t cost;
+
+    BOOL candidate; // The group may be evaluated on its own.
+    BOOL inner;     // So may those in it.
+
+    // What follows in the parens isn't necessarily evaluated: an && or || of
+    // the level was read, or the first comma of an if(), the one comma with a
+    // jump that leads elsewhere than its close paren.
+    BOOL seen;
+} SplitFrame;
+
+static void* Split_thread(void* arg);
+
+Split* Split_new(size_t threads, size_t grain) {
+    Split* split = xmalloc(sizeof(Split));
+    memset(split, 0, sizeof(Split));
+
+    if(!threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads     = online > 0 ? (size_t)online : 1;
+    }
+
+    split->grain     = grain ? grain : SPLIT_DEFAULT_GRAIN;
+    split->workers   = xmalloc(threads * sizeof(SplitWorker));
+    split->tasks     = Stack_new(sizeof(SplitTask));
+    split->groups    = Stack_new(sizeof(SplitGroup));
+    split->frames    = Stack_new(sizeof(SplitFrame));
+    split->members   = Stack_new(sizeof(SplitGroup));
+    split->units     = Stack_new(sizeof(size_t));
+    split->allocator = xalloc_current();
+    split->threads   = 1;
+
+    memset(split->workers, 0, threads * sizeof(SplitWorker));
+
+    for(size_t i = 0; i < threads; ++i) {
+        split->workers[i].split = split;
+        pthread_mutex_init(&split->workers[i].deque.lock, 0);
+    }
+
+    pthread_mutex_init(&split->lock, 0);
+    pthread_cond_init(&split->start, 0);
+    pthread_cond_init(&split->wake, 0);
+    pthread_cond_init(&split->idle, 0);
+    atomic_init(&split->queued, 0);
+
+    // Make do with fewer threads if the system won't give us all of them.
+    while(split->threads < threads &&
+          pthread_create(&split->workers[split->threads].thread,
+                         0,
+                         Split_thread,
+                         &split->workers[split->threads]) == 0) {
+        split->threads += 1;
+    }
+
+    return split;
+}
+
+void Split_free(Split* split) {
+    if(!split)
+        return;
+
+    pthread_mutex_lock(&split->lock);
+    split->stop = TRUE;
+    pthread_cond_broadcast(&split->start);
+    pthread_mutex_unlock(&split->lock);
+
+    for(size_t i = 1; i < split->threads; ++i) {
+        pthread_join(split->workers[i].thread, 0);
+    }
+
+    for(size_t i = 0; i < split->threads; ++i) {
+        pthread_mutex_destroy(&split->workers[i].deque.lock);
+        xfree(split->workers[i].deque.items);
+    }
+
+    pthread_cond_destroy(&split->idle);
+    pthread_cond_destroy(&split->wake);
+    pthread_cond_destroy(&split->start);
+    pthread_mutex_destroy(&split->lock);
+
+    Stack_free(split->tasks);
+    Stack_free(split->groups);
+    Stack_free(split->frames);
+    Stack_free(split->members);
+    Stack_free(split->units);
+    xfree(split->workers);
+    xfree(split->pending);
+    xfree(split->values);
+    xfree(split->steps);
+    xfree(split);
+}
+
+// The open paren of the first group of the unit at index unit.
+static size_t Split_unitOpen(const Split* split, size_t unit) {
+    const size_t*    units = Stack_getBase(split->units);
+    const SplitTask* task  = Stack_itemAt(split->tasks, units[unit]);
+
+    return ((const SplitGroup*)Stack_itemAt(split->groups, task->first))->open;
+}
+
+// Packs the members from index from on into batches of about the grain in
+// tokens, in order, which become tasks inside the parent. A batch doesn't
+// reach over one of the units from index units on, whose tokens would be
+// among its steps.
+static void Split_pack(Split* split, size_t from, size_t units, size_t parent) {
+    SplitGroup* members = Stack_getBase(split->members);
+    size_t      count   = Stack_getCount(split->members);
+    size_t      first   = Stack_getCount(split->tasks);
+    size_t      cost    = 0;
+    SplitTask*  task;
+
+    for(size_t i = from; i < count; ++i) {
+        while(units < Stack_getCount(split->units) &&
+              Split_unitOpen(split, units) < members[i].open) {
+            units += 1;
+            cost = 0;
+        }
+
+        if(!cost) {
+            SplitTask batch = {.parent = parent,
+                               .first  = Stack_getCount(split->groups)};
+
+            Stack_pushFrom(split->tasks, &batch);
+            task = Stack_itemAt(split->tasks, parent);
+            task->children += 1;
+        }
+
+        Stack_pushFrom(split->groups, &members[i]);
+        task = Stack_getHead(split->tasks);
+        task->count += 1;
+        cost += members[i].close - members[i].open + 1;
+
+        if(cost >= split->grain)
+            cost = 0;
+    }
+
+    Stack_truncate(split->members, from);
+
+    // A step for each group, and one for each token between them.
+    const SplitGroup* groups = Stack_getBase(split->groups);
+
+    for(size_t t = first; t < Stack_getCount(split->tasks); ++t) {
+        task = Stack_itemAt(split->tasks, t);
+
+        if(task->count < 2)
+            continue;
+
+        const SplitGroup* group = &groups[task->first];
+        const SplitGroup* last  = &group[task->count - 1];
+        size_t            steps = last->close - group->open + 1;
+
+        for(size_t k = 0; k < task->count; ++k) {
+            steps -= group[k].close - group[k].open;
+        }
+
+        task->steps      = split->step_total;
+        task->step_count = steps;
+        split->step_total += steps;
+    }
+}
+
+// Makes the units from index from on tasks inside the parent.
+static void Split_adopt(Split* split, size_t from, size_t parent) {
+    const size_t* units = Stack_getBase(split->units);
+    SplitTask*    tasks = Stack_getBase(split->tasks);
+
+    for(size_t i = from; i < Stack_getCount(split->units); ++i) {
+        tasks[units[i]].parent = parent;
+        tasks[parent].children += 1;
+    }
+
+    Stack_truncate(split->units, from);
+}
+
+// Decides what the group of the frame is, now that its close paren is at
+// index close: a member, evaluated whole in a batch, if it is small, and a
+// task if it holds at least two tasks' worth of groups. Otherwise the groups
+// in it are its parent's, and it is evaluated along with the parent.
+static void Split_close(Split* split, const SplitFrame* frame, size_t close) {
+    SplitFrame* parent = Stack_getHead(split->frames);
+    SplitGroup  group  = {.open = frame->open, .close = close};
+    size_t      cost   = close - frame->open + 1;
+    size_t      units  = Stack_getCount(split->units) - frame->units;
+
+    if(!frame->candidate)
+        return;
+
+    if(cost <= split->grain) {
+        Stack_truncate(split->members, frame->members);
+        Stack_pushFrom(split->members, &group);
+        parent->cost += cost;
+        return;
+    }
+
+    if(units * split->grain + frame->cost < 2 * split->grain) {
+        parent->cost += frame->cost;
+        return;
+    }
+
+    size_t    index = Stack_getCount(split->tasks);
+    SplitTask task  = {.first = Stack_getCount(split->groups), .count = 1};
+
+    Stack_pushFrom(split->tasks, &task);
+    Stack_pushFrom(split->groups, &group);
+
+    Split_pack(split, frame->members, frame->units, index);
+    Split_adopt(split, frame->units, index);
+    Stack_pushFrom(split->units, &index);
+}
+
+// Plans the tasks of the run's tokens in one pass over them. Returns the
+// number of tasks besides task 0.
+static size_t Split_plan(Split* split) {
+    const Token* tokens = split->tokens->tokens;
+    size_t       count  = split->tokens->count;
+    SplitTask    whole  = {0};
+    SplitFrame   level  = {.inner = TRUE};
+
+    Stack_clear(split->tasks);
+    Stack_clear(split->groups);
+    Stack_clear(split->frames);
+    Stack_clear(split->members);
+    Stack_clear(split->units);
+
+    split->step_total = 0;
+
+    Stack_pushFrom(split->tasks, &whole);
+    Stack_pushFrom(split->frames, &level);
+
+    for(size_t i = 0; i < count; ++i) {
+        const Token* token = &tokens[i];
+
+        if(!(token->type & (TT_OPA | TT_CPA | TT_JMP)))
+            continue;
+
+        SplitFrame* top = Stack_getHead(split->frames);
+
+        if(token->type & TT_OPA) {
+            SplitFrame frame = {
+                .open      = i,
+                .members   = Stack_getCount(split->members),
+                .units     = Stack_getCount(split->units),
+                .candidate = top->inner && !top->seen,
+            };
+
+            // The body of a series is evaluated over its range, with the
+            // index as a variable, so nothing in a series stands on its own.
+            frame.inner = frame.candidate &&
+                          !(i + 2 < count && tokens[i + 1].type & TT_VAR &&
+                            tokens[i + 2].type & TT_COM &&
+                            Series_isSeries(token->func));
+
+            Stack_pushFrom(split->frames, &frame);
+        } else if(token->type & TT_CPA) {
+            SplitFrame frame;
+
+            if(Stack_getCount(split->frames) > 1) {
+                Stack_popInto(split->frames, &frame);
+                Split_close(split, &frame, i);
+            }
+        } else if(token->type & (TT_AND | TT_OR) ||
+                  (token->type & TT_COM && token->depth)) {
+            top->seen = TRUE;
+        }
+    }
+
+    // The groups in parens that are never closed are their parent's.
+    while(Stack_getCount(split->frames) > 1) {
+        SplitFrame frame;
+        Stack_popInto(split->frames, &frame);
+
+        ((SplitFrame*)Stack_getHead(split->frames))->cost += frame.cost;
+    }
+
+    Split_pack(split, 0, 0, 0);
+    Split_adopt(split, 0, 0);
+
+    return Stack_getCount(split->tasks) - 1;
+}
+
+// Evaluates the steps of the batch in place of the tokens from the open paren
+// of its first group, at *at, and moves *at on to the close paren of its last
+// one. A jump out of the steps is left to the caller.
+static SftError* Split_steps(Split* split, Sft* sft, size_t batch, size_t* at) {
+    const SplitTask*  task  = Stack_itemAt(split->tasks, batch);
+    const SplitStep*  steps = &split->steps[task->steps];
+    const SplitGroup* last  =
+        Stack_itemAt(split->groups, task->first + task->count - 1);
+
+    for(size_t k = 0; k < task->step_count; ++k) {
+        SftError* error = Sft_evalToken(sft, &steps[k].token, steps[k].index);
+
+        if(error)
+            return error;
+
+        if(sft->skip_to > last->close)
+            return 0;
+
+        if(sft->skip_to) {
+            while(k + 1 < task->step_count && steps[k + 1].index < sft->skip_to)
+                ++k;
+
+            sft->skip_to = 0;
+        }
+    }
+
+    *at = last->close;
+    return 0;
+}
+
+// Evaluates the tokens [from, to) of the run, reading the groups in them that
+// were evaluated in a task as their values, and the batches as their steps.
+static SftError* Split_range(Split* split, Sft* sft, size_t from, size_t to) {
+    const Token* tokens = split->tokens->tokens;
+    SftError*    error  = 0;
+
+    for(size_t i = from; !error && i < to; ++i) {
+        const SplitValue* value = 0;
+
+        if(tokens[i].type & TT_OPA)
+            value = &split->values[i];
+
+        if(value && value->batch) {
+            error = Split_steps(split, sft, value->batch, &i);
+        } else if(value && value->close) {
+            Token number = {.type   = TT_NUM,
+                            .f64    = value->value,
+                            .offset = tokens[i].offset};
+
+            error = Sft_evalToken(sft, &number, i);
+            i     = value->close;
+        } else {
+            error = Sft_evalToken(sft, &tokens[i], i);
+        }
+
+        if(sft->skip_to) {
+            i            = sft->skip_to - 1;
+            sft->skip_to = 0;
+        }
+    }
+
+    return error;
+}
+
+// Evaluates the group on its own, and gives it its value if it leaves one
+// alone on the number cellar, as it would in the expression.
+static void Split_group(Split* split, Sft* sft, const SplitGroup* group) {
+    Sft_reset(sft);
+
+    if(Split_range(split, sft, group->open, group->close + 1) ||
+       !Stack_empty(sft->operator_stack) ||
+       Stack_getCount(sft->number_stack) != 1 || sft->capturing ||
+       sft->index_pending)
+        return;
+
+    SplitValue* value = &split->values[group->open];
+
+    value->value = *(double*)Stack_getHead(sft->number_stack);
+    value->close = group->close;
+}
+
+// Leaves the steps of the batch for the task around it, if all its groups
+// came to a value.
+static void Split_leave(Split* split, size_t batch) {
+    const Token*      tokens = split->tokens->tokens;
+    const SplitTask*  task   = Stack_itemAt(split->tasks, batch);
+    const SplitGroup* groups = Stack_itemAt(split->groups, task->first);
+    SplitStep*        step   = &split->steps[task->steps];
+    size_t            at     = groups[0].open;
+
+    for(size_t k = 0; k < task->count; ++k) {
+        if(!split->values[groups[k].open].close)
+            return;
+    }
+
+    for(size_t k = 0; k < task->count; ++k) {
+        for(; at < groups[k].open; ++at, ++step) {
+            step->token = tokens[at];
+            step->index = at;
+        }
+
+        step->token = (Token){.type   = TT_NUM,
+                              .f64    = split->values[at].value,
+                              .offset = tokens[at].offset};
+        step->index = at;
+
+        step += 1;
+        at = groups[k].close + 1;
+    }
+
+    split->values[groups[0].open].batch = batch;
+}
+
+static void SplitDeque_push(SplitDeque* deque, size_t task) {
+    pthread_mutex_lock(&deque->lock);
+    deque->items[deque->bottom++] = task;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+// Takes the newest task, or the oldest one. Returns FALSE if there is none.
+static BOOL SplitDeque_take(SplitDeque* deque, BOOL newest, size_t* task) {
+    pthread_mutex_lock(&deque->lock);
+
+    BOOL found = deque->top < deque->bottom;
+
+    if(found && newest)
+        *task = deque->items[--deque->bottom];
+    else if(found)
+        *task = deque->items[deque->top++];
+
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// Takes the oldest task of the first other worker that has one, starting
+// with the next one.
+static BOOL Split_steal(Split* split, SplitWorker* self, size_t* task) {
+    size_t index = (size_t)(self - split->workers);
+
+    for(size_t k = 1; k < split->threads; ++k) {
+        SplitWorker* victim = &split->workers[(index + k) % split->threads];
+
+        if(SplitDeque_take(&victim->deque, FALSE, task)) {
+            self->stolen += 1;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// Runs the task, and the parent on this worker next if it was the last task
+// inside it, or ends the run if that is task 0.
+static void Split_run(Split* split, SplitWorker* self, Sft* sft, size_t index) {
+    const SplitTask*  task   = Stack_itemAt(split->tasks, index);
+    const SplitGroup* groups = Stack_getBase(split->groups);
+
+    for(size_t k = 0; k < task->count; ++k) {
+        Split_group(split, sft, &groups[task->first + k]);
+    }
+
+    if(task->step_count)
+        Split_leave(split, index);
+
+    if(atomic_fetch_sub(&split->pending[task->parent], 1) != 1)
+        return;
+
+    if(task->parent) {
+        SplitDeque_push(&self->deque, task->parent);
+        atomic_fetch_add(&split->queued, 1);
+    }
+
+    // Under the lock, so that no worker is between finding nothing to do and
+    // waiting for it.
+    pthread_mutex_lock(&split->lock);
+
+    if(task->parent)
+        pthread_cond_signal(&split->wake);
+    else
+        pthread_cond_broadcast(&split->wake);
+
+    pthread_mutex_unlock(&split->lock);
+}
+
+// Runs tasks of the run until it is over.
+static void Split_work(Split* split, SplitWorker* self, Sft* sft) {
+    size_t task;
+
+    while(atomic_load(&split->pending[0])) {
+        if(atomic_load(&split->queued) &&
+           (SplitDeque_take(&self->deque, TRUE, &task) ||
+            Split_steal(split, self, &task))) {
+            atomic_fetch_sub(&split->queued, 1);
+            Split_run(split, self, sft, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&split->lock);
+
+        while(!atomic_load(&split->queued) && atomic_load(&split->pending[0]))
+            pthread_cond_wait(&split->wake, &split->lock);
+
+        pthread_mutex_unlock(&split->lock);
+    }
+}
+
+// A worker besides the calling thread, with an Sft of its own, taking part in
+// every run until the Split is freed.
+static void* Split_thread(void* arg) {
+    SplitWorker* self  = arg;
+    Split*       split = self->split;
+    XallocScope  scope = xalloc_enter(split->allocator, 0);
+    Sft*         sft   = Sft_new();
+    size_t       seen  = 0;
+
+    Series_setPooled(TRUE);
+    pthread_mutex_lock(&split->lock);
+
+    while(TRUE) {
+        while(!split->stop && split->generation == seen)
+            pthread_cond_wait(&split->start, &split->lock);
+
+        if(split->stop)
+            break;
+
+        seen = split->generation;
+        pthread_mutex_unlock(&split->lock);
+
+        Sft_setResolver(sft, split->resolve, split->resolve_user);
+        Split_work(split, self, sft);
+
+        pthread_mutex_lock(&split->lock);
+
+        if(--split->busy == 0)
+            pthread_cond_signal(&split->idle);
+    }
+
+    pthread_mutex_unlock(&split->lock);
+
+    Sft_free(sft);
+    xalloc_leave(scope);
+    return 0;
+}
+
+// Sizes what the run needs for its tokens and tasks, and deals the tasks
+// that are ready out to the workers in order, a slice to each.
+static void Split_prepare(Split* split, size_t tasks) {
+    size_t           count = split->tokens->count;
+    const SplitTask* plan  = Stack_getBase(split->tasks);
+    size_t           ready = 0;
+    size_t           dealt = 0;
+
+    if(count > split->capacity) {
+        split->values = xrealloc(split->values, count * sizeof(SplitValue));
+        memset(&split->values[split->capacity],
+               0,
+               (count - split->capacity) * sizeof(SplitValue));
+        split->capacity = count;
+    }
+
+    if(split->step_total > split->step_capacity) {
+        split->steps = xrealloc(split->steps,
+                                split->step_total * sizeof(SplitStep));
+        split->step_capacity = split->step_total;
+    }
+
+    if(tasks + 1 > split->pending_capacity) {
+        split->pending = xrealloc(split->pending,
+                                  (tasks + 1) * sizeof(atomic_size_t));
+
+        for(size_t i = 0; i < split->threads; ++i) {
+            SplitDeque* deque = &split->workers[i].deque;
+            deque->items = xrealloc(deque->items, (tasks + 1) * sizeof(size_t));
+        }
+
+        split->pending_capacity = tasks + 1;
+    }
+
+    for(size_t i = 0; i < split->threads; ++i) {
+        split->workers[i].deque.top    = 0;
+        split->workers[i].deque.bottom = 0;
+        split->workers[i].stolen       = 0;
+    }
+
+    for(size_t i = 0; i <= tasks; ++i) {
+        atomic_init(&split->pending[i], plan[i].children);
+        ready += i && !plan[i].children;
+    }
+
+    for(size_t i = 1; i <= tasks; ++i) {
+        if(!plan[i].children) {
+            SplitDeque* deque =
+                &split->workers[dealt * split->threads / ready].deque;
+
+            deque->items[deque->bottom++] = i;
+            dealt += 1;
+        }
+    }
+
+    atomic_store(&split->queued, ready);
+}
+
+SftError* Split_eval(Split*      split,
+                     Sft*        sft,
+                     TokenArray* tokens,
+                     double*     out_result) {
+    split->last_tasks  = 0;
+    split->last_stolen = 0;
+
+    if(split->threads < 2 || tokens->count < 2 * split->grain)
+        return Sft_evalTokens(sft, tokens, out_result);
+
+    split->tokens = tokens;
+
+    size_t tasks = Split_plan(split);
+
+    if(tasks < 2)
+        return Sft_evalTokens(sft, tokens, out_result);
+
+    Split_prepare(split, tasks);
+
+    split->resolve      = sft->resolve;
+    split->resolve_user = sft->resolve_user;
+
+    pthread_mutex_lock(&split->lock);
+    split->generation += 1;
+    split->busy = split->threads - 1;
+    pthread_cond_broadcast(&split->start);
+    pthread_mutex_unlock(&split->lock);
+
+    // Alongside the pool, the calling thread is one of it.
+    BOOL pooled = Series_setPooled(TRUE);
+    Split_work(split, &split->workers[0], sft);
+    Series_setPooled(pooled);
+
+    pthread_mutex_lock(&split->lock);
+
+    while(split->busy)
+        pthread_cond_wait(&split->idle, &split->lock);
+
+    pthread_mutex_unlock(&split->lock);
+
+    split->last_tasks = tasks;
+
+    for(size_t i = 0; i < split->threads; ++i) {
+        split->last_stolen += split->workers[i].stolen;
+    }
+
+    // What is left is task 0, the whole expression, on the calling thread,
+    // where errors are reported as they would be without splitting.
+    Sft_begin(sft, tokens);
+
+    SftError* error = Split_range(split, sft, 0, tokens->count);
+
+    if(!error)
+        error = Sft_finish(sft, tokens->count, out_result);
+
+    const SplitGroup* groups = Stack_getBase(split->groups);
+
+    for(size_t i = 0; i < Stack_getCount(split->groups); ++i) {
+        split->values[groups[i].open] = (SplitValue){0};
+    }
+
+    return error;
+}
@@ -0,0 +1,164 @@
+#ifndef _H_SPLIT_
+#define _H_SPLIT_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "common.h"
+#include "evaluator.h"
+#include "stack.h"
+#include "tokenizer.h"
+
+// One long expression evaluated on several threads. A group, a parenthesized
+// subexpression or function call, comes to the same value wherever it stands,
+// so groups are evaluated as tasks on a pool of threads, and the expression
+// around them then reads each one as the number it came to, the way Resubmit
+// reads the groups an edit left alone. What the tasks do, and in which order
+// the values are put together, depends on nothing but the tokens and the
+// grain, and the expression comes to the same result, or fails with the same
+// error, as Sft_evalTokens would, bit for bit, however many threads there are.
+//
+// The tasks come from the tree of groups: groups of up to `grain` tokens are
+// packed in order into batches of about `grain` tokens, and a larger group
+// that holds at least two tasks' worth of them is a task of its own, which
+// runs once the tasks inside it are done. Each thread takes the tasks that
+// became ready on it first, and otherwise steals the oldest task of another.
+//
+// Operators between groups are applied by whichever task holds them, in
+// order, so a long chain of operators without parens, or a deep nesting of
+// parens that hold little else, leaves nothing to split and is evaluated on
+// the calling thread. So is what a run doesn't necessarily evaluate: the
+// body of a series, the arguments of if() after the condition, and what
+// follows an && or || in its parens.
+
+// Tokens of the largest group packed into batches, and about the tokens of a
+// batch, when Split_new is given 0.
+#define SPLIT_DEFAULT_GRAIN 4096
+
+// A group of tokens, from its open paren, or function name and paren, to its
+// close paren.
+typedef struct SplitGroup {
+    size_t open;
+    size_t close;
+} SplitGroup;
+
+// What a group came to in a task, by the index of its open paren. Groups that
+// fail in a task have a close of 0, and are evaluated again in the task
+// around them, which fails with the error in the same place as Sft_evalTokens
+// would, or skips them as it would.
+typedef struct SplitValue {
+    double value;
+    size_t close;
+    size_t batch; // The batch whose steps start with the group, or 0.
+} SplitValue;
+
+// A token the task around a batch evaluates, with its index: one between the
+// groups of the batch, or a group as the number it came to. Reading the few
+// steps of a batch in a row, where the batch left them, spares the task
+// around it reading its way through the tokens of the groups to skip them.
+typedef struct SplitStep {
+    Token  token;
+    size_t index;
+} SplitStep;
+
+// The groups[first, first + count) evaluated in order once the tasks inside
+// them are, which then count down the pending tasks of the parent. Task 0 is
+// the whole expression, which the calling thread evaluates last.
+typedef struct SplitTask {
+    size_t parent;
+    size_t first;
+    size_t count;
+    size_t children; // Tasks inside it.
+
+    // The steps[steps, steps + step_count) of a batch of several groups,
+    // from its first group to its last.
+    size_t steps;
+    size_t step_count;
+} SplitTask;
+
+// The tasks ready to run on a thread: it takes the newest one from the
+// bottom, and the other threads steal the oldest one from the top.
+typedef struct SplitDeque {
+    pthread_mutex_t lock;
+    size_t*         items;
+    size_t          top;
+    size_t          bottom;
+} SplitDeque;
+
+typedef struct SplitWorker {
+    struct Split* split;
+    pthread_t     thread;
+    SplitDeque    deque;
+    size_t        stolen; // Tasks of other threads taken in the last run.
+} SplitWorker;
+
+typedef struct Split {
+    size_t grain;
+
+    // Worker 0 is the calling thread; the others are started by Split_new
+    // and wait for the next run in between.
+    SplitWorker* workers;
+    size_t       threads;
+
+    // Guards the fields below it, and wakes the workers for a run, and for
+    // tasks to steal during one.
+    pthread_mutex_t lock;
+    pthread_cond_t  start;
+    pthread_cond_t  wake;
+    pthread_cond_t  idle;
+    size_t          generation; // Runs started.
+    size_t          busy;       // Workers still in the run.
+    BOOL            stop;
+
+    // The run: its tokens, the variables they read, and its tasks, with the
+    // tasks inside each that aren't done yet. The run is over once none of
+    // those of task 0 are left.
+    TokenArray*    tokens;
+    SftResolver    resolve;
+    void*          resolve_user;
+    Stack*         tasks;  // SplitTask
+    Stack*         groups; // SplitGroup, of the tasks.
+    atomic_size_t* pending;
+    size_t         pending_capacity;
+    atomic_size_t  queued; // Tasks in the deques.
+
+    // By token index, all zero in between runs.
+    SplitValue* values;
+    size_t      capacity;
+
+    SplitStep* steps;
+    size_t     step_total;
+    size_t     step_capacity;
+
+    // Scratch for planning the tasks.
+    Stack* frames;
+    Stack* members; // SplitGroup
+    Stack* units;   // size_t, tasks not yet given a parent.
+
+    // The allocator of the thread that made the Split, for the others.
+    const SeqftAllocator* allocator;
+
+    // Of the last Split_eval: the tasks, 0 if it wasn't split, and how many
+    // of them were stolen.
+    size_t last_tasks;
+    size_t last_stolen;
+} Split;
+
+// Starts a pool of threads - 1 threads besides the calling one, or one per
+// online CPU if threads is 0, and splits into tasks of about grain tokens, or
+// SPLIT_DEFAULT_GRAIN if it is 0.
+extern Split* Split_new(size_t threads, size_t grain);
+extern void   Split_free(Split* split);
+
+// Evaluates the tokens like Sft_evalTokens does, with the Sft on the calling
+// thread and with Sfts of their own on the others, which look variables up
+// with the resolver of the Sft, at the same time; a resolver that only reads,
+// as Vars_resolve does, is fine. The functions the Sft calls must be pure, as
+// those of FN_LOOKUP are. Expressions of fewer than twice the grain tokens
+// aren't split.
+extern SftError* Split_eval(Split*      split,
+                            Sft*        sft,
+                            TokenArray* tokens,
+                            double*     out_result);
+
+#endif // _H_SPLIT_
@@ -60,10 +60,10 @@ void Stack_free(Stack* s) {
             }
         }
 
-        free(s->base);
+        xfree(s->base);
     }
 
-    free(s);
+    xfree(s);
 }
 
 // ----------------------------------------------------------------------------
@@ -100,7 +100,9 @@ Stack* Stack_shrinkToFit(Stack* s) {
 
 Stack* Stack_pushFrom(Stack* s, void* item) {
     if(((s->count + 1) * s->item_size) > s->allocated) {
-        Stack_expandBy(s, 1);
+        // Double the item count, so that n pushes cost O(n) copying overall,
+        // no matter how the allocator handles realloc.
+        Stack_expandBy(s, s->count ? s->count : STACK_MIN_GROWTH);
     }
 
     void* dest = s->base + (s->item_size * s->count);
@@ -126,6 +128,57 @@ void* Stack_pop(Stack* s) {
     return item_copy;
 }
 
+BOOL Stack_popInto(Stack* s, void* cpyout) {
+    if(s->count == 0)
+        return FALSE;
+
+    if(cpyout) {
+        memcpy(cpyout, s->head, s->item_size);
+    }
+
+    s->head = (char*)s->head - s->item_size;
+    s->count -= 1;
+
+    return TRUE;
+}
+
+void Stack_truncate(Stack* s, size_t count) {
+    if(count >= s->count)
+        return;
+
+    s->count = count;
+    s->head  = count ? (char*)s->base + s->item_size * (count - 1) : s->base;
+}
+
+void Stack_splice(Stack*      s,
+                  size_t      at,
+                  size_t      removed,
+                  const void* items,
+                  size_t      count) {
+    size_t after = s->count - at - removed;
+    size_t total = at + count + after;
+
+    if(total * s->item_size > s->allocated) {
+        // At least doubles, like Stack_pushFrom.
+        size_t more = total - s->count;
+        Stack_expandBy(s, more > s->count ? more : s->count);
+    }
+
+    char* base = s->base;
+
+    if(count != removed) {
+        memmove(base + s->item_size * (at + count),
+                base + s->item_size * (at + removed),
+                s->item_size * after);
+    }
+
+    if(count)
+        memcpy(base + s->item_size * at, items, s->item_size * count);
+
+    s->count = total;
+    s->head  = total ? base + (s->item_size * (total - 1)) : base;
+}
+
 // Always reallocates Stack to fit smaller size. Does not allocate memory for
 // a copy. Will memcpy the popped item to cpyout if non-zero. Provide ptr to
 // item being popped to custom deallocator (if present). Won't realloc to 0;
@@ -194,7 +247,7 @@ void Stack_reClear(Stack* s) { if(!s || !s->base)
 
     // s->base      = xrealloc(s->base, required_alloc);
 
-    free(s->base);
+    xfree(s->base);
     s->base = xmalloc(required_alloc);
 
     s->allocated = required_alloc;
@@ -204,6 +257,22 @@ void Stack_reClear(Stack* s) { if(!s || !s->base)
         s->allocated && s->item_size ? s->allocated / s->item_size : 0;
 }
 
+void* Stack_release(Stack* s, size_t* out_count) {
+    void* items = s->base;
+
+    if(out_count) {
+        *out_count = s->count;
+    }
+
+    s->base      = 0;
+    s->head      = 0;
+    s->count     = 0;
+    s->allocated = 0;
+    s->capacity  = 0;
+
+    return items;
+}
+
 // ---------------------------------------------------------------------------- 
 
 size_t Stack_cloneData(Stack* s, void** dest) {
@@ -10,6 +10,10 @@ typedef struct Stack Stack;
 
 #define STACK_DEFAULT_ALLOC 4096
 
+// Number of items room is made for when pushing onto an empty stack that has
+// no memory allocated; past that, pushing onto a full stack doubles it.
+#define STACK_MIN_GROWTH 16
+
 extern Stack* Stack_new(size_t item_size);
 extern Stack* Stack_withCapacity(size_t item_size, size_t count);
 extern void   Stack_free(Stack* s);
@@ -41,6 +45,25 @@ extern Stack* Stack_pushFrom(Stack* s, void* item);
 // not considered anymore, and is overwritten if a new item is pushed.
 extern void* Stack_pop(Stack* s);
 
+// Like Stack_pop, but copies the last element into cpyout (if non-zero)
+// instead of a newly allocated copy, so nothing needs to be freed. Returns
+// FALSE if the stack was empty, leaving cpyout untouched.
+extern BOOL Stack_popInto(Stack* s, void* cpyout);
+
+// Drops every item past the first count items, without reallocating or
+// passing them through the deallocator. Does nothing if count is not smaller
+// than the current item count.
+extern void Stack_truncate(Stack* s, size_t count);
+
+// Replaces the removed items from index at on with the count items, moving the
+// ones after them along. The removed items aren't passed through the
+// deallocator.
+extern void Stack_splice(Stack*      s,
+                         size_t      at,
+                         size_t      removed,
+                         const void* items,
+                         size_t      count);
+
 // Always reallocates Stack to fit smaller size. Does not allocate memory for
 // a copy. Will memcpy the popped item to cpyout if non-zero. Provide ptr to
 // item being popped to custom deallocator (if present). Won't realloc to 0;
@@ -59,6 +82,12 @@ extern void Stack_clear(Stack* s);
 // field, if set. If not, defaults to STACK_DEFAULT_ALLOC global macro (4096).
 extern void Stack_reClear(Stack* s);
 
+// Hands the items over to the caller, who becomes responsible for freeing
+// them with xfree (and their members, as the deallocator isn't called). The
+// stack is left empty with no memory allocated; the next push allocates.
+// Returns the items, and writes their count to out_count if non-zero.
+extern void* Stack_release(Stack* s, size_t* out_count);
+
 // ----------------------------------------------------------------------------
 
 // Memcpy's all the elements stored in the stack to a newlly allocated void*,
@@ -1,5 +1,7 @@
 #include "tokenizer.h"
 #include "common.h"
+#include "dtoa.h"
+#include "evaluator.h"
 #include "stack.h"
 #include <ctype.h>
 #include <stdio.h>
@@ -9,11 +11,14 @@
 /*  Rules:
  *
  *  These operators are allowed and treated as single tokens: + - / % * ^
+ *  and so are these, of one or two characters: < <= > >= == != && ||
  *
  *  There can also exist:
  *    - Decimal Numbers:
  *      - No letter or leading zeros.
  *      - Can have a decimal point.
+ *      - Can have an exponent after the digits: e or E, an optional sign and
+ *        digits, as in 1e6, 2.5E-3 or 1e+300.
  *      - Can be prefixed with ~ in order to negate the number.
  *
  *    - Other Base Numbers:
@@ -76,63 +81,88 @@
  *         - Always: add the token for the operator, if it's a valid operator.
  * */
 
-char* Token_toString(Token* token) {
-    memset(token->str, 0, sizeof(token->str));
+// Writes at most size bytes, including the null terminator, and returns the
+// length of the string, like snprintf.
+size_t Token_toString(const Token* token, char* buffer, size_t size) {
+    const char* symbol = "?";
 
-    if(token->type == TT_OPA && token->func) {
-        memcpy(token->str, token->func, strlen(token->func));
-        token->str[strlen(token->func)] = '(';
-    }
-
-    else if(token->type == TT_NUM) {
-        snprintf(token->str, sizeof(token->str), "%.2f", token->f64);
-    }
-
-    else if(token->type == TT_ADD) {
-        token->str[0] = '+';
-    }
-
-    else if(token->type == TT_COM) {
-        token->str[0] = ',';
-    }
-
-    else if(token->type == TT_SUB) {
-        token->str[0] = '-';
-    }
-
-    else if(token->type == TT_DIV) {
-        token->str[0] = '/';
-    }
-
-    else if(token->type == TT_MOD) {
-        token->str[0] = '%';
-    }
-
-    else if(token->type == TT_MUL) {
-        token->str[0] = '*';
-    }
-
-    else if(token->type == TT_POW) {
-        token->str[0] = '^';
-    }
-
-    else if(token->type == TT_NEG) {
-        token->str[0] = '~';
-    }
+    switch(token->type) {
+        case TT_NUM: {
+            char   digits[DTOA_SHORTEST_SIZE];
+            size_t len = dtoa_shortest(token->f64, digits);
 
-    else if(token->type == TT_OPA) {
-        token->str[0] = '(';
-    }
+            if(size) {
+                size_t copied = len < size - 1 ? len : size - 1;
+                memcpy(buffer, digits, copied);
+                buffer[copied] = '\0';
+            }
 
-    else if(token->type == TT_CPA) {
-        token->str[0] = ')';
-    }
+            return len;
+        }
+        case TT_VAR:
+            return (size_t)snprintf(buffer, size, "%s", token->func);
+        case TT_OPA:
+            if(token->func)
+                return (size_t)snprintf(buffer, size, "%s(", token->func);
 
-    else {
-        token->str[0] = '?';
+            symbol = "(";
+            break;
+        case TT_ADD:
+            symbol = "+";
+            break;
+        case TT_COM:
+            symbol = ",";
+            break;
+        case TT_SUB:
+            symbol = "-";
+            break;
+        case TT_DIV:
+            symbol = "/";
+            break;
+        case TT_MOD:
+            symbol = "%";
+            break;
+        case TT_MUL:
+            symbol = "*";
+            break;
+        case TT_POW:
+            symbol = "^";
+            break;
+        case TT_NEG:
+            symbol = "~";
+            break;
+        case TT_CPA:
+            symbol = ")";
+            break;
+        case TT_LT:
+            symbol = "<";
+            break;
+        case TT_LE:
+            symbol = "<=";
+            break;
+        case TT_GT:
+            symbol = ">";
+            break;
+        case TT_GE:
+            symbol = ">=";
+            break;
+        case TT_EQ:
+            symbol = "==";
+            break;
+        case TT_NE:
+            symbol = "!=";
+            break;
+        case TT_AND:
+            symbol = "&&";
+            break;
+        case TT_OR:
+            symbol = "||";
+            break;
+        default:
+            break;
     }
 
-    return token->str;
+    return (size_t)snprintf(buffer, size, "%s", symbol);
 }
 
 void Token_print(Token* t) {
@@ -143,12 +173,12 @@ void Token_print(Token* t) {
            t->f64,
            t->func ? t->func : "null");
 
-    free(b);
+    xfree(b);
 }
 
 void Token_freeMembers(Token* t) {
     if(t && t->func) {
-        free(t->func);
+        xfree(t->func);
         t->func = 0;
     }
 }
@@ -159,14 +189,14 @@ void TokenArray_freeMembers(TokenArray* t) {
             Token_freeMembers(&t->tokens[i]);
         }
 
-        free(t->tokens);
+        xfree(t->tokens);
     }
 }
 
 void TokenArray_free(TokenArray* t) {
     if(t) {
         TokenArray_freeMembers(t);
-        free(t);
+        xfree(t);
     }
 }
 
@@ -193,6 +223,9 @@ char* TokenType_toString(TokenType ttype) {
         case TT_NUM:
             sprintf(buffer, "Number");
             break;
+        case TT_VAR:
+            sprintf(buffer, "Variable");
+            break;
         case TT_ADD:
             sprintf(buffer, "Operator [ + ]");
             break;
@@ -220,6 +253,24 @@ char* TokenType_toString(TokenType ttype) {
         case TT_CPA:
             sprintf(buffer, "Operator [ ) ]");
             break;
+        case TT_COM:
+            sprintf(buffer, "Separator [ , ]");
+            break;
+        case TT_LT:
+        case TT_LE:
+        case TT_GT:
+        case TT_GE:
+        case TT_EQ:
+        case TT_NE:
+        case TT_AND:
+        case TT_OR: {
+            Token token = {.type = ttype};
+            char  symbol[4];
+
+            Token_toString(&token, symbol, sizeof(symbol));
+            sprintf(buffer, "Operator [ %s ]", symbol);
+            break;
+        }
         default:
             sprintf(buffer, "Unknown Token Type: %b", ttype);
             break;
@@ -234,8 +285,10 @@ Tokenizer* Tokenizer_new() {
 
     t->tokens = Stack_withCapacity(sizeof(Token), 100);
     t->stacc  = Stack_withCapacity(sizeof(char), 100);
+    t->levels = 0;
+    t->fresh  = Stack_new(sizeof(Token));
     Stack_setDeallocator(t->tokens, (void (*)(void*)) & Token_freeMembers);
-    Stack_setDefaultAlloc(t->tokens, 100);
+    Stack_setDefaultAlloc(t->tokens, sizeof(Token) * 100);
     Stack_setDefaultAlloc(t->stacc, 100);
 
     t->accfl = ACC_NIL;
@@ -251,9 +304,17 @@ Tokenizer* Tokenizer_new() {
     t->tt_map['^'] = TT_POW;
     t->tt_map['~'] = TT_NEG;
     t->tt_map['('] = TT_OPA;
-    t->tt_map[','] = TT_OPA;
+    t->tt_map[','] = TT_COM;
     t->tt_map[')'] = TT_CPA;
 
+    // The first character of the operators of two; see Tokenizer_pair.
+    t->tt_map['<'] = TT_LT;
+    t->tt_map['>'] = TT_GT;
+    t->tt_map['='] = TT_EQ;
+    t->tt_map['!'] = TT_NE;
+    t->tt_map['&'] = TT_AND;
+    t->tt_map['|'] = TT_OR;
+
     return t;
 }
 
@@ -261,11 +322,12 @@ void Tokenizer_free(Tokenizer* t) {
     if(t) {
         Stack_free(t->tokens);
         Stack_free(t->stacc);
-        if(t->error) {
-            free(t->error);
-            t->error = 0;
-        }
-        free(t);
+        Stack_free(t->levels);
+        Stack_free(t->cellar);
+        Stack_free(t->fresh);
+        xfree(t->expr);
+        xfree(t->next_expr);
+        xfree(t);
     }
 }
 
@@ -279,7 +341,7 @@ void Tokenizer_addToken(Tokenizer* t, Token* token) {
 
         if(token_str) {
             printf("Added token to stack %s\n", token_str);
-            free(token_str);
+            xfree(token_str);
         }
     }
 #endif
@@ -287,45 +349,46 @@ void Tokenizer_addToken(Tokenizer* t, Token* token) {
     t->accfl = ACC_NIL;
 }
 
+// Keeps the memory of both stacks, so that a Tokenizer reused for many
+// expressions stops allocating once it has seen the largest one.
 void Tokenizer_clear(Tokenizer* t) {
-    Stack_reClear(t->tokens);
-    Stack_reClear(t->stacc);
-
-    t->accfl = ACC_NIL;
-
-    if(t->error) {
-        free(t->error);
-        t->error = 0;
+    for(size_t i = 0; i < Stack_getCount(t->tokens); ++i) {
+        Token_freeMembers(Stack_itemAt(t->tokens, i));
     }
-}
 
-void Tokenizer_error(Tokenizer* t, const char* message, size_t expr_index) {
-    IterErr error = {.message = message, .index = expr_index};
+    Stack_clear(t->tokens);
+    Stack_clear(t->stacc);
 
-    if(t->error) {
-        free(t->error);
-        t->error = 0;
-    }
+    t->accfl     = ACC_NIL;
+    t->acc_start = 0;
+    t->error     = 0;
+    t->kept      = FALSE;
+}
 
-    t->error    = xmalloc(sizeof(IterErr));
-    *(t->error) = error;
+// Records the error in place; nothing is allocated or formatted.
+void Tokenizer_error(Tokenizer* t, ErrCode code, size_t expr_index) {
+    t->last_error.code    = code;
+    t->last_error.message = ErrCode_describe(code);
+    t->last_error.index   = expr_index;
+    t->error              = &t->last_error;
 }
 
 BOOL Tokenizer_parseAccNum(Tokenizer* t) {
     Token token = {.type = TT_NUM, .f64 = 0, .func = 0};
+    token.offset = t->acc_start;
 
-    char*  base_ptr = Stack_getBase(t->stacc);
-    size_t count    = Stack_getCount(t->stacc);
+    size_t count = Stack_getCount(t->stacc);
 
     if(!count) {
-        Tokenizer_error(t, "Not enough digits to construct a number.", count);
+        Tokenizer_error(t, ERR_NUMBER_TOO_SHORT, t->acc_start);
         return TRUE;
     }
 
-    char buffer[count + 1]; // Nullbyte
-    memset(buffer, 0, count + 1);
+    // Terminate the accumulated digits in place, rather than copying them
+    // into a buffer sized by the literal, which can be arbitrarily long.
+    Stack_push(t->stacc, (char)'\0');
 
-    char*  begin = base_ptr;
+    char*  begin = Stack_getBase(t->stacc);
     size_t len   = count;
 
     // Futureproof against me adding any control bits in the future by
@@ -338,8 +401,10 @@ BOOL Tokenizer_parseAccNum(Tokenizer* t) {
     int strtoll_base = custom_base ? custom_base : 10;
 
     if(custom_base || is_float) {
-        if(count < 3) {
-            Tokenizer_error(t, "Incomplete number.", count);
+        // An exponent needs digits as much as a base prefix or point does.
+        if(count < 3 ||
+           (t->accfl & ACC_EXP && !isdigit((unsigned char)begin[count - 1]))) {
+            Tokenizer_error(t, ERR_INCOMPLETE_NUMBER, t->acc_start);
 
             return TRUE;
         }
@@ -351,79 +416,470 @@ BOOL Tokenizer_parseAccNum(Tokenizer* t) {
         }
     }
 
-    memcpy(buffer, begin, len);
-
-    if(is_float) {
-        token.f64 = atof(buffer);
+    // A decimal integer of more than 18 digits may not fit a long long, and
+    // is rounded by strtod alone, as shorter ones are by their conversion.
+    if(is_float || (!custom_base && len > 18)) {
+        token.f64 = atof(begin);
     } else {
-        token.f64 = strtoll(buffer, 0, strtoll_base);
+        token.f64 = strtoll(begin, 0, strtoll_base);
     }
 
     Tokenizer_addToken(t, &token);
     return 0;
 }
 
-TokenArray* Tokenizer_parse(Tokenizer* t, const char* cexpr, size_t expr_len) {
-    Tokenizer_clear(t);
+// Adds a token of the given type named by the accumulated letters: the open
+// paren of a function call, or a variable.
+static void Tokenizer_addName(Tokenizer* t, TokenType type) {
+    size_t len   = Stack_getCount(t->stacc);
+    Token  token = {.type = type, .f64 = 0, .func = 0};
 
-    char expr[expr_len + 1];
-    expr_len = filter_whitespace(cexpr, expr_len, expr);
+    token.offset = t->acc_start;
+    token.func   = (char*)xmalloc(len + 1);
+    memcpy(token.func, Stack_getBase(t->stacc), len);
+    token.func[len] = '\0';
 
-    if(!expr_len) {
-        perror("Could not filter whitespace from expression!\n");
-        abort();
+    Tokenizer_addToken(t, &token);
+}
+
+// Reads the second character of an operator that may or must have one, from
+// the operator at expr[*i], advancing i past it. Fails on an = ! & or | that
+// isn't part of one.
+static BOOL Tokenizer_pair(Tokenizer*  t,
+                           const char* expr,
+                           size_t      len,
+                           size_t*     i,
+                           TokenType*  op) {
+    char c    = expr[*i];
+    char next = *i + 1 < len ? expr[*i + 1] : '\0';
+
+    switch(c) {
+        case '<':
+        case '>':
+            if(next != '=')
+                return TRUE;
+
+            *op = c == '<' ? TT_LE : TT_GE;
+            break;
+        case '=':
+        case '!':
+            if(next != '=') {
+                Tokenizer_error(t, ERR_INVALID_CHARACTER, *i);
+                return FALSE;
+            }
+            break;
+        default: // & and |
+            if(next != c) {
+                Tokenizer_error(t, ERR_INVALID_CHARACTER, *i);
+                return FALSE;
+            }
+            break;
     }
 
-    printdbg("Stripped Expression: '%s'(%zu). Originally '%s'(%zu)\n",
-             expr,
-             expr_len,
-             cexpr,
-             strlen(cexpr));
+    *i += 1;
+    return TRUE;
+}
+
+// A level of parens, for Tokenizer_link.
+typedef struct TokenizerLevel {
+    size_t and; // Index of the && whose right operand is still going, or 0.
+    size_t or;  // Same for ||.
+
+    // Whether the level is the paren of an if(), and the indexes of its
+    // first two commas.
+    BOOL     branch;
+    uint32_t commas;
+    size_t   first;
+    size_t   second;
+} TokenizerLevel;
+
+// Ends the level at the token at index end, a comma or close paren of the
+// level, or the end of the expression, pointing the jumps of what it ends.
+static void TokenizerLevel_end(TokenizerLevel* level,
+                               Token*          tokens,
+                               size_t          end,
+                               BOOL            paren) {
+    if(level->and)
+        tokens[level->and].depth = end;
+
+    if(level->or)
+        tokens[level->or].depth = end;
+
+    level->and = 0;
+    level->or  = 0;
+
+    // An if() with the wrong number of arguments has no branches to skip, so
+    // that all of them are evaluated and counted.
+    if(paren && level->branch && level->commas == 2) {
+        tokens[level->first].depth  = level->second;
+        tokens[level->second].depth = end;
+    }
+}
+
+// Points the jumps of the tokens, see Token: the right operand of an && ends
+// at the next && or || of its level, or the comma or close paren that ends
+// the level, or the expression; that of an || at all of these but an &&.
+// The first comma of an if() jumps to its second, and that to the close
+// paren.
+static void Tokenizer_link(Tokenizer* t) {
+    Token* tokens = Stack_getBase(t->tokens);
+    size_t count  = Stack_getCount(t->tokens);
+
+    if(!t->levels)
+        t->levels = Stack_new(sizeof(TokenizerLevel));
+
+    // Level 0 is outside of any paren.
+    Stack*         levels = t->levels;
+    TokenizerLevel level  = {0};
+
+    Stack_pushFrom(levels, &level);
+
+    for(size_t i = 0; i < count; ++i) {
+        Token* token = &tokens[i];
+
+        if(!(token->type & (TT_JMP | TT_PAS)))
+            continue;
+
+        // A retokenized expression holds the jumps of the one before.
+        if(token->type & TT_JMP)
+            token->depth = 0;
+
+        TokenizerLevel* top = Stack_getHead(levels);
+
+        switch(token->type) {
+            case TT_AND:
+                if(top->and)
+                    tokens[top->and].depth = i;
+
+                top->and = i;
+                break;
+            case TT_OR:
+                TokenizerLevel_end(top, tokens, i, FALSE);
+                top->or = i;
+                break;
+            case TT_COM:
+                TokenizerLevel_end(top, tokens, i, FALSE);
+                top->commas += 1;
+
+                if(top->commas == 1)
+                    top->first = i;
+                else if(top->commas == 2)
+                    top->second = i;
+                break;
+            case TT_OPA:
+                level        = (TokenizerLevel) {0};
+                level.branch = token->func && !strcmp(token->func, "if");
+                Stack_pushFrom(levels, &level);
+                break;
+            case TT_CPA:
+                TokenizerLevel_end(top, tokens, i, Stack_getCount(levels) > 1);
+
+                if(Stack_getCount(levels) > 1)
+                    Stack_popInto(levels, 0);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Whatever is left ends with the expression, unclosed parens and all.
+    while(!Stack_empty(levels)) {
+        TokenizerLevel_end(Stack_getHead(levels), tokens, count, TRUE);
+        Stack_popInto(levels, 0);
+    }
+}
+
+// Where the operands of what is read now start among the numbers counted by
+// Tokenizer_checkOperand, as Sft_operandBase has it.
+static size_t Tokenizer_operandBase(Stack* cellar) {
+    if(Stack_empty(cellar))
+        return 0;
+
+    Token* top = Stack_getHead(cellar);
+    return top->type & TT_OPA ? top->depth + top->commas : top->depth;
+}
+
+// Pops and applies the operators of the cellar down to an open paren, or all
+// of them, to the count of numbers. Returns FALSE and sets t->error if one
+// lacks operands.
+static BOOL Tokenizer_applyUntil(Tokenizer* t,
+                                 Stack*     cellar,
+                                 int        precedence,
+                                 size_t*    numbers) {
+    while(!Stack_empty(cellar)) {
+        Token* top = Stack_getHead(cellar);
+
+        if(top->type & TT_OPA || TokenType_precedence(top->type) < precedence)
+            break;
+
+        size_t operands = top->type & TT_BOP ? 2 : 1;
+
+        if(*numbers < top->depth + operands) {
+            Tokenizer_error(t, ERR_MISSING_OPERAND, top->offset);
+            return FALSE;
+        }
+
+        *numbers -= operands - 1;
+        Stack_popInto(cellar, 0);
+    }
+
+    return TRUE;
+}
+
+// Reads the tokens from index from up to to, an operand that a jump may skip,
+// the way the evaluator reads them when it doesn't, counting numbers instead
+// of computing them. Returns FALSE and sets t->error where it would fail,
+// unless on a variable, whose value is only known then. A series is read as
+// the call of sum or prod it is without one.
+static BOOL Tokenizer_checkOperand(Tokenizer* t, size_t from, size_t to) {
+    const Token* tokens  = Stack_getBase(t->tokens);
+    size_t       numbers = 0;
+
+    if(!t->cellar)
+        t->cellar = Stack_new(sizeof(Token));
+
+    Stack* cellar = t->cellar;
+    Stack_clear(cellar);
+
+    for(size_t i = from; i < to; ++i) {
+        Token token = tokens[i];
+
+        if(token.type & (TT_NUM | TT_VAR)) {
+            numbers += 1;
+        } else if(token.type & TT_OPS) {
+            if(!Tokenizer_applyUntil(
+                   t, cellar, TokenType_precedence(token.type), &numbers))
+                return FALSE;
+
+            token.depth = Tokenizer_operandBase(cellar);
+            Stack_pushFrom(cellar, &token);
+        } else if(token.type & TT_OPA) {
+            token.depth  = numbers;
+            token.commas = 0;
+            Stack_pushFrom(cellar, &token);
+        } else if(token.type & (TT_COM | TT_CPA)) {
+            if(!Tokenizer_applyUntil(t, cellar, 0, &numbers))
+                return FALSE;
+
+            // The evaluator lets a close paren without an open one pass.
+            if(Stack_empty(cellar)) {
+                if(token.type & TT_CPA)
+                    continue;
+
+                Tokenizer_error(t, ERR_COMMA_OUTSIDE_CALL, token.offset);
+                return FALSE;
+            }
+
+            Token* paren = Stack_getHead(cellar);
+            size_t count = numbers - paren->depth;
+
+            // A comma ends an argument of one number, and so does the close
+            // paren of a call of more than one, see eval_x_is_close_paren.
+            if((token.type & TT_COM || paren->commas) &&
+               count != paren->commas + 1) {
+                Tokenizer_error(t, ERR_MISSING_ARGUMENT, token.offset);
+                return FALSE;
+            }
+
+            if(token.type & TT_COM) {
+                paren->commas += 1;
+                continue;
+            }
+
+            if(paren->func) {
+                const Function* f = Function_lookup(paren->func, 0);
+
+                if(!f || count < f->min_args || count > f->max_args) {
+                    Tokenizer_error(t,
+                                    f ? ERR_ARGUMENT_COUNT
+                                      : ERR_UNKNOWN_FUNCTION,
+                                    paren->offset);
+                    return FALSE;
+                }
+
+                numbers = paren->depth + 1;
+            } else if(paren->commas) {
+                Tokenizer_error(t, ERR_COMMA_OUTSIDE_CALL, paren->offset);
+                return FALSE;
+            }
+
+            Stack_popInto(cellar, 0);
+        }
+    }
+
+    // The end of the operand, or of the expression with parens left open.
+    while(!Stack_empty(cellar)) {
+        if(!Tokenizer_applyUntil(t, cellar, 0, &numbers))
+            return FALSE;
+
+        if(Stack_empty(cellar))
+            break;
+
+        Token paren;
+        Stack_popInto(cellar, &paren);
+
+        if(paren.commas && numbers - paren.depth != paren.commas + 1) {
+            Tokenizer_error(t, ERR_MISSING_ARGUMENT, paren.offset);
+            return FALSE;
+        }
+
+        numbers += 1;
+    }
+
+    // Nothing at all, where the jump expects an operand or an argument.
+    if(!numbers) {
+        const Token* jump = &tokens[from - 1];
+
+        Tokenizer_error(t,
+                        jump->type & TT_COM ? ERR_MISSING_ARGUMENT
+                                            : ERR_MISSING_OPERAND,
+                        jump->offset);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Checks the operands that the linked jumps skip, see Token, which would be
+// left unread when skipped: the outermost ones reaching from index first to
+// index last, whose checks take in those within. Returns FALSE and sets
+// t->error if one of them couldn't be evaluated.
+static BOOL Tokenizer_checkJumps(Tokenizer* t, size_t first, size_t last) {
+    const Token* tokens = Stack_getBase(t->tokens);
+    size_t       count  = Stack_getCount(t->tokens);
+    size_t       until  = 0; // Where the last operand checked ends.
+
+    for(size_t i = 0; i < count && i <= last; ++i) {
+        if(!(tokens[i].type & TT_JMP) || !tokens[i].depth || i < until)
+            continue;
+
+        until = tokens[i].depth;
+
+        if(until >= first && !Tokenizer_checkOperand(t, i + 1, until))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Where Tokenizer_retokenize can stop lexing the new expression: at any
+// position from `from` on, where it is the same as the old one from old_from
+// on, at which an old token starts. A lexer with nothing accumulated there
+// would go on to lex the rest into the same tokens as before.
+typedef struct TokenizerSync {
+    const Token* old;
+    size_t       count;
+    size_t       from;
+    size_t       old_from;
+
+    // The first old token not known to start before the position looked at,
+    // which is where the old tokens resume once synced.
+    size_t next;
+    BOOL   synced;
+} TokenizerSync;
+
+static BOOL TokenizerSync_at(TokenizerSync* sync, size_t i) {
+    if(i < sync->from)
+        return FALSE;
 
-    for(int i = 0; i < expr_len; ++i) {
-        char c = expr[i];
+    size_t old_at = sync->old_from + (i - sync->from);
 
-        TokenType op = t->tt_map[c];
+    while(sync->next < sync->count && sync->old[sync->next].offset < old_at)
+        sync->next += 1;
+
+    sync->synced =
+        sync->next < sync->count && sync->old[sync->next].offset == old_at;
+
+    return sync->synced;
+}
+
+// Strips the whitespace of cexpr into the buffer, which only ever grows, so
+// that its size isn't bounded by the C stack. Returns the stripped length.
+static size_t Tokenizer_strip(char**      buffer,
+                              size_t*     capacity,
+                              const char* cexpr,
+                              size_t      expr_len) {
+    if(expr_len + 1 > *capacity) {
+        *buffer   = xrealloc(*buffer, expr_len + 1);
+        *capacity = expr_len + 1;
+    }
+
+    return filter_whitespace(cexpr, expr_len, *buffer);
+}
+
+// Lexes the stripped expression from index from on, which must be where a
+// token starts, into t->tokens, adding the tokens with jumps to link to
+// *jumps.
+// Stops early if sync isn't null and it says so, with the accumulator empty.
+static BOOL Tokenizer_lex(Tokenizer*     t,
+                          const char*    expr,
+                          size_t         expr_len,
+                          size_t         from,
+                          TokenizerSync* sync,
+                          size_t*        jumps) {
+    for(size_t i = from; i < expr_len; ++i) {
+        char   c     = expr[i];
+        size_t start = i;
+
+        if(sync && t->accfl == ACC_NIL && TokenizerSync_at(sync, i))
+            return TRUE;
+
+        // The sign of an exponent is part of the number, not an operator.
+        if(t->accfl & ACC_EXP && (c == '+' || c == '-') &&
+           tolower(*(unsigned char*)Stack_getHead(t->stacc)) == 'e') {
+            Stack_pushFrom(t->stacc, &c);
+            continue;
+        }
+
+        TokenType op = t->tt_map[(unsigned char)c];
+
+        if(op & (TT_CMP | TT_LOG) &&
+           !Tokenizer_pair(t, expr, expr_len, &i, &op))
+            return FALSE;
+
+        *jumps += op & (TT_LOG | TT_COM) ? 1 : 0;
 
         // It's an operator. Parse the accumulator, and add the operator token.
         // ------------------------------------------------------------------------
         if(op & TT_OPA && t->accfl & ACC_FUN) {
-            Token token = {.type = TT_OPA, .f64 = 0, .func = 0};
-            token.func  = (char*)xmalloc(Stack_getCount(t->stacc) + 1);
-            memset(token.func, 0, Stack_getCount(t->stacc) + 1);
-            memcpy(
-                token.func, Stack_getBase(t->stacc), Stack_getCount(t->stacc));
-
-            Tokenizer_addToken(t, &token);
-        } else if(op & (TT_OPS | TT_PAS) && t->accfl & ACC_NUM) {
+            Tokenizer_addName(t, TT_OPA);
+        } else if(op & (TT_OPS | TT_CPA | TT_COM) && t->accfl & ACC_FUN) {
+            // A name not followed by ( is a variable.
+            Tokenizer_addName(t, TT_VAR);
+            Tokenizer_addToken(
+                t, &(Token) {.type = op, .f64 = 0, .func = 0, .offset = start});
+        } else if(op & (TT_OPS | TT_PAS | TT_COM) && t->accfl & ACC_NUM) {
             // Returns non-zero on error.
             if(Tokenizer_parseAccNum(t)) {
-                return 0;
+                return FALSE;
             }
 
-            Tokenizer_addToken(t, &(Token) {.type = op, .f64 = 0, .func = 0});
-        } else if(op & (TT_OPS | TT_PAS)) {
-            Token token = {.type = op, .f64 = 0, .func = 0};
+            Tokenizer_addToken(
+                t, &(Token) {.type = op, .f64 = 0, .func = 0, .offset = start});
+        } else if(op & (TT_OPS | TT_PAS | TT_COM)) {
+            Token token = {.type = op, .f64 = 0, .func = 0, .offset = start};
             Tokenizer_addToken(t, &token);
         }
 
         // If it's a letter and accflg is NIL, start accumulating a function.
         // --------------------------------------------------------------------
-        else if(isalpha(c) && t->accfl == ACC_NIL) {
+        else if(isalpha((unsigned char)c) && t->accfl == ACC_NIL) {
             Stack_pushFrom(t->stacc, &c);
-            t->accfl = ACC_FUN;
+            t->accfl     = ACC_FUN;
+            t->acc_start = i;
         }
 
         // If it's a digit and accflg is NIL, start accumulating a number.
         // --------------------------------------------------------------------
-        else if(isdigit(c) && t->accfl == ACC_NIL) {
+        else if(isdigit((unsigned char)c) && t->accfl == ACC_NIL) {
             // If the first digit of an accumulation is 0, then there are some
             // rules that must be followed. A single zero is okay, but if a
             // next character exists and also a digit, then this 0 would be
             // a leading 0, which is not allowed in decimal numbers, but
             // if the next character is a valid base character, or a decimal
             // point, then the accfl is changed, and any future 0's are ok.
-            t->accfl = ACC_DEC | (c == '0' ? ACC_DTZ : 0);
+            t->accfl     = ACC_DEC | (c == '0' ? ACC_DTZ : 0);
+            t->acc_start = i;
             Stack_pushFrom(t->stacc, &c);
         }
 
@@ -436,8 +892,17 @@ TokenArray* Tokenizer_parse(Tokenizer* t, const char* cexpr, size_t expr_len) {
         // If we're accumulating a number, push the character, but..
         // --------------------------------------------------------------------
         else if(t->accfl & ACC_NUM) {
+            char last = *(char*)Stack_getHead(t->stacc);
+
+            // An exponent can follow the digits of a decimal number, with or
+            // without a point, once.
+            if((c == 'e' || c == 'E') && t->accfl & (ACC_DEC | ACC_FPN) &&
+               !(t->accfl & ACC_EXP) && isdigit((unsigned char)last)) {
+                t->accfl = ACC_FPN | ACC_EXP;
+            }
+
             // If this is the second character, check for a format specifier.
-            if(Stack_getCount(t->stacc) == 1) {
+            else if(Stack_getCount(t->stacc) == 1) {
                 switch(c) {
                     case 'x':
                         t->accfl = ACC_HEX;
@@ -452,6 +917,10 @@ TokenArray* Tokenizer_parse(Tokenizer* t, const char* cexpr, size_t expr_len) {
                         t->accfl = ACC_FPN;
                         break;
                     default:
+                        if(!valid_for_base(c, ACC_DEC)) {
+                            Tokenizer_error(t, ERR_INVALID_DIGIT, i);
+                            return FALSE;
+                        }
                         break;
                 }
             } else if((t->accfl & ACC_DEC) && c == '.') {
@@ -460,17 +929,16 @@ TokenArray* Tokenizer_parse(Tokenizer* t, const char* cexpr, size_t expr_len) {
 
             // Otherwise, check if the character is valid for the number type.
             else if(!valid_for_base(c, t->accfl)) {
-                Tokenizer_error(t, "Invalid character in number.", i);
-                return 0;
+                Tokenizer_error(t, ERR_INVALID_DIGIT, i);
+                return FALSE;
             }
 
             // If the trailing zero flag has been set, and not removed by the
             // conversion to another number type (hex, bin, oct, float), then
             // this must be decimal, in which case a leading zero is illegal.
             if(t->accfl & ACC_DTZ) {
-                Tokenizer_error(
-                    t, "Leading zero in number is illegal in this context.", 0);
-                return 0;
+                Tokenizer_error(t, ERR_LEADING_ZERO, t->acc_start);
+                return FALSE;
             }
 
             Stack_pushFrom(t->stacc, &c);
@@ -479,58 +947,299 @@ TokenArray* Tokenizer_parse(Tokenizer* t, const char* cexpr, size_t expr_len) {
         // If it's not an operator, letter, digit, the expression is invalid.
         // --------------------------------------------------------------------
         else {
-            Tokenizer_error(t, "Invalid expression.", i);
-            return 0;
+            Tokenizer_error(t, ERR_INVALID_CHARACTER, i);
+            return FALSE;
         }
     }
 
-    // If there's any remaining elements in the accumulator, and
-    // a function is being accumulated, then that's an error, since an open
-    // paren is needed to complete it.
-    //
-    // A number is fine though.
-
+    // Whatever remains in the accumulator ends with the expression: a name
+    // there is a variable, since no paren follows it.
     if(!Stack_empty(t->stacc)) {
         if(t->accfl & ACC_FUN) {
-            Tokenizer_error(
-                t, "Function with no opening parenthesis.", expr_len);
-            return 0;
+            Tokenizer_addName(t, TT_VAR);
         } else if(t->accfl & ACC_NUM) {
-            Tokenizer_parseAccNum(t);
+            if(Tokenizer_parseAccNum(t)) {
+                return FALSE;
+            }
         }
     }
 
-    if(t->accfl & ACC_FUN) {
-        Tokenizer_error(t, "Function with no opening parenthesis.", expr_len);
-        return 0;
+    return TRUE;
+}
+
+BOOL Tokenizer_tokenize(Tokenizer* t, const char* cexpr, size_t expr_len) {
+    Tokenizer_clear(t);
+
+    expr_len    = Tokenizer_strip(&t->expr, &t->expr_capacity, cexpr, expr_len);
+    t->expr_len = expr_len;
+
+    char* expr = t->expr;
+
+    if(!expr_len) {
+        Tokenizer_error(t, ERR_EMPTY_EXPRESSION, 0);
+        return FALSE;
     }
 
-    TokenArray* tkr = csrxmalloc(sizeof(TokenArray));
+    printdbg("Stripped Expression: '%s'(%zu). Originally '%s'(%zu)\n",
+             expr,
+             expr_len,
+             cexpr,
+             strlen(cexpr));
+
+    // Whether there is anything for Tokenizer_link to do.
+    size_t jumps = 0;
+
+    if(!Tokenizer_lex(t, expr, expr_len, 0, 0, &jumps))
+        return FALSE;
+
+    // What a jump skips is checked all the same, so that an expression fails
+    // here, or when evaluated, whatever the values it's evaluated with.
+    if(jumps) {
+        Tokenizer_link(t);
 
-    size_t item_size  = Stack_getItemSize(t->tokens);
-    size_t item_count = Stack_getCount(t->tokens);
-    void*  base_ptr   = Stack_getBase(t->tokens);
+        if(!Tokenizer_checkJumps(t, 0, Stack_getCount(t->tokens)))
+            return FALSE;
+    }
+
+    t->jumps = jumps;
+
+    t->kept = TRUE;
+    return TRUE;
+}
 
-    size_t mem_to_copy = item_size * item_count;
+// Whether the tokens are the same to Tokenizer_link: either both are neither
+// parens nor jumps, or they are of one type, and if open parens, both of an
+// if() or neither.
+static BOOL Token_sameShape(const Token* a, const Token* b) {
+    if(!(a->type & (TT_JMP | TT_PAS)) && !(b->type & (TT_JMP | TT_PAS)))
+        return TRUE;
+
+    if(a->type != b->type)
+        return FALSE;
+
+    if(!(a->type & TT_OPA))
+        return TRUE;
 
-    tkr->tokens = csrxmalloc(mem_to_copy);
-    memcpy(tkr->tokens, base_ptr, mem_to_copy);
+    BOOL a_if = a->func && !strcmp(a->func, "if");
+    BOOL b_if = b->func && !strcmp(b->func, "if");
 
-    for(int i = 0; i < item_count; ++i) {
-        Token* t = &tkr->tokens[i];
-        if(t->func) {
-            size_t func_len = strlen(t->func);
-            char*  new_func = csrxmalloc(func_len + 1);
-            memset(new_func, 0, func_len + 1);
-            memcpy(new_func, t->func, func_len);
-            t->func = new_func;
+    return a_if == b_if;
+}
+
+// The index of the last token starting at or before the position.
+static size_t Tokenizer_tokenAt(const Token* tokens, size_t count, size_t at) {
+    size_t low  = 0;
+    size_t high = count;
+
+    while(high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+
+        if(tokens[mid].offset <= at)
+            low = mid;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+BOOL Tokenizer_retokenize(Tokenizer*  t,
+                          const char* cexpr,
+                          size_t      expr_len,
+                          TokenEdit*  edit) {
+    if(!t->kept) {
+        BOOL tokenized = Tokenizer_tokenize(t, cexpr, expr_len);
+
+        edit->first    = 0;
+        edit->removed  = 0;
+        edit->inserted = tokenized ? Stack_getCount(t->tokens) : 0;
+
+        return tokenized;
+    }
+
+    // Whatever a failed lex left accumulated.
+    Stack_clear(t->stacc);
+    t->accfl     = ACC_NIL;
+    t->acc_start = 0;
+    t->error     = 0;
+
+    const char* old     = t->expr;
+    size_t      old_len = t->expr_len;
+    size_t      len =
+        Tokenizer_strip(&t->next_expr, &t->next_capacity, cexpr, expr_len);
+    const char* expr = t->next_expr;
+
+    if(!len) {
+        Tokenizer_error(t, ERR_EMPTY_EXPRESSION, 0);
+        return FALSE;
+    }
+
+    // The characters both expressions start with and end with, compared a
+    // block at a time while they're the same.
+    size_t shorter = len < old_len ? len : old_len;
+    size_t prefix  = 0;
+    size_t suffix  = 0;
+
+    while(prefix + 64 <= shorter && !memcmp(old + prefix, expr + prefix, 64))
+        prefix += 64;
+
+    while(prefix < shorter && old[prefix] == expr[prefix])
+        prefix += 1;
+
+    while(suffix + 64 <= shorter - prefix &&
+          !memcmp(old + old_len - suffix - 64, expr + len - suffix - 64, 64))
+        suffix += 64;
+
+    while(suffix < shorter - prefix &&
+          old[old_len - 1 - suffix] == expr[len - 1 - suffix])
+        suffix += 1;
+
+    Token* tokens = Stack_getBase(t->tokens);
+    size_t count  = Stack_getCount(t->tokens);
+
+    if(prefix == len && len == old_len) {
+        edit->first    = count;
+        edit->removed  = 0;
+        edit->inserted = 0;
+        return TRUE;
+    }
+
+    // The token holding the last character before the edit may extend into
+    // it, while those before it end where they did, on characters that
+    // didn't change.
+    size_t first = prefix ? Tokenizer_tokenAt(tokens, count, prefix - 1) : 0;
+
+    TokenizerSync sync = {.old      = tokens,
+                          .count    = count,
+                          .from     = len - suffix,
+                          .old_from = old_len - suffix,
+                          .next     = first};
+
+    // Lexed onto a stack of their own, to be spliced in after.
+    Stack* kept  = t->tokens;
+    size_t jumps = 0;
+
+    size_t from = tokens[first].offset;
+
+    t->tokens  = t->fresh;
+    BOOL lexed = Tokenizer_lex(t, expr, len, from, &sync, &jumps);
+    t->tokens  = kept;
+
+    Token* fresh    = Stack_getBase(t->fresh);
+    size_t inserted = Stack_getCount(t->fresh);
+
+    if(!lexed) {
+        for(size_t i = 0; i < inserted; ++i) {
+            Token_freeMembers(&fresh[i]);
         }
+
+        Stack_clear(t->fresh);
+        return FALSE;
     }
 
-    tkr->count = item_count;
+    size_t end     = sync.synced ? sync.next : count;
+    size_t removed = end - first;
+
+    // An edit that leaves every paren and jump where it was, as changing a
+    // number or a name does, leaves their links as they were, which the
+    // tokens lexed again take over.
+    BOOL same = removed == inserted;
 
-    Stack_reClear(t->tokens);
-    Stack_reClear(t->stacc);
+    for(size_t i = 0; same && i < inserted; ++i) {
+        same = Token_sameShape(&fresh[i], &tokens[first + i]);
+
+        if(fresh[i].type & TT_JMP)
+            fresh[i].depth = tokens[first + i].depth;
+    }
+
+    // Otherwise, whether the edit touched any paren or jump, rather than just
+    // numbers, names and other operators, which leaves the jumps as they were
+    // but for their indexes. So does one at the start, since a jump can't be
+    // linked from index 0.
+    BOOL structural = jumps || !first ? TRUE : FALSE;
+
+    for(size_t i = 0; i < inserted; ++i) {
+        structural |= fresh[i].type & TT_PAS ? TRUE : FALSE;
+    }
+
+    for(size_t i = first; i < end; ++i) {
+        structural |= tokens[i].type & (TT_JMP | TT_PAS) ? TRUE : FALSE;
+        t->jumps -= tokens[i].type & TT_JMP ? 1 : 0;
+        Token_freeMembers(&tokens[i]);
+    }
+
+    t->jumps += jumps;
+
+    Stack_splice(t->tokens, first, removed, fresh, inserted);
+    Stack_clear(t->fresh);
+
+    tokens = Stack_getBase(t->tokens);
+    count  = Stack_getCount(t->tokens);
+
+    if(len != old_len) {
+        for(size_t i = first + inserted; i < count; ++i) {
+            tokens[i].offset = tokens[i].offset - old_len + len;
+        }
+    }
+
+    // Past a structural edit, the jumps on either side of it may cross it,
+    // and are linked again. Those of any other can't land on its tokens, and
+    // only move with the tokens after it.
+    BOOL relinked = !same && structural && t->jumps;
+
+    if(relinked) {
+        Tokenizer_link(t);
+    } else if(t->jumps && inserted != removed) {
+        for(size_t i = 0; i < count; ++i) {
+            if(tokens[i].type & TT_JMP && tokens[i].depth &&
+               tokens[i].depth >= end)
+                tokens[i].depth = tokens[i].depth - removed + inserted;
+        }
+    }
+
+    // What the jumps skip is checked as by Tokenizer_tokenize: all of it once
+    // linked again, or else only what reaches the edit, the rest having been
+    // checked before. Tokens that fail it are no longer anything to start
+    // from.
+    size_t check_from = relinked ? 0 : first;
+    size_t check_to   = relinked ? count : first + inserted;
+
+    if(t->jumps && !Tokenizer_checkJumps(t, check_from, check_to)) {
+        t->kept = FALSE;
+        return FALSE;
+    }
+
+    char* swap       = t->expr;
+    t->expr          = t->next_expr;
+    t->next_expr     = swap;
+    size_t capacity  = t->expr_capacity;
+    t->expr_capacity = t->next_capacity;
+    t->next_capacity = capacity;
+    t->expr_len      = len;
+
+    edit->first    = first;
+    edit->removed  = removed;
+    edit->inserted = inserted;
+
+    return TRUE;
+}
+
+void Tokenizer_view(Tokenizer* t, TokenArray* view) {
+    view->tokens = Stack_getBase(t->tokens);
+    view->count  = Stack_getCount(t->tokens);
+}
+
+TokenArray* Tokenizer_parse(Tokenizer* t, const char* cexpr, size_t expr_len) {
+    if(!Tokenizer_tokenize(t, cexpr, expr_len)) {
+        return 0;
+    }
+
+    // The token stack's memory, function names included, is handed over to
+    // the TokenArray as is, rather than copied, which would double the peak
+    // memory of parsing a large expression.
+    TokenArray* tkr = csrxmalloc(sizeof(TokenArray));
+    tkr->tokens     = Stack_release(t->tokens, &tkr->count);
+    t->kept         = FALSE;
 
     return tkr;
 }
@@ -38,21 +38,71 @@ typedef enum {
     TT_MUL = 0x00000020, //: *
     TT_POW = 0x00000040, //: ^
     TT_NEG = 0x00000080, //: ~  UNARY
+    TT_VAR = 0x00000100, //: Name not followed by (, held in func.
+    TT_LT  = 0x00000200, //: <
+    TT_LE  = 0x00000400, //: <=
+    TT_GT  = 0x00000800, //: >
+    TT_GE  = 0x00001000, //: >=
+    TT_EQ  = 0x00002000, //: ==
+    TT_NE  = 0x00004000, //: !=
+    TT_AND = 0x00008000, //: &&
     TT_COM = 0x00010000, //: ,
+    TT_OR  = 0x00020000, //: ||
     TT_OPA = 0x00100000, //: (
     TT_CPA = 0x00200000, //: )
     TT_NIL = 0xFFFFFFFF,
     TT_UOP = TT_NEG,
-    TT_BOP = TT_ADD | TT_SUB | TT_DIV | TT_MOD | TT_MUL | TT_POW,
+    TT_CMP = TT_LT | TT_LE | TT_GT | TT_GE | TT_EQ | TT_NE,
+    TT_LOG = TT_AND | TT_OR,
+    TT_BOP = TT_ADD | TT_SUB | TT_DIV | TT_MOD | TT_MUL | TT_POW | TT_CMP |
+             TT_LOG,
     TT_OPS = TT_UOP | TT_BOP,
     TT_PAS = TT_OPA | TT_CPA,
+    TT_JMP = TT_LOG | TT_COM, // May hold a jump in depth, see Token.
 } TokenType;
 
+// How tightly the operator binds; the evaluator applies the operators on top
+// of the cellar that bind at least as tightly as the one it's about to push.
+// Logical operators bind loosest, then equality, then the relational ones,
+// then the arithmetic ones as they always have, each tighter than the last.
+static inline int TokenType_precedence(TokenType type) {
+    // By the bit of the type; 11 for TT_NEG.
+    static const unsigned char LEVELS[32] = {
+        [1] = 5,   [2] = 6,   [3] = 7,   [4] = 8,   [5] = 9,  [6] = 10,
+        [7] = 11,  [9] = 4,   [10] = 4,  [11] = 4,  [12] = 4, [13] = 3,
+        [14] = 3,  [15] = 2,  [17] = 1,
+    };
+
+    return LEVELS[__builtin_ctz((unsigned)type)];
+}
+
 typedef struct Token {
     TokenType type;
-    double    f64;
-    char*     func;
-    char      str[256];
+
+    // Only used by the evaluator for open parens on the operator cellar: the
+    // number of commas seen inside the paren so far, and the depth of the
+    // number cellar when it was pushed, from which arguments are counted.
+    //
+    // For operators on the operator cellar, depth is where their operands
+    // start on the number cellar, as the evaluator keeps it.
+    //
+    // For TT_VAR, depth is free for a variable resolver to cache its binding
+    // in (see Sft_setResolver); the tokenizer leaves it 0.
+    //
+    // For TT_AND and TT_OR, and the commas of if(c, a, b), the tokenizer sets
+    // depth to the index of the token the evaluator skips to when it needn't
+    // evaluate what follows: the right operand of an operator whose left one
+    // decides it, or the branch of the if() not taken. 0 if there's no such
+    // token to skip to, as for tokens put together by hand.
+    uint32_t commas;
+    size_t   depth;
+
+    double f64;
+    char*  func;
+
+    // Index of the token's first character in the expression with its
+    // whitespace stripped, the same coordinates as IterErr.index.
+    size_t offset;
 } Token;
 
 typedef enum {
@@ -62,12 +112,14 @@ typedef enum {
     ACC_FPN = 0x00000004, // Floating point number
     ACC_OCT = 0x00000008, // Octal number
     ACC_HEX = 0x00000010, // Hexadecimal number
-    ACC_FUN = 0x00000080, // Function
+    ACC_FUN = 0x00000080, // Function or variable name
     ACC_NUM = ACC_FPN | ACC_BIN | ACC_OCT | ACC_DEC | ACC_HEX,
     ACC_DTZ = 0x00001000, // Control bit set together with ACC_DEC that's set
                           // to indicate that the number has a trailing zero
                           // which needs to be resolved into something other
                           // than ACC_DEC by the next character to be valid.
+    ACC_EXP = 0x00002000, // Control bit set together with ACC_FPN once an e
+                          // or E started the exponent of a decimal number.
 } AccFlag;
 
 typedef struct {
@@ -75,7 +127,7 @@ typedef struct {
     size_t count;
 } TokenArray;
 
-extern char* Token_toString(Token* token);
+extern size_t Token_toString(const Token* token, char* buffer, size_t size);
 
 extern void Token_print(Token* t);
 
@@ -90,21 +142,88 @@ typedef struct Tokenizer {
     AccFlag   accfl;
     Stack*    stacc; // haha, get it?... I'll see myself out.
     Stack*    tokens;
-    IterErr*  error;
+    Stack*    levels; // Scratch for linking the jumps of tokens.
+    Stack*    cellar; // Scratch for checking what the jumps skip.
+
+    // Points to last_error if the last parse failed, null otherwise.
+    IterErr* error;
+    IterErr  last_error;
+
+    // Index at which the accumulator started accumulating.
+    size_t acc_start;
+
+    // Whitespace-stripped copy of the expression being parsed.
+    char*  expr;
+    size_t expr_capacity;
+    size_t expr_len;
+
+    // Whether tokens and expr are those of the last successful tokenize, for
+    // Tokenizer_retokenize to start from, and how many of the tokens have
+    // jumps to link (see Token).
+    BOOL   kept;
+    size_t jumps;
+
+    // Scratch for Tokenizer_retokenize: the new expression stripped, and its
+    // tokens from where it differs from the last one.
+    char*  next_expr;
+    size_t next_capacity;
+    Stack* fresh;
 } Tokenizer;
 
+// What Tokenizer_retokenize changed: the removed tokens from index first on
+// were replaced by the inserted ones. Those after them are the same tokens as
+// before, moved along, with offsets moved by the change in length.
+typedef struct TokenEdit {
+    size_t first;
+    size_t removed;
+    size_t inserted;
+} TokenEdit;
+
 // Returns a newly allocated string representing the token. Caller responsible
 // for freeing char* returned from this function.
 extern char* TokenType_toString(TokenType t);
 
 extern Tokenizer*  Tokenizer_new();
+// Tokenizes the expression into the Tokenizer's own token stack, without
+// allocating once the Tokenizer has grown to fit. Returns FALSE and sets
+// t->error on failure. Use Tokenizer_view to look at the tokens.
+//
+// The operands that the jumps of the tokens may skip (see Token) are checked
+// as the evaluator would read them, so that an expression that fails with
+// them evaluated fails here rather than only for some values: for operators
+// without operands, empty or stray arguments, unknown functions and wrong
+// argument counts. Variables are only looked up once evaluated.
+extern BOOL Tokenizer_tokenize(Tokenizer* t, const char* cexpr, size_t expr_len);
+
+// Like Tokenizer_tokenize, but for an expression that is an edit of the last
+// one tokenized: only the tokens from the one before the first character
+// that differs, up to where the expression is the same again, are lexed
+// again and spliced in, so that the time taken depends on the size of the
+// edit rather than that of the expression, but for a pass moving the tokens
+// after it. Writes what changed to edit; if there is no last expression to
+// start from, all the tokens are inserted. On failure, the tokens of the last
+// expression are kept, to start from next time, but for one that lexed and
+// failed the check of what its jumps skip, after which there is nothing to
+// start from.
+extern BOOL Tokenizer_retokenize(Tokenizer*  t,
+                                 const char* cexpr,
+                                 size_t      expr_len,
+                                 TokenEdit*  edit);
+
+// Points view at the tokens of the last successful Tokenizer_tokenize or
+// Tokenizer_retokenize. They belong to the Tokenizer, and are only valid
+// until it is used again; the view must not be freed.
+extern void Tokenizer_view(Tokenizer* t, TokenArray* view);
+
+// Tokenizes the expression and hands the tokens over in a newly allocated
+// TokenArray, to be freed with TokenArray_free. Returns null on failure.
 extern TokenArray* Tokenizer_parse(Tokenizer*  t,
                                    const char* cexpr,
                                    size_t      expr_len);
 extern BOOL        Tokenizer_parseAccNum(Tokenizer* t);
-extern void        Tokenizer_error(Tokenizer*  t,
-                                   const char* message,
-                                   size_t      expr_index);
+extern void        Tokenizer_error(Tokenizer* t,
+                                   ErrCode    code,
+                                   size_t     expr_index);
 extern void        Tokenizer_clear(Tokenizer* t);
 extern void        Tokenizer_addToken(Tokenizer* t, Token* token);
 extern void        Tokenizer_free(Tokenizer* t);
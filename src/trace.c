@@ -0,0 +1,157 @@
+#include "trace.h"
+#include "evaluator.h"
+#include "tokenizer.h"
+
+#include <inttypes.h>
+
+Trace* Trace_new(size_t capacity) {
+    size_t rounded = 1;
+
+    if(!capacity)
+        capacity = TRACE_DEFAULT_CAPACITY;
+
+    while(rounded < capacity) {
+        rounded <<= 1;
+    }
+
+    Trace* trace = xmalloc(sizeof(Trace));
+    memset(trace, 0, sizeof(Trace));
+
+    trace->events = xmalloc(rounded * sizeof(TraceEvent));
+    trace->mask   = rounded - 1;
+
+    return trace;
+}
+
+void Trace_free(Trace* trace) {
+    if(trace) {
+        xfree(trace->events);
+        xfree(trace);
+    }
+}
+
+void Trace_clear(Trace* trace) {
+    if(trace)
+        trace->recorded = 0;
+}
+
+size_t Trace_count(Trace* trace) {
+    if(!trace)
+        return 0;
+
+    return trace->recorded > trace->mask ? trace->mask + 1 : trace->recorded;
+}
+
+int Trace_write(Trace* trace, FILE* stream) {
+    size_t count = Trace_count(trace);
+
+    TraceFileHeader header = {.magic    = TRACE_MAGIC,
+                              .version  = TRACE_VERSION,
+                              .recorded = trace ? trace->recorded : 0,
+                              .count    = count};
+
+    if(fwrite(&header, sizeof(header), 1, stream) != 1)
+        return -1;
+
+    if(!count)
+        return 0;
+
+    // The oldest held event sits right after the newest one once the ring
+    // has wrapped around, otherwise at the start of the buffer.
+    size_t first = (trace->recorded - count) & trace->mask;
+    size_t tail  = (trace->mask + 1) - first;
+
+    if(tail > count)
+        tail = count;
+
+    if(fwrite(&trace->events[first], sizeof(TraceEvent), tail, stream) != tail)
+        return -1;
+
+    if(count > tail
+       && fwrite(trace->events, sizeof(TraceEvent), count - tail, stream)
+              != count - tail)
+        return -1;
+
+    return 0;
+}
+
+static const char* TraceKind_name(uint32_t kind) {
+    switch(kind) {
+        case TRACE_BEGIN:
+            return "begin";
+        case TRACE_END:
+            return "end";
+        case TRACE_PUSH_NUM:
+            return "push.num";
+        case TRACE_PUSH_OP:
+            return "push.op";
+        case TRACE_POP_NUM:
+            return "pop.num";
+        case TRACE_POP_OP:
+            return "pop.op";
+        case TRACE_APPLY_OP:
+            return "apply";
+        case TRACE_CALL:
+            return "call";
+        case TRACE_ERROR:
+            return "error";
+        default:
+            return "?";
+    }
+}
+
+void Trace_render(const TraceEvent* events, size_t count, FILE* stream) {
+    if(!count)
+        return;
+
+    uint64_t origin = events[0].ns;
+
+    for(size_t i = 0; i < count; ++i) {
+        const TraceEvent* e = &events[i];
+
+        fprintf(stream,
+                "%10" PRIu64 "ns  #%-6" PRIu32 " %-9s",
+                e->ns - origin,
+                e->token,
+                TraceKind_name(e->kind));
+
+        switch(e->kind) {
+            case TRACE_BEGIN:
+                fprintf(stream, " tokens=%" PRIu32, e->aux);
+                break;
+            case TRACE_PUSH_OP:
+            case TRACE_POP_OP:
+            case TRACE_APPLY_OP: {
+                Token token = {.type = (TokenType)e->aux};
+                char  symbol[8];
+
+                Token_toString(&token, symbol, sizeof(symbol));
+                fprintf(stream, " %s", symbol);
+
+                if(e->kind == TRACE_APPLY_OP)
+                    fprintf(stream, " = %g", e->value);
+                break;
+            }
+            case TRACE_CALL:
+                if(e->aux < FN_LOOKUP_COUNT)
+                    fprintf(stream, " %s()", FN_LOOKUP[e->aux].name);
+                else
+                    fprintf(stream, " fn#%" PRIu32 "()", e->aux);
+
+                fprintf(stream, " = %g", e->value);
+                break;
+            case TRACE_ERROR:
+                fprintf(stream, " %s", ErrCode_describe((ErrCode)e->aux));
+                break;
+            case TRACE_PUSH_NUM:
+            case TRACE_POP_NUM:
+            case TRACE_END:
+                fprintf(stream, " %g", e->value);
+                break;
+            default:
+                break;
+        }
+
+        fprintf(stream, "\n");
+    }
+}
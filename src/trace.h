@@ -0,0 +1,107 @@
+#ifndef _H_TRACE_
+#define _H_TRACE_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+
+// Evaluation trace. A fixed-size ring buffer of compact binary events that
+// the evaluator appends to as it works, cheap enough to leave enabled on a
+// live system. Nothing is formatted while recording; events are written out
+// raw with Trace_write() and turned into text offline by Trace_render(), or
+// by the seqft_tracedump tool which reads the raw files.
+//
+// Recording is selected at compile time with SEQFT_TRACE. Without it the
+// SFT_TRACE() macro expands to nothing and the evaluator carries no cost.
+
+#define TRACE_MAGIC            0x52545153 // "SQTR"
+#define TRACE_VERSION          1
+#define TRACE_DEFAULT_CAPACITY 4096
+
+typedef enum {
+    TRACE_BEGIN    = 1, // Evaluation started. aux = token count.
+    TRACE_END      = 2, // Evaluation finished. value = result.
+    TRACE_PUSH_NUM = 3, // Number pushed onto the number cellar.
+    TRACE_PUSH_OP  = 4, // Operator pushed onto the operator cellar.
+    TRACE_POP_NUM  = 5, // Number popped off the number cellar.
+    TRACE_POP_OP   = 6, // Operator popped off the operator cellar.
+    TRACE_APPLY_OP = 7, // Operator applied. aux = TokenType, value = result.
+    TRACE_CALL     = 8, // Function called. aux = function index, value = result.
+    TRACE_ERROR    = 9, // Evaluation failed. aux = ErrCode.
+} TraceKind;
+
+typedef struct TraceEvent {
+    uint64_t ns;    // CLOCK_MONOTONIC timestamp in nanoseconds.
+    double   value; // Number involved in the event, if any.
+    uint32_t token; // Index of the token being processed.
+    uint32_t aux;   // Event specific, see TraceKind.
+    uint32_t kind;  // TraceKind
+    uint32_t _reserved;
+} TraceEvent;
+
+// The ring only ever overwrites its oldest events; `recorded` keeps counting
+// so that the number of dropped events can be reported by the dumper.
+typedef struct Trace {
+    TraceEvent* events;
+    size_t      mask; // capacity - 1, capacity is a power of two.
+    uint64_t    recorded;
+} Trace;
+
+// Header preceding every block of events written by Trace_write().
+typedef struct TraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t recorded; // Events recorded in total, including dropped ones.
+    uint64_t count;    // Events that follow this header.
+} TraceFileHeader;
+
+// Capacity is rounded up to a power of two. 0 means TRACE_DEFAULT_CAPACITY.
+extern Trace* Trace_new(size_t capacity);
+extern void   Trace_free(Trace* trace);
+extern void   Trace_clear(Trace* trace);
+
+// Number of events currently held by the ring buffer.
+extern size_t Trace_count(Trace* trace);
+
+// Writes the held events, oldest first, to the stream in the binary format
+// described by TraceFileHeader. Returns non-zero on failure.
+extern int Trace_write(Trace* trace, FILE* stream);
+
+// Renders events as text, one line per event, timestamps relative to the
+// first event.
+extern void Trace_render(const TraceEvent* events, size_t count, FILE* stream);
+
+static inline uint64_t Trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void Trace_record(Trace*    trace,
+                                TraceKind kind,
+                                size_t    token,
+                                uint32_t  aux,
+                                double    value) {
+    if(!trace)
+        return;
+
+    TraceEvent* event = &trace->events[trace->recorded++ & trace->mask];
+    event->ns         = Trace_now();
+    event->value      = value;
+    event->token      = (uint32_t)token;
+    event->aux        = aux;
+    event->kind       = kind;
+}
+
+#ifdef SEQFT_TRACE
+    #define SFT_TRACE(trace, kind, token, aux, value) \
+        Trace_record(trace, kind, token, aux, value)
+#else
+    #define SFT_TRACE(trace, kind, token, aux, value) \
+        do {                                          \
+        } while(0)
+#endif
+
+#endif // _H_TRACE_
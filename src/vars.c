@@ -0,0 +1,329 @@
+#include "vars.h"
+
+// A frame of the depth first search over dependents: the variable, and the
+// index of the next of its dependents to visit.
+typedef struct {
+    size_t node;
+    size_t next;
+} VarsFrame;
+
+static Variable* Vars_variable(const Vars* vars, size_t index) {
+    return Stack_itemAt(vars->variables, index);
+}
+
+static void Variable_freeMembers(Variable* var) {
+    xfree(var->name);
+    xfree(var->source);
+    TokenArray_free(var->tokens);
+    Stack_free(var->deps);
+    Stack_free(var->dependents);
+}
+
+Vars* Vars_new(void) {
+    Vars* vars = xmalloc(sizeof(Vars));
+    memset(vars, 0, sizeof(Vars));
+
+    vars->variables = Stack_new(sizeof(Variable));
+    vars->names     = HashMap_new();
+    vars->t         = Tokenizer_new();
+    vars->sft       = Sft_new();
+    vars->walk      = Stack_new(sizeof(VarsFrame));
+    vars->order     = Stack_new(sizeof(size_t));
+
+    Stack_setDeallocator(vars->variables,
+                         (void (*)(void*)) & Variable_freeMembers);
+    Sft_setResolver(vars->sft, Vars_resolve, vars);
+
+    return vars;
+}
+
+void Vars_free(Vars* vars) {
+    if(!vars)
+        return;
+
+    Stack_free(vars->variables);
+    HashMap_free(vars->names);
+    Tokenizer_free(vars->t);
+    Sft_free(vars->sft);
+    Stack_free(vars->walk);
+    Stack_free(vars->order);
+    xfree(vars);
+}
+
+// Returns the index of the variable called name, adding it without a formula
+// if it doesn't exist yet. Invalidates pointers to variables when it adds.
+static size_t Vars_intern(Vars* vars, const char* name, size_t len) {
+    size_t index;
+
+    if(HashMap_get(vars->names, name, len, &index))
+        return index;
+
+    Variable var = {0};
+    var.name     = xmalloc(len + 1);
+    memcpy(var.name, name, len);
+    var.name[len]  = '\0';
+    var.state      = ERR_UNKNOWN_VARIABLE;
+    var.deps       = Stack_new(sizeof(size_t));
+    var.dependents = Stack_new(sizeof(size_t));
+
+    index = Stack_getCount(vars->variables);
+    Stack_pushFrom(vars->variables, &var);
+    HashMap_put(vars->names, name, len, index);
+
+    return index;
+}
+
+// Removes one occurrence of value from a stack of size_t, not keeping order.
+static void remove_index(Stack* s, size_t value) {
+    size_t  count = Stack_getCount(s);
+    size_t* items = Stack_getBase(s);
+
+    for(size_t i = 0; i < count; ++i) {
+        if(items[i] == value) {
+            items[i] = items[count - 1];
+            Stack_truncate(s, count - 1);
+            return;
+        }
+    }
+}
+
+// Visits root and every variable depending on it, directly or not, and leaves
+// them in vars->order in postorder, so that reading it backwards gives a
+// topological order. Returns FALSE, stopping early, if it reaches a variable
+// marked with `forbidden`.
+static BOOL Vars_walkDependents(Vars* vars, size_t root, uint64_t forbidden) {
+    uint64_t visited = ++vars->epoch;
+
+    Stack_clear(vars->walk);
+    Stack_clear(vars->order);
+
+    if(Vars_variable(vars, root)->mark == forbidden)
+        return FALSE;
+
+    Vars_variable(vars, root)->mark = visited;
+    Stack_pushFrom(vars->walk, &(VarsFrame) {.node = root, .next = 0});
+
+    while(!Stack_empty(vars->walk)) {
+        VarsFrame* frame = Stack_getHead(vars->walk);
+        Variable*  var   = Vars_variable(vars, frame->node);
+
+        if(frame->next == Stack_getCount(var->dependents)) {
+            Stack_pushFrom(vars->order, &frame->node);
+            Stack_popInto(vars->walk, 0);
+            continue;
+        }
+
+        size_t    next = *(size_t*)Stack_itemAt(var->dependents, frame->next);
+        Variable* dep  = Vars_variable(vars, next);
+        frame->next += 1;
+
+        if(dep->mark == forbidden)
+            return FALSE;
+
+        if(dep->mark != visited) {
+            dep->mark = visited;
+            Stack_pushFrom(vars->walk, &(VarsFrame) {.node = next, .next = 0});
+        }
+    }
+
+    return TRUE;
+}
+
+// Evaluates the variable's formula, and returns whether its value or state
+// changed.
+static BOOL Vars_evaluate(Vars* vars, Variable* var) {
+    double  value = 0;
+    ErrCode state = ERR_NONE;
+
+    SftError* error = Sft_evalTokens(vars->sft, var->tokens, &value);
+
+    if(error)
+        state = error->code;
+
+    vars->recomputed += 1;
+
+    // Compared bitwise, so that a NaN staying NaN counts as unchanged.
+    BOOL changed = state != var->state ||
+                   (state == ERR_NONE &&
+                    memcmp(&value, &var->value, sizeof(double)));
+
+    var->value = state == ERR_NONE ? value : 0;
+    var->state = state;
+
+    return changed;
+}
+
+BOOL Vars_assign(Vars*       vars,
+                 const char* name,
+                 size_t      name_len,
+                 const char* formula,
+                 size_t      len,
+                 IterErr*    error) {
+    vars->recomputed = 0;
+
+    TokenArray* tokens = Tokenizer_parse(vars->t, formula, len);
+
+    if(!tokens) {
+        *error = *vars->t->error;
+        return FALSE;
+    }
+
+    size_t   root  = Vars_intern(vars, name, name_len);
+    Stack*   deps  = Stack_new(sizeof(size_t));
+    uint64_t input = ++vars->epoch;
+
+    // Bind every variable the formula reads, and collect each once.
+    for(size_t i = 0; i < tokens->count; ++i) {
+        Token* token = &tokens->tokens[i];
+
+        if(!(token->type & TT_VAR))
+            continue;
+
+        size_t    index = Vars_intern(vars, token->func, strlen(token->func));
+        Variable* dep   = Vars_variable(vars, index);
+
+        token->depth = index + 1;
+
+        if(dep->mark != input) {
+            dep->mark = input;
+            Stack_pushFrom(deps, &index);
+        }
+    }
+
+    // The formula would close a cycle if it read the variable itself or
+    // anything downstream of it.
+    if(!Vars_walkDependents(vars, root, input)) {
+        Stack_free(deps);
+        TokenArray_free(tokens);
+
+        error->code    = ERR_DEPENDENCY_CYCLE;
+        error->message = ErrCode_describe(ERR_DEPENDENCY_CYCLE);
+        error->index   = 0;
+        return FALSE;
+    }
+
+    Variable* var = Vars_variable(vars, root);
+
+    for(size_t i = 0; i < Stack_getCount(var->deps); ++i) {
+        size_t index = *(size_t*)Stack_itemAt(var->deps, i);
+        remove_index(Vars_variable(vars, index)->dependents, root);
+    }
+
+    for(size_t i = 0; i < Stack_getCount(deps); ++i) {
+        size_t index = *(size_t*)Stack_itemAt(deps, i);
+        Stack_pushFrom(Vars_variable(vars, index)->dependents, &root);
+    }
+
+    Stack_free(var->deps);
+    TokenArray_free(var->tokens);
+    xfree(var->source);
+
+    var->deps   = deps;
+    var->tokens = tokens;
+    var->source = xmalloc(len + 1);
+    memcpy(var->source, formula, len);
+    var->source[len] = '\0';
+    var->dirty       = TRUE;
+
+    // Its dependents haven't changed, so the walk above is still the
+    // downstream of the variable. Evaluate it in topological order, each
+    // formula only if something it reads changed.
+    for(size_t i = Stack_getCount(vars->order); i-- > 0;) {
+        size_t    index = *(size_t*)Stack_itemAt(vars->order, i);
+        Variable* down  = Vars_variable(vars, index);
+
+        if(!down->dirty)
+            continue;
+
+        down->dirty = FALSE;
+
+        if(!Vars_evaluate(vars, down))
+            continue;
+
+        for(size_t j = 0; j < Stack_getCount(down->dependents); ++j) {
+            size_t next = *(size_t*)Stack_itemAt(down->dependents, j);
+            Vars_variable(vars, next)->dirty = TRUE;
+        }
+    }
+
+    return TRUE;
+}
+
+const Variable* Vars_get(const Vars* vars, const char* name) {
+    size_t index;
+
+    if(!HashMap_get(vars->names, name, strlen(name), &index))
+        return 0;
+
+    return Vars_variable(vars, index);
+}
+
+size_t Vars_count(const Vars* vars) {
+    return Stack_getCount(vars->variables);
+}
+
+const Variable* Vars_at(const Vars* vars, size_t index) {
+    return Vars_variable(vars, index);
+}
+
+BOOL Vars_resolve(void* user, const Token* token, double* value) {
+    Vars*  vars  = user;
+    size_t index = token->depth;
+
+    // Formulas are bound when assigned; anything else is looked up by name.
+    if(index) {
+        index -= 1;
+    } else if(!HashMap_get(
+                  vars->names, token->func, strlen(token->func), &index)) {
+        return FALSE;
+    }
+
+    Variable* var = Vars_variable(vars, index);
+
+    if(var->state != ERR_NONE)
+        return FALSE;
+
+    *value = var->value;
+    return TRUE;
+}
+
+BOOL Vars_splitAssignment(const char*  statement,
+                          size_t       len,
+                          const char** name,
+                          size_t*      name_len,
+                          const char** formula,
+                          size_t*      formula_len) {
+    size_t i = 0;
+
+    while(i < len && isspace((unsigned char)statement[i]))
+        ++i;
+
+    size_t start = i;
+
+    if(i == len || !isalpha((unsigned char)statement[i]))
+        return FALSE;
+
+    while(i < len && (isalnum((unsigned char)statement[i]) ||
+                      statement[i] == '_'))
+        ++i;
+
+    size_t end = i;
+
+    while(i < len && isspace((unsigned char)statement[i]))
+        ++i;
+
+    // x == 1 is a comparison.
+    if(i == len || statement[i] != '=' ||
+       (i + 1 < len && statement[i + 1] == '='))
+        return FALSE;
+
+    for(++i; i < len && isspace((unsigned char)statement[i]);)
+        ++i;
+
+    *name        = statement + start;
+    *name_len    = end - start;
+    *formula     = statement + i;
+    *formula_len = len - i;
+
+    return TRUE;
+}
@@ -0,0 +1,99 @@
+#ifndef _H_VARS_
+#define _H_VARS_
+
+#include "common.h"
+#include "evaluator.h"
+#include "hashmap.h"
+#include "stack.h"
+#include "tokenizer.h"
+
+// Named variables defined by formulas over each other, as in a spreadsheet:
+//
+//     a = 2
+//     b = a * 10
+//     c = b + a
+//
+// Every formula is tokenized once, when assigned, and the variables it reads
+// are recorded as edges of a dependency graph. Assigning a variable evaluates
+// it and then only what depends on it, each formula once, in topological
+// order; everything else keeps its cached value. A formula whose inputs all
+// come out unchanged is not evaluated again, so the propagation stops early.
+//
+// Referring to a variable that has not been assigned yet is allowed; it has
+// no value until it is, and neither has anything depending on it.
+
+typedef struct Variable {
+    char* name;
+
+    // The formula as assigned, and its tokens, in which every TT_VAR token's
+    // depth holds the index of its variable plus one. Both null until the
+    // variable is assigned.
+    char*       source;
+    TokenArray* tokens;
+
+    // The value is only meaningful if state is ERR_NONE; otherwise state is
+    // the error the formula's last evaluation failed with.
+    double  value;
+    ErrCode state;
+
+    Stack* deps;       // size_t indices of the variables the formula reads.
+    Stack* dependents; // size_t indices of the variables reading this one.
+
+    // Scratch for traversals of the graph, see Vars_assign.
+    uint64_t mark;
+    BOOL     dirty;
+} Variable;
+
+typedef struct Vars {
+    Stack*   variables; // Variable, indexed by the values of names.
+    HashMap* names;
+
+    // Used for tokenizing and evaluating formulas, with Vars_resolve.
+    Tokenizer* t;
+    Sft*       sft;
+
+    // Scratch for traversals: the frames of the depth first search, and the
+    // variables it finished, in postorder.
+    Stack*   walk;
+    Stack*   order;
+    uint64_t epoch;
+
+    // Formulas evaluated by the last assignment, the assigned one included.
+    size_t recomputed;
+} Vars;
+
+extern Vars* Vars_new(void);
+extern void  Vars_free(Vars* vars);
+
+// Assigns the formula, len bytes long, to the variable called name, then
+// brings everything that depends on it up to date. Returns FALSE and writes
+// the error if the formula can't be tokenized or would make the variable
+// depend on itself, in which case nothing changes. A formula that fails to
+// evaluate is still assigned, and the variable has no value.
+extern BOOL Vars_assign(Vars*       vars,
+                        const char* name,
+                        size_t      name_len,
+                        const char* formula,
+                        size_t      len,
+                        IterErr*    error);
+
+// Returns the variable called name, or null if it was never mentioned.
+extern const Variable* Vars_get(const Vars* vars, const char* name);
+
+extern size_t          Vars_count(const Vars* vars);
+extern const Variable* Vars_at(const Vars* vars, size_t index);
+
+// An SftResolver, with the Vars as user, for evaluating expressions that read
+// variables.
+extern BOOL Vars_resolve(void* vars, const Token* token, double* value);
+
+// Splits a statement of the form "name = formula". Returns FALSE if it isn't
+// one: a name is a letter followed by letters, digits and underscores.
+extern BOOL Vars_splitAssignment(const char*  statement,
+                                 size_t       len,
+                                 const char** name,
+                                 size_t*      name_len,
+                                 const char** formula,
+                                 size_t*      formula_len);
+
+#endif // _H_VARS_
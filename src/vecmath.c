@@ -0,0 +1,86 @@
+#include "vecmath.h"
+
+#include <stdatomic.h>
+
+#include "vecmath_kernels.h"
+
+// The table in use, picked on the first call. Every thread that races to it
+// picks the same one.
+static _Atomic(const VecKernels*) vec_kernels = 0;
+
+static BOOL vec_hasAvx2(void) {
+#ifdef VECMATH_AVX2
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return FALSE;
+#endif
+}
+
+static const VecKernels* vec_table(VecIsa isa) {
+#ifdef VECMATH_AVX2
+    if(isa == VEC_AVX2)
+        return &vecmath_avx2Kernels;
+#endif
+    (void)isa;
+    return &vecmath_baseKernels;
+}
+
+static const VecKernels* vec_get(void) {
+    const VecKernels* kernels =
+        atomic_load_explicit(&vec_kernels, memory_order_relaxed);
+
+    if(!kernels) {
+        kernels = vec_table(vec_hasAvx2() ? VEC_AVX2 : VEC_BASELINE);
+        atomic_store_explicit(&vec_kernels, kernels, memory_order_relaxed);
+    }
+
+    return kernels;
+}
+
+VecIsa vec_isa(void) {
+    return vec_get() == vec_table(VEC_BASELINE) ? VEC_BASELINE : VEC_AVX2;
+}
+
+const char* vec_isaName(VecIsa isa) {
+    if(isa == VEC_AVX2)
+        return "avx2";
+
+#if defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+BOOL vec_setIsa(VecIsa isa) {
+    if(isa == VEC_AVX2 && !vec_hasAvx2())
+        return FALSE;
+
+    atomic_store_explicit(&vec_kernels, vec_table(isa), memory_order_relaxed);
+    return TRUE;
+}
+
+void vec_exp(const double* x, double* out, size_t len) {
+    vec_get()->exp(x, out, len);
+}
+
+void vec_log(const double* x, double* out, size_t len) {
+    vec_get()->log(x, out, len);
+}
+
+void vec_pow(const double* x, const double* y, double* out, size_t len) {
+    vec_get()->pow(x, y, out, len);
+}
+
+void vec_floor(const double* x, double* out, size_t len) {
+    vec_get()->floor(x, out, len);
+}
+
+void vec_ceil(const double* x, double* out, size_t len) {
+    vec_get()->ceil(x, out, len);
+}
+
+void vec_round(const double* x, double* out, size_t len) {
+    vec_get()->round(x, out, len);
+}
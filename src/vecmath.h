@@ -0,0 +1,56 @@
+#ifndef _H_VECMATH_
+#define _H_VECMATH_
+
+#include <stddef.h>
+
+#include "common.h"
+
+// Elementwise math over arrays of doubles, for evaluating one formula over a
+// column of values. Like the reductions of reduce.h, these process two lanes
+// per instruction where SSE2 is available and fall back to plain loops of the
+// same arithmetic elsewhere. On x86-64 CPUs with AVX2 and FMA they process
+// four lanes, with fused multiply-adds, which can change the last bit of exp,
+// log and pow. They assume the default rounding mode, round to nearest.
+//
+// Errors, in units in the last place of the exact result, as measured by
+// seqft_mathcheck against long double references, with either instruction
+// set:
+//
+//     vec_exp    < 1 ulp     (0.80 seen)
+//     vec_log    < 1 ulp     (0.84 seen)
+//     vec_pow    < 1 ulp     (0.87 seen, 0.93 for subnormal results)
+//     vec_floor, vec_ceil, vec_round   exact
+//
+// Special values follow C99 Annex F, as libm does: vec_pow hands every lane
+// with a base that isn't positive and finite, or an exponent that isn't
+// finite or is beyond 2^900 in magnitude, to pow() itself.
+//
+// out may be the same array as an input.
+
+extern void vec_exp(const double* x, double* out, size_t len);
+extern void vec_log(const double* x, double* out, size_t len);
+extern void vec_pow(const double* x, const double* y, double* out, size_t len);
+
+extern void vec_floor(const double* x, double* out, size_t len);
+extern void vec_ceil(const double* x, double* out, size_t len);
+
+// Rounds half away from zero, like round().
+extern void vec_round(const double* x, double* out, size_t len);
+
+// Instruction sets the kernels run on. VEC_BASELINE is SSE2 where the build
+// targets it, and plain doubles elsewhere.
+typedef enum {
+    VEC_BASELINE,
+    VEC_AVX2,
+} VecIsa;
+
+// The instruction set in use, the best the CPU has unless vec_setIsa chose.
+extern VecIsa      vec_isa(void);
+extern const char* vec_isaName(VecIsa isa);
+
+// Makes every later call use the instruction set, for the checks and
+// benchmarks. Returns FALSE, and changes nothing, if the build or the CPU
+// lacks it.
+extern BOOL vec_setIsa(VecIsa isa);
+
+#endif // _H_VECMATH_
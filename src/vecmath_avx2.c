@@ -0,0 +1,113 @@
+#include <immintrin.h>
+#include <stdint.h>
+
+// The kernels of vecmath_kernels.h on four lanes of AVX2, with fused
+// multiply-adds for the polynomials and for exact products. Only this file is
+// compiled with -mavx2 -mfma, and -ffp-contract=off, so that the compiler
+// doesn't fuse the additions the error free transformations rely on;
+// vecmath.c calls it only where the CPU has both.
+
+typedef __m256d V;
+
+#define VEC_LANES 4
+
+static inline V v_set(double a) {
+    return _mm256_set1_pd(a);
+}
+
+static inline V v_bits(uint64_t bits) {
+    return _mm256_castsi256_pd(_mm256_set1_epi64x((long long)bits));
+}
+
+static inline V v_load(const double* p) {
+    return _mm256_loadu_pd(p);
+}
+
+static inline void v_store(double* p, V a) {
+    _mm256_storeu_pd(p, a);
+}
+
+static inline V v_add(V a, V b) {
+    return _mm256_add_pd(a, b);
+}
+
+static inline V v_sub(V a, V b) {
+    return _mm256_sub_pd(a, b);
+}
+
+static inline V v_mul(V a, V b) {
+    return _mm256_mul_pd(a, b);
+}
+
+static inline V v_div(V a, V b) {
+    return _mm256_div_pd(a, b);
+}
+
+static inline V v_fma(V a, V b, V c) {
+    return _mm256_fmadd_pd(a, b, c);
+}
+
+// a < b ? a : b, and a > b ? a : b: b where either is NaN.
+static inline V v_min(V a, V b) {
+    return _mm256_min_pd(a, b);
+}
+
+static inline V v_max(V a, V b) {
+    return _mm256_max_pd(a, b);
+}
+
+static inline V v_lt(V a, V b) {
+    return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+}
+
+static inline V v_gt(V a, V b) {
+    return _mm256_cmp_pd(a, b, _CMP_GT_OQ);
+}
+
+static inline V v_ge(V a, V b) {
+    return _mm256_cmp_pd(a, b, _CMP_GE_OQ);
+}
+
+static inline V v_eq(V a, V b) {
+    return _mm256_cmp_pd(a, b, _CMP_EQ_OQ);
+}
+
+// Not equal, or unordered.
+static inline V v_ne(V a, V b) {
+    return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ);
+}
+
+static inline V v_and(V a, V b) {
+    return _mm256_and_pd(a, b);
+}
+
+// ~a & b.
+static inline V v_andnot(V a, V b) {
+    return _mm256_andnot_pd(a, b);
+}
+
+static inline V v_or(V a, V b) {
+    return _mm256_or_pd(a, b);
+}
+
+static inline V v_shl(V a, int n) {
+    return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(a), n));
+}
+
+static inline V v_shr(V a, int n) {
+    return _mm256_castsi256_pd(_mm256_srli_epi64(_mm256_castpd_si256(a), n));
+}
+
+// One bit per lane, set where the mask is.
+static inline int v_movemask(V mask) {
+    return _mm256_movemask_pd(mask);
+}
+
+// The fused a * b - p is exact.
+static inline void v_twoProd(V a, V b, V* p, V* e) {
+    *p = v_mul(a, b);
+    *e = _mm256_fmsub_pd(a, b, *p);
+}
+
+#define VECMATH_KERNELS vecmath_avx2Kernels
+#include "vecmath_kernels.h"
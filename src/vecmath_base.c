@@ -0,0 +1,234 @@
+#include <stdint.h>
+#include <string.h>
+
+// The kernels of vecmath_kernels.h on two lanes of SSE2, or on one double at a
+// time where it's missing.
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+    #define VECMATH_SSE2
+#endif
+
+#ifdef VECMATH_SSE2
+
+typedef __m128d V;
+
+    #define VEC_LANES 2
+
+static inline V v_set(double a) {
+    return _mm_set1_pd(a);
+}
+
+static inline V v_bits(uint64_t bits) {
+    return _mm_castsi128_pd(_mm_set1_epi64x((long long)bits));
+}
+
+static inline V v_load(const double* p) {
+    return _mm_loadu_pd(p);
+}
+
+static inline void v_store(double* p, V a) {
+    _mm_storeu_pd(p, a);
+}
+
+static inline V v_add(V a, V b) {
+    return _mm_add_pd(a, b);
+}
+
+static inline V v_sub(V a, V b) {
+    return _mm_sub_pd(a, b);
+}
+
+static inline V v_mul(V a, V b) {
+    return _mm_mul_pd(a, b);
+}
+
+static inline V v_div(V a, V b) {
+    return _mm_div_pd(a, b);
+}
+
+// a < b ? a : b, and a > b ? a : b: b where either is NaN.
+static inline V v_min(V a, V b) {
+    return _mm_min_pd(a, b);
+}
+
+static inline V v_max(V a, V b) {
+    return _mm_max_pd(a, b);
+}
+
+static inline V v_lt(V a, V b) {
+    return _mm_cmplt_pd(a, b);
+}
+
+static inline V v_gt(V a, V b) {
+    return _mm_cmpgt_pd(a, b);
+}
+
+static inline V v_eq(V a, V b) {
+    return _mm_cmpeq_pd(a, b);
+}
+
+// Not equal, or unordered.
+static inline V v_ne(V a, V b) {
+    return _mm_cmpneq_pd(a, b);
+}
+
+static inline V v_and(V a, V b) {
+    return _mm_and_pd(a, b);
+}
+
+// ~a & b.
+static inline V v_andnot(V a, V b) {
+    return _mm_andnot_pd(a, b);
+}
+
+static inline V v_or(V a, V b) {
+    return _mm_or_pd(a, b);
+}
+
+static inline V v_shl(V a, int n) {
+    return _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(a), n));
+}
+
+static inline V v_shr(V a, int n) {
+    return _mm_castsi128_pd(_mm_srli_epi64(_mm_castpd_si128(a), n));
+}
+
+static inline V v_ge(V a, V b) {
+    return _mm_cmpge_pd(a, b);
+}
+
+// One bit per lane, set where the mask is.
+static inline int v_movemask(V mask) {
+    return _mm_movemask_pd(mask);
+}
+
+#else
+
+typedef double V;
+
+    #define VEC_LANES 1
+
+static inline uint64_t v_u(V a) {
+    uint64_t bits;
+    memcpy(&bits, &a, sizeof(bits));
+    return bits;
+}
+
+static inline V v_bits(uint64_t bits) {
+    V a;
+    memcpy(&a, &bits, sizeof(a));
+    return a;
+}
+
+static inline V v_mask(int condition) {
+    return v_bits(condition ? ~0ull : 0);
+}
+
+static inline V v_set(double a) {
+    return a;
+}
+
+static inline V v_load(const double* p) {
+    return *p;
+}
+
+static inline void v_store(double* p, V a) {
+    *p = a;
+}
+
+static inline V v_add(V a, V b) {
+    return a + b;
+}
+
+static inline V v_sub(V a, V b) {
+    return a - b;
+}
+
+static inline V v_mul(V a, V b) {
+    return a * b;
+}
+
+static inline V v_div(V a, V b) {
+    return a / b;
+}
+
+static inline V v_min(V a, V b) {
+    return a < b ? a : b;
+}
+
+static inline V v_max(V a, V b) {
+    return a > b ? a : b;
+}
+
+static inline V v_lt(V a, V b) {
+    return v_mask(a < b);
+}
+
+static inline V v_gt(V a, V b) {
+    return v_mask(a > b);
+}
+
+static inline V v_eq(V a, V b) {
+    return v_mask(a == b);
+}
+
+static inline V v_ne(V a, V b) {
+    return v_mask(a != b);
+}
+
+static inline V v_and(V a, V b) {
+    return v_bits(v_u(a) & v_u(b));
+}
+
+static inline V v_andnot(V a, V b) {
+    return v_bits(~v_u(a) & v_u(b));
+}
+
+static inline V v_or(V a, V b) {
+    return v_bits(v_u(a) | v_u(b));
+}
+
+static inline V v_shl(V a, int n) {
+    return v_bits(v_u(a) << n);
+}
+
+static inline V v_shr(V a, int n) {
+    return v_bits(v_u(a) >> n);
+}
+
+static inline V v_ge(V a, V b) {
+    return v_mask(a >= b);
+}
+
+static inline int v_movemask(V mask) {
+    return v_u(mask) != 0;
+}
+
+#endif
+
+static inline V v_fma(V a, V b, V c) {
+    return v_add(v_mul(a, b), c);
+}
+
+// Splits a into two halves of 26 bits. Overflows above 2^996.
+static inline void v_split(V a, V* hi, V* lo) {
+    V c = v_mul(a, v_set(134217729.0)); // 2^27 + 1
+    *hi = v_sub(c, v_sub(c, a));
+    *lo = v_sub(a, *hi);
+}
+
+// Dekker's product, since there's no fused multiply-add here.
+static inline void v_twoProd(V a, V b, V* p, V* e) {
+    V ah, al, bh, bl;
+
+    *p = v_mul(a, b);
+    v_split(a, &ah, &al);
+    v_split(b, &bh, &bl);
+    *e = v_add(v_add(v_add(v_sub(v_mul(ah, bh), *p), v_mul(ah, bl)),
+                     v_mul(al, bh)),
+               v_mul(al, bl));
+}
+
+#define VECMATH_KERNELS vecmath_baseKernels
+#include "vecmath_kernels.h"
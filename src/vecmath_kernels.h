@@ -0,0 +1,411 @@
+#ifndef _H_VECMATH_KERNELS_
+#define _H_VECMATH_KERNELS_
+
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The kernels behind vecmath.h, compiled once per instruction set:
+// vecmath_base.c for SSE2, or plain doubles without it, and vecmath_avx2.c
+// for AVX2 with FMA. Each defines V, a vector of VEC_LANES doubles, and the
+// operations on it below, then defines VECMATH_KERNELS as the name of its
+// table and includes this file. vecmath.c picks a table at run time.
+//
+// Comparisons give masks, all bits of a lane set where they hold, that the
+// bitwise operations and v_select take. The operations are:
+//
+//     v_set v_bits v_load v_store          broadcast, and unaligned access
+//     v_add v_sub v_mul v_div v_min v_max
+//     v_fma(a, b, c)                       a * b + c, rounded once or twice
+//     v_twoProd(a, b, &p, &e)              p + e exactly a * b
+//     v_lt v_gt v_ge v_eq v_ne             masks
+//     v_and v_andnot v_or v_shl v_shr      on the bits
+//     v_movemask                           one bit per lane, set in masks
+
+typedef struct VecKernels {
+    void (*exp)(const double* x, double* out, size_t len);
+    void (*log)(const double* x, double* out, size_t len);
+    void (*pow)(const double* x, const double* y, double* out, size_t len);
+    void (*floor)(const double* x, double* out, size_t len);
+    void (*ceil)(const double* x, double* out, size_t len);
+    void (*round)(const double* x, double* out, size_t len);
+} VecKernels;
+
+extern const VecKernels vecmath_baseKernels;
+extern const VecKernels vecmath_avx2Kernels;
+
+#endif // _H_VECMATH_KERNELS_
+
+#ifdef VECMATH_KERNELS
+
+static inline V v_select(V mask, V a, V b) {
+    return v_or(v_and(mask, a), v_andnot(mask, b));
+}
+
+#define SIGN_MASK     0x8000000000000000ull
+#define EXPONENT_BITS 52
+
+// Round to nearest, ties to even, of |a| < 2^51: adding 1.5 * 2^52 leaves no
+// bits below the point.
+static inline V v_rint(V a) {
+    return v_sub(v_add(a, v_set(0x1.8p52)), v_set(0x1.8p52));
+}
+
+// 2^k for an integer k in [-1022, 1023], built from its exponent bits.
+static inline V v_pow2i(V k) {
+    return v_shl(v_add(k, v_set(0x1p52 + 1023)), EXPONENT_BITS);
+}
+
+// Error free transformations: s + e is exactly a + b. v_twoProd, giving p + e
+// exactly a * b, comes with the other operations.
+
+static inline void v_twoSum(V a, V b, V* s, V* e) {
+    *s     = v_add(a, b);
+    V bb   = v_sub(*s, a);
+    *e     = v_add(v_sub(a, v_sub(*s, bb)), v_sub(b, bb));
+}
+
+// Needs |a| >= |b|.
+static inline void v_fastTwoSum(V a, V b, V* s, V* e) {
+    *s = v_add(a, b);
+    *e = v_sub(b, v_sub(*s, a));
+}
+
+// ln 2 split so that k * LN2_HI is exact for |k| < 2^11.
+#define LN2_HI  6.93147180369123816490e-01
+#define LN2_LO  1.90821492927058770002e-10
+#define INV_LN2 1.44269504088896338700e+00
+
+// Beyond these e^x is infinite, or zero, and k below stays in range.
+#define EXP_MAX 710.0
+#define EXP_MIN -746.0
+
+// e^(hi + lo), with |lo| well below ulp(hi). Reduces to e^r * 2^k with
+// |r| <= ln 2 / 2, where the Taylor series to r^13 is within 2^-57 of e^r,
+// and keeps the low part of r apart until the last additions. 2^k is applied
+// as two factors, so that results down in the subnormals are rounded once.
+// Wrong for NaN.
+static inline V exp_kernel(V hi, V lo) {
+    hi = v_min(v_max(hi, v_set(EXP_MIN)), v_set(EXP_MAX));
+
+    V k    = v_rint(v_mul(hi, v_set(INV_LN2)));
+    V r_hi = v_sub(hi, v_mul(k, v_set(LN2_HI)));
+    V r_lo = v_sub(lo, v_mul(k, v_set(LN2_LO)));
+    V r    = v_add(r_hi, r_lo);
+
+    // (e^r - 1 - r) / r^2
+    V q = v_set(1.6059043836821613e-10);
+    q   = v_fma(q, r, v_set(2.08767569878681e-09));
+    q   = v_fma(q, r, v_set(2.505210838544172e-08));
+    q   = v_fma(q, r, v_set(2.755731922398589e-07));
+    q   = v_fma(q, r, v_set(2.7557319223985893e-06));
+    q   = v_fma(q, r, v_set(2.48015873015873e-05));
+    q   = v_fma(q, r, v_set(1.984126984126984e-04));
+    q   = v_fma(q, r, v_set(1.388888888888889e-03));
+    q   = v_fma(q, r, v_set(8.333333333333333e-03));
+    q   = v_fma(q, r, v_set(4.1666666666666664e-02));
+    q   = v_fma(q, r, v_set(1.6666666666666666e-01));
+    q   = v_fma(q, r, v_set(0.5));
+
+    // 1 + r_hi is exact as s + e, so the result is rounded once, at the end.
+    V w = v_fma(v_mul(r, r), q, r_lo);
+    V s, e;
+
+    v_fastTwoSum(v_set(1.0), r_hi, &s, &e);
+
+    V p = v_add(s, v_add(e, w));
+
+    V k1 = v_rint(v_mul(k, v_set(0.5)));
+    V k2 = v_sub(k, k1);
+
+    return v_mul(v_mul(p, v_pow2i(k1)), v_pow2i(k2));
+}
+
+#define SQRT2 1.41421356237309514547e+00
+
+// Splits positive finite x, subnormals included, into 2^e * m with m in
+// [sqrt(2)/2, sqrt(2)), and returns f = m - 1, which is exact.
+static inline V log_reduce(V x, V* e) {
+    V tiny = v_lt(x, v_set(DBL_MIN));
+    x      = v_select(tiny, v_mul(x, v_set(0x1p54)), x);
+
+    // The biased exponent, moved under the bits of 2^52 to read it as a
+    // double.
+    V biased = v_sub(v_or(v_shr(x, EXPONENT_BITS), v_bits(0x4330000000000000ull)),
+                     v_set(0x1p52));
+    V m      = v_or(v_and(x, v_bits(0x000fffffffffffffull)),
+               v_bits(0x3ff0000000000000ull));
+    V big    = v_gt(m, v_set(SQRT2));
+
+    *e = v_sub(biased, v_add(v_set(1023.0), v_and(tiny, v_set(54.0))));
+    *e = v_add(*e, v_and(big, v_set(1.0)));
+
+    return v_sub(v_select(big, v_mul(m, v_set(0.5)), m), v_set(1.0));
+}
+
+// log(x) for positive finite x, within 1 ulp: fdlibm's e_log.c, from
+// log(1 + f) = 2 atanh(s) with s = f / (2 + f) and a minimax polynomial in
+// s^2.
+static inline V log_kernel(V x) {
+    V e;
+    V f = log_reduce(x, &e);
+
+    V s = v_div(f, v_add(v_set(2.0), f));
+    V z = v_mul(s, s);
+    V w = v_mul(z, z);
+
+    V t1 = v_mul(w, v_add(v_set(3.999999999940941908e-01),
+                          v_mul(w, v_add(v_set(2.222219843214978396e-01),
+                                         v_mul(w, v_set(1.531383769920937332e-01))))));
+    V t2 = v_mul(z,
+                 v_add(v_set(6.666666666666735130e-01),
+                       v_mul(w,
+                             v_add(v_set(2.857142874366239149e-01),
+                                   v_mul(w,
+                                         v_add(v_set(1.818357216161805012e-01),
+                                               v_mul(w, v_set(1.479819860511658591e-01))))))));
+    V R    = v_add(t2, t1);
+    V hfsq = v_mul(v_mul(v_set(0.5), f), f);
+
+    V inner = v_add(v_mul(s, v_add(hfsq, R)), v_mul(e, v_set(LN2_LO)));
+    return v_sub(v_mul(e, v_set(LN2_HI)), v_sub(v_sub(hfsq, inner), f));
+}
+
+// log(x) as hi + lo, to about 2^-66 relative, for pow: the first two terms of
+// 2 atanh(s) = 2s + 2s^3/3 + 2s^5/5 + ... in double double arithmetic and the
+// rest, which is below 2^-15 of the total, in double. |s| < 0.1716, so the
+// series to s^25 is within 2^-70.
+static inline void log_kernel2(V x, V* hi, V* lo) {
+    V e;
+    V f = log_reduce(x, &e);
+
+    // s = f / (2 + f), with the remainder of the division in s_lo.
+    V u_hi = v_add(v_set(2.0), f);
+    V u_lo = v_add(v_sub(v_set(2.0), u_hi), f);
+    V s_hi = v_div(f, u_hi);
+    V p, pe;
+
+    v_twoProd(s_hi, u_hi, &p, &pe);
+
+    V s_lo = v_div(v_sub(v_sub(v_sub(f, p), pe), v_mul(s_hi, u_lo)), u_hi);
+
+    // s^2, s^3 and 2s^3/3.
+    V z_hi, z_lo, c_hi, c_lo, t_hi, t_lo;
+
+    v_twoProd(s_hi, s_hi, &z_hi, &z_lo);
+    z_lo = v_add(z_lo, v_mul(v_set(2.0), v_mul(s_hi, s_lo)));
+
+    v_twoProd(s_hi, z_hi, &c_hi, &c_lo);
+    c_lo = v_add(c_lo, v_add(v_mul(s_hi, z_lo), v_mul(s_lo, z_hi)));
+
+    v_twoProd(c_hi, v_set(6.6666666666666663e-01), &t_hi, &t_lo);
+    t_lo = v_add(t_lo,
+                 v_add(v_mul(c_hi, v_set(3.700743415417188e-17)),
+                       v_mul(c_lo, v_set(6.6666666666666663e-01))));
+
+    // 2s^5/5 + 2s^7/7 + ... + 2s^25/25
+    V q = v_set(0.08);
+    q   = v_fma(q, z_hi, v_set(8.695652173913043e-02));
+    q   = v_fma(q, z_hi, v_set(9.523809523809523e-02));
+    q   = v_fma(q, z_hi, v_set(1.0526315789473684e-01));
+    q   = v_fma(q, z_hi, v_set(1.1764705882352941e-01));
+    q   = v_fma(q, z_hi, v_set(1.3333333333333333e-01));
+    q   = v_fma(q, z_hi, v_set(1.5384615384615385e-01));
+    q   = v_fma(q, z_hi, v_set(1.8181818181818182e-01));
+    q   = v_fma(q, z_hi, v_set(2.2222222222222222e-01));
+    q   = v_fma(q, z_hi, v_set(2.857142857142857e-01));
+    q   = v_fma(q, z_hi, v_set(0.4));
+    q   = v_mul(q, v_add(v_mul(c_hi, z_hi),
+                         v_add(v_mul(c_hi, z_lo), v_mul(c_lo, z_hi))));
+
+    // e ln 2 + 2s + 2s^3/3 + the rest, largest first.
+    V h1, e1, h2, e2;
+
+    v_twoSum(v_mul(e, v_set(LN2_HI)), v_mul(v_set(2.0), s_hi), &h1, &e1);
+    v_twoSum(h1, t_hi, &h2, &e2);
+
+    V small = v_add(v_add(v_mul(v_set(2.0), s_lo), t_lo),
+                    v_add(q, v_mul(e, v_set(LN2_LO))));
+
+    v_fastTwoSum(h2, v_add(v_add(e1, e2), small), hi, lo);
+}
+
+// x^y = e^(y log x) for positive finite x and finite y below 2^900, with the
+// product kept in double double, so that its error stays far below an ulp of
+// the result even where y log x is near the overflow threshold.
+static inline V pow_kernel(V x, V y) {
+    V l_hi, l_lo, p_hi, p_lo;
+
+    log_kernel2(x, &l_hi, &l_lo);
+    v_twoProd(y, l_hi, &p_hi, &p_lo);
+    p_lo = v_add(p_lo, v_mul(y, l_lo));
+
+    // Normalized, since the reduction in exp_kernel works on the high part.
+    v_fastTwoSum(p_hi, p_lo, &p_hi, &p_lo);
+
+    return exp_kernel(p_hi, p_lo);
+}
+
+// trunc(x), exactly: rounding |x| below 2^52 to an integer, by adding 2^52,
+// and stepping back where that went up.
+static inline V trunc_kernel(V x) {
+    V a = v_andnot(v_bits(SIGN_MASK), x);
+    V t = v_sub(v_add(v_min(a, v_set(0x1p52)), v_set(0x1p52)), v_set(0x1p52));
+
+    t = v_sub(t, v_and(v_gt(t, a), v_set(1.0)));
+
+    // Integers, infinities and NaNs from 2^52 up are their own truncation.
+    return v_select(v_lt(a, v_set(0x1p52)),
+                    v_or(t, v_and(v_bits(SIGN_MASK), x)),
+                    x);
+}
+
+static inline V floor_kernel(V x) {
+    V t = trunc_kernel(x);
+    return v_sub(t, v_and(v_gt(t, x), v_set(1.0)));
+}
+
+// Subtracts -1 rather than adding 1, which would turn -0 into +0.
+static inline V ceil_kernel(V x) {
+    V t = trunc_kernel(x);
+    return v_sub(t, v_and(v_lt(t, x), v_set(-1.0)));
+}
+
+// Truncates |x| and adds one where the fraction dropped was at least a half;
+// that fraction is exact, unlike |x| + 0.5, which rounds up for the double
+// just below 0.5.
+static inline V round_kernel(V x) {
+    V sign = v_and(v_bits(SIGN_MASK), x);
+    V a    = v_andnot(v_bits(SIGN_MASK), x);
+    V t    = trunc_kernel(a);
+
+    t = v_add(t, v_and(v_ge(v_sub(a, t), v_set(0.5)), v_set(1.0)));
+
+    return v_select(v_lt(a, v_set(0x1p52)), v_or(t, sign), x);
+}
+
+static inline V vec_expLanes(V x) {
+    // NaN compares unequal to itself.
+    return v_select(v_ne(x, x), x, exp_kernel(x, v_set(0.0)));
+}
+
+static inline V vec_logLanes(V x) {
+    V result = log_kernel(v_max(x, v_set(DBL_TRUE_MIN)));
+
+    result = v_select(v_eq(x, v_set(INFINITY)), x, result);
+    result = v_select(v_eq(x, v_set(0.0)), v_set(-INFINITY), result);
+    result = v_select(v_lt(x, v_set(0.0)), v_set(NAN), result);
+    return v_select(v_ne(x, x), x, result);
+}
+
+// Applies the kernel to every element, and to what's left past the last full
+// vector padded with ones.
+#define VEC_MAP(kernel, x, out, len)                                       \
+    do {                                                                   \
+        size_t i = 0;                                                      \
+                                                                           \
+        for(; i + VEC_LANES <= (len); i += VEC_LANES) {                    \
+            v_store((out) + i, kernel(v_load((x) + i)));                   \
+        }                                                                  \
+                                                                           \
+        if(i < (len)) {                                                    \
+            double lanes[VEC_LANES] = {0};                                 \
+                                                                           \
+            for(size_t j = 0; j < VEC_LANES; ++j) {                        \
+                lanes[j] = i + j < (len) ? (x)[i + j] : 1.0;               \
+            }                                                              \
+                                                                           \
+            v_store(lanes, kernel(v_load(lanes)));                         \
+            memcpy((out) + i, lanes, ((len) - i) * sizeof(double));        \
+        }                                                                  \
+    } while(0)
+
+static void kernels_exp(const double* x, double* out, size_t len) {
+    VEC_MAP(vec_expLanes, x, out, len);
+}
+
+static void kernels_log(const double* x, double* out, size_t len) {
+    VEC_MAP(vec_logLanes, x, out, len);
+}
+
+static void kernels_floor(const double* x, double* out, size_t len) {
+    VEC_MAP(floor_kernel, x, out, len);
+}
+
+static void kernels_ceil(const double* x, double* out, size_t len) {
+    VEC_MAP(ceil_kernel, x, out, len);
+}
+
+static void kernels_round(const double* x, double* out, size_t len) {
+    VEC_MAP(round_kernel, x, out, len);
+}
+
+// Lanes pow_kernel handles; pow() gets the rest.
+static inline V pow_regular(V x, V y) {
+    V ay = v_andnot(v_bits(SIGN_MASK), y);
+
+    return v_and(v_and(v_gt(x, v_set(0.0)), v_lt(x, v_set(INFINITY))),
+                 v_lt(ay, v_set(0x1p900)));
+}
+
+// One vector of x^y into out, where lanes that pow_regular rejects come from
+// pow(). x and y are read before out is written.
+static inline void pow_vector(V vx, V vy, double* out) {
+    V regular = pow_regular(vx, vy);
+    V result  = pow_kernel(v_select(regular, vx, v_set(1.0)),
+                          v_select(regular, vy, v_set(1.0)));
+    int lanes = v_movemask(regular);
+
+    if(lanes == (1 << VEC_LANES) - 1) {
+        v_store(out, result);
+        return;
+    }
+
+    double lanes_x[VEC_LANES];
+    double lanes_y[VEC_LANES];
+
+    v_store(lanes_x, vx);
+    v_store(lanes_y, vy);
+    v_store(out, result);
+
+    for(size_t j = 0; j < VEC_LANES; ++j) {
+        if(!(lanes >> j & 1))
+            out[j] = pow(lanes_x[j], lanes_y[j]);
+    }
+}
+
+static void kernels_pow(const double* x, const double* y, double* out, size_t len) {
+    size_t i = 0;
+
+    for(; i + VEC_LANES <= len; i += VEC_LANES) {
+        pow_vector(v_load(x + i), v_load(y + i), out + i);
+    }
+
+    if(i < len) {
+        double lanes_x[VEC_LANES];
+        double lanes_y[VEC_LANES];
+        double result[VEC_LANES];
+
+        // Past the end the kernel works on ones.
+        for(size_t j = 0; j < VEC_LANES; ++j) {
+            lanes_x[j] = i + j < len ? x[i + j] : 1.0;
+            lanes_y[j] = i + j < len ? y[i + j] : 1.0;
+        }
+
+        pow_vector(v_load(lanes_x), v_load(lanes_y), result);
+        memcpy(out + i, result, (len - i) * sizeof(double));
+    }
+}
+
+const VecKernels VECMATH_KERNELS = {
+    .exp   = kernels_exp,
+    .log   = kernels_log,
+    .pow   = kernels_pow,
+    .floor = kernels_floor,
+    .ceil  = kernels_ceil,
+    .round = kernels_round,
+};
+
+#endif // VECMATH_KERNELS
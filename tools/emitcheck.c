@@ -0,0 +1,427 @@
+#include <dlfcn.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "emit.h"
+#include "evaluator.h"
+#include "tokenizer.h"
+
+// Equivalence check for `seqft --emit-c`. Emits each formula of the corpus
+// below into a C file of its own, compiles them into a shared object with the
+// compiler seqft was built with (or $CC) at -O3 -march=native, loads it, and
+// compares each function against Sft_evalTokens over special and random
+// values of its variables, bit for bit; any NaN matches any other. Also checks
+// that formulas the emitter turns away fail with the error the evaluator
+// gives.
+//
+// Usage: seqft_emitcheck [values per formula]   (default 20000)
+
+#ifndef SEQFT_EMITCHECK_CC
+    #define SEQFT_EMITCHECK_CC "cc"
+#endif
+
+#define MAX_PARAMETERS 8
+
+static const char* const CORPUS[] = {
+    "x + y * z - w / v",
+    "x - y - z - w",
+    "x / y / z",
+    "~x ^ 2 + ~(y - z)",
+    "x ^ y ^ z",
+    "2 ^ ~x",
+    "(x + y) * (x - y) / (x * y + 1)",
+    "x * x * x + 3 * x * x * y + 3 * x * y * y + y * y * y",
+    "x * 1000000000000 * y / 0.000001",
+    "0.1 + x + 0.2 - x",
+    "17 % 5 + x * (100 % 7)",
+    "x % y - ~z % 0.5 + w % 0",
+    "1 / 3 + x / 7 - 0.0025 * y",
+    "round(x) + ceil(y) - round(~x * 0.5)",
+    "sum(x)",
+    "sum(x, y, z)",
+    "sum(x, y, z, w, v, x * y, y * z, 1)",
+    "sum(x, y, z, w, v, x, y, z, w, v, 1, 2, 3)",
+    "avg(x, y, z, w, v)",
+    "avg(x, 1, 2, 3, y, 4, 5, 6, z)",
+    "min(x, y) + max(z, w)",
+    "min(x, y, z, w, v, 0.5, ~0.5, x * y, 3)",
+    "max(x, y, z, w, v, 0.5, ~0.5, x * y, 3, y - z)",
+    "hypot(x, y)",
+    "hypot(x, y, z, w, v, 0.001, 3)",
+    "hypot(x * 1000000000000, y * 1000000000000, z)",
+    "prod(2, x, y, z, w)",
+    "prod(x, 2, y, 0.5, z)",
+    "sum(x, 1, y)",
+    "prod(x, 1, 2, y, z)",
+    "x < y",
+    "x <= y == y >= z",
+    "x != y || z > w && v",
+    "x && y || z",
+    "(x > 0) * x + (x <= 0) * y",
+    "if(x < y, x, y) - if(z, w, v)",
+    "if(x > 0 && y > 0, hypot(x, y), if(x < 0, ~x, sum(y, z, 1)))",
+    "x > 1 && 1 / (x - 1) > 0.5 || y",
+    "max(if(x, y, z), min(x, y) < z, x == x)",
+    "sum(x ^ 2, y ^ 2, z ^ 2) ^ 0.5 - hypot(x, y, z)",
+    "((((x + 1) * 2 - y) / 3 + z) ^ 2)",
+};
+
+// Formulas the emitter turns away, and the error it must give.
+static const struct {
+    const char* formula;
+    ErrCode     code;
+} REJECTED[] = {
+    {"sum(i, 1, 10, i ^ 2)", ERR_EMIT_UNSUPPORTED },
+    {"prod(x, y, z, w)",     ERR_EMIT_UNSUPPORTED },
+    {"x + (y",               ERR_EMIT_UNSUPPORTED },
+    {"(2)(3)",               ERR_EMIT_UNSUPPORTED },
+    {"int + 1",              ERR_EMIT_UNSUPPORTED },
+    {"seqft_x * 2",          ERR_EMIT_UNSUPPORTED },
+    {"x +",                  ERR_MISSING_OPERAND  },
+    {"foo(x)",               ERR_UNKNOWN_FUNCTION },
+    {"if(x, y)",             ERR_ARGUMENT_COUNT   },
+    {"max(x,, y)",           ERR_MISSING_ARGUMENT },
+    {"x, y",                 ERR_COMMA_OUTSIDE_CALL},
+};
+
+#define CORPUS_COUNT (sizeof(CORPUS) / sizeof(CORPUS[0]))
+
+static const double SPECIAL[] = {
+    0.0,    -0.0,    1.0,     -1.0,    0.5,      2.0,   3.0,
+    0.1,    -2.5,    1e308,   -1e308,  1e-310,   1e-300, 123456.789,
+    INFINITY, -INFINITY, NAN,
+};
+
+#define SPECIAL_COUNT (sizeof(SPECIAL) / sizeof(SPECIAL[0]))
+
+typedef double (*Emitted)(const double* v);
+
+// The parameters of one formula and the values they take, for the resolver.
+typedef struct Binding {
+    const char* const* names;
+    size_t             count;
+    const double*      values;
+} Binding;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+// A special value one time in four, and otherwise a random one of about any
+// magnitude, or one near 1, of either sign.
+static double random_value(void) {
+    uint64_t pick = next_random();
+
+    if(pick % 4 == 0)
+        return SPECIAL[(pick >> 8) % SPECIAL_COUNT];
+
+    double unit = (double)(next_random() >> 11) * 0x1p-53;
+    double sign = pick & 0x100 ? -1 : 1;
+
+    if(pick % 4 == 1)
+        return sign * ldexp(0.5 + unit, (int)((pick >> 16) % 2000) - 1000);
+
+    return sign * (unit * 8);
+}
+
+static BOOL resolve(void* user, const Token* token, double* value) {
+    const Binding* binding = user;
+
+    for(size_t i = 0; i < binding->count; ++i) {
+        if(!strcmp(binding->names[i], token->func)) {
+            *value = binding->values[i];
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static BOOL same(double a, double b) {
+    return (isnan(a) && isnan(b)) || !memcmp(&a, &b, sizeof(double));
+}
+
+// Writes the function f<index> of the formula, and f<index>_v taking its
+// parameters from an array.
+static BOOL emit_formula(FILE* out, size_t index, const TokenArray* tokens) {
+    char      name[32];
+    SftError  error;
+    Stack*    parameters = Emit_parameters(tokens);
+    size_t    count      = Stack_getCount(parameters);
+
+    snprintf(name, sizeof(name), "f%zu", index);
+
+    if(Emit_c(out, name, CORPUS[index], tokens, &error)) {
+        fprintf(stderr,
+                "FAIL emitting '%s': %s\n",
+                CORPUS[index],
+                SftError_message(&error));
+        Stack_free(parameters);
+        return FALSE;
+    }
+
+    fprintf(out,
+            "\ndouble %s_v(const double* v) {\n    return %s(",
+            name,
+            name);
+
+    for(size_t i = 0; i < count; ++i) {
+        fprintf(out, "%sv[%zu]", i ? ", " : "", i);
+    }
+
+    fprintf(out, ");\n}\n\n");
+    Stack_free(parameters);
+    return TRUE;
+}
+
+// Emits every formula into a file of its own, since each comes with its own
+// copy of the helpers, and appends the file to the compiler's arguments.
+static BOOL emit_corpus(const char* dir,
+                        Tokenizer*  t,
+                        TokenArray* arrays,
+                        char*       files,
+                        size_t      size) {
+    char path[512];
+
+    for(size_t i = 0; i < CORPUS_COUNT; ++i) {
+        if(!Tokenizer_tokenize(t, CORPUS[i], strlen(CORPUS[i]))) {
+            fprintf(stderr,
+                    "FAIL tokenizing '%s': %s\n",
+                    CORPUS[i],
+                    t->error->message);
+            return FALSE;
+        }
+
+        TokenArray view;
+        Tokenizer_view(t, &view);
+
+        // Kept, for the evaluator, once the Tokenizer has moved on.
+        arrays[i].count  = view.count;
+        arrays[i].tokens = xmalloc(view.count * sizeof(Token));
+
+        for(size_t k = 0; k < view.count; ++k) {
+            arrays[i].tokens[k] = view.tokens[k];
+
+            if(view.tokens[k].func) {
+                size_t len = strlen(view.tokens[k].func) + 1;
+
+                arrays[i].tokens[k].func = xmalloc(len);
+                memcpy(arrays[i].tokens[k].func, view.tokens[k].func, len);
+            }
+        }
+
+        snprintf(path, sizeof(path), "%s/f%zu.c", dir, i);
+        FILE* out = fopen(path, "w");
+
+        if(!out) {
+            perror(path);
+            return FALSE;
+        }
+
+        BOOL ok = emit_formula(out, i, &arrays[i]);
+        fclose(out);
+
+        if(!ok)
+            return FALSE;
+
+        size_t used = strlen(files);
+        snprintf(files + used, size - used, " %s", path);
+    }
+
+    return TRUE;
+}
+
+// Evaluates the formula both ways over the values. Returns the mismatches.
+static size_t check_formula(Sft*              sft,
+                            size_t            index,
+                            const TokenArray* tokens,
+                            Emitted           emitted,
+                            size_t            trials) {
+    Stack*  parameters = Emit_parameters(tokens);
+    double  values[MAX_PARAMETERS];
+    Binding binding = {
+        .names  = Stack_getBase(parameters),
+        .count  = Stack_getCount(parameters),
+        .values = values,
+    };
+    size_t  mismatches = 0;
+
+    Sft_setResolver(sft, resolve, &binding);
+
+    for(size_t trial = 0; trial < trials; ++trial) {
+        for(size_t i = 0; i < binding.count; ++i) {
+            // Every special value of the first variable comes first.
+            values[i] = trial < SPECIAL_COUNT && i == 0 ? SPECIAL[trial]
+                                                        : random_value();
+        }
+
+        double    expected = 0;
+        double    actual   = emitted(values);
+        SftError* error =
+            Sft_evalTokens(sft, (TokenArray*)tokens, &expected);
+
+        if(error) {
+            fprintf(stderr,
+                    "FAIL evaluating '%s': %s\n",
+                    CORPUS[index],
+                    SftError_message(error));
+            mismatches += 1;
+            break;
+        }
+
+        if(!same(expected, actual)) {
+            if(mismatches < 4) {
+                fprintf(stderr, "FAIL '%s' at", CORPUS[index]);
+
+                for(size_t i = 0; i < binding.count; ++i) {
+                    fprintf(stderr,
+                            " %s=%.17g",
+                            binding.names[i],
+                            values[i]);
+                }
+
+                fprintf(stderr,
+                        ": evaluator %.17g, emitted %.17g\n",
+                        expected,
+                        actual);
+            }
+
+            mismatches += 1;
+        }
+    }
+
+    Stack_free(parameters);
+    return mismatches;
+}
+
+static size_t check_rejected(Tokenizer* t) {
+    size_t failures = 0;
+
+    for(size_t i = 0; i < sizeof(REJECTED) / sizeof(REJECTED[0]); ++i) {
+        const char* formula = REJECTED[i].formula;
+        SftError    error   = {0};
+        TokenArray  tokens;
+
+        if(!Tokenizer_tokenize(t, formula, strlen(formula))) {
+            fprintf(stderr, "FAIL tokenizing '%s'\n", formula);
+            failures += 1;
+            continue;
+        }
+
+        Tokenizer_view(t, &tokens);
+
+        FILE*     sink   = fopen("/dev/null", "w");
+        SftError* failed = Emit_c(sink, "f", formula, &tokens, &error);
+        fclose(sink);
+
+        if(!failed || failed->code != REJECTED[i].code) {
+            fprintf(stderr,
+                    "FAIL '%s': expected error %d, got %d\n",
+                    formula,
+                    REJECTED[i].code,
+                    failed ? (int)failed->code : 0);
+            failures += 1;
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    size_t      trials = argc > 1 ? strtoul(argv[1], 0, 10) : 20000;
+    const char* cc     = getenv("CC") ? getenv("CC") : SEQFT_EMITCHECK_CC;
+    char        dir[]  = "/tmp/seqft_emitcheck.XXXXXX";
+    char        files[CORPUS_COUNT * 48] = "";
+    char        command[sizeof(files) + 512];
+    char        path[512];
+
+    if(!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    Tokenizer* t = Tokenizer_new();
+    TokenArray arrays[CORPUS_COUNT] = {0};
+    size_t     failures = check_rejected(t);
+
+    if(!emit_corpus(dir, t, arrays, files, sizeof(files))) {
+        for(size_t i = 0; i < CORPUS_COUNT; ++i) {
+            TokenArray_freeMembers(&arrays[i]);
+        }
+
+        Tokenizer_free(t);
+        return 1;
+    }
+
+    snprintf(command,
+             sizeof(command),
+             "%s -std=c11 -O3 -march=native -shared -fPIC -o %s/emitted.so%s "
+             "-lm",
+             cc,
+             dir,
+             files);
+
+    printf("%s\n", command);
+
+    if(system(command)) {
+        fprintf(stderr, "FAIL compiling the emitted code, kept in %s\n", dir);
+        Tokenizer_free(t);
+        return 1;
+    }
+
+    snprintf(path, sizeof(path), "%s/emitted.so", dir);
+    void* library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+
+    if(!library) {
+        fprintf(stderr, "FAIL loading %s: %s\n", path, dlerror());
+        Tokenizer_free(t);
+        return 1;
+    }
+
+    Sft* sft = Sft_new();
+
+    for(size_t i = 0; i < CORPUS_COUNT; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%zu_v", i);
+
+        Emitted emitted;
+        *(void**)&emitted = dlsym(library, name);
+
+        size_t mismatches =
+            check_formula(sft, i, &arrays[i], emitted, trials);
+
+        printf("%-60s %s\n", CORPUS[i], mismatches ? "FAIL" : "ok");
+        failures += mismatches;
+
+        TokenArray_freeMembers(&arrays[i]);
+    }
+
+    Sft_free(sft);
+    dlclose(library);
+    Tokenizer_free(t);
+
+    if(failures) {
+        printf("FAIL: %zu mismatches, the emitted code is in %s\n",
+               failures,
+               dir);
+        return 1;
+    }
+
+    snprintf(command, sizeof(command), "rm -r %s", dir);
+
+    if(system(command))
+        fprintf(stderr, "couldn't remove %s\n", dir);
+
+    printf("OK: %zu formulas, %zu values each\n", CORPUS_COUNT, trials);
+    return 0;
+}
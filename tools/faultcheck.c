@@ -0,0 +1,310 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "common.h"
+#include "server.h"
+#include "tokenizer.h"
+
+// Checks that a line that can't be evaluated fails on its own: the lines
+// after it, and every other client of a server, still get their answers.
+// Each check feeds lines that once brought the whole process down, followed
+// by ones with a known reply, and compares the replies line by line. Also
+// checks that a formula fails whether or not the operand at fault would be
+// skipped when evaluated, rather than only for some values.
+//
+// Usage: seqft_faultcheck
+
+// Longest reply a check reads.
+#define REPLY_SIZE 4096
+
+typedef struct FaultCase {
+    const char* input;   // Newline separated lines.
+    const char* replies; // What they must come to, newline separated.
+} FaultCase;
+
+static const FaultCase SERVER_CASES[] = {
+    {"1%0\n7%0.5\n2*3\n", "nan\n0\n6\n"},
+    {"1+1\n", "2\n"},
+};
+
+#define SERVER_CASE_COUNT (sizeof(SERVER_CASES) / sizeof(SERVER_CASES[0]))
+
+// One file, with the bad lines in the middle so that a run which stops at
+// them misses the lines after.
+static const FaultCase BATCH_CASE = {
+    "1+1\n2^10\n1%0\n7%0.5\nsum(i,1,4,i%0)\n2*3\nmax(1,2)\n",
+    "2\n1024\nnan\n0\nnan\n6\n2\n",
+};
+
+// The ways of running it: on the calling thread, in one small chunk per line
+// on several, with repeats answered from the cache, and split among threads.
+static const BatchOptions BATCH_RUNS[] = {
+    {.threads = 1},
+    {.threads = 4, .chunk_size = 1},
+    {.threads = 2, .dedup = TRUE},
+    {.threads = 2, .split = TRUE},
+};
+
+#define BATCH_RUN_COUNT (sizeof(BATCH_RUNS) / sizeof(BATCH_RUNS[0]))
+
+// A formula that is fine, and an edit of it that fails with the code, for
+// all the values of its condition, though the operand at fault is one that
+// && , || or if() skips for some.
+typedef struct SkippedCase {
+    const char* fine;
+    const char* faulty;
+    ErrCode     code;
+} SkippedCase;
+
+static const SkippedCase SKIPPED_CASES[] = {
+    {"0&&max(1,2,3)",      "0&&max(1,2,",       ERR_MISSING_ARGUMENT},
+    {"1&&2*3",             "1&&2*",             ERR_MISSING_OPERAND },
+    {"1||max(1)",          "1||foo(1)",         ERR_UNKNOWN_FUNCTION},
+    {"0||hypot(1,2)",      "0||round(1,2)",     ERR_ARGUMENT_COUNT  },
+    {"if(1,2,max(1))",     "if(1,2,foo(1))",    ERR_UNKNOWN_FUNCTION},
+    {"if(0,max(1,2),3)",   "if(0,max(1,,2),3)", ERR_MISSING_ARGUMENT},
+    {"if(1,2,3)+4",        "if(1,2,)+4",        ERR_MISSING_ARGUMENT},
+};
+
+#define SKIPPED_CASE_COUNT (sizeof(SKIPPED_CASES) / sizeof(SKIPPED_CASES[0]))
+
+static BOOL write_all(int fd, const char* data, size_t len) {
+    while(len) {
+        ssize_t n = write(fd, data, len);
+
+        if(n <= 0)
+            return FALSE;
+
+        data += n;
+        len -= (size_t)n;
+    }
+
+    return TRUE;
+}
+
+// Reads from fd into reply until it holds lines lines, or the peer is done.
+static size_t read_lines(int fd, char* reply, size_t lines) {
+    size_t len = 0;
+
+    while(lines && len + 1 < REPLY_SIZE) {
+        ssize_t n = read(fd, reply + len, REPLY_SIZE - 1 - len);
+
+        if(n <= 0)
+            break;
+
+        for(ssize_t i = 0; i < n; ++i) {
+            lines -= reply[len + (size_t)i] == '\n';
+        }
+
+        len += (size_t)n;
+    }
+
+    reply[len] = '\0';
+    return len;
+}
+
+static size_t count_lines(const char* text) {
+    size_t lines = 0;
+
+    for(; *text; ++text) {
+        lines += *text == '\n';
+    }
+
+    return lines;
+}
+
+static BOOL compare(const char* what, const FaultCase* c, const char* reply) {
+    if(!strcmp(reply, c->replies))
+        return TRUE;
+
+    fprintf(stderr,
+            "FAIL %s: sent\n%sexpected\n%sgot\n%s\n",
+            what,
+            c->input,
+            c->replies,
+            reply);
+    return FALSE;
+}
+
+// Runs the batch case through Batch_runFile once with each of the options.
+static BOOL check_batch(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/seqft_faultcheck.%d.txt", getpid());
+
+    FILE* input = fopen(path, "w");
+
+    if(!input || fputs(BATCH_CASE.input, input) < 0 || fclose(input)) {
+        fprintf(stderr, "FAIL batch: couldn't write %s\n", path);
+        return FALSE;
+    }
+
+    BOOL   ok    = TRUE;
+    size_t lines = count_lines(BATCH_CASE.input);
+
+    for(size_t i = 0; i < BATCH_RUN_COUNT; ++i) {
+        FILE*      output = tmpfile();
+        BatchStats stats  = {0};
+        char       reply[REPLY_SIZE];
+
+        if(!output || Batch_runFile(path, output, &BATCH_RUNS[i], &stats)) {
+            fprintf(stderr, "FAIL batch: run %zu didn't finish\n", i);
+            ok = FALSE;
+        } else {
+            rewind(output);
+            reply[fread(reply, 1, sizeof(reply) - 1, output)] = '\0';
+            ok = compare("batch", &BATCH_CASE, reply) && ok;
+
+            if(stats.lines != lines) {
+                fprintf(stderr,
+                        "FAIL batch: run %zu read %zu of %zu lines\n",
+                        i,
+                        stats.lines,
+                        lines);
+                ok = FALSE;
+            }
+        }
+
+        if(output)
+            fclose(output);
+    }
+
+    unlink(path);
+    return ok;
+}
+
+// Tokenizes the formula, or retokenizes it as an edit of the last one, and
+// checks that it fails with the code, or succeeds for ERR_NONE.
+static BOOL check_tokenized(Tokenizer*  t,
+                            const char* formula,
+                            BOOL        edit,
+                            ErrCode     code) {
+    size_t    len = strlen(formula);
+    TokenEdit edited;
+
+    BOOL    tokenized = edit ? Tokenizer_retokenize(t, formula, len, &edited)
+                             : Tokenizer_tokenize(t, formula, len);
+    ErrCode got       = tokenized ? ERR_NONE : t->error->code;
+
+    if(got == code)
+        return TRUE;
+
+    fprintf(stderr,
+            "FAIL %s '%s': expected error %d, got %d\n",
+            edit ? "editing into" : "tokenizing",
+            formula,
+            code,
+            got);
+    return FALSE;
+}
+
+// Tokenizes each faulty formula, as `seqft --compile` does, and then edits
+// the fine one into it and back, as interactive input is retokenized.
+static BOOL check_skipped(void) {
+    Tokenizer* t  = Tokenizer_new();
+    BOOL       ok = TRUE;
+
+    for(size_t i = 0; i < SKIPPED_CASE_COUNT; ++i) {
+        const SkippedCase* c = &SKIPPED_CASES[i];
+
+        ok = check_tokenized(t, c->faulty, FALSE, c->code) && ok;
+        ok = check_tokenized(t, c->fine, FALSE, ERR_NONE) && ok;
+        ok = check_tokenized(t, c->faulty, TRUE, c->code) && ok;
+        ok = check_tokenized(t, c->fine, TRUE, ERR_NONE) && ok;
+    }
+
+    Tokenizer_free(t);
+    return ok;
+}
+
+typedef struct ServerThread {
+    const char*   address;
+    ServerOptions options;
+    int           rc;
+} ServerThread;
+
+static void* serve(void* arg) {
+    ServerThread* server = arg;
+    server->rc           = Server_run(server->address, &server->options);
+    return 0;
+}
+
+// Connects once the server listens, trying for a few seconds.
+static int connect_soon(const char* address, const char* path) {
+    for(int tries = 0; tries < 300; ++tries) {
+        if(access(path, F_OK) == 0) {
+            int fd = Server_connect(address);
+
+            if(fd >= 0)
+                return fd;
+        }
+
+        usleep(10000);
+    }
+
+    return -1;
+}
+
+// Sends each case on a connection of its own to a server on a thread, one
+// after the other, so that a case that took the server down fails the next.
+static BOOL check_server(void) {
+    char path[64];
+    char address[80];
+
+    snprintf(path, sizeof(path), "/tmp/seqft_faultcheck.%d.sock", getpid());
+    snprintf(address, sizeof(address), "unix:%s", path);
+    unlink(path);
+
+    ServerThread server = {.address = address, .options = {.threads = 2}};
+    pthread_t    thread;
+
+    if(pthread_create(&thread, 0, serve, &server) != 0) {
+        fprintf(stderr, "FAIL server: couldn't start a thread\n");
+        return FALSE;
+    }
+
+    BOOL ok = TRUE;
+
+    for(size_t i = 0; ok && i < SERVER_CASE_COUNT; ++i) {
+        const FaultCase* c = &SERVER_CASES[i];
+        int              fd = connect_soon(address, path);
+        char             reply[REPLY_SIZE];
+
+        if(fd < 0) {
+            fprintf(stderr, "FAIL server: couldn't connect for case %zu\n", i);
+            ok = FALSE;
+            break;
+        }
+
+        ok = write_all(fd, c->input, strlen(c->input));
+        read_lines(fd, reply, count_lines(c->replies));
+        ok = compare("server", c, reply) && ok;
+        close(fd);
+    }
+
+    pthread_kill(thread, SIGINT);
+    pthread_join(thread, 0);
+    unlink(path);
+
+    return ok && server.rc == 0;
+}
+
+int main(void) {
+    // The server takes SIGINT on its own thread only.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, 0);
+
+    BOOL ok = check_batch();
+    ok      = check_server() && ok;
+    ok      = check_skipped() && ok;
+
+    fprintf(stderr, ok ? "OK\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
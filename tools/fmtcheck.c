@@ -0,0 +1,264 @@
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "dtoa.h"
+#include "tokenizer.h"
+
+// Round trip check for dtoa_shortest. Formats edge cases, random bit patterns
+// covering every exponent, and random short decimals, and fails if strtod of
+// any output isn't bit for bit the original double, or if the tokenizer
+// reads it back as anything else, so that results can be entered again as
+// printed. Finite ones, that is, and without the sign, which a ~ would
+// write. Also counts outputs
+// longer than the shortest "%.{1..17}g" that round trips, checks dtoa_fixed
+// against known strings, and compares speed with snprintf("%.17g").
+//
+// Usage: seqft_fmtcheck [random doubles]   (default 10000000)
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+static double random_double(uint64_t n) {
+    uint64_t bits = next_random();
+    double   value;
+
+    // Every other one a short decimal, which is what results mostly are.
+    if(n & 1) {
+        value = (double)((int64_t)(bits % 2000001) - 1000000) /
+                pow(10, (double)((bits >> 32) % 9));
+    } else {
+        memcpy(&value, &bits, sizeof(value));
+    }
+
+    return value;
+}
+
+static size_t failures = 0;
+
+static Tokenizer* reader = 0;
+
+// Whether the tokenizer reads the text as the one number value.
+static BOOL reads_back(const char* text, double value) {
+    TokenArray tokens;
+
+    if(!Tokenizer_tokenize(reader, text, strlen(text)))
+        return FALSE;
+
+    Tokenizer_view(reader, &tokens);
+
+    return tokens.count == 1 && tokens.tokens[0].type == TT_NUM &&
+           !memcmp(&tokens.tokens[0].f64, &value, sizeof(double));
+}
+
+static void check_roundtrip(double value, size_t* longer) {
+    char   buffer[DTOA_SHORTEST_SIZE + 1];
+    size_t len = dtoa_shortest(value, buffer);
+    buffer[len] = '\0';
+
+    if(isnan(value)) {
+        if(strcmp(buffer, "nan")) {
+            printf("FAIL nan -> '%s'\n", buffer);
+            failures++;
+        }
+
+        return;
+    }
+
+    double back = strtod(buffer, 0);
+
+    if(memcmp(&back, &value, sizeof(double))) {
+        if(failures++ < 10)
+            printf("FAIL %.17g -> '%s' -> %.17g\n", value, buffer, back);
+
+        return;
+    }
+
+    const char* digits = buffer[0] == '-' ? buffer + 1 : buffer;
+
+    if(isfinite(value) && !reads_back(digits, fabs(value))) {
+        if(failures++ < 10)
+            printf("FAIL %.17g -> '%s' doesn't tokenize back\n", value, buffer);
+
+        return;
+    }
+
+    if(!longer)
+        return;
+
+    // Digits in the shortest %g form that still reads back exactly.
+    char shortest[40];
+
+    for(int precision = 1; precision <= 17; ++precision) {
+        snprintf(shortest, sizeof(shortest), "%.*g", precision, value);
+
+        if(strtod(shortest, 0) == value) {
+            // Significant digits of ours: leading and trailing zeros of
+            // plain notation don't count.
+            char   mantissa[DTOA_SHORTEST_SIZE];
+            size_t digits = 0;
+
+            for(const char* p = buffer; *p && *p != 'e'; ++p) {
+                if(*p >= '0' && *p <= '9' && (digits || *p != '0'))
+                    mantissa[digits++] = *p;
+            }
+
+            while(digits && mantissa[digits - 1] == '0') {
+                --digits;
+            }
+
+            if(digits > (size_t)precision)
+                *longer += 1;
+
+            break;
+        }
+    }
+}
+
+static void check_fixed(double value, int precision, const char* expected) {
+    char   buffer[DTOA_FIXED_SIZE(DTOA_MAX_PRECISION) + 1];
+    size_t len = dtoa_fixed(value, precision, buffer);
+    buffer[len] = '\0';
+
+    if(strcmp(buffer, expected)) {
+        printf("FAIL fixed %.17g, %d -> '%s', expected '%s'\n",
+               value,
+               precision,
+               buffer,
+               expected);
+        failures++;
+    }
+}
+
+static void check_shortest(double value, const char* expected) {
+    char   buffer[DTOA_SHORTEST_SIZE + 1];
+    size_t len = dtoa_shortest(value, buffer);
+    buffer[len] = '\0';
+
+    if(strcmp(buffer, expected)) {
+        printf("FAIL %.17g -> '%s', expected '%s'\n", value, buffer, expected);
+        failures++;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoull(argv[1], 0, 10) : 10000000;
+
+    reader = Tokenizer_new();
+
+    const double edges[] = {0.0,       -0.0,     1.0,          -1.0,
+                            0.1,       0.2,      0.3,          1.0 / 3,
+                            2.0 / 3,   1e21,     1e-7,         1e22,
+                            1e23,      5e-324,   DBL_MIN,      DBL_MAX,
+                            -DBL_MAX,  DBL_EPSILON, 9007199254740993.0,
+                            123456789012345678.0, 0.000001, 1.7976931348623157e308,
+                            2.2250738585072009e-308, 4.9406564584124654e-324,
+                            INFINITY,  -INFINITY, NAN};
+
+    for(size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); ++i) {
+        check_roundtrip(edges[i], 0);
+    }
+
+    // Every power of two, and the doubles either side of it.
+    for(int e = -1074; e <= 1023; ++e) {
+        double value = ldexp(1.0, e);
+        check_roundtrip(value, 0);
+        check_roundtrip(nextafter(value, 0), 0);
+        check_roundtrip(nextafter(value, INFINITY), 0);
+    }
+
+    check_shortest(0.0, "0");
+    check_shortest(-0.0, "-0");
+    check_shortest(7.0, "7");
+    check_shortest(1024.0, "1024");
+    check_shortest(0.1, "0.1");
+    check_shortest(-0.000125, "-0.000125");
+    check_shortest(1e21, "1e+21");
+    check_shortest(1e20, "100000000000000000000");
+    check_shortest(2.5e-7, "2.5e-07");
+    check_shortest(5e-324, "5e-324");
+    check_shortest(1.7976931348623157e308, "1.7976931348623157e+308");
+    check_shortest(INFINITY, "inf");
+    check_shortest(-INFINITY, "-inf");
+
+    check_fixed(3.14159, 2, "3.14");
+    check_fixed(2.675, 2, "2.68");
+    check_fixed(0.5, 0, "1");
+    check_fixed(0.4, 0, "0");
+    check_fixed(-0.004, 2, "0.00");
+    check_fixed(-0.005, 2, "-0.01");
+    check_fixed(9.999, 2, "10.00");
+    check_fixed(999.5, 0, "1000");
+    check_fixed(1e21, 1, "1000000000000000000000.0");
+    check_fixed(1.5e-10, 3, "0.000");
+    check_fixed(0.0, 3, "0.000");
+    check_fixed(123.456, 6, "123.456000");
+
+    size_t longer = 0;
+
+    for(size_t i = 0; i < count; ++i) {
+        double value = random_double(i);
+
+        if(isnan(value))
+            continue;
+
+        // The %g search is slow; compare lengths on a sample.
+        check_roundtrip(value, i % 64 == 0 ? &longer : 0);
+    }
+
+    printf("random doubles: %zu, longer than shortest: %zu of %zu sampled\n",
+           count,
+           longer,
+           (count + 63) / 64);
+
+    // Speed, on the same mix of doubles.
+    enum { SPEED_COUNT = 2000000 };
+    double* values = xmalloc(SPEED_COUNT * sizeof(double));
+    char    buffer[64];
+    size_t  total = 0;
+
+    for(size_t i = 0; i < SPEED_COUNT; ++i) {
+        values[i] = random_double(i);
+    }
+
+    uint64_t start = monotonic_ns();
+
+    for(size_t i = 0; i < SPEED_COUNT; ++i) {
+        total += dtoa_shortest(values[i], buffer);
+    }
+
+    uint64_t grisu = monotonic_ns() - start;
+    start          = monotonic_ns();
+
+    for(size_t i = 0; i < SPEED_COUNT; ++i) {
+        total += (size_t)snprintf(buffer, sizeof(buffer), "%.17g", values[i]);
+    }
+
+    uint64_t printf_ns = monotonic_ns() - start;
+
+    printf("dtoa_shortest: %.1f ns/op, snprintf %%.17g: %.1f ns/op (%zu bytes)\n",
+           (double)grisu / SPEED_COUNT,
+           (double)printf_ns / SPEED_COUNT,
+           total);
+
+    xfree(values);
+    Tokenizer_free(reader);
+
+    if(failures) {
+        printf("%zu failures\n", failures);
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "evaluator.h"
+#include "tokenizer.h"
+
+// Steady state leak check. Evaluates a rotating set of expressions, valid and
+// invalid, on a single reused Tokenizer/Sft pair, and fails if either the
+// number of live allocations or the resident set size grew between the end
+// of the warmup and the end of the run. A few pages of slack are allowed for
+// the allocator settling its free lists; a leak of even one byte per
+// evaluation shows up as megabytes over a million evaluations.
+//
+// Usage: seqft_leakcheck [evaluations]   (default 1000000)
+
+typedef struct AllocCounters {
+    uint64_t mallocs;
+    uint64_t reallocs;
+    uint64_t frees;
+    int64_t  live;
+} AllocCounters;
+
+static void count_allocation(XallocEvent event,
+                             void*       old_ptr,
+                             void*       new_ptr,
+                             size_t      size,
+                             void*       user) {
+    AllocCounters* counters = user;
+
+    switch(event) {
+        case XALLOC_MALLOC:
+            counters->mallocs++;
+            counters->live++;
+            break;
+        case XALLOC_REALLOC:
+            counters->reallocs++;
+
+            if(!old_ptr && new_ptr)
+                counters->live++;
+            else if(old_ptr && !new_ptr && size == 0)
+                counters->live--;
+            break;
+        case XALLOC_FREE:
+            counters->frees++;
+            counters->live--;
+            break;
+    }
+}
+
+// Anonymous resident memory, i.e. resident minus file backed pages, so that
+// code pages faulted in along the way don't count as growth.
+static size_t resident_bytes(void) {
+    FILE* statm    = fopen("/proc/self/statm", "r");
+    long  resident = 0;
+    long  shared   = 0;
+
+    if(!statm)
+        return 0;
+
+    if(fscanf(statm, "%*s %ld %ld", &resident, &shared) != 2)
+        resident = shared = 0;
+
+    fclose(statm);
+    return (size_t)(resident - shared) * 4096;
+}
+
+static const char* CORPUS[] = {
+    "1+1+1",
+    "0x10230 * 0b1011 - 0o17",
+    "20 * 0x0F ^ (0b0010 / 0o07) % 16 / 12.0",
+    "round(2.5) + ceil(1.25) * ~3",
+    "((((1+2)*3)-4)/5)",
+    "1 +",        // Missing operand.
+    "0xz012",     // Invalid digit.
+    "func",       // Function without parenthesis.
+    "nosuch(12)", // Unknown function.
+    "(1+2",       // Unbalanced.
+};
+
+#define RSS_SLACK (16 * 1024)
+
+#define CORPUS_SIZE (sizeof(CORPUS) / sizeof(CORPUS[0]))
+
+static void evaluate(Tokenizer* t, Sft* sft, const char* expr, size_t len) {
+    TokenArray* tokens = Tokenizer_parse(t, expr, len);
+
+    if(tokens) {
+        double result = 0;
+        Sft_evalTokens(sft, tokens, &result);
+    }
+
+    TokenArray_free(tokens);
+}
+
+int main(int argc, char** argv) {
+    size_t evaluations = argc > 1 ? strtoull(argv[1], 0, 10) : 1000000;
+    size_t warmup      = evaluations / 100 + CORPUS_SIZE;
+    size_t lengths[CORPUS_SIZE];
+
+    for(size_t i = 0; i < CORPUS_SIZE; ++i) {
+        lengths[i] = strlen(CORPUS[i]);
+    }
+
+    AllocCounters counters = {0};
+    xalloc_setHook(count_allocation, &counters);
+
+    Tokenizer* t   = Tokenizer_new();
+    Sft*       sft = Sft_new();
+
+    for(size_t i = 0; i < warmup; ++i) {
+        evaluate(t, sft, CORPUS[i % CORPUS_SIZE], lengths[i % CORPUS_SIZE]);
+    }
+
+    int64_t live_before = counters.live;
+    size_t  rss_before  = resident_bytes();
+
+    for(size_t i = 0; i < evaluations; ++i) {
+        evaluate(t, sft, CORPUS[i % CORPUS_SIZE], lengths[i % CORPUS_SIZE]);
+    }
+
+    int64_t live_after = counters.live;
+    size_t  rss_after  = resident_bytes();
+
+    Sft_free(sft);
+    Tokenizer_free(t);
+
+    fprintf(stderr,
+            "evaluations: %zu\n"
+            "allocations: %.2f malloc, %.2f realloc, %.2f free per evaluation\n"
+            "live allocations: %lld -> %lld (after teardown %lld)\n"
+            "resident: %zu KiB -> %zu KiB\n",
+            evaluations,
+            (double)counters.mallocs / (double)(evaluations + warmup),
+            (double)counters.reallocs / (double)(evaluations + warmup),
+            (double)counters.frees / (double)(evaluations + warmup),
+            (long long)live_before,
+            (long long)live_after,
+            (long long)counters.live,
+            rss_before / 1024,
+            rss_after / 1024);
+
+    int failed = 0;
+
+    if(live_after != live_before || counters.live != 0) {
+        fprintf(stderr, "FAIL: live allocation count changed\n");
+        failed = 1;
+    }
+
+    if(rss_after > rss_before + RSS_SLACK) {
+        fprintf(stderr, "FAIL: resident memory grew\n");
+        failed = 1;
+    }
+
+    if(!failed) {
+        fprintf(stderr, "OK\n");
+    }
+
+    return failed;
+}
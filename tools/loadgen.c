@@ -0,0 +1,267 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "server.h"
+
+// Load generator for `seqft --serve`. Each connection runs on its own thread
+// and keeps `depth` requests in flight: it sends that many expressions, then
+// reads their replies, timing every request from the moment it was written
+// to the moment its reply line arrived. Reports the overall request rate and
+// the latency distribution across all connections.
+//
+// Usage: seqft_loadgen ADDRESS [--connections N] [--requests N] [--depth N]
+//                              [--expr EXPR]
+//
+// Requests is per connection. Without --expr the connections cycle through
+// a small fixed mix of valid and invalid expressions.
+
+static const char* DEFAULT_EXPRESSIONS[] = {
+    "1+2*3-4/5",
+    "(1+2)*(3+4)*(5+6)",
+    "max(1,2,3,4,5,6,7,8)+sum(1,2,3)",
+    "hypot(3,4)^2-~7",
+    "2^10/(3-1)*round(2.5)",
+    "1+*2",
+    "avg(1,2,3,4)*min(9,8,7)",
+    "unknown(1)",
+};
+
+#define DEFAULT_EXPRESSION_COUNT \
+    (sizeof(DEFAULT_EXPRESSIONS) / sizeof(DEFAULT_EXPRESSIONS[0]))
+
+typedef struct Client {
+    const char*  address;
+    const char*  expr; // Null for the default mix.
+    size_t       requests;
+    size_t       depth;
+    size_t       offset; // Where in the default mix this client starts.
+    uint64_t*    latencies;
+    size_t       completed;
+    size_t       errors;
+    BOOL         failed;
+    pthread_t    thread;
+} Client;
+
+static BOOL write_all(int fd, const char* data, size_t len) {
+    while(len) {
+        ssize_t n = write(fd, data, len);
+
+        if(n <= 0)
+            return FALSE;
+
+        data += n;
+        len -= (size_t)n;
+    }
+
+    return TRUE;
+}
+
+static void* Client_run(void* arg) {
+    Client* client = arg;
+    int     fd     = Server_connect(client->address);
+
+    if(fd < 0) {
+        client->failed = TRUE;
+        return 0;
+    }
+
+    uint64_t* sent_at = xmalloc(client->depth * sizeof(uint64_t));
+    char*     request = 0;
+    size_t    request_capacity = 0;
+    char      reply[4096];
+    size_t    reply_len = 0;
+    BOOL      at_line_start = TRUE;
+
+    while(client->completed < client->requests && !client->failed) {
+        size_t batch = client->requests - client->completed;
+
+        if(batch > client->depth)
+            batch = client->depth;
+
+        // Gather the whole batch into one write, stamping each request.
+        size_t request_len = 0;
+
+        for(size_t i = 0; i < batch; ++i) {
+            size_t      n    = client->offset + client->completed + i;
+            const char* expr = client->expr ? client->expr
+                               : DEFAULT_EXPRESSIONS[n % DEFAULT_EXPRESSION_COUNT];
+            size_t      len  = strlen(expr);
+
+            if(request_len + len + 1 > request_capacity) {
+                request_capacity = (request_len + len + 1) * 2;
+                request          = xrealloc(request, request_capacity);
+            }
+
+            memcpy(request + request_len, expr, len);
+            request_len += len;
+            request[request_len++] = '\n';
+        }
+
+        uint64_t now = monotonic_ns();
+
+        for(size_t i = 0; i < batch; ++i) {
+            sent_at[i] = now;
+        }
+
+        if(!write_all(fd, request, request_len)) {
+            client->failed = TRUE;
+            break;
+        }
+
+        // Read until every request of the batch has its reply line.
+        size_t answered = 0;
+
+        while(answered < batch) {
+            ssize_t n = read(fd, reply, sizeof(reply));
+
+            if(n <= 0) {
+                client->failed = TRUE;
+                break;
+            }
+
+            uint64_t arrived = monotonic_ns();
+            reply_len        = (size_t)n;
+
+            for(size_t i = 0; i < reply_len && answered < batch; ++i) {
+                if(at_line_start && reply[i] == 'e')
+                    client->errors += 1;
+
+                at_line_start = reply[i] == '\n';
+
+                if(at_line_start) {
+                    client->latencies[client->completed + answered] =
+                        arrived - sent_at[answered];
+                    answered += 1;
+                }
+            }
+        }
+
+        client->completed += answered;
+    }
+
+    close(fd);
+    xfree(request);
+    xfree(sent_at);
+    return 0;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(const uint64_t* sorted, size_t count, double p) {
+    size_t index = (size_t)(p / 100.0 * (double)(count - 1) + 0.5);
+    return (double)sorted[index] / 1e3;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2 || argv[1][0] == '-') {
+        fprintf(stderr,
+                "Usage: %s ADDRESS [--connections N] [--requests N] "
+                "[--depth N] [--expr EXPR]\n",
+                argv[0]);
+        return 2;
+    }
+
+    const char* address     = argv[1];
+    const char* expr        = 0;
+    size_t      connections = 4;
+    size_t      requests    = 100000;
+    size_t      depth       = 1;
+
+    for(int i = 2; i + 1 < argc; i += 2) {
+        if(!strcmp(argv[i], "--connections"))
+            connections = strtoul(argv[i + 1], 0, 10);
+        else if(!strcmp(argv[i], "--requests"))
+            requests = strtoul(argv[i + 1], 0, 10);
+        else if(!strcmp(argv[i], "--depth"))
+            depth = strtoul(argv[i + 1], 0, 10);
+        else if(!strcmp(argv[i], "--expr"))
+            expr = argv[i + 1];
+        else {
+            fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(!connections || !requests || !depth) {
+        fprintf(stderr, "Connections, requests and depth must be positive\n");
+        return 2;
+    }
+
+    Client*   clients   = xmalloc(connections * sizeof(Client));
+    uint64_t* latencies = xmalloc(connections * requests * sizeof(uint64_t));
+    uint64_t  start     = monotonic_ns();
+
+    for(size_t i = 0; i < connections; ++i) {
+        Client* client = &clients[i];
+        memset(client, 0, sizeof(Client));
+
+        client->address   = address;
+        client->expr      = expr;
+        client->requests  = requests;
+        client->depth     = depth;
+        client->offset    = i;
+        client->latencies = latencies + i * requests;
+
+        if(pthread_create(&client->thread, 0, Client_run, client) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    size_t completed = 0;
+    size_t errors    = 0;
+    BOOL   failed    = FALSE;
+
+    for(size_t i = 0; i < connections; ++i) {
+        pthread_join(clients[i].thread, 0);
+
+        // Compact the latencies of every client into one run for sorting.
+        memmove(latencies + completed,
+                clients[i].latencies,
+                clients[i].completed * sizeof(uint64_t));
+
+        completed += clients[i].completed;
+        errors += clients[i].errors;
+        failed |= clients[i].failed;
+    }
+
+    double seconds = (double)(monotonic_ns() - start) / 1e9;
+
+    if(failed)
+        fprintf(stderr, "Some connections failed before finishing\n");
+
+    if(!completed) {
+        xfree(latencies);
+        xfree(clients);
+        return 1;
+    }
+
+    qsort(latencies, completed, sizeof(uint64_t), compare_u64);
+
+    printf("connections: %zu, depth: %zu\n", connections, depth);
+    printf("requests: %zu in %.3fs, %zu error replies\n",
+           completed,
+           seconds,
+           errors);
+    printf("throughput: %.0f requests/s\n", (double)completed / seconds);
+    printf("latency (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           percentile_us(latencies, completed, 50),
+           percentile_us(latencies, completed, 90),
+           percentile_us(latencies, completed, 99),
+           percentile_us(latencies, completed, 99.9),
+           (double)latencies[completed - 1] / 1e3);
+
+    xfree(latencies);
+    xfree(clients);
+    return failed;
+}
@@ -0,0 +1,391 @@
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "vecmath.h"
+
+// Accuracy check for the kernels of vecmath.h. Measures the error of vec_exp,
+// vec_log and vec_pow in ulps over random arguments spread across their
+// whole domains, against the long double functions where long double is
+// wider than double (against the double ones, and so to within their own
+// error, elsewhere), and fails if it exceeds the bounds documented in
+// vecmath.h. Also checks special values against libm bit for bit, and
+// vec_floor, vec_ceil and vec_round, which are exact, against libm on edge
+// cases and random doubles. Runs everything once per instruction set the CPU
+// has. The throughput of the kernels is in seqft_bench.
+//
+// Usage: seqft_mathcheck [random arguments per function]   (default 4000000)
+
+#if LDBL_MANT_DIG > DBL_MANT_DIG
+    #define REFERENCE "long double"
+typedef long double Real;
+    #define real_exp  expl
+    #define real_log  logl
+    #define real_pow  powl
+    #define real_fabs fabsl
+#else
+    #define REFERENCE "libm"
+typedef double Real;
+    #define real_exp  exp
+    #define real_log  log
+    #define real_pow  pow
+    #define real_fabs fabs
+#endif
+
+// Errors must stay below these, as documented in vecmath.h.
+static const double EXP_BOUND = 1.0;
+static const double LOG_BOUND = 1.0;
+static const double POW_BOUND = 1.0;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+// Uniform in [lo, hi).
+static double uniform(double lo, double hi) {
+    return lo + (hi - lo) * (double)(next_random() >> 11) * 0x1p-53;
+}
+
+static double from_bits(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static BOOL same_bits(double a, double b) {
+    return (isnan(a) && isnan(b)) || !memcmp(&a, &b, sizeof(double));
+}
+
+// Distance from the exact value in ulps of the double nearest to it; the ulp
+// of the smallest subnormal below the normal range.
+static double ulp_error(double got, Real exact) {
+    double nearest = (double)exact;
+
+    if(isnan(nearest) || isinf(nearest) || isinf(got))
+        return same_bits(got, nearest) ? 0 : INFINITY;
+
+    int exponent = nearest == 0 ? DBL_MIN_EXP : ilogb(nearest);
+
+    if(exponent < DBL_MIN_EXP - 1)
+        exponent = DBL_MIN_EXP - 1;
+
+    Real ulp = (Real)ldexp(1.0, exponent - (DBL_MANT_DIG - 1));
+    return (double)(real_fabs((Real)got - exact) / ulp);
+}
+
+static size_t failures = 0;
+
+// Largest error seen for one function, and where, next to libm's over the
+// same arguments.
+typedef struct Accuracy {
+    const char* name;
+    double      bound;
+    double      worst;
+    double      x, y;
+    double      libm_worst;
+    size_t      count;
+} Accuracy;
+
+static void Accuracy_add(Accuracy* a,
+                         double    got,
+                         double    libm,
+                         Real      exact,
+                         double    x,
+                         double    y) {
+    double error      = ulp_error(got, exact);
+    double libm_error = ulp_error(libm, exact);
+
+    a->count += 1;
+
+    if(libm_error > a->libm_worst)
+        a->libm_worst = libm_error;
+
+    if(error > a->worst) {
+        a->worst = error;
+        a->x     = x;
+        a->y     = y;
+    }
+}
+
+static void Accuracy_report(const Accuracy* a) {
+    printf("%-4s %zu arguments, max error %.3f ulp at (%.17g, %.17g), "
+           "libm %.3f ulp\n",
+           a->name,
+           a->count,
+           a->worst,
+           a->x,
+           a->y,
+           a->libm_worst);
+
+    if(a->worst >= a->bound) {
+        printf("FAIL %s reaches its bound of %.2f ulp\n", a->name, a->bound);
+        failures++;
+    }
+}
+
+enum { BLOCK = 4096 };
+
+static double xs[BLOCK];
+static double ys[BLOCK];
+static double out[BLOCK];
+
+static void check_exp(size_t count, Accuracy* a) {
+    for(size_t done = 0; done < count; done += BLOCK) {
+        for(size_t i = 0; i < BLOCK; ++i) {
+            // Half over the whole range, subnormal results included, half
+            // near zero where most arguments are.
+            xs[i] = i & 1 ? uniform(-745.2, 709.8) : uniform(-2, 2);
+        }
+
+        vec_exp(xs, out, BLOCK);
+
+        for(size_t i = 0; i < BLOCK; ++i) {
+            Accuracy_add(a, out[i], exp(xs[i]), real_exp((Real)xs[i]), xs[i], 0);
+        }
+    }
+}
+
+static void check_log(size_t count, Accuracy* a) {
+    for(size_t done = 0; done < count; done += BLOCK) {
+        for(size_t i = 0; i < BLOCK; ++i) {
+            // Every positive exponent, subnormals included, and close to 1.
+            xs[i] = i & 1 ? from_bits(next_random() % 0x7FF0000000000000ull)
+                          : uniform(0.5, 2);
+        }
+
+        vec_log(xs, out, BLOCK);
+
+        for(size_t i = 0; i < BLOCK; ++i) {
+            Accuracy_add(a, out[i], log(xs[i]), real_log((Real)xs[i]), xs[i], 0);
+        }
+    }
+}
+
+static void check_pow(size_t count, Accuracy* a) {
+    for(size_t done = 0; done < count; done += BLOCK) {
+        for(size_t i = 0; i < BLOCK; ++i) {
+            double x = 0, y = 0;
+
+            switch(i % 4) {
+                case 0:
+                    // Any base, with an exponent taking the result anywhere
+                    // from the subnormals to the largest doubles.
+                    x = from_bits(next_random() % 0x7FF0000000000000ull);
+                    y = uniform(-745, 709.7) / log(x);
+                    break;
+                case 1:
+                    // Bases close to 1 and large exponents.
+                    x = 1 + uniform(-0x1p-20, 0x1p-20);
+                    y = uniform(-1, 1) * 0x1p28;
+                    break;
+                case 2:
+                    // Small integer exponents.
+                    x = uniform(0, 100);
+                    y = (double)(int)uniform(-40, 40);
+                    break;
+                default:
+                    x = uniform(0, 10);
+                    y = uniform(-10, 10);
+                    break;
+            }
+
+            xs[i] = x;
+            ys[i] = y;
+        }
+
+        vec_pow(xs, ys, out, BLOCK);
+
+        for(size_t i = 0; i < BLOCK; ++i) {
+            Accuracy_add(a,
+                         out[i],
+                         pow(xs[i], ys[i]),
+                         real_pow((Real)xs[i], (Real)ys[i]),
+                         xs[i],
+                         ys[i]);
+        }
+    }
+}
+
+static const double SPECIALS[] = {
+    0.0,      -0.0,      1.0,       -1.0,     0.5,        -0.5,
+    2.0,      -2.0,      3.0,       -3.0,     0.25,       1e300,
+    -1e300,   1e-300,    DBL_MIN,   DBL_MAX,  -DBL_MAX,   5e-324,
+    709.7827, -745.1332, 710.0,     -746.0,   0x1p900,    0x1p1000,
+    INFINITY, -INFINITY, NAN,       -NAN,     1 + 0x1p-52, 1 - 0x1p-53,
+};
+
+enum { SPECIAL_COUNT = sizeof(SPECIALS) / sizeof(SPECIALS[0]) };
+
+typedef void (*UnaryKernel)(const double*, double*, size_t);
+
+// Compares a kernel with libm on one argument, in place, which also covers
+// lengths that leave a partial vector: bit for bit where libm's result is
+// exact, and within the bound elsewhere.
+static void check_same(const char* name,
+                       UnaryKernel kernel,
+                       double      (*libm)(double),
+                       Real        (*real)(Real),
+                       double      bound,
+                       double      x) {
+    double value    = x;
+    double expected = libm(x);
+
+    kernel(&value, &value, 1);
+
+    if(real && isfinite(expected) && expected != 0 &&
+       (Real)expected != real((Real)x)) {
+        if(ulp_error(value, real((Real)x)) < bound)
+            return;
+    } else if(same_bits(value, expected)) {
+        return;
+    }
+
+    if(failures++ < 20)
+        printf("FAIL %s(%.17g) = %.17g, libm %.17g\n", name, x, value, expected);
+}
+
+static Real real_exp_(Real x) {
+    return real_exp(x);
+}
+
+static Real real_log_(Real x) {
+    return real_log(x);
+}
+
+static void check_specials(void) {
+    double x[SPECIAL_COUNT * SPECIAL_COUNT];
+    double y[SPECIAL_COUNT * SPECIAL_COUNT];
+    double result[SPECIAL_COUNT * SPECIAL_COUNT];
+    size_t n = 0;
+
+    for(size_t i = 0; i < SPECIAL_COUNT; ++i) {
+        check_same("exp", vec_exp, exp, real_exp_, EXP_BOUND, SPECIALS[i]);
+        check_same("log", vec_log, log, real_log_, LOG_BOUND, SPECIALS[i]);
+
+        for(size_t j = 0; j < SPECIAL_COUNT; ++j) {
+            x[n]   = SPECIALS[i];
+            y[n++] = SPECIALS[j];
+        }
+    }
+
+    vec_pow(x, y, result, n);
+
+    for(size_t i = 0; i < n; ++i) {
+        double expected = pow(x[i], y[i]);
+        Real   exact    = real_pow((Real)x[i], (Real)y[i]);
+
+        if(isfinite(expected) && expected != 0 && (Real)expected != exact) {
+            if(ulp_error(result[i], exact) < POW_BOUND)
+                continue;
+        } else if(same_bits(result[i], expected)) {
+            continue;
+        }
+
+        if(failures++ < 20) {
+            printf("FAIL pow(%.17g, %.17g) = %.17g, libm %.17g\n",
+                   x[i],
+                   y[i],
+                   result[i],
+                   expected);
+        }
+    }
+}
+
+static void check_rounding(size_t count) {
+    UnaryKernel kernels[] = {vec_floor, vec_ceil, vec_round};
+    double (*libm[])(double) = {floor, ceil, round};
+    const char* names[] = {"floor", "ceil", "round"};
+
+    for(int k = 0; k < 3; ++k) {
+        for(size_t i = 0; i < SPECIAL_COUNT; ++i) {
+            check_same(names[k], kernels[k], libm[k], 0, 0, SPECIALS[i]);
+        }
+
+        // Halves, and the doubles either side of them, up to where every
+        // double is an integer.
+        for(int e = -2; e <= 53; ++e) {
+            for(int n = 0; n < 64; ++n) {
+                double half = ldexp(n + 0.5, e);
+
+                for(int sign = -1; sign <= 1; sign += 2) {
+                    double x = sign * half;
+
+                    double below = nextafter(x, 0);
+                    double above = nextafter(x, sign * INFINITY);
+
+                    check_same(names[k], kernels[k], libm[k], 0, 0, x);
+                    check_same(names[k], kernels[k], libm[k], 0, 0, below);
+                    check_same(names[k], kernels[k], libm[k], 0, 0, above);
+                }
+            }
+        }
+
+        // Random bit patterns, which are mostly far from integers or
+        // integers already, and random fractions.
+        for(size_t done = 0; done < count; done += BLOCK) {
+            for(size_t i = 0; i < BLOCK; ++i) {
+                xs[i] = i & 1 ? from_bits(next_random())
+                              : uniform(-1e6, 1e6);
+            }
+
+            kernels[k](xs, out, BLOCK);
+
+            for(size_t i = 0; i < BLOCK; ++i) {
+                if(!same_bits(out[i], libm[k](xs[i]))) {
+                    if(failures++ < 20) {
+                        printf("FAIL %s(%.17g) = %.17g, libm %.17g\n",
+                               names[k],
+                               xs[i],
+                               out[i],
+                               libm[k](xs[i]));
+                    }
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoull(argv[1], 0, 10) : 4000000;
+
+    printf("reference: %s\n", REFERENCE);
+
+    for(int isa = VEC_BASELINE; isa <= VEC_AVX2; ++isa) {
+        if(!vec_setIsa((VecIsa)isa))
+            continue;
+
+        printf("%s:\n", vec_isaName((VecIsa)isa));
+
+        Accuracy exp_accuracy = {.name = "exp", .bound = EXP_BOUND};
+        Accuracy log_accuracy = {.name = "log", .bound = LOG_BOUND};
+        Accuracy pow_accuracy = {.name = "pow", .bound = POW_BOUND};
+
+        check_exp(count, &exp_accuracy);
+        check_log(count, &log_accuracy);
+        check_pow(count, &pow_accuracy);
+
+        Accuracy_report(&exp_accuracy);
+        Accuracy_report(&log_accuracy);
+        Accuracy_report(&pow_accuracy);
+
+        check_specials();
+        check_rounding(count);
+    }
+
+    if(failures) {
+        printf("%zu failures\n", failures);
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "seqft.h"
+
+// Resume check. Evaluates every expression once without limits, then again
+// under a budget so short that it runs out many times over, once of time and
+// once of steps, calling SeqftContext_resume until the evaluation is done,
+// and fails unless that finishes and comes to the same result, bit for bit.
+// An evaluation that lost its progress whenever the budget ran out would
+// never finish, so resumes are capped.
+//
+// Usage: seqft_resumecheck [budget ns] [budget steps]
+//                          (default 100000 and 100000)
+
+static const char* CORPUS[] = {
+    // Compiled, on threads.
+    "sum(i,1,10^8,1/i)",
+    "prod(k,1,3*10^6,1+1/k^2)",
+    // Evaluated token by token for every value of the index.
+    "sum(i,1,3*10^5,if(i<7,1/i,~1/i)*sum(j,1,2,j))",
+    // A body that runs out of budget itself, within a long inner series.
+    "sum(i,1,20,sum(j,1,10^5*i,1/j))",
+    // More than one series, and tokens after them.
+    "sum(n,1,10^6,1/n^2)+sum(m,1,10^6,1/m^3)*2-1",
+};
+
+#define CORPUS_SIZE (sizeof(CORPUS) / sizeof(CORPUS[0]))
+
+#define MAX_RESUMES 1000000
+
+// Evaluates the expression under the budget, resuming it until it's done,
+// and compares the result with the expected one.
+static int check(SeqftContext* ctx,
+                 const char*   expr,
+                 uint64_t      steps,
+                 uint64_t      ns,
+                 double        expected) {
+    size_t len     = strlen(expr);
+    double result  = 0;
+    size_t resumes = 0;
+
+    SeqftContext_setBudget(ctx, steps, ns);
+    int code = SeqftContext_eval(ctx, expr, len, &result);
+
+    while(code == SEQFT_ERR_BUDGET_EXHAUSTED && resumes < MAX_RESUMES) {
+        code = SeqftContext_resume(ctx, &result);
+        resumes += 1;
+    }
+
+    fprintf(stderr,
+            "%s: %zu resumes of %s\n",
+            expr,
+            resumes,
+            steps ? "steps" : "time");
+
+    if(code != SEQFT_OK) {
+        fprintf(stderr, "FAIL %s: %s\n", expr, SeqftContext_errorMessage(ctx));
+        return 1;
+    }
+
+    if(memcmp(&result, &expected, sizeof(double))) {
+        fprintf(stderr,
+                "FAIL %s: %.17g resumed, %.17g in one go\n",
+                expr,
+                result,
+                expected);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    uint64_t      ns     = argc > 1 ? strtoull(argv[1], 0, 10) : 100000;
+    uint64_t      steps  = argc > 2 ? strtoull(argv[2], 0, 10) : 100000;
+    SeqftContext* ctx    = SeqftContext_new();
+    int           failed = 0;
+
+    for(size_t i = 0; i < CORPUS_SIZE; ++i) {
+        const char* expr     = CORPUS[i];
+        double      expected = 0;
+
+        SeqftContext_setBudget(ctx, 0, 0);
+
+        if(SeqftContext_eval(ctx, expr, strlen(expr), &expected) != SEQFT_OK) {
+            fprintf(stderr,
+                    "FAIL %s: %s\n",
+                    expr,
+                    SeqftContext_errorMessage(ctx));
+            failed = 1;
+            continue;
+        }
+
+        failed |= check(ctx, expr, 0, ns, expected);
+        failed |= check(ctx, expr, steps, 0, expected);
+    }
+
+    SeqftContext_free(ctx);
+
+    if(!failed) {
+        fprintf(stderr, "OK\n");
+    }
+
+    return failed;
+}
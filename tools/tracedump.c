@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "trace.h"
+
+// Renders trace files written by Trace_write(). A file may hold any number of
+// blocks, one per traced evaluation, each preceded by its own header.
+//
+// Usage: seqft_tracedump <trace file>...
+
+static int dump_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+
+    if(!file) {
+        perror(path);
+        return 1;
+    }
+
+    TraceFileHeader header;
+    size_t          block = 0;
+
+    while(fread(&header, sizeof(header), 1, file) == 1) {
+        if(header.magic != TRACE_MAGIC || header.version != TRACE_VERSION) {
+            fprintf(stderr, "%s: not a seqft trace (block %zu)\n", path, block);
+            fclose(file);
+            return 1;
+        }
+
+        TraceEvent* events = xmalloc(header.count * sizeof(TraceEvent) + 1);
+
+        if(fread(events, sizeof(TraceEvent), header.count, file)
+           != header.count) {
+            fprintf(stderr, "%s: truncated block %zu\n", path, block);
+            xfree(events);
+            fclose(file);
+            return 1;
+        }
+
+        printf("== %s block %zu: %llu events",
+               path,
+               block,
+               (unsigned long long)header.count);
+
+        if(header.recorded > header.count) {
+            printf(" (%llu dropped)",
+                   (unsigned long long)(header.recorded - header.count));
+        }
+
+        printf(" ==\n");
+        Trace_render(events, header.count, stdout);
+        printf("\n");
+
+        xfree(events);
+        ++block;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s <trace file>...\n", argv[0]);
+        return 2;
+    }
+
+    int status = 0;
+
+    for(int i = 1; i < argc; ++i) {
+        status |= dump_file(argv[i]);
+    }
+
+    return status;
+}